@@ -464,7 +464,15 @@ void Texture::serialize(Serializer& ser) {
   ser.from_ptr(&w);
   ser.from_ptr(&h);
   ser.from_ptr(&combo_id);
-  ser.from_pod_vector(&data);
+  ser.from_ptr(&format);
+  if (format == TextureFormat::RGBA8) {
+    ser.from_pod_vector(&data);
+  } else {
+    ser.from_pod_vector(&compressed_data);
+    if (format == TextureFormat::BC1) {
+      ser.from_ptr(&bc1_alpha);
+    }
+  }
   ser.from_str(&debug_name);
   ser.from_str(&debug_tpage_name);
   ser.from_ptr(&load_to_pool);
@@ -742,7 +750,11 @@ void TfragTree::memory_usage(MemoryUsageTracker* tracker) const {
 }
 
 void Texture::memory_usage(MemoryUsageTracker* tracker) const {
-  tracker->add(MemoryUsageCategory::TEXTURE, data.size() * sizeof(u32));
+  if (format == TextureFormat::RGBA8) {
+    tracker->add(MemoryUsageCategory::TEXTURE, data.size() * sizeof(u32));
+  } else {
+    tracker->add(MemoryUsageCategory::TEXTURE, compressed_data.size());
+  }
 }
 
 void IndexTexture::memory_usage(MemoryUsageTracker* tracker) const {
@@ -18,7 +18,7 @@ namespace tfrag3 {
 // - if changing any large things (vertices, vis, bvh, colors, textures) update get_memory_usage
 // - if adding a new category to the memory usage, update extract_level to print it.
 
-constexpr int TFRAG3_VERSION = 40;
+constexpr int TFRAG3_VERSION = 41;
 
 enum MemoryUsageCategory {
   TEXTURE,
@@ -294,11 +294,18 @@ struct PackedTimeOfDay {
   }
 };
 
-// A single texture. Stored as RGBA8888.
+// Storage format of a Texture in the fr3 file. Compressed textures store a full mip chain,
+// largest first, in compressed_data. The loader decodes mip 0 into data when it needs the pixels.
+enum class TextureFormat : u8 { RGBA8 = 0, BC1 = 1, BC3 = 2 };
+
+// A single texture. Stored as RGBA8888, or as BC1/BC3 blocks.
 struct Texture {
   u16 w, h;
   u32 combo_id = 0;
   std::vector<u32> data;
+  TextureFormat format = TextureFormat::RGBA8;
+  std::vector<u8> compressed_data;  // all mips, largest first. Empty for RGBA8.
+  u8 bc1_alpha = 255;               // BC1 has no alpha, so this is used for every pixel.
   std::string debug_name;
   std::string debug_tpage_name;
   bool load_to_pool = false;
@@ -0,0 +1,340 @@
+#include "fr3_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "common/util/Assert.h"
+#include "common/util/Serializer.h"
+#include "common/util/WorkerPool.h"
+#include "common/util/compress.h"
+
+#include "fmt/core.h"
+
+namespace tfrag3 {
+
+namespace {
+
+// textures are grouped into sections of about this size.
+constexpr size_t kTextureSectionBytes = 1024 * 1024;
+
+/*!
+ * Sizes of the level's vectors, so they can be resized before sections are read in parallel.
+ */
+void serialize_meta(Level& level, Serializer& ser) {
+  ser.from_ptr(&level.version);
+  if (ser.is_loading() && level.version != TFRAG3_VERSION) {
+    ASSERT_MSG(false, fmt::format("version mismatch when loading tfrag3 data. Got {}, expected {}, "
+                                  "did you forget to re-decompile?",
+                                  level.version, TFRAG3_VERSION));
+  }
+  ser.from_str(&level.level_name);
+
+  auto size = [&](auto& vec) {
+    if (ser.is_saving()) {
+      ser.save<size_t>(vec.size());
+    } else {
+      vec.resize(ser.load<size_t>());
+    }
+  };
+  size(level.textures);
+  size(level.index_textures);
+  for (auto& trees : level.tfrag_trees) {
+    size(trees);
+  }
+  for (auto& trees : level.tie_trees) {
+    size(trees);
+  }
+  size(level.shrub_trees);
+}
+
+/*!
+ * Save or load the part of the level in this section. When loading, this only writes to the part
+ * of the level that belongs to the section, so sections can be loaded at the same time.
+ */
+void serialize_section(Level& level, const ChunkedFr3Section& section, Serializer& ser) {
+  switch (section.kind) {
+    case Fr3SectionKind::META:
+      serialize_meta(level, ser);
+      break;
+    case Fr3SectionKind::TEXTURES:
+      for (u32 i = 0; i < section.count; i++) {
+        level.textures.at(section.first + i).serialize(ser);
+      }
+      break;
+    case Fr3SectionKind::INDEX_TEXTURES:
+      for (auto& tex : level.index_textures) {
+        tex.serialize(ser);
+      }
+      break;
+    case Fr3SectionKind::TFRAG_TREE:
+      level.tfrag_trees.at(section.geom).at(section.first).serialize(ser);
+      break;
+    case Fr3SectionKind::TIE_TREE:
+      level.tie_trees.at(section.geom).at(section.first).serialize(ser);
+      break;
+    case Fr3SectionKind::SHRUB_TREE:
+      level.shrub_trees.at(section.first).serialize(ser);
+      break;
+    case Fr3SectionKind::HFRAG:
+      level.hfrag.serialize(ser);
+      break;
+    case Fr3SectionKind::COLLISION:
+      level.collision.serialize(ser);
+      break;
+    case Fr3SectionKind::MERC:
+      level.merc_data.serialize(ser);
+      break;
+    default:
+      ASSERT_MSG(false, fmt::format("unknown fr3 section kind {}", (u32)section.kind));
+  }
+}
+
+void unpack_section(Level& level, const ChunkedFr3Section& section) {
+  switch (section.kind) {
+    case Fr3SectionKind::TFRAG_TREE:
+      level.tfrag_trees[section.geom][section.first].unpack();
+      break;
+    case Fr3SectionKind::TIE_TREE:
+      level.tie_trees[section.geom][section.first].unpack();
+      break;
+    case Fr3SectionKind::SHRUB_TREE:
+      level.shrub_trees[section.first].unpack();
+      break;
+    default:
+      break;
+  }
+}
+
+void load_section(Level& level,
+                  const ChunkedFr3Section& section,
+                  const u8* data,
+                  bool compressed,
+                  bool unpack) {
+  std::vector<u8> decomp_data;
+  const u8* section_data = data + section.offset;
+  if (compressed) {
+    decomp_data = compression::decompress_zstd(section_data, section.size);
+    section_data = decomp_data.data();
+  }
+  ASSERT(compressed ? decomp_data.size() == section.decompressed_size
+                    : section.size == section.decompressed_size);
+  Serializer ser(section_data, section.decompressed_size, Serializer::no_copy);
+  serialize_section(level, section, ser);
+  ASSERT_MSG(ser.get_load_finished(),
+             fmt::format("fr3 section {} has extra data", (u32)section.kind));
+  if (unpack) {
+    unpack_section(level, section);
+  }
+}
+
+void unpack_all_trees(Level& level) {
+  for (auto& tie_tree : level.tie_trees) {
+    for (auto& tree : tie_tree) {
+      tree.unpack();
+    }
+  }
+  for (auto& t_tree : level.tfrag_trees) {
+    for (auto& tree : t_tree) {
+      tree.unpack();
+    }
+  }
+  for (auto& shrub_tree : level.shrub_trees) {
+    shrub_tree.unpack();
+  }
+}
+
+std::vector<ChunkedFr3Section> make_sections(const Level& level) {
+  std::vector<ChunkedFr3Section> sections;
+  auto add = [&](Fr3SectionKind kind, u32 geom, u32 first, u32 count) {
+    auto& section = sections.emplace_back();
+    section.kind = kind;
+    section.geom = geom;
+    section.first = first;
+    section.count = count;
+  };
+
+  add(Fr3SectionKind::META, 0, 0, 0);
+  size_t tex_bytes = 0;
+  u32 tex_first = 0;
+  for (u32 i = 0; i < level.textures.size(); i++) {
+    const auto& tex = level.textures[i];
+    tex_bytes += tex.format == TextureFormat::RGBA8 ? tex.data.size() * sizeof(u32)
+                                                    : tex.compressed_data.size();
+    if (tex_bytes >= kTextureSectionBytes || i + 1 == level.textures.size()) {
+      add(Fr3SectionKind::TEXTURES, 0, tex_first, i + 1 - tex_first);
+      tex_first = i + 1;
+      tex_bytes = 0;
+    }
+  }
+  add(Fr3SectionKind::INDEX_TEXTURES, 0, 0, level.index_textures.size());
+  for (u32 geom = 0; geom < level.tfrag_trees.size(); geom++) {
+    for (u32 i = 0; i < level.tfrag_trees[geom].size(); i++) {
+      add(Fr3SectionKind::TFRAG_TREE, geom, i, 1);
+    }
+  }
+  for (u32 geom = 0; geom < level.tie_trees.size(); geom++) {
+    for (u32 i = 0; i < level.tie_trees[geom].size(); i++) {
+      add(Fr3SectionKind::TIE_TREE, geom, i, 1);
+    }
+  }
+  for (u32 i = 0; i < level.shrub_trees.size(); i++) {
+    add(Fr3SectionKind::SHRUB_TREE, 0, i, 1);
+  }
+  add(Fr3SectionKind::HFRAG, 0, 0, 1);
+  add(Fr3SectionKind::COLLISION, 0, 0, 1);
+  add(Fr3SectionKind::MERC, 0, 0, 1);
+  return sections;
+}
+
+}  // namespace
+
+/*!
+ * Write a level in the chunked format. Each section is compressed on its own, or stored as is if
+ * compress is false.
+ */
+Fr3WriteResult write_chunked_fr3(Level& level, bool compress) {
+  Fr3WriteResult result;
+  auto sections = make_sections(level);
+  std::vector<std::vector<u8>> section_data(sections.size());
+  for (size_t i = 0; i < sections.size(); i++) {
+    Serializer ser;
+    serialize_section(level, sections[i], ser);
+    auto [data, size] = ser.get_save_result();
+    if (compress) {
+      section_data[i] = compression::compress_zstd(data, size);
+    } else {
+      section_data[i].assign(data, data + size);
+    }
+    sections[i].decompressed_size = size;
+    sections[i].size = section_data[i].size();
+    result.uncompressed_size += size;
+  }
+
+  ChunkedFr3Header header;
+  header.section_count = sections.size();
+  header.flags = compress ? 0 : CHUNKED_FR3_FLAG_UNCOMPRESSED;
+  u64 offset = sizeof(ChunkedFr3Header) + sizeof(ChunkedFr3Section) * sections.size();
+  for (auto& section : sections) {
+    if (!compress) {
+      offset = (offset + 15) & ~15ull;
+    }
+    section.offset = offset;
+    offset += section.size;
+  }
+
+  result.data.resize(offset);
+  memcpy(result.data.data(), &header, sizeof(header));
+  memcpy(result.data.data() + sizeof(header), sections.data(),
+         sizeof(ChunkedFr3Section) * sections.size());
+  for (size_t i = 0; i < sections.size(); i++) {
+    memcpy(result.data.data() + sections[i].offset, section_data[i].data(),
+           section_data[i].size());
+  }
+  return result;
+}
+
+bool is_chunked_fr3(const u8* data, size_t size) {
+  u32 magic;
+  if (size < sizeof(ChunkedFr3Header)) {
+    return false;
+  }
+  memcpy(&magic, data, sizeof(u32));
+  return magic == CHUNKED_FR3_MAGIC;
+}
+
+/*!
+ * Size of the serialized level in an FR3 file, found without decoding it: the sum of the section
+ * sizes for chunked files, or the size in the zstd header otherwise. Only the start of the file is
+ * read. Returns 0 if the file is too short to tell.
+ */
+size_t fr3_serialized_size(const u8* data, size_t size) {
+  if (!is_chunked_fr3(data, size)) {
+    if (size < sizeof(size_t)) {
+      return 0;
+    }
+    size_t result;
+    memcpy(&result, data, sizeof(size_t));
+    return result;
+  }
+
+  ChunkedFr3Header header;
+  memcpy(&header, data, sizeof(header));
+  if (sizeof(header) + sizeof(ChunkedFr3Section) * (size_t)header.section_count > size) {
+    return 0;
+  }
+  size_t result = 0;
+  for (u32 i = 0; i < header.section_count; i++) {
+    ChunkedFr3Section section;
+    memcpy(&section, data + sizeof(header) + sizeof(ChunkedFr3Section) * i, sizeof(section));
+    result += section.decompressed_size;
+  }
+  return result;
+}
+
+/*!
+ * Read a level from an FR3 file in any format. For chunked files, sections are loaded on the
+ * pool's threads, largest first. If unpack is set, trees are unpacked as soon as they are loaded.
+ * The data is only read from, so it can be a memory mapped file.
+ * If cancel is set while reading a chunked file, the remaining sections are skipped and nullptr is
+ * returned.
+ */
+std::unique_ptr<Level> read_fr3(const u8* data,
+                                size_t size,
+                                WorkerPool* pool,
+                                bool unpack,
+                                const std::atomic<bool>* cancel) {
+  auto result = std::make_unique<Level>();
+  if (!is_chunked_fr3(data, size)) {
+    auto decomp_data = compression::decompress_zstd(data, size);
+    Serializer ser(decomp_data.data(), decomp_data.size(), Serializer::no_copy);
+    result->serialize(ser);
+    if (unpack) {
+      unpack_all_trees(*result);
+    }
+    return result;
+  }
+
+  ChunkedFr3Header header;
+  memcpy(&header, data, sizeof(header));
+  ASSERT_MSG(header.version == CHUNKED_FR3_VERSION,
+             fmt::format("chunked fr3 version mismatch. Got {}, expected {}", header.version,
+                         CHUNKED_FR3_VERSION));
+  size_t table_end = sizeof(header) + sizeof(ChunkedFr3Section) * header.section_count;
+  ASSERT(table_end <= size);
+  std::vector<ChunkedFr3Section> sections(header.section_count);
+  memcpy(sections.data(), data + sizeof(header), table_end - sizeof(header));
+  for (auto& section : sections) {
+    ASSERT(section.offset + section.size <= size);
+  }
+  bool compressed = !(header.flags & CHUNKED_FR3_FLAG_UNCOMPRESSED);
+
+  // the meta section sizes the level, then the rest can be loaded in any order.
+  ASSERT(!sections.empty() && sections[0].kind == Fr3SectionKind::META);
+  load_section(*result, sections[0], data, compressed, false);
+  std::vector<int> order(sections.size() - 1);
+  std::iota(order.begin(), order.end(), 1);
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return sections[a].decompressed_size > sections[b].decompressed_size;
+  });
+
+  auto load = [&](int i) {
+    if (cancel && *cancel) {
+      return;
+    }
+    load_section(*result, sections[order[i]], data, compressed, unpack);
+  };
+  if (pool) {
+    pool->parallel_for(order.size(), load);
+  } else {
+    for (size_t i = 0; i < order.size(); i++) {
+      load(i);
+    }
+  }
+  if (cancel && *cancel) {
+    return nullptr;
+  }
+  return result;
+}
+
+}  // namespace tfrag3
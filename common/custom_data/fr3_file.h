@@ -0,0 +1,75 @@
+#pragma once
+
+/*!
+ * @file fr3_file.h
+ * Reading and writing FR3 files, which store a tfrag3::Level.
+ *
+ * The original format is the whole serialized level, compressed as a single zstd frame.
+ * The chunked format splits the level into sections (textures, each tree, merc, collision...)
+ * that are compressed separately, with an index at the start of the file. This lets the sections
+ * be decompressed and deserialized in parallel. The sections can also be stored uncompressed, so
+ * they can be read directly from a memory mapped file without an intermediate buffer.
+ * read_fr3 can read all of these.
+ */
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/custom_data/Tfrag3Data.h"
+
+class WorkerPool;
+
+namespace tfrag3 {
+
+constexpr u32 CHUNKED_FR3_MAGIC = 0x43335246;  // "FR3C"
+constexpr u32 CHUNKED_FR3_VERSION = 1;
+// set if the sections aren't compressed. They are then 16-byte aligned in the file.
+constexpr u32 CHUNKED_FR3_FLAG_UNCOMPRESSED = 1;
+
+enum class Fr3SectionKind : u32 {
+  META = 0,
+  TEXTURES = 1,
+  INDEX_TEXTURES = 2,
+  TFRAG_TREE = 3,
+  TIE_TREE = 4,
+  SHRUB_TREE = 5,
+  HFRAG = 6,
+  COLLISION = 7,
+  MERC = 8,
+};
+
+struct ChunkedFr3Header {
+  u32 magic = CHUNKED_FR3_MAGIC;
+  u32 version = CHUNKED_FR3_VERSION;
+  u32 section_count = 0;
+  u32 flags = 0;
+};
+
+struct ChunkedFr3Section {
+  Fr3SectionKind kind;
+  u32 geom = 0;   // for trees, the geometry (lod) index
+  u32 first = 0;  // index of the first tree or texture
+  u32 count = 0;  // number of trees or textures
+  u64 offset = 0;
+  u64 size = 0;               // compressed size, in the file
+  u64 decompressed_size = 0;  // size of the serialized section
+};
+static_assert(sizeof(ChunkedFr3Section) == 40);
+
+struct Fr3WriteResult {
+  std::vector<u8> data;
+  size_t uncompressed_size = 0;
+};
+
+Fr3WriteResult write_chunked_fr3(Level& level, bool compress = true);
+bool is_chunked_fr3(const u8* data, size_t size);
+size_t fr3_serialized_size(const u8* data, size_t size);
+std::unique_ptr<Level> read_fr3(const u8* data,
+                                size_t size,
+                                WorkerPool* pool,
+                                bool unpack,
+                                const std::atomic<bool>* cancel = nullptr);
+
+}  // namespace tfrag3
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include "common/common_types.h"
@@ -29,6 +30,8 @@ class FixedChunkDmaCopier {
   void serialize_last_result(Serializer& serializer);
 
   const DmaData& get_last_result() const { return m_result; }
+  // take the last result, so it can be used while the copier runs again.
+  void swap_last_result(DmaData& other) { std::swap(m_result, other); }
 
   const void* get_last_input_data() const { return m_input_data; }
   u32 get_last_input_offset() const { return m_input_offset; }
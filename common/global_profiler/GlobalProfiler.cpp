@@ -1,6 +1,7 @@
 // clang-format off
 #include "GlobalProfiler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <thread>
@@ -11,20 +12,6 @@
 
 #include "fmt/core.h"
 #include "third-party/json.hpp"
-
-#ifdef OS_POSIX
-u64 get_current_tid() {
-  return (u64)pthread_self();
-}
-#else
-#define NOMINMAX
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#include "Processthreadsapi.h"
-u64 get_current_tid() {
-  return (u64)GetCurrentThreadId();
-}
-#endif
 #include "common/log/log.h"
 // clang-format on
 
@@ -32,14 +19,91 @@ u64 get_current_ts() {
   return std::chrono::steady_clock::now().time_since_epoch().count();
 }
 
+/*!
+ * The events recorded by a single thread. Only that thread writes events, and write_count is
+ * updated after each one, so the flush thread can read them without a lock.
+ */
+struct ProfThreadEvents {
+  std::vector<ProfNode> events;
+  // number of events written by the recording thread.
+  std::atomic<u64> write_count = 0;
+  // when streaming, number of events written to the file by the flush thread.
+  std::atomic<u64> read_count = 0;
+  // when streaming, events that didn't fit because the flush thread fell behind.
+  std::atomic<u64> dropped = 0;
+  u32 short_id = 0;
+  std::string name;
+};
+
+namespace {
+thread_local ProfThreadEvents* t_events = nullptr;
+thread_local std::string t_thread_name;
+
+constexpr auto kFlushInterval = std::chrono::milliseconds(100);
+
+/*!
+ * Append a Chrome trace event. Times are in microseconds.
+ */
+void append_trace_event(std::string& out,
+                        const ProfNode& event,
+                        const std::string& json_name,
+                        u32 tid,
+                        u64 base_ts) {
+  double ts = (event.ts - base_ts) / 1000.;
+  switch (event.kind) {
+    case ProfNode::BEGIN:
+      out += fmt::format("{{\"name\":{},\"ph\":\"B\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}",
+                         json_name, tid, ts);
+      break;
+    case ProfNode::END:
+      out += fmt::format("{{\"ph\":\"E\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}", tid, ts);
+      break;
+    case ProfNode::INSTANT:
+      out += fmt::format("{{\"name\":{},\"ph\":\"i\",\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}",
+                         json_name, tid, ts);
+      break;
+    case ProfNode::COUNTER:
+      out += fmt::format(
+          "{{\"name\":{},\"ph\":\"C\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},"
+          "\"args\":{{\"value\":{}}}}}",
+          json_name, tid, ts, event.value);
+      break;
+    default:
+      ASSERT(false);
+  }
+}
+
+void append_thread_name(std::string& out, const ProfThreadEvents& events) {
+  out += fmt::format(
+      "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":{}}}}}",
+      events.short_id,
+      nlohmann::json(events.name).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace));
+}
+}  // namespace
+
 GlobalProfiler::GlobalProfiler() {
   m_t0 = get_current_ts();
+  m_empty_name = intern("");
+  m_root_name = intern("ROOT");
   set_max_events(65536);
 }
 
+GlobalProfiler::~GlobalProfiler() {
+  stop_streaming();
+}
+
+/*!
+ * Set the number of events kept for each thread.
+ */
 void GlobalProfiler::set_max_events(size_t event_count) {
   ASSERT(!m_enabled);
-  m_nodes.resize(event_count);
+  std::lock_guard<std::mutex> lk(m_threads_mutex);
+  m_max_events = event_count;
+  for (auto& events : m_threads) {
+    events->events.resize(event_count);
+    events->write_count = 0;
+    events->read_count = 0;
+  }
 }
 
 void GlobalProfiler::set_waiting_for_event(const std::string& event_name) {
@@ -48,6 +112,94 @@ void GlobalProfiler::set_waiting_for_event(const std::string& event_name) {
   }
 }
 
+/*!
+ * Set the name of the calling thread, shown in the trace.
+ */
+void GlobalProfiler::set_thread_name(const char* name) {
+  t_thread_name = name;
+  if (t_events) {
+    std::lock_guard<std::mutex> lk(m_threads_mutex);
+    t_events->name = name;
+  }
+}
+
+/*!
+ * Get the id for a name. Each thread caches the ids it has used, so this only locks the first time
+ * a thread sees a name.
+ */
+u32 GlobalProfiler::intern(const char* name) {
+  thread_local std::unordered_map<std::string_view, u32> t_name_ids;
+  std::string_view view(name);
+  auto it = t_name_ids.find(view);
+  if (it != t_name_ids.end()) {
+    return it->second;
+  }
+
+  std::lock_guard<std::mutex> lk(m_names_mutex);
+  auto global_it = m_name_ids.find(view);
+  if (global_it == m_name_ids.end()) {
+    m_names.push_back(std::make_unique<std::string>(name));
+    global_it = m_name_ids.emplace(*m_names.back(), m_names.size() - 1).first;
+  }
+  // the key points to the string in m_names, which doesn't move.
+  t_name_ids.emplace(global_it->first, global_it->second);
+  return global_it->second;
+}
+
+ProfThreadEvents* GlobalProfiler::thread_events() {
+  if (!t_events) {
+    std::lock_guard<std::mutex> lk(m_threads_mutex);
+    auto events = std::make_unique<ProfThreadEvents>();
+    events->events.resize(m_max_events);
+    events->short_id = m_threads.size();
+    events->name =
+        t_thread_name.empty() ? fmt::format("thread {}", events->short_id) : t_thread_name;
+    t_events = events.get();
+    m_threads.push_back(std::move(events));
+  }
+  return t_events;
+}
+
+std::vector<ProfThreadEvents*> GlobalProfiler::all_thread_events() {
+  std::lock_guard<std::mutex> lk(m_threads_mutex);
+  std::vector<ProfThreadEvents*> result;
+  for (auto& events : m_threads) {
+    result.push_back(events.get());
+  }
+  return result;
+}
+
+/*!
+ * The name as a quoted and escaped json string. Only used by one thread at a time.
+ */
+const std::string& GlobalProfiler::json_name(u32 name) {
+  if (name >= m_json_names.size()) {
+    std::lock_guard<std::mutex> lk(m_names_mutex);
+    while (m_json_names.size() < m_names.size()) {
+      m_json_names.push_back(nlohmann::json(*m_names[m_json_names.size()])
+                                 .dump(-1, ' ', false, nlohmann::json::error_handler_t::replace));
+    }
+  }
+  return m_json_names.at(name);
+}
+
+void GlobalProfiler::record(u32 name, ProfNode::Kind kind, double value) {
+  auto* events = thread_events();
+  u64 idx = events->write_count.load(std::memory_order_relaxed);
+  u64 size = events->events.size();
+  // while streaming, don't overwrite events that haven't been written to the file yet.
+  if (m_streaming && idx - events->read_count.load(std::memory_order_acquire) >= size) {
+    events->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto& node = events->events[idx % size];
+  node.ts = get_current_ts() - m_t0;
+  node.value = value;
+  node.name = name;
+  node.kind = kind;
+  events->write_count.store(idx + 1, std::memory_order_release);
+}
+
 void GlobalProfiler::event(const char* name, ProfNode::Kind kind) {
   if (m_waiting_for_event && m_waiting_for_event.value() == name) {
     m_ignore_events = true;
@@ -55,13 +207,7 @@ void GlobalProfiler::event(const char* name, ProfNode::Kind kind) {
   if (!m_enabled || m_ignore_events) {
     return;
   }
-  size_t my_idx = (m_next_idx++ % m_nodes.size());
-  auto& node = m_nodes[my_idx];
-  node.ts = get_current_ts() - m_t0;
-  node.tid = get_current_tid();
-  node.kind = kind;
-  strncpy(node.name, name, sizeof(node.name));
-  node.name[sizeof(node.name) - 1] = '\0';
+  record(intern(name), kind, 0);
 }
 
 void GlobalProfiler::instant_event(const char* name) {
@@ -80,112 +226,171 @@ void GlobalProfiler::end_event() {
   if (!m_enabled || m_ignore_events) {
     return;
   }
-  size_t my_idx = (m_next_idx++ % m_nodes.size());
-  auto& node = m_nodes[my_idx];
-  node.ts = get_current_ts() - m_t0;
-  node.tid = get_current_tid();
-  node.kind = ProfNode::END;
-  node.name[0] = '\0';
+  record(m_empty_name, ProfNode::END, 0);
+}
+
+/*!
+ * Record the value of a counter, like draw calls or memory used. These are drawn as a graph.
+ */
+void GlobalProfiler::counter(const char* name, double value) {
+  if (!m_enabled || m_ignore_events) {
+    return;
+  }
+  record(intern(name), ProfNode::COUNTER, value);
 }
 
 void GlobalProfiler::clear() {
-  m_next_idx = 0;
+  for (auto* events : all_thread_events()) {
+    events->write_count = 0;
+    events->read_count = 0;
+  }
 }
 
 void GlobalProfiler::set_enable(bool en) {
   m_enabled = en;
 }
 
+/*!
+ * Write the events in memory to a Chrome trace json file. Recording must be stopped.
+ */
 void GlobalProfiler::dump_to_json(const std::string& path) {
   ASSERT(!m_enabled);
+  ASSERT(!m_streaming);
 
-  nlohmann::json json;
-  auto& trace_events = json["traceEvents"];
-  json["displayTimeUnit"] = "ms";
-
-  u64 lowest_ts = UINT64_MAX;
-  struct ThreadInfo {
-    size_t lowest_at_target = UINT64_MAX;
-    size_t highest_at_target = 0;
-    size_t debug = 0;
-    u32 short_id = 0;
+  // for each thread, only keep events between the first and last ROOT. There are no open events
+  // at a ROOT, so every begin in this range has its end.
+  struct Range {
+    ProfThreadEvents* events;
+    u64 first, last;
   };
-  std::unordered_map<u32, ThreadInfo> info_per_thread;
-
-  // first, find all the threads
-  std::string kRootName = "ROOT";
-  for (size_t offset = m_nodes.size(); offset-- > 0;) {
-    size_t idx = (m_next_idx + offset) % m_nodes.size();
-    const auto& event = m_nodes[idx];
+  std::vector<Range> ranges;
+  u64 lowest_ts = UINT64_MAX;
+  for (auto* events : all_thread_events()) {
+    u64 size = events->events.size();
+    u64 end = events->write_count;
+    u64 begin = end > size ? end - size : 0;
+    Range range{events, UINT64_MAX, 0};
+    for (u64 i = begin; i < end; i++) {
+      const auto& event = events->events[i % size];
+      if (event.kind == ProfNode::INSTANT && event.name == m_root_name) {
+        range.first = std::min(range.first, i);
+        range.last = i;
+      }
+    }
+    if (range.first != UINT64_MAX) {
+      lowest_ts = std::min(lowest_ts, events->events[range.first % size].ts);
+      ranges.push_back(range);
+    }
+  }
 
-    if (event.kind != ProfNode::UNUSED) {
-      lowest_ts = std::min(event.ts, lowest_ts);
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  for (auto& range : ranges) {
+    u64 size = range.events->events.size();
+    for (u64 i = range.first; i <= range.last; i++) {
+      const auto& event = range.events->events[i % size];
+      if (!first) {
+        out += ",\n";
+      }
+      first = false;
+      append_trace_event(out, event, json_name(event.name), range.events->short_id, lowest_ts);
     }
-    if (event.kind == ProfNode::INSTANT && kRootName == event.name) {
-      auto& info = info_per_thread[event.tid];
-      info.lowest_at_target = std::min(info.lowest_at_target, offset);
-      info.highest_at_target = std::max(info.highest_at_target, offset);
+    if (!first) {
+      out += ",\n";
     }
+    first = false;
+    append_thread_name(out, *range.events);
   }
+  out += "\n]}\n";
 
-  u32 i = 0;
-  for (auto& info : info_per_thread) {
-    info.second.short_id = i++;
+  file_util::write_text_file(path, out);
+}
+
+/*!
+ * Start recording, and write events to a Chrome trace json file as they come in. This can record
+ * for as long as needed, instead of just the last few seconds.
+ */
+bool GlobalProfiler::start_streaming(const std::string& path) {
+  ASSERT(!m_streaming);
+  m_stream_file = file_util::open_file(path, "w");
+  if (!m_stream_file) {
+    lg::error("Failed to open {} for profiler trace", path);
+    return false;
   }
+  fmt::print(m_stream_file, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  m_stream_first_event = true;
 
-  for (size_t event_idx = 0; event_idx < m_nodes.size(); event_idx++) {
-    auto& event = m_nodes[(event_idx + m_next_idx) % m_nodes.size()];
-    if (event.kind == ProfNode::UNUSED) {
-      continue;
-    }
-    auto& info = info_per_thread.at(event.tid);
-    if (event_idx < info.lowest_at_target || event_idx > info.highest_at_target) {
-      continue;
-    }
+  // only events from now on are written.
+  for (auto* events : all_thread_events()) {
+    events->read_count = events->write_count.load();
+    events->dropped = 0;
+  }
+  m_stop_flush = false;
+  m_streaming = true;
+  m_enabled = true;
+  m_flush_thread = std::thread(&GlobalProfiler::flush_thread, this);
+  lg::info("Streaming profiler trace to {}", path);
+  return true;
+}
 
-    auto& json_event = trace_events.emplace_back();
-    // name
-    if (event.kind != ProfNode::END) {
-      json_event["name"] = event.name;
-    }
+/*!
+ * Stop recording, write the remaining events and close the file.
+ */
+void GlobalProfiler::stop_streaming() {
+  if (!m_streaming) {
+    return;
+  }
+  m_enabled = false;
+  {
+    std::lock_guard<std::mutex> lk(m_flush_mutex);
+    m_stop_flush = true;
+  }
+  m_flush_cv.notify_all();
+  m_flush_thread.join();
+  m_streaming = false;
+}
 
-    // cat
-    // json_event["cat"] = "a";  // ??
-    // ph BEi
-    switch (event.kind) {
-      case ProfNode::END:
-        json_event["ph"] = "E";
-        break;
-      case ProfNode::BEGIN:
-        json_event["ph"] = "B";
-        break;
-      case ProfNode::INSTANT:
-        json_event["ph"] = "i";
-        break;
-      default:
-        ASSERT(false);
-    }
-    // pid
-    json_event["pid"] = 1;
-    // tid
-    json_event["tid"] = info.short_id;
-    // ts
-    json_event["ts"] = (event.ts - lowest_ts) / 1000.f;
-    if (event.ts < info.debug) {
-      lg::debug("out of order: {} {} {} ms", event.ts / 1000.f, info.debug / 1000.f,
-                (info.debug - event.ts) / 1000000.f);
-      lg::debug("  idx: {}, range {} {}", event_idx, info.lowest_at_target, info.highest_at_target);
-      lg::debug("  now: {}", m_next_idx.load());
-    }
-    info.debug = event.ts;
+void GlobalProfiler::flush_thread() {
+  std::unique_lock<std::mutex> lk(m_flush_mutex);
+  while (!m_stop_flush) {
+    m_flush_cv.wait_for(lk, kFlushInterval, [&] { return m_stop_flush; });
+    flush_events();
   }
 
-  for (auto& t : info_per_thread) {
-    lg::debug("thread: {}: {} -> {}", t.first, t.second.lowest_at_target,
-              t.second.highest_at_target);
+  std::string out;
+  u64 dropped = 0;
+  for (auto* events : all_thread_events()) {
+    out += m_stream_first_event ? "" : ",\n";
+    m_stream_first_event = false;
+    append_thread_name(out, *events);
+    dropped += events->dropped;
+  }
+  out += "\n]}\n";
+  fwrite(out.data(), 1, out.size(), m_stream_file);
+  fclose(m_stream_file);
+  m_stream_file = nullptr;
+  if (dropped) {
+    lg::warn("Profiler trace dropped {} events, the buffers were full", dropped);
   }
+}
 
-  file_util::write_text_file(path, json.dump());
+void GlobalProfiler::flush_events() {
+  std::string out;
+  for (auto* events : all_thread_events()) {
+    u64 size = events->events.size();
+    u64 end = events->write_count.load(std::memory_order_acquire);
+    for (u64 i = events->read_count.load(std::memory_order_relaxed); i < end; i++) {
+      const auto& event = events->events[i % size];
+      out += m_stream_first_event ? "" : ",\n";
+      m_stream_first_event = false;
+      append_trace_event(out, event, json_name(event.name), events->short_id, 0);
+    }
+    events->read_count.store(end, std::memory_order_release);
+  }
+  if (!out.empty()) {
+    fwrite(out.data(), 1, out.size(), m_stream_file);
+    fflush(m_stream_file);
+  }
 }
 
 GlobalProfiler gprof;
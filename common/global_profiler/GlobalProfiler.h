@@ -1,38 +1,90 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "common/common_types.h"
 
+/*!
+ * A single recorded event. The name is an id from GlobalProfiler::intern.
+ */
 struct ProfNode {
   u64 ts;
-  u64 tid;
-  char name[128];
-  enum Kind : u8 { BEGIN, END, INSTANT, UNUSED } kind = UNUSED;
+  double value;  // only used by COUNTER
+  u32 name;
+  // the first three values are used by GOAL code.
+  enum Kind : u8 { BEGIN, END, INSTANT, UNUSED, COUNTER } kind = UNUSED;
 };
 
+struct ProfThreadEvents;
+
 class GlobalProfiler {
  public:
   GlobalProfiler();
+  ~GlobalProfiler();
   void set_max_events(size_t event_count);
   void set_waiting_for_event(const std::string& event_name);
+  void set_thread_name(const char* name);
   void instant_event(const char* name);
   void begin_event(const char* name);
   void event(const char* name, ProfNode::Kind kind);
   void end_event();
+  void counter(const char* name, double value);
   void clear();
   void set_enable(bool en);
+  bool enabled() const { return m_enabled; }
   void dump_to_json(const std::string& path);
   void root_event();
 
+  bool start_streaming(const std::string& path);
+  void stop_streaming();
+  bool streaming() const { return m_streaming; }
+
+  u32 intern(const char* name);
+
  private:
+  void record(u32 name, ProfNode::Kind kind, double value);
+  ProfThreadEvents* thread_events();
+  std::vector<ProfThreadEvents*> all_thread_events();
+  const std::string& json_name(u32 name);
+  void flush_thread();
+  void flush_events();
+
   std::atomic_bool m_enabled = false;
   u64 m_t0 = 0;
-  std::atomic_size_t m_next_idx = 0;
-  std::vector<ProfNode> m_nodes;
+  size_t m_max_events = 0;
+  u32 m_root_name = 0;
+  u32 m_empty_name = 0;
+
+  // each thread records to its own buffer, so recording only needs a lock the first time.
+  std::mutex m_threads_mutex;
+  std::vector<std::unique_ptr<ProfThreadEvents>> m_threads;
+
+  // names are stored once, and events refer to them by index.
+  std::mutex m_names_mutex;
+  std::vector<std::unique_ptr<std::string>> m_names;
+  std::unordered_map<std::string_view, u32> m_name_ids;
+  std::vector<std::string> m_json_names;  // only used by the thread writing json.
+
+  // when streaming, a thread writes events to a file as they come in, instead of keeping the last
+  // few seconds in memory.
+  std::atomic_bool m_streaming = false;
+  std::thread m_flush_thread;
+  std::mutex m_flush_mutex;
+  std::condition_variable m_flush_cv;
+  bool m_stop_flush = false;
+  FILE* m_stream_file = nullptr;
+  bool m_stream_first_event = true;
+
   // this is very niche, but sometimes you want to capture up to a given event (ie. long startup)
   // instead of having to make the user quit and record as fast as possible, we can instead just
   // stop capturing events once we have received what we are looking for
@@ -0,0 +1,442 @@
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "common/util/Assert.h"
+
+namespace {
+
+u32 channel(u32 pixel, int c) {
+  return (pixel >> (8 * c)) & 0xff;
+}
+
+u32 make_pixel(u32 r, u32 g, u32 b, u32 a) {
+  return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+u16 pack_565(const float rgb[3]) {
+  auto q = [](float x, int max) {
+    return (u16)std::clamp((int)std::lround(x * max / 255.f), 0, max);
+  };
+  return (q(rgb[0], 31) << 11) | (q(rgb[1], 63) << 5) | q(rgb[2], 31);
+}
+
+void unpack_565(u16 c, u32 rgb[3]) {
+  u32 r = (c >> 11) & 31;
+  u32 g = (c >> 5) & 63;
+  u32 b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+/*!
+ * The four colors of a 4-color block.
+ */
+void color_palette(u16 c0, u16 c1, u32 palette[4][3]) {
+  unpack_565(c0, palette[0]);
+  unpack_565(c1, palette[1]);
+  for (int i = 0; i < 3; i++) {
+    palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+    palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+  }
+}
+
+/*!
+ * Pick the closest palette entry for each pixel. Returns the packed indices and the total error.
+ */
+u32 assign_color_indices(const u32 pixels[16], u16 c0, u16 c1, u64* error) {
+  u32 palette[4][3];
+  color_palette(c0, c1, palette);
+  u32 indices = 0;
+  *error = 0;
+  for (int p = 0; p < 16; p++) {
+    u32 best = 0;
+    u32 best_err = UINT32_MAX;
+    for (u32 i = 0; i < 4; i++) {
+      u32 err = 0;
+      for (int c = 0; c < 3; c++) {
+        int d = (int)channel(pixels[p], c) - (int)palette[i][c];
+        err += d * d;
+      }
+      if (err < best_err) {
+        best_err = err;
+        best = i;
+      }
+    }
+    indices |= best << (2 * p);
+    *error += best_err;
+  }
+  return indices;
+}
+
+/*!
+ * Least squares fit of the endpoints, given which palette entry each pixel uses.
+ */
+bool refine_endpoints(const u32 pixels[16], u32 indices, float e0[3], float e1[3]) {
+  // weight of endpoint 0 for each index.
+  constexpr float kWeights[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+  float aa = 0, ab = 0, bb = 0;
+  float ax[3] = {0, 0, 0};
+  float bx[3] = {0, 0, 0};
+  for (int p = 0; p < 16; p++) {
+    float a = kWeights[(indices >> (2 * p)) & 3];
+    float b = 1.f - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < 3; c++) {
+      ax[c] += a * channel(pixels[p], c);
+      bx[c] += b * channel(pixels[p], c);
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-6f) {
+    return false;
+  }
+  for (int c = 0; c < 3; c++) {
+    e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+    e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+  }
+  return true;
+}
+
+/*!
+ * Encode the color part of a block, always in 4-color mode.
+ */
+void encode_color_block(const u32 pixels[16], u8* out) {
+  // endpoints along the principal axis of the colors.
+  float mean[3] = {0, 0, 0};
+  for (int p = 0; p < 16; p++) {
+    for (int c = 0; c < 3; c++) {
+      mean[c] += channel(pixels[p], c) / 16.f;
+    }
+  }
+  float cov[6] = {0, 0, 0, 0, 0, 0};  // rr, rg, rb, gg, gb, bb
+  for (int p = 0; p < 16; p++) {
+    float d[3];
+    for (int c = 0; c < 3; c++) {
+      d[c] = channel(pixels[p], c) - mean[c];
+    }
+    cov[0] += d[0] * d[0];
+    cov[1] += d[0] * d[1];
+    cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1];
+    cov[4] += d[1] * d[2];
+    cov[5] += d[2] * d[2];
+  }
+  float axis[3] = {1, 1, 1};
+  for (int iter = 0; iter < 8; iter++) {
+    float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                     cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                     cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+    if (len < 1e-6f) {
+      break;
+    }
+    for (int c = 0; c < 3; c++) {
+      axis[c] = next[c] / len;
+    }
+  }
+  float min_t = 0, max_t = 0;
+  for (int p = 0; p < 16; p++) {
+    float t = 0;
+    for (int c = 0; c < 3; c++) {
+      t += (channel(pixels[p], c) - mean[c]) * axis[c];
+    }
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  float e0[3], e1[3];
+  for (int c = 0; c < 3; c++) {
+    e0[c] = mean[c] + axis[c] * max_t;
+    e1[c] = mean[c] + axis[c] * min_t;
+  }
+
+  u16 c0 = pack_565(e0);
+  u16 c1 = pack_565(e1);
+  u64 error;
+  u32 indices = assign_color_indices(pixels, c0, c1, &error);
+
+  // one round of least squares refinement, if it helps.
+  if (refine_endpoints(pixels, indices, e0, e1)) {
+    u16 r0 = pack_565(e0);
+    u16 r1 = pack_565(e1);
+    u64 refined_error;
+    u32 refined_indices = assign_color_indices(pixels, r0, r1, &refined_error);
+    if (refined_error < error) {
+      c0 = r0;
+      c1 = r1;
+      indices = refined_indices;
+    }
+  }
+
+  // c0 > c1 selects 4-color mode for BC1. Swapping the endpoints swaps indices 0/1 and 2/3.
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    indices ^= 0x55555555;
+  } else if (c0 == c1) {
+    indices = 0;
+  }
+  memcpy(out, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &indices, 4);
+}
+
+void decode_color_block(const u8* in, u32 pixels[16], bool allow_3_color) {
+  u16 c0, c1;
+  u32 indices;
+  memcpy(&c0, in, 2);
+  memcpy(&c1, in + 2, 2);
+  memcpy(&indices, in + 4, 4);
+  u32 palette[4][3];
+  color_palette(c0, c1, palette);
+  u32 alpha[4] = {255, 255, 255, 255};
+  if (allow_3_color && c0 <= c1) {
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+    alpha[3] = 0;
+  }
+  for (int p = 0; p < 16; p++) {
+    u32 i = (indices >> (2 * p)) & 3;
+    pixels[p] = make_pixel(palette[i][0], palette[i][1], palette[i][2], alpha[i]);
+  }
+}
+
+void alpha_palette(u32 a0, u32 a1, u32 palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (u32 i = 2; i < 8; i++) {
+      palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+  } else {
+    for (u32 i = 2; i < 6; i++) {
+      palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encode_alpha_block(const u32 pixels[16], u8* out) {
+  u32 a0 = 0, a1 = 255;
+  for (int p = 0; p < 16; p++) {
+    a0 = std::max(a0, channel(pixels[p], 3));
+    a1 = std::min(a1, channel(pixels[p], 3));
+  }
+  out[0] = a0;
+  out[1] = a1;
+  u64 indices = 0;
+  if (a0 != a1) {
+    u32 palette[8];
+    alpha_palette(a0, a1, palette);
+    for (int p = 0; p < 16; p++) {
+      u32 a = channel(pixels[p], 3);
+      u32 best = 0;
+      u32 best_err = UINT32_MAX;
+      for (u32 i = 0; i < 8; i++) {
+        u32 err = std::abs((int)a - (int)palette[i]);
+        if (err < best_err) {
+          best_err = err;
+          best = i;
+        }
+      }
+      indices |= (u64)best << (3 * p);
+    }
+  }
+  memcpy(out + 2, &indices, 6);
+}
+
+void decode_alpha_block(const u8* in, u32 pixels[16]) {
+  u32 palette[8];
+  alpha_palette(in[0], in[1], palette);
+  u64 indices = 0;
+  memcpy(&indices, in + 2, 6);
+  for (int p = 0; p < 16; p++) {
+    u32 a = palette[(indices >> (3 * p)) & 7];
+    pixels[p] = (pixels[p] & 0xffffff) | (a << 24);
+  }
+}
+
+/*!
+ * Get the 4x4 block at (bx, by), repeating edge pixels for images that aren't a multiple of 4.
+ */
+void get_block(const u32* rgba, u32 w, u32 h, u32 bx, u32 by, u32 pixels[16]) {
+  for (u32 y = 0; y < 4; y++) {
+    for (u32 x = 0; x < 4; x++) {
+      u32 px = std::min(bx * 4 + x, w - 1);
+      u32 py = std::min(by * 4 + y, h - 1);
+      pixels[y * 4 + x] = rgba[py * w + px];
+    }
+  }
+}
+
+}  // namespace
+
+u32 bc_block_bytes(BcFormat format) {
+  return format == BcFormat::BC1 ? 8 : 16;
+}
+
+u32 bc_image_bytes(BcFormat format, u32 w, u32 h) {
+  return ((w + 3) / 4) * ((h + 3) / 4) * bc_block_bytes(format);
+}
+
+/*!
+ * Number of levels in a full mip chain, down to 1x1.
+ */
+u32 mip_count(u32 w, u32 h) {
+  u32 count = 1;
+  while (w > 1 || h > 1) {
+    w = std::max(1u, w / 2);
+    h = std::max(1u, h / 2);
+    count++;
+  }
+  return count;
+}
+
+void bc1_encode_block(const u32 pixels[16], u8* out) {
+  encode_color_block(pixels, out);
+}
+
+void bc3_encode_block(const u32 pixels[16], u8* out) {
+  encode_alpha_block(pixels, out);
+  encode_color_block(pixels, out + 8);
+}
+
+void bc1_decode_block(const u8* in, u32 pixels[16]) {
+  decode_color_block(in, pixels, true);
+}
+
+void bc3_decode_block(const u8* in, u32 pixels[16]) {
+  decode_color_block(in + 8, pixels, false);
+  decode_alpha_block(in, pixels);
+}
+
+std::vector<u8> bc_encode_image(BcFormat format, const u32* rgba, u32 w, u32 h) {
+  std::vector<u8> result(bc_image_bytes(format, w, h));
+  u32 block_bytes = bc_block_bytes(format);
+  u8* out = result.data();
+  for (u32 by = 0; by < (h + 3) / 4; by++) {
+    for (u32 bx = 0; bx < (w + 3) / 4; bx++) {
+      u32 pixels[16];
+      get_block(rgba, w, h, bx, by, pixels);
+      if (format == BcFormat::BC1) {
+        bc1_encode_block(pixels, out);
+      } else {
+        bc3_encode_block(pixels, out);
+      }
+      out += block_bytes;
+    }
+  }
+  return result;
+}
+
+/*!
+ * Decode an image. BC1 blocks don't store alpha, so all BC1 pixels get bc1_alpha.
+ */
+void bc_decode_image(BcFormat format,
+                     const u8* data,
+                     u32 w,
+                     u32 h,
+                     u32* rgba_out,
+                     u8 bc1_alpha) {
+  u32 block_bytes = bc_block_bytes(format);
+  for (u32 by = 0; by < (h + 3) / 4; by++) {
+    for (u32 bx = 0; bx < (w + 3) / 4; bx++) {
+      u32 pixels[16];
+      if (format == BcFormat::BC1) {
+        bc1_decode_block(data, pixels);
+        for (auto& pixel : pixels) {
+          pixel = (pixel & 0xffffff) | ((u32)bc1_alpha << 24);
+        }
+      } else {
+        bc3_decode_block(data, pixels);
+      }
+      data += block_bytes;
+      for (u32 y = 0; y < 4 && by * 4 + y < h; y++) {
+        for (u32 x = 0; x < 4 && bx * 4 + x < w; x++) {
+          rgba_out[(by * 4 + y) * w + bx * 4 + x] = pixels[y * 4 + x];
+        }
+      }
+    }
+  }
+}
+
+/*!
+ * Convert BC1 blocks from bc1_encode_block to BC3 blocks with a constant alpha, for GPUs. This is
+ * exact, because the encoder only makes 4-color blocks, which BC3 decodes the same way.
+ */
+std::vector<u8> bc1_to_bc3(const u8* bc1, size_t size, u8 alpha) {
+  ASSERT(size % 8 == 0);
+  std::vector<u8> result(size * 2);
+  for (size_t i = 0; i < size / 8; i++) {
+    u8* out = result.data() + i * 16;
+    out[0] = alpha;
+    out[1] = alpha;
+    memset(out + 2, 0, 6);
+    memcpy(out + 8, bc1 + i * 8, 8);
+  }
+  return result;
+}
+
+/*!
+ * Make the next mip level with a 2x2 box filter.
+ */
+std::vector<u32> downsample_rgba(const u32* rgba, u32 w, u32 h) {
+  u32 out_w = std::max(1u, w / 2);
+  u32 out_h = std::max(1u, h / 2);
+  std::vector<u32> result(out_w * out_h);
+  for (u32 y = 0; y < out_h; y++) {
+    for (u32 x = 0; x < out_w; x++) {
+      u32 x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+      u32 y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+      u32 out[4];
+      for (int c = 0; c < 4; c++) {
+        out[c] = (channel(rgba[y0 * w + x0], c) + channel(rgba[y0 * w + x1], c) +
+                  channel(rgba[y1 * w + x0], c) + channel(rgba[y1 * w + x1], c) + 2) /
+                 4;
+      }
+      result[y * out_w + x] = make_pixel(out[0], out[1], out[2], out[3]);
+    }
+  }
+  return result;
+}
+
+/*!
+ * BC1 if every pixel has the same alpha, which is written to bc1_alpha. Most PS2 textures are
+ * opaque, with an alpha of 0x80 rather than 255. Otherwise BC3 to keep the alpha.
+ */
+BcFormat pick_bc_format(const u32* rgba, size_t count, u8* bc1_alpha) {
+  u32 alpha = count ? channel(rgba[0], 3) : 255;
+  for (size_t i = 0; i < count; i++) {
+    if (channel(rgba[i], 3) != alpha) {
+      return BcFormat::BC3;
+    }
+  }
+  *bc1_alpha = alpha;
+  return BcFormat::BC1;
+}
+
+/*!
+ * Peak signal to noise ratio over all four channels, in dB. Identical images give infinity.
+ */
+double rgba_psnr(const u32* a, const u32* b, size_t count) {
+  ASSERT(count > 0);
+  double sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    for (int c = 0; c < 4; c++) {
+      double d = (double)channel(a[i], c) - (double)channel(b[i], c);
+      sum += d * d;
+    }
+  }
+  double mse = sum / (count * 4);
+  if (mse == 0) {
+    return INFINITY;
+  }
+  return 10. * std::log10(255. * 255. / mse);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/*!
+ * @file texture_compression.h
+ * CPU encoder and decoder for BC1 (DXT1) and BC3 (DXT5) block compressed textures.
+ *
+ * Pixels are RGBA8, stored as a u32 with red in the low byte, like tfrag3::Texture data.
+ * Compressed images are made of 4x4 pixel blocks. Images that aren't a multiple of 4 are padded
+ * by repeating the edge pixels.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "common/common_types.h"
+
+enum class BcFormat : u8 {
+  BC1 = 0,  // 8 bytes per block, color only. The alpha of the whole image is kept separately.
+  BC3 = 1,  // 16 bytes per block, color plus interpolated alpha.
+};
+
+u32 bc_block_bytes(BcFormat format);
+u32 bc_image_bytes(BcFormat format, u32 w, u32 h);
+u32 mip_count(u32 w, u32 h);
+
+void bc1_encode_block(const u32 pixels[16], u8* out);
+void bc3_encode_block(const u32 pixels[16], u8* out);
+void bc1_decode_block(const u8* in, u32 pixels[16]);
+void bc3_decode_block(const u8* in, u32 pixels[16]);
+
+std::vector<u8> bc_encode_image(BcFormat format, const u32* rgba, u32 w, u32 h);
+void bc_decode_image(BcFormat format,
+                     const u8* data,
+                     u32 w,
+                     u32 h,
+                     u32* rgba_out,
+                     u8 bc1_alpha = 255);
+std::vector<u8> bc1_to_bc3(const u8* bc1, size_t size, u8 alpha);
+
+std::vector<u32> downsample_rgba(const u32* rgba, u32 w, u32 h);
+BcFormat pick_bc_format(const u32* rgba, size_t count, u8* bc1_alpha);
+double rgba_psnr(const u32* a, const u32* b, size_t count);
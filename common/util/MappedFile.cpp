@@ -0,0 +1,89 @@
+#include "MappedFile.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "fmt/core.h"
+
+#ifdef OS_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#else
+// clang-format off
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+// clang-format on
+#endif
+
+/*!
+ * Map the file. Throws if it can't be opened, like file_util::read_binary_file.
+ */
+MappedFile::MappedFile(const fs::path& path) {
+  std::error_code ec;
+  m_size = fs::file_size(path, ec);
+  if (ec) {
+    throw std::runtime_error(
+        fmt::format("File {} cannot be mapped: {}", path.string(), ec.message()));
+  }
+  if (m_size == 0) {
+    return;
+  }
+
+#ifdef OS_POSIX
+  int fd = open(path.string().c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(
+        fmt::format("File {} cannot be mapped: {}", path.string(), strerror(errno)));
+  }
+  void* mem = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file open.
+  close(fd);
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error(
+        fmt::format("File {} cannot be mapped: {}", path.string(), strerror(errno)));
+  }
+  m_data = (const u8*)mem;
+#else
+  m_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = nullptr;
+    throw std::runtime_error(fmt::format("File {} cannot be mapped: error {}", path.string(),
+                                         (u32)GetLastError()));
+  }
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping) {
+    m_data = (const u8*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!m_data) {
+    auto error = GetLastError();
+    if (m_mapping) {
+      CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+    throw std::runtime_error(
+        fmt::format("File {} cannot be mapped: error {}", path.string(), (u32)error));
+  }
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef OS_POSIX
+  if (m_data) {
+    munmap(const_cast<u8*>(m_data), m_size);
+  }
+#else
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common/common_types.h"
+#include "common/util/FileUtil.h"
+
+/*!
+ * A read-only memory mapping of a whole file. Pages are read from the OS file cache when they are
+ * first used, and aren't copied into memory owned by the program.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const fs::path& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const u8* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  const u8* m_data = nullptr;
+  size_t m_size = 0;
+#ifndef OS_POSIX
+  void* m_file = nullptr;
+  void* m_mapping = nullptr;
+#endif
+};
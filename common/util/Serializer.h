@@ -52,6 +52,15 @@ class Serializer {
     memcpy(m_data, data, size);
   }
 
+  /*!
+   * Construct a serializer that reads from the given data without copying it. The data must stay
+   * valid until the serializer is destroyed.
+   */
+  static constexpr struct NoCopy {
+  } no_copy = {};
+  Serializer(const u8* data, size_t size, NoCopy)
+      : m_data(const_cast<u8*>(data)), m_size(size), m_writing(false), m_owns_data(false) {}
+
   // don't allow copying, assigning, or move constructing.
   Serializer(const Serializer& other) = delete;
   Serializer& operator=(const Serializer& other) = delete;
@@ -67,6 +76,7 @@ class Serializer {
     m_size = other.m_size;
     m_offset = other.m_offset;
     m_writing = other.m_writing;
+    m_owns_data = other.m_owns_data;
 
     other.m_data = nullptr;
     other.m_size = 0;
@@ -74,7 +84,11 @@ class Serializer {
     return *this;
   }
 
-  ~Serializer() { free(m_data); }
+  ~Serializer() {
+    if (m_owns_data) {
+      free(m_data);
+    }
+  }
 
   /*!
    * Save or load the thing pointed to by ptr.
@@ -230,4 +244,5 @@ class Serializer {
   size_t m_size = 0;
   size_t m_offset = 0;
   bool m_writing = false;
+  bool m_owns_data = true;
 };
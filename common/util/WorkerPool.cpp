@@ -0,0 +1,84 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#include "common/util/Assert.h"
+
+WorkerPool::WorkerPool(int num_workers) {
+  ASSERT(num_workers >= 0);
+  for (int i = 0; i < num_workers; i++) {
+    m_threads.emplace_back([this]() { worker_loop(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_exit = true;
+  }
+  m_work_cv.notify_all();
+  for (auto& t : m_threads) {
+    t.join();
+  }
+}
+
+/*!
+ * Number of workers to create, leaving one hardware thread for the caller.
+ */
+int WorkerPool::default_worker_count(int max_workers) {
+  int hw = std::thread::hardware_concurrency();
+  return std::clamp(hw - 1, 0, max_workers);
+}
+
+void WorkerPool::run_iterations() {
+  int idx;
+  while ((idx = m_next_idx.fetch_add(1)) < m_count) {
+    (*m_func)(idx);
+  }
+}
+
+void WorkerPool::parallel_for(int count, const std::function<void(int)>& func) {
+  if (count <= 1 || m_threads.empty()) {
+    for (int i = 0; i < count; i++) {
+      func(i);
+    }
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_func = &func;
+    m_count = count;
+    m_next_idx = 0;
+    m_busy_workers = m_threads.size();
+    m_generation++;
+  }
+  m_work_cv.notify_all();
+
+  run_iterations();
+
+  std::unique_lock<std::mutex> lk(m_mutex);
+  m_done_cv.wait(lk, [&]() { return m_busy_workers == 0; });
+  m_func = nullptr;
+}
+
+void WorkerPool::worker_loop() {
+  u64 last_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(m_mutex);
+      m_work_cv.wait(lk, [&]() { return m_exit || m_generation != last_generation; });
+      if (m_exit) {
+        return;
+      }
+      last_generation = m_generation;
+    }
+
+    run_iterations();
+
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (--m_busy_workers == 0) {
+      m_done_cv.notify_one();
+    }
+  }
+}
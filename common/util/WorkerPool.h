@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+
+/*!
+ * A fixed group of threads that runs loops in parallel:
+ *  for (int i = 0; i < count; i++) {
+ *    func(i);
+ *  }
+ * Unlike SimpleThreadGroup, the threads are created once and reused, so this is cheap enough to use
+ * every frame. The calling thread also runs iterations, and parallel_for returns once all of them
+ * are done. Iterations are handed out one at a time, so they may be uneven in size.
+ * Only one thread may call parallel_for at a time.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(int num_workers);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  void parallel_for(int count, const std::function<void(int)>& func);
+  int num_threads() const { return m_threads.size() + 1; }
+
+  static int default_worker_count(int max_workers);
+
+ private:
+  void worker_loop();
+  void run_iterations();
+
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  const std::function<void(int)>* m_func = nullptr;
+  int m_count = 0;
+  std::atomic<int> m_next_idx = 0;
+  int m_busy_workers = 0;
+  u64 m_generation = 0;
+  bool m_exit = false;
+};
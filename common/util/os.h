@@ -17,3 +17,11 @@ struct CpuInfo {
 };
 
 CpuInfo& get_cpu_info();
+
+// Functions marked AVX2_TARGET can use AVX2 intrinsics, even though the rest of the build only
+// enables AVX. Only call them if get_cpu_info().has_avx2 is set.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__aarch64__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
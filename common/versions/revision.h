@@ -0,0 +1,2 @@
+#define BUILT_TAG ""
+#define BUILT_SHA "c8236be"
@@ -123,6 +123,12 @@ Config make_config_via_json(nlohmann::json& json) {
   config.rip_levels = json.at("rip_levels").get<bool>();
   config.extract_collision = json.at("extract_collision").get<bool>();
   config.generate_all_types = json.at("generate_all_types").get<bool>();
+  if (json.contains("uncompressed_fr3")) {
+    config.uncompressed_fr3 = json.at("uncompressed_fr3").get<bool>();
+  }
+  if (json.contains("compress_textures")) {
+    config.compress_textures = json.at("compress_textures").get<bool>();
+  }
   if (json.contains("read_spools")) {
     config.read_spools = json.at("read_spools").get<bool>();
   }
@@ -124,6 +124,8 @@ struct Config {
   bool dump_joint_geo_info = false;
   bool dump_tex_info = false;
   bool rip_levels = false;
+  bool uncompressed_fr3 = false;
+  bool compress_textures = false;
   bool extract_collision = false;
   bool find_functions = false;
   bool read_spools = false;
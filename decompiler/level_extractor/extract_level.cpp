@@ -3,10 +3,11 @@
 #include <set>
 #include <thread>
 
+#include "common/custom_data/fr3_file.h"
 #include "common/log/log.h"
+#include "common/texture/texture_compression.h"
 #include "common/util/FileUtil.h"
 #include "common/util/SimpleThreadGroup.h"
-#include "common/util/compress.h"
 #include "common/util/string_util.h"
 
 #include "decompiler/level_extractor/BspHeader.h"
@@ -248,6 +249,76 @@ level_tools::BspHeader extract_bsp_from_level(const ObjectFileDB& db,
   return bsp_header;
 }
 
+/*!
+ * Replace the RGBA data of each texture with a BC1/BC3 compressed mip chain. The RGBA data is kept
+ * in memory so level ripping still sees the original colors, but only the compressed data is
+ * written to the fr3. Logs the PSNR of the largest mip, which is what most of the screen sees.
+ * Textures are encoded in parallel.
+ */
+void compress_level_textures(tfrag3::Level& level, const std::string& name) {
+  constexpr double kWarnPsnr = 30.;
+  std::vector<tfrag3::Texture*> textures;
+  for (auto& tex : level.textures) {
+    if (!tex.data.empty() && tex.format == tfrag3::TextureFormat::RGBA8) {
+      textures.push_back(&tex);
+    }
+  }
+  if (textures.empty()) {
+    return;
+  }
+
+  std::vector<double> psnrs(textures.size());
+  SimpleThreadGroup threads;
+  threads.run(
+      [&](int idx) {
+        auto& tex = *textures[idx];
+        auto format = pick_bc_format(tex.data.data(), tex.data.size(), &tex.bc1_alpha);
+        tex.format =
+            format == BcFormat::BC1 ? tfrag3::TextureFormat::BC1 : tfrag3::TextureFormat::BC3;
+        tex.compressed_data.clear();
+
+        std::vector<u32> mip = tex.data;
+        u32 w = tex.w, h = tex.h;
+        for (u32 i = 0; i < mip_count(tex.w, tex.h); i++) {
+          auto bc = bc_encode_image(format, mip.data(), w, h);
+          if (i == 0) {
+            std::vector<u32> decoded(mip.size());
+            bc_decode_image(format, bc.data(), w, h, decoded.data(), tex.bc1_alpha);
+            psnrs[idx] = rgba_psnr(mip.data(), decoded.data(), mip.size());
+            lg::debug("{}: {} {}x{} PSNR {:.2f} dB", name, tex.debug_name, w, h, psnrs[idx]);
+            if (psnrs[idx] < kWarnPsnr) {
+              lg::warn("{}: texture {} compressed poorly, PSNR {:.2f} dB", name, tex.debug_name,
+                       psnrs[idx]);
+            }
+          }
+          tex.compressed_data.insert(tex.compressed_data.end(), bc.begin(), bc.end());
+          if (w > 1 || h > 1) {
+            mip = downsample_rgba(mip.data(), w, h);
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+          }
+        }
+      },
+      textures.size());
+  threads.join();
+
+  double min_psnr = 1000., psnr_sum = 0.;
+  size_t rgba_bytes = 0, bc_bytes = 0;
+  int bc1_count = 0;
+  for (size_t i = 0; i < textures.size(); i++) {
+    min_psnr = std::min(min_psnr, psnrs[i]);
+    psnr_sum += psnrs[i];
+    bc1_count += textures[i]->format == tfrag3::TextureFormat::BC1;
+    rgba_bytes += textures[i]->data.size() * sizeof(u32);
+    bc_bytes += textures[i]->compressed_data.size();
+  }
+  int count = textures.size();
+  lg::info("{}: compressed {} textures ({} BC1, {} BC3): {} -> {} bytes with mips, PSNR avg "
+           "{:.2f} dB, min {:.2f} dB",
+           name, count, bc1_count, count - bc1_count, rgba_bytes, bc_bytes, psnr_sum / count,
+           min_psnr);
+}
+
 /*!
  * Extract stuff found in GAME.CGO.
  * Even though GAME.CGO isn't technically a level, the decompiler/loader treat it like one,
@@ -308,18 +379,18 @@ void extract_common(const ObjectFileDB& db,
     }
   }
 
-  Serializer ser;
-  tfrag_level.serialize(ser);
-  auto compressed =
-      compression::compress_zstd(ser.get_save_result().first, ser.get_save_result().second);
+  if (config.compress_textures) {
+    compress_level_textures(tfrag_level, dgo_name);
+  }
+  auto fr3 = tfrag3::write_chunked_fr3(tfrag_level, !config.uncompressed_fr3);
 
   lg::info("stats for {}", dgo_name);
-  print_memory_usage(tfrag_level, ser.get_save_result().second);
-  lg::info("compressed: {} -> {} ({:.2f}%)", ser.get_save_result().second, compressed.size(),
-           100.f * compressed.size() / ser.get_save_result().second);
+  print_memory_usage(tfrag_level, fr3.uncompressed_size);
+  lg::info("compressed: {} -> {} ({:.2f}%)", fr3.uncompressed_size, fr3.data.size(),
+           100.f * fr3.data.size() / fr3.uncompressed_size);
   file_util::write_binary_file(
       output_folder / fmt::format("{}.fr3", dgo_name.substr(0, dgo_name.length() - 4)),
-      compressed.data(), compressed.size());
+      fr3.data.data(), fr3.data.size());
 
   if (config.rip_levels) {
     auto file_path = file_util::get_jak_project_dir() / "glb_out" / "common.glb";
@@ -347,16 +418,16 @@ void extract_from_level(const ObjectFileDB& db,
   extract_art_groups_from_level(db, tex_db, bsp_header.texture_remap_table, dgo_name, level_data,
                                 art_group_data);
 
-  Serializer ser;
-  level_data.serialize(ser);
-  auto compressed =
-      compression::compress_zstd(ser.get_save_result().first, ser.get_save_result().second);
+  if (config.compress_textures) {
+    compress_level_textures(level_data, level_data.level_name);
+  }
+  auto fr3 = tfrag3::write_chunked_fr3(level_data, !config.uncompressed_fr3);
   lg::info("stats for {}", level_data.level_name);
-  print_memory_usage(level_data, ser.get_save_result().second);
-  lg::info("compressed: {} -> {} ({:.2f}%)", ser.get_save_result().second, compressed.size(),
-           100.f * compressed.size() / ser.get_save_result().second);
+  print_memory_usage(level_data, fr3.uncompressed_size);
+  lg::info("compressed: {} -> {} ({:.2f}%)", fr3.uncompressed_size, fr3.data.size(),
+           100.f * fr3.data.size() / fr3.uncompressed_size);
   file_util::write_binary_file(output_folder / fmt::format("{}.fr3", level_data.level_name),
-                               compressed.data(), compressed.size());
+                               fr3.data.data(), fr3.data.size());
 
   if (config.rip_levels) {
     auto back_file_path = file_util::get_jak_project_dir() / "glb_out" /
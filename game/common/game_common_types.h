@@ -18,5 +18,7 @@ enum class Language {
 struct GameLaunchOptions {
   GameVersion game_version = GameVersion::Jak1;
   bool disable_display = false;
+  bool null_renderer = false;
+  bool pipelined_frames = false;
   int server_port = DECI2_PORT;
 };
@@ -0,0 +1,265 @@
+#include "frame_capture.h"
+
+#include <cstring>
+
+#include "common/goal_constants.h"
+#include "common/log/log.h"
+#include "common/util/Assert.h"
+#include "common/util/compress.h"
+
+namespace frame_capture {
+
+void InitialState::serialize(Serializer& ser) {
+  ser.from_string_vector(&levels);
+  ser.from_string_vector(&active_levels);
+  ser.from_ptr(&pmode_alp);
+  ser.from_pod_vector(&texture_slots);
+}
+
+void Event::serialize(Serializer& ser) {
+  ser.from_ptr(&kind);
+  switch (kind) {
+    case EventKind::MEMORY:
+      ser.from_pod_vector(&chunk_addrs);
+      ser.from_pod_vector(&chunk_data);
+      break;
+    case EventKind::TEXTURE_UPLOAD_NOW:
+    case EventKind::TEXTURE_RELOCATE:
+    case EventKind::SEND_CHAIN:
+      ser.from_ptr(&args);
+      break;
+    case EventKind::SET_LEVELS:
+    case EventKind::SET_ACTIVE_LEVELS:
+      ser.from_string_vector(&levels);
+      break;
+    case EventKind::PMODE_ALP:
+      ser.from_ptr(&alp);
+      break;
+    default:
+      ASSERT_NOT_REACHED();
+  }
+}
+
+/*!
+ * Start capturing the next frame_count frames to a file. Returns false if a capture is already
+ * running or the file couldn't be opened.
+ */
+bool Writer::start(const fs::path& path,
+                   int frame_count,
+                   GameVersion version,
+                   u32 s7_offset,
+                   InitialState state) {
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (m_active || frame_count <= 0) {
+    return false;
+  }
+  file_util::create_dir_if_needed_for_file(path);
+  m_file = file_util::open_file(path, "wb");
+  if (!m_file) {
+    lg::error("Failed to open frame capture file {}", path.string());
+    return false;
+  }
+  m_path = path;
+  m_frames_left = frame_count;
+  m_frames_written = 0;
+  m_bytes_written = 0;
+  m_events.clear();
+  // compared against all zeros, so the first frame stores all of the used memory.
+  m_last_memory.assign(EE_MAIN_MEM_SIZE, 0);
+
+  FileHeader header;
+  header.game_version = (u32)version;
+  header.s7_offset = s7_offset;
+  fwrite(&header, sizeof(FileHeader), 1, m_file);
+  m_bytes_written += sizeof(FileHeader);
+
+  Serializer ser;
+  state.serialize(ser);
+  write_block(ser);
+
+  lg::info("Capturing {} frames to {}", frame_count, path.string());
+  m_active = true;
+  return true;
+}
+
+void Writer::texture_upload_now(const u8* memory, const u8* tpage, int mode, u32 s7_ptr) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  // the upload reads the texture page from memory, so it needs to be up to date.
+  add_memory_delta(memory);
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::TEXTURE_UPLOAD_NOW;
+  evt.args[0] = tpage - memory;
+  evt.args[1] = mode;
+  evt.args[2] = s7_ptr;
+}
+
+void Writer::texture_relocate(u32 destination, u32 source, u32 format) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::TEXTURE_RELOCATE;
+  evt.args[0] = destination;
+  evt.args[1] = source;
+  evt.args[2] = format;
+}
+
+void Writer::set_levels(const std::vector<std::string>& levels) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::SET_LEVELS;
+  evt.levels = levels;
+}
+
+void Writer::set_active_levels(const std::vector<std::string>& levels) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::SET_ACTIVE_LEVELS;
+  evt.levels = levels;
+}
+
+void Writer::set_pmode_alp(float alp) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::PMODE_ALP;
+  evt.alp = alp;
+}
+
+/*!
+ * End of a frame. Writes out the frame, and finishes the capture after the last one.
+ */
+void Writer::send_chain(const u8* memory, u32 offset) {
+  if (!m_active) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (!m_active) {
+    return;
+  }
+  add_memory_delta(memory);
+  auto& evt = m_events.emplace_back();
+  evt.kind = EventKind::SEND_CHAIN;
+  evt.args[0] = offset;
+
+  Serializer ser;
+  ser.save<u32>(m_events.size());
+  for (auto& e : m_events) {
+    e.serialize(ser);
+  }
+  write_block(ser);
+  m_events.clear();
+  m_frames_written++;
+
+  if (--m_frames_left == 0) {
+    finish();
+  }
+}
+
+/*!
+ * Add the chunks of memory that changed since the last call. The low memory is protected and
+ * never used, so it's skipped.
+ */
+void Writer::add_memory_delta(const u8* memory) {
+  Event evt;
+  evt.kind = EventKind::MEMORY;
+  for (u32 addr = EE_MAIN_MEM_LOW_PROTECT; addr < EE_MAIN_MEM_SIZE; addr += kMemoryChunkSize) {
+    u8* last = m_last_memory.data() + addr;
+    if (memcmp(memory + addr, last, kMemoryChunkSize)) {
+      memcpy(last, memory + addr, kMemoryChunkSize);
+      evt.chunk_addrs.push_back(addr);
+      evt.chunk_data.insert(evt.chunk_data.end(), last, last + kMemoryChunkSize);
+    }
+  }
+  if (!evt.chunk_addrs.empty()) {
+    m_events.push_back(std::move(evt));
+  }
+}
+
+void Writer::write_block(Serializer& ser) {
+  auto result = ser.get_save_result();
+  auto compressed = compression::compress_zstd(result.first, result.second);
+  u64 size = compressed.size();
+  fwrite(&size, sizeof(u64), 1, m_file);
+  fwrite(compressed.data(), compressed.size(), 1, m_file);
+  m_bytes_written += sizeof(u64) + compressed.size();
+}
+
+void Writer::finish() {
+  fclose(m_file);
+  m_file = nullptr;
+  m_active = false;
+  std::vector<u8>().swap(m_last_memory);
+  lg::info("Frame capture done: {} frames, {:.2f} MB, in {}", m_frames_written,
+           m_bytes_written / (1024. * 1024.), m_path.string());
+}
+
+Reader::Reader(const fs::path& path) {
+  m_file_data = file_util::read_binary_file(path);
+  ASSERT_MSG(m_file_data.size() >= sizeof(FileHeader), "frame capture file is too small");
+  memcpy(&m_header, m_file_data.data(), sizeof(FileHeader));
+  ASSERT_MSG(m_header.magic == kMagic, "not a frame capture file");
+  ASSERT_MSG(m_header.version == kVersion, "frame capture file has the wrong version");
+
+  // find all the blocks. A capture that was cut off will have an incomplete last block.
+  std::vector<Block> blocks;
+  size_t offset = sizeof(FileHeader);
+  while (offset + sizeof(u64) <= m_file_data.size()) {
+    u64 size;
+    memcpy(&size, m_file_data.data() + offset, sizeof(u64));
+    offset += sizeof(u64);
+    if (offset + size > m_file_data.size()) {
+      break;
+    }
+    blocks.push_back({offset, size});
+    offset += size;
+  }
+  ASSERT_MSG(!blocks.empty(), "frame capture file has no initial state");
+
+  auto state_data =
+      compression::decompress_zstd(m_file_data.data() + blocks[0].offset, blocks[0].size);
+  Serializer ser(state_data.data(), state_data.size());
+  m_initial_state.serialize(ser);
+  m_frames.assign(blocks.begin() + 1, blocks.end());
+}
+
+std::vector<Event> Reader::read_frame(int idx) const {
+  const auto& block = m_frames.at(idx);
+  auto data = compression::decompress_zstd(m_file_data.data() + block.offset, block.size);
+  Serializer ser(data.data(), data.size());
+  std::vector<Event> events(ser.load<u32>());
+  for (auto& e : events) {
+    e.serialize(ser);
+  }
+  ASSERT(!events.empty() && events.back().kind == EventKind::SEND_CHAIN);
+  return events;
+}
+
+}  // namespace frame_capture
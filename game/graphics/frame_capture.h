@@ -0,0 +1,138 @@
+#pragma once
+
+/*!
+ * @file frame_capture.h
+ * Recording of everything the renderer gets from the game over a number of frames, so it can be
+ * replayed offline with tools/frame_replay for benchmarking.
+ *
+ * The renderers read EE memory outside of the DMA chain (texture uploads, texture animation, ...),
+ * so the DMA chain alone isn't enough to replay a frame. Instead, each frame stores the EE memory
+ * chunks that changed since the previous frame, along with the texture uploads and level changes
+ * that happened during the frame. Each frame is compressed separately, so capturing doesn't need
+ * to keep more than one frame in memory.
+ *
+ * File format:
+ *   FileHeader
+ *   [u64 size][zstd] InitialState
+ *   [u64 size][zstd] frame 0 events
+ *   [u64 size][zstd] frame 1 events
+ *   ...
+ */
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/util/FileUtil.h"
+#include "common/util/Serializer.h"
+#include "common/versions/versions.h"
+
+#include "game/graphics/texture/TexturePool.h"
+
+namespace frame_capture {
+
+constexpr u32 kMagic = 0x50414346;  // FCAP
+constexpr u32 kVersion = 1;
+constexpr u32 kMemoryChunkSize = 64 * 1024;
+
+struct FileHeader {
+  u32 magic = kMagic;
+  u32 version = kVersion;
+  u32 game_version = 0;
+  u32 s7_offset = 0;
+};
+
+/*!
+ * Renderer state at the start of the capture.
+ */
+struct InitialState {
+  std::vector<std::string> levels;
+  std::vector<std::string> active_levels;
+  float pmode_alp = 1.f;
+  std::vector<TextureSlotAssignment> texture_slots;
+
+  void serialize(Serializer& ser);
+};
+
+enum class EventKind : u32 {
+  MEMORY = 0,              // chunk_addrs, chunk_data
+  TEXTURE_UPLOAD_NOW = 1,  // args: tpage, mode, s7
+  TEXTURE_RELOCATE = 2,    // args: destination, source, format
+  SET_LEVELS = 3,          // levels
+  SET_ACTIVE_LEVELS = 4,   // levels
+  PMODE_ALP = 5,           // alp
+  SEND_CHAIN = 6,          // args: offset. Always the last event of a frame.
+};
+
+struct Event {
+  EventKind kind = EventKind::MEMORY;
+  u32 args[3] = {0, 0, 0};
+  float alp = 0;
+  std::vector<std::string> levels;
+  std::vector<u32> chunk_addrs;
+  std::vector<u8> chunk_data;
+
+  void serialize(Serializer& ser);
+};
+
+/*!
+ * Records frames from the graphics system's entry points. All functions are thread safe, and do
+ * nothing if a capture isn't running. Memory pointers are the start of EE memory.
+ */
+class Writer {
+ public:
+  bool active() const { return m_active; }
+  bool start(const fs::path& path,
+             int frame_count,
+             GameVersion version,
+             u32 s7_offset,
+             InitialState state);
+
+  void texture_upload_now(const u8* memory, const u8* tpage, int mode, u32 s7_ptr);
+  void texture_relocate(u32 destination, u32 source, u32 format);
+  void set_levels(const std::vector<std::string>& levels);
+  void set_active_levels(const std::vector<std::string>& levels);
+  void set_pmode_alp(float alp);
+  void send_chain(const u8* memory, u32 offset);
+
+ private:
+  void add_memory_delta(const u8* memory);
+  void write_block(Serializer& ser);
+  void finish();
+
+  std::mutex m_mutex;
+  std::atomic<bool> m_active = false;
+  FILE* m_file = nullptr;
+  fs::path m_path;
+  int m_frames_left = 0;
+  int m_frames_written = 0;
+  u64 m_bytes_written = 0;
+  std::vector<u8> m_last_memory;
+  std::vector<Event> m_events;
+};
+
+/*!
+ * Reads a capture file. Frames are decompressed on demand.
+ */
+class Reader {
+ public:
+  explicit Reader(const fs::path& path);
+  const FileHeader& header() const { return m_header; }
+  const InitialState& initial_state() const { return m_initial_state; }
+  int frame_count() const { return m_frames.size(); }
+  std::vector<Event> read_frame(int idx) const;
+
+ private:
+  struct Block {
+    size_t offset;
+    size_t size;
+  };
+  std::vector<u8> m_file_data;
+  FileHeader m_header;
+  InitialState m_initial_state;
+  std::vector<Block> m_frames;
+};
+
+}  // namespace frame_capture
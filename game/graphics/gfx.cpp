@@ -21,6 +21,7 @@
 #include "game/kernel/common/kmachine.h"
 #include "game/kernel/common/kscheme.h"
 #include "game/runtime.h"
+#include "pipelines/null.h"
 #include "pipelines/opengl.h"
 
 namespace Gfx {
@@ -36,6 +37,8 @@ const GfxRendererModule* GetRenderer(GfxPipeline pipeline) {
       return NULL;
     case GfxPipeline::OpenGL:
       return &gRendererOpenGL;
+    case GfxPipeline::Null:
+      return &gRendererNull;
     default:
       lg::error("Requested unknown renderer {}", fmt::underlying(pipeline));
       return NULL;
@@ -50,7 +53,7 @@ const GfxRendererModule* GetCurrentRenderer() {
   return g_global_settings.renderer;
 }
 
-u32 Init(GameVersion version) {
+u32 Init(GameVersion version, GfxPipeline pipeline) {
   lg::info("GFX Init");
   prof().instant_event("ROOT");
 
@@ -58,7 +61,7 @@ u32 Init(GameVersion version) {
   g_debug_settings.load_settings();
   {
     auto p = scoped_prof("startup::gfx::get_renderer");
-    g_global_settings.renderer = GetRenderer(GfxPipeline::OpenGL);
+    g_global_settings.renderer = GetRenderer(pipeline);
   }
 
   {
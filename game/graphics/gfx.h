@@ -23,7 +23,7 @@ struct GfxGlobalSettings;
 class GfxDisplay;
 
 // enum for rendering pipeline
-enum class GfxPipeline { Invalid = 0, OpenGL };
+enum class GfxPipeline { Invalid = 0, OpenGL, Null };
 
 // module for the different rendering pipelines
 struct GfxRendererModule {
@@ -85,6 +85,8 @@ struct GfxGlobalSettings {
   // frame timing things
   bool experimental_accurate_lag = false;
   bool sleep_in_frame_limiter = true;
+  // copy the DMA chain so the game can run the next frame while this one renders.
+  bool pipelined_frames = false;
 
   // fancy effect things
   bool hack_no_tex = false;
@@ -110,7 +112,7 @@ extern game_settings::DebugSettings g_debug_settings;
 
 const GfxRendererModule* GetCurrentRenderer();
 
-u32 Init(GameVersion version);
+u32 Init(GameVersion version, GfxPipeline pipeline = GfxPipeline::OpenGL);
 void Loop(std::function<bool()> f);
 u32 Exit();
 
@@ -3,9 +3,8 @@
 #include "fmt/core.h"
 #include "third-party/imgui/imgui.h"
 
-std::string BucketRenderer::name_and_id() const {
-  return fmt::format("[{:2d}] {}", (int)m_my_id, m_name);
-}
+BucketRenderer::BucketRenderer(const std::string& name, int my_id)
+    : m_name(name), m_my_id(my_id), m_name_and_id(fmt::format("[{:2d}] {}", my_id, name)) {}
 
 EmptyBucketRenderer::EmptyBucketRenderer(const std::string& name, int my_id)
     : BucketRenderer(name, my_id) {}
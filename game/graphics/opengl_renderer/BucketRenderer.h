@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common/dma/dma_chain_read.h"
 
@@ -19,6 +21,21 @@ struct LevelVis {
 };
 
 class EyeRenderer;
+
+/*!
+ * Game memory that renderers read outside of the DMA chain. When the game runs during rendering,
+ * this is copied along with the chain. Entries are keyed by the transfer in the copied chain that
+ * refers to them.
+ */
+struct EeSnapshot {
+  std::unordered_map<const u8*, TexturePool::UploadNowPlan> upload_now;
+  std::unordered_map<const u8*, std::vector<u8>> anim_uploads;
+  void clear() {
+    upload_now.clear();
+    anim_uploads.clear();
+  }
+};
+
 /*!
  * The main renderer will contain a single SharedRenderState that's passed to all bucket renderers.
  * This allows bucket renders to share textures and shaders.
@@ -37,6 +54,7 @@ struct SharedRenderState {
   u32 default_regs_buffer = 0;  // address of the default regs chain.
 
   void* ee_main_memory = nullptr;
+  const EeSnapshot* ee_snapshot = nullptr;  // if set, use this instead of reading ee_main_memory
   u32 offset_of_s7;
 
   bool use_sky_cpu = true;
@@ -94,11 +112,11 @@ struct SharedRenderState {
  */
 class BucketRenderer {
  public:
-  BucketRenderer(const std::string& name, int my_id) : m_name(name), m_my_id(my_id) {}
+  BucketRenderer(const std::string& name, int my_id);
   virtual void render(DmaFollower& dma,
                       SharedRenderState* render_state,
                       ScopedProfilerNode& prof) = 0;
-  std::string name_and_id() const;
+  const std::string& name_and_id() const { return m_name_and_id; }
   virtual ~BucketRenderer() = default;
   bool& enabled() { return m_enabled; }
   virtual bool empty() const { return false; }
@@ -106,10 +124,27 @@ class BucketRenderer {
   virtual void init_shaders(ShaderLibrary&) {}
   virtual void init_textures(TexturePool&, GameVersion) {}
 
+  /*!
+   * Renderers that return true can also be rendered in two steps, instead of with render().
+   * prepare() reads the bucket's DMA, up to bucket_end, and does the CPU work. It may run on a
+   * worker thread at the same time as other buckets, so it can't use OpenGL or modify render_state.
+   * submit() does the rest, on the render thread, in bucket order.
+   */
+  virtual bool can_prepare() const { return false; }
+  virtual void prepare(DmaFollower& /*dma*/,
+                       u32 /*bucket_end*/,
+                       SharedRenderState* /*render_state*/,
+                       ScopedProfilerNode& /*prof*/) {}
+  virtual void submit(SharedRenderState* /*render_state*/, ScopedProfilerNode& /*prof*/) {}
+
  protected:
   std::string m_name;
   int m_my_id;
   bool m_enabled = true;
+
+ private:
+  // kept, so the profiler can use it every frame without formatting it again.
+  std::string m_name_and_id;
 };
 
 class RenderMux : public BucketRenderer {
@@ -909,14 +909,22 @@ void OpenGLRenderer::blit_display() {
   }
 }
 
+void OpenGLRenderer::run_vif_interrupt(int bucket_id) {
+  if (m_vif_interrupts) {
+    vif_interrupt_callback(bucket_id);
+  }
+}
+
 /*!
  * Main render function. This is called from the gfx loop with the chain passed from the game.
  */
 void OpenGLRenderer::render(DmaFollower dma, const RenderOptions& settings) {
-  m_profiler.clear();
+  m_profiler.begin_frame();
   m_render_state.reset();
   m_render_state.ee_main_memory = g_ee_main_mem;
+  m_render_state.ee_snapshot = settings.ee_snapshot;
   m_render_state.offset_of_s7 = offset_of_s7();
+  m_vif_interrupts = settings.vif_interrupts;
 
   {
     g_current_renderer = "frame-setup";
@@ -1019,6 +1027,15 @@ void OpenGLRenderer::render(DmaFollower dma, const RenderOptions& settings) {
   }
 
   m_profiler.finish();
+  if (prof().enabled()) {
+    prof().counter("draw-calls", m_profiler.root()->stats().draw_calls);
+    prof().counter("triangles", m_profiler.root()->stats().triangles);
+    if (m_merc2) {
+      u64 merc_bytes = m_merc2->upload_bytes();
+      prof().counter("merc-upload-bytes", merc_bytes - m_last_merc_upload_bytes);
+      m_last_merc_upload_bytes = merc_bytes;
+    }
+  }
   //  if (m_profiler.root_time() > 0.018) {
   //    fmt::print("Slow frame: {:.2f} ms\n", m_profiler.root_time() * 1000);
   //    fmt::print("{}\n", m_profiler.to_string());
@@ -1072,6 +1089,7 @@ void OpenGLRenderer::draw_renderer_selection_window() {
   ImGui::Checkbox("Sky CPU", &m_render_state.use_sky_cpu);
   ImGui::Checkbox("Occlusion Cull", &m_render_state.use_occlusion_culling);
   ImGui::Checkbox("Blackout Loads", &m_enable_fast_blackout_loads);
+  ImGui::Checkbox("Parallel Prepare", &m_parallel_prepare);
 
   if (m_texture_animator && ImGui::TreeNode("Texture Animator")) {
     m_texture_animator->draw_debug_window();
@@ -1249,11 +1267,14 @@ void OpenGLRenderer::dispatch_buckets_jak1(DmaFollower dma,
 
   // loop over the buckets!
   for (size_t bucket_id = 0; bucket_id < m_bucket_renderers.size(); bucket_id++) {
+    if (m_parallel_prepare && (int)bucket_id == m_render_state.bucket_for_vis_copy + 1) {
+      prepare_buckets(dma, bucket_id, prof);
+    }
     auto& renderer = m_bucket_renderers[bucket_id];
     auto bucket_prof = prof.make_scoped_child(renderer->name_and_id());
     g_current_renderer = renderer->name_and_id();
     // lg::info("Render: {} start", g_current_renderer);
-    renderer->render(dma, &m_render_state, bucket_prof);
+    render_bucket(bucket_id, dma, bucket_prof);
     if (sync_after_buckets) {
       auto pp = scoped_prof("finish");
       glFinish();
@@ -1263,7 +1284,7 @@ void OpenGLRenderer::dispatch_buckets_jak1(DmaFollower dma,
     //  should have ended at the start of the next chain
     ASSERT(dma.current_tag_offset() == m_render_state.next_bucket);
     m_render_state.next_bucket += 16;
-    vif_interrupt_callback(bucket_id);
+    run_vif_interrupt(bucket_id);
     m_category_times[(int)m_bucket_categories[bucket_id]] += bucket_prof.get_elapsed_time();
 
     // hack to draw the collision mesh in the middle the drawing
@@ -1289,11 +1310,14 @@ void OpenGLRenderer::dispatch_buckets_jak2(DmaFollower dma,
   m_render_state.num_vis_to_copy = jak2::LEVEL_MAX;
 
   for (size_t bucket_id = 0; bucket_id < m_bucket_renderers.size(); bucket_id++) {
+    if (m_parallel_prepare && (int)bucket_id == m_render_state.bucket_for_vis_copy + 1) {
+      prepare_buckets(dma, bucket_id, prof);
+    }
     auto& renderer = m_bucket_renderers[bucket_id];
     auto bucket_prof = prof.make_scoped_child(renderer->name_and_id());
     g_current_renderer = renderer->name_and_id();
     // lg::info("Render: {} start", g_current_renderer);
-    renderer->render(dma, &m_render_state, bucket_prof);
+    render_bucket(bucket_id, dma, bucket_prof);
     if (sync_after_buckets) {
       auto pp = scoped_prof("finish");
       glFinish();
@@ -1303,7 +1327,7 @@ void OpenGLRenderer::dispatch_buckets_jak2(DmaFollower dma,
     //  should have ended at the start of the next chain
     ASSERT(dma.current_tag_offset() == m_render_state.next_bucket);
     m_render_state.next_bucket += 16;
-    vif_interrupt_callback(bucket_id + 1);
+    run_vif_interrupt(bucket_id + 1);
     m_category_times[(int)m_bucket_categories[bucket_id]] += bucket_prof.get_elapsed_time();
 
     // hack to draw the collision mesh in the middle the drawing
@@ -1313,7 +1337,7 @@ void OpenGLRenderer::dispatch_buckets_jak2(DmaFollower dma,
       m_collide_renderer.render(&m_render_state, p);
     }
   }
-  vif_interrupt_callback(m_bucket_renderers.size());
+  run_vif_interrupt(m_bucket_renderers.size());
 
   // TODO ending data.
 }
@@ -1331,11 +1355,14 @@ void OpenGLRenderer::dispatch_buckets_jak3(DmaFollower dma,
   m_render_state.num_vis_to_copy = jak3::LEVEL_MAX;
 
   for (size_t bucket_id = 0; bucket_id < m_bucket_renderers.size(); bucket_id++) {
+    if (m_parallel_prepare && (int)bucket_id == m_render_state.bucket_for_vis_copy + 1) {
+      prepare_buckets(dma, bucket_id, prof);
+    }
     auto& renderer = m_bucket_renderers[bucket_id];
     auto bucket_prof = prof.make_scoped_child(renderer->name_and_id());
     g_current_renderer = renderer->name_and_id();
     // lg::info("Render: {} start", g_current_renderer);
-    renderer->render(dma, &m_render_state, bucket_prof);
+    render_bucket(bucket_id, dma, bucket_prof);
     if (sync_after_buckets) {
       auto pp = scoped_prof("finish");
       glFinish();
@@ -1345,7 +1372,7 @@ void OpenGLRenderer::dispatch_buckets_jak3(DmaFollower dma,
     //  should have ended at the start of the next chain
     ASSERT(dma.current_tag_offset() == m_render_state.next_bucket);
     m_render_state.next_bucket += 16;
-    vif_interrupt_callback(bucket_id + 1);
+    run_vif_interrupt(bucket_id + 1);
     m_category_times[(int)m_bucket_categories[bucket_id]] += bucket_prof.get_elapsed_time();
 
     // hack to draw the collision mesh in the middle the drawing
@@ -1355,11 +1382,69 @@ void OpenGLRenderer::dispatch_buckets_jak3(DmaFollower dma,
       m_collide_renderer.render(&m_render_state, p);
     }
   }
-  vif_interrupt_callback(m_bucket_renderers.size());
+  run_vif_interrupt(m_bucket_renderers.size());
 
   // TODO ending data.
 }
 
+/*!
+ * Run prepare() for the buckets from first_bucket on that support it, in parallel. Each bucket's
+ * DMA starts at its entry in the bucket array, so they can be read without following the chain
+ * through the earlier buckets. Must be called after the vis data is copied, which culling uses.
+ */
+void OpenGLRenderer::prepare_buckets(const DmaFollower& dma,
+                                     int first_bucket,
+                                     ScopedProfilerNode& prof) {
+  m_buckets_to_prepare.clear();
+  for (int i = first_bucket; i < (int)m_bucket_renderers.size(); i++) {
+    if (m_bucket_renderers[i]->can_prepare()) {
+      m_buckets_to_prepare.push_back(i);
+    }
+  }
+  if (m_buckets_to_prepare.empty()) {
+    return;
+  }
+
+  auto prepare_prof = prof.make_scoped_child("prepare");
+  m_prepare_nodes.resize(m_buckets_to_prepare.size());
+  for (size_t i = 0; i < m_buckets_to_prepare.size(); i++) {
+    auto& renderer = m_bucket_renderers[m_buckets_to_prepare[i]];
+    m_prepare_nodes[i] = prepare_prof.make_child(renderer->name_and_id());
+  }
+  m_prepare_workers.parallel_for(m_buckets_to_prepare.size(), [&](int i) {
+    int bucket_id = m_buckets_to_prepare[i];
+    auto& renderer = m_bucket_renderers[bucket_id];
+    u32 bucket_start = m_render_state.buckets_base + 16 * bucket_id;
+    u32 bucket_end = bucket_start + 16;
+    // restart on the thread that runs the bucket, so the node times the work, not the wait.
+    m_prepare_nodes[i]->start();
+    ScopedProfilerNode bucket_prof(m_prepare_nodes[i]);
+    DmaFollower bucket_dma(dma.base(), bucket_start);
+    renderer->prepare(bucket_dma, bucket_end, &m_render_state, bucket_prof);
+    ASSERT(bucket_dma.current_tag_offset() == bucket_end);
+  });
+
+  m_bucket_prepared.assign(m_bucket_renderers.size(), false);
+  for (int bucket_id : m_buckets_to_prepare) {
+    m_bucket_prepared[bucket_id] = true;
+  }
+}
+
+/*!
+ * Render a single bucket. Buckets that were prepared only need to be submitted, and the DMA is
+ * moved to the end of the bucket, where prepare left its copy.
+ */
+void OpenGLRenderer::render_bucket(int bucket_id, DmaFollower& dma, ScopedProfilerNode& prof) {
+  auto& renderer = m_bucket_renderers[bucket_id];
+  if (bucket_id < (int)m_bucket_prepared.size() && m_bucket_prepared[bucket_id]) {
+    m_bucket_prepared[bucket_id] = false;
+    renderer->submit(&m_render_state, prof);
+    dma = DmaFollower(dma.base(), m_render_state.next_bucket);
+  } else {
+    renderer->render(dma, &m_render_state, prof);
+  }
+}
+
 /*!
  * This function finds buckets and dispatches them to the appropriate part.
  */
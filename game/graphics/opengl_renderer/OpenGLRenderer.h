@@ -4,6 +4,7 @@
 #include <memory>
 
 #include "common/dma/dma_chain_read.h"
+#include "common/util/WorkerPool.h"
 
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/opengl_renderer/CollideMeshRenderer.h"
@@ -51,6 +52,12 @@ struct RenderOptions {
   // when enabled, does a `glFinish()` after each major rendering pass. This blocks until the GPU
   // is done working, making it easier to profile GPU utilization.
   bool gpu_sync = false;
+
+  // call the game's VIF interrupt handler after buckets. This runs GOAL code on the render thread,
+  // so it must be off if the game is running during rendering.
+  bool vif_interrupts = true;
+  // the game memory the renderer needs, copied with the chain. If null, game memory is read.
+  const EeSnapshot* ee_snapshot = nullptr;
 };
 
 /*!
@@ -70,14 +77,20 @@ class OpenGLRenderer {
   // the graphics system.
   void render(DmaFollower dma, const RenderOptions& settings);
 
+  // timing of the last frame rendered.
+  Profiler& profiler() { return m_profiler; }
+
  private:
   void setup_frame(const RenderOptions& settings);
   void dispatch_buckets(DmaFollower dma, ScopedProfilerNode& prof, bool sync_after_buckets);
   void dispatch_buckets_jak1(DmaFollower dma, ScopedProfilerNode& prof, bool sync_after_buckets);
   void dispatch_buckets_jak2(DmaFollower dma, ScopedProfilerNode& prof, bool sync_after_buckets);
   void dispatch_buckets_jak3(DmaFollower dma, ScopedProfilerNode& prof, bool sync_after_buckets);
+  void prepare_buckets(const DmaFollower& dma, int first_bucket, ScopedProfilerNode& prof);
+  void render_bucket(int bucket_id, DmaFollower& dma, ScopedProfilerNode& prof);
 
   void do_pcrtc_effects(float alp, SharedRenderState* render_state, ScopedProfilerNode& prof);
+  void run_vif_interrupt(int bucket_id);
   void blit_display();
   void init_bucket_renderers_jak1();
   void init_bucket_renderers_jak2();
@@ -122,7 +135,16 @@ class OpenGLRenderer {
   CollideMeshRenderer m_collide_renderer;
 
   float m_last_pmode_alp = 1.;
+  bool m_vif_interrupts = true;
   bool m_enable_fast_blackout_loads = true;
+  u64 m_last_merc_upload_bytes = 0;
+
+  // buckets after the vis data can run their CPU work on these threads, before they are drawn.
+  WorkerPool m_prepare_workers{WorkerPool::default_worker_count(4)};
+  std::vector<int> m_buckets_to_prepare;
+  std::vector<ProfilerNode*> m_prepare_nodes;
+  std::vector<bool> m_bucket_prepared;
+  bool m_parallel_prepare = true;
 
   struct FboState {
     struct {
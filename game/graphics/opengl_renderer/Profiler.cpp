@@ -3,74 +3,184 @@
 #include <algorithm>
 
 #include "common/log/log.h"
+#include "common/util/FileUtil.h"
 #include "common/util/colors.h"
+#include "common/util/string_util.h"
 
 #include "fmt/core.h"
 #include "third-party/imgui/imgui.h"
 
-ProfilerNode::ProfilerNode(const std::string& name) : m_name(name) {}
+ProfilerNode::ProfilerNode(const char* name) : m_name(name) {}
 
-ProfilerNode* ProfilerNode::make_child(const std::string& name) {
-  m_children.emplace_back(name);
-  return &m_children.back();
+/*!
+ * Get the child with this name, and start it. This is the first child with the name that hasn't
+ * run yet this frame, so names can be used more than once. Only allocates the first time.
+ */
+ProfilerNode* ProfilerNode::make_child(const char* name) {
+  size_t idx = m_next_child;
+  // usually, children are made in the same order every frame.
+  if (idx >= m_children.size() || m_children[idx]->m_active || m_children[idx]->m_name != name) {
+    idx = 0;
+    while (idx < m_children.size() &&
+           (m_children[idx]->m_active || m_children[idx]->m_name != name)) {
+      idx++;
+    }
+    if (idx == m_children.size()) {
+      m_children.push_back(std::make_unique<ProfilerNode>(name));
+    }
+  }
+  m_next_child = idx + 1;
+  auto* child = m_children[idx].get();
+  child->start();
+  return child;
+}
+
+ScopedProfilerNode ProfilerNode::make_scoped_child(const char* name) {
+  return ScopedProfilerNode(make_child(name));
+}
+
+ScopedProfilerNode ProfilerNode::make_scoped_child(const std::string& name) {
+  return ScopedProfilerNode(make_child(name.c_str()));
+}
+
+/*!
+ * Reset the stats for this frame, and start timing.
+ */
+void ProfilerNode::start() {
+  m_stats = ProfilerStats();
+  m_finished = false;
+  m_active = true;
+  m_timer.start();
+}
+
+/*!
+ * Mark this node and all children as not run yet, for the start of a new frame.
+ */
+void ProfilerNode::begin_frame() {
+  m_active = false;
+  m_finished = false;
+  m_next_child = 0;
+  for (auto& child : m_children) {
+    child->begin_frame();
+  }
 }
 
 void ProfilerNode::finish() {
   if (m_finished) {
     lg::error("finish() called twice on {}", m_name);
-  } else {
-    m_stats.duration = m_timer.getSeconds();
-    float total_child_time = 0;
-    for (const auto& child : m_children) {
-      if (!child.finished()) {
-        lg::error("finish() not called on {}", child.name());
-      }
-      total_child_time += child.m_stats.duration;
-      m_stats.add_draw_stats(child.m_stats);
+    return;
+  }
+  m_stats.duration = m_timer.getSeconds();
+  float total_child_time = 0;
+  bool any_children = false;
+  for (const auto& child : m_children) {
+    if (!child->m_active) {
+      continue;
     }
+    if (!child->finished()) {
+      lg::error("finish() not called on {}", child->name());
+    }
+    any_children = true;
+    total_child_time += child->m_stats.duration;
+    m_stats.add_draw_stats(child->m_stats);
+  }
 
-    if (!m_children.empty()) {
-      float unknown_time = m_stats.duration - total_child_time;
-      if (unknown_time > 0.0001 || unknown_time > (m_stats.duration * 0.05)) {
-        ProfilerNode unk("unknown");
-        unk.m_stats.duration = unknown_time;
-        m_children.push_back(unk);
-      }
+  if (any_children) {
+    float unknown_time = m_stats.duration - total_child_time;
+    if (unknown_time > 0.0001 || unknown_time > (m_stats.duration * 0.05)) {
+      auto* unk = make_child("unknown");
+      unk->m_stats.duration = unknown_time;
+      unk->m_finished = true;
+      unk->add_history(unknown_time);
     }
   }
+
+  add_history(m_stats.duration);
   m_finished = true;
 }
 
-void ProfilerNode::sort(ProfilerSort mode) {
-  if (mode == ProfilerSort::NONE) {
-    return;
+void ProfilerNode::add_history(float duration) {
+  m_history[m_history_next] = duration;
+  m_history_next = (m_history_next + 1) % kHistorySize;
+  m_history_count = std::min(m_history_count + 1, kHistorySize);
+  m_history_total++;
+}
+
+/*!
+ * Stats of the history, for display. Sorting the history is too slow to do for every node on every
+ * frame, so this is only recomputed after kHistoryStatsInterval new samples.
+ */
+const ProfilerHistoryStats& ProfilerNode::history_stats() const {
+  if (!m_cached_history_valid || m_history_total - m_cached_history_at >= kHistoryStatsInterval) {
+    m_cached_history = compute_history_stats();
+    m_cached_history_at = m_history_total;
+    m_cached_history_valid = true;
   }
-  std::sort(m_children.begin(), m_children.end(),
-            [=](const ProfilerNode& a, const ProfilerNode& b) {
-              switch (mode) {
-                case ProfilerSort::DRAW_CALLS:
-                  return a.m_stats.draw_calls > b.m_stats.draw_calls;
-                case ProfilerSort::TIME:
-                  return a.m_stats.duration > b.m_stats.duration;
-                case ProfilerSort::TRIANGLES:
-                  return a.m_stats.triangles > b.m_stats.triangles;
-                default:
-                  ASSERT(false);
-              }
-            });
-  for (auto& child : m_children) {
-    child.sort(mode);
+  return m_cached_history;
+}
+
+ProfilerHistoryStats ProfilerNode::compute_history_stats() const {
+  ProfilerHistoryStats result;
+  result.count = m_history_count;
+  if (m_history_count == 0) {
+    return result;
   }
+  std::array<float, kHistorySize> sorted;
+  std::copy(m_history.begin(), m_history.begin() + m_history_count, sorted.begin());
+  std::sort(sorted.begin(), sorted.begin() + m_history_count);
+  double total = 0;
+  for (int i = 0; i < m_history_count; i++) {
+    total += sorted[i];
+  }
+  auto percentile = [&](float p) {
+    return sorted[std::min(m_history_count - 1, (int)(p * m_history_count))];
+  };
+  result.mean = total / m_history_count;
+  result.p50 = percentile(0.5f);
+  result.p95 = percentile(0.95f);
+  result.p99 = percentile(0.99f);
+  result.max = sorted[m_history_count - 1];
+  return result;
 }
 
-ScopedProfilerNode ProfilerNode::make_scoped_child(const std::string& name) {
-  return ScopedProfilerNode(make_child(name));
+namespace {
+/*!
+ * Children that ran this frame, sorted for display.
+ */
+std::vector<ProfilerNode*> sorted_active_children(const ProfilerNode& node, ProfilerSort mode) {
+  std::vector<ProfilerNode*> result;
+  for (auto& child : node.children()) {
+    if (child->active()) {
+      result.push_back(child.get());
+    }
+  }
+  if (mode != ProfilerSort::NONE) {
+    std::stable_sort(result.begin(), result.end(), [=](ProfilerNode* a, ProfilerNode* b) {
+      switch (mode) {
+        case ProfilerSort::DRAW_CALLS:
+          return a->stats().draw_calls > b->stats().draw_calls;
+        case ProfilerSort::TIME:
+          return a->stats().duration > b->stats().duration;
+        case ProfilerSort::TRIANGLES:
+          return a->stats().triangles > b->stats().triangles;
+        default:
+          ASSERT(false);
+      }
+    });
+  }
+  return result;
 }
+}  // namespace
 
 Profiler::Profiler() : m_root("root") {}
 
-void Profiler::clear() {
-  m_root = ProfilerNode("root");
+/*!
+ * Start a new frame. The root is started, and nodes from the last frame become inactive until
+ * they are made again.
+ */
+void Profiler::begin_frame() {
+  m_root.begin_frame();
+  m_root.start();
 }
 
 void Profiler::finish() {
@@ -81,9 +191,20 @@ void Profiler::draw() {
   ImGui::Begin("Profiler");
   const char* listbox_entries[] = {"None", "Time", "Draw Calls", "Tris"};
   ImGui::Combo("Sort", &m_mode_selector, listbox_entries, 4);
-  m_root.sort((ProfilerSort)m_mode_selector);
   ImGui::SameLine();
   bool all = ImGui::Button("Expand All");
+  ImGui::SameLine();
+  ImGui::Checkbox("Percentiles", &m_show_percentiles);
+  ImGui::SameLine();
+  if (ImGui::Button("Export CSV")) {
+    auto path = file_util::get_jak_project_dir() / "profile" /
+                fmt::format("{}.csv", str_util::current_local_timestamp_no_colons());
+    file_util::create_dir_if_needed_for_file(path);
+    m_export_status = export_csv(path.string()) ? "Saved " + path.string() : "Export failed";
+  }
+  if (!m_export_status.empty()) {
+    ImGui::Text("%s", m_export_status.c_str());
+  }
   ImGui::Dummy(ImVec2(0.0f, 80.0f));
   draw_node(m_root, all, 0, 0.f);
   ImGui::End();
@@ -110,19 +231,25 @@ void Profiler::draw_node(ProfilerNode& node, bool expand, int depth, float start
   auto str =
       fmt::format("{:20s} {:.2f}ms {:6d} tri {:4d} draw", node.m_name, node.m_stats.duration * 1000,
                   node.m_stats.triangles, node.m_stats.draw_calls);
-  if (node.m_children.empty()) {
+  if (m_show_percentiles) {
+    auto history = node.history_stats();
+    str += fmt::format(" | p50 {:.2f} p95 {:.2f} p99 {:.2f} max {:.2f}", history.p50 * 1000,
+                       history.p95 * 1000, history.p99 * 1000, history.max * 1000);
+  }
+  auto children = sorted_active_children(node, (ProfilerSort)m_mode_selector);
+  if (children.empty()) {
     ImGui::Text("   %s", str.c_str());
     color_orange = ImGui::IsItemHovered();
   } else {
     if (expand) {
       ImGui::SetNextItemOpen(true);
     }
-    if (ImGui::TreeNode(node.m_name.c_str(), "%s", str.c_str())) {
+    if (ImGui::TreeNode(&node, "%s", str.c_str())) {
       color_orange = ImGui::IsItemHovered();
       float child_start = start_time;
-      for (auto& child : node.m_children) {
-        draw_node(child, expand, depth + 1, child_start);
-        child_start += child.m_stats.duration;
+      for (auto* child : children) {
+        draw_node(*child, expand, depth + 1, child_start);
+        child_start += child->m_stats.duration;
       }
       ImGui::TreePop();
     }
@@ -146,7 +273,6 @@ void Profiler::draw_node(ProfilerNode& node, bool expand, int depth, float start
 }
 
 std::string Profiler::to_string() {
-  m_root.sort(ProfilerSort::TIME);
   std::string str;
   m_root.to_string_helper(str, 0);
   return str;
@@ -155,8 +281,38 @@ std::string Profiler::to_string() {
 void ProfilerNode::to_string_helper(std::string& str, int depth) const {
   str +=
       fmt::format("{}{:.2f} ms {:30s}\n", std::string(depth, ' '), m_stats.duration * 1000, m_name);
-  for (const auto& child : m_children) {
-    child.to_string_helper(str, depth + 1);
+  for (auto* child : sorted_active_children(*this, ProfilerSort::TIME)) {
+    child->to_string_helper(str, depth + 1);
+  }
+}
+
+/*!
+ * Write the history of every node to a CSV file, one row per node. Times are in milliseconds.
+ */
+bool Profiler::export_csv(const std::string& path) const {
+  FILE* fp = file_util::open_file(path, "w");
+  if (!fp) {
+    lg::error("Failed to open {} for the profiler export", path);
+    return false;
+  }
+  fmt::print(fp, "node,samples,last,mean,p50,p95,p99,max\n");
+  m_root.export_csv_helper(fp, "");
+  fclose(fp);
+  lg::info("Saved profiler history to {}", path);
+  return true;
+}
+
+void ProfilerNode::export_csv_helper(FILE* fp, const std::string& parent_path) const {
+  auto path = parent_path.empty() ? m_name : parent_path + "/" + m_name;
+  auto history = compute_history_stats();
+  // names are quoted, since bucket names have spaces.
+  fmt::print(fp, "\"{}\",{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n", path, history.count,
+             m_stats.duration * 1000, history.mean * 1000, history.p50 * 1000, history.p95 * 1000,
+             history.p99 * 1000, history.max * 1000);
+  for (auto& child : m_children) {
+    if (child->active()) {
+      child->export_csv_helper(fp, path);
+    }
   }
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,31 +26,75 @@ struct ProfilerStats {
 
 class ScopedProfilerNode;
 
+/*!
+ * Summary of the durations in a node's history, in seconds.
+ */
+struct ProfilerHistoryStats {
+  int count = 0;
+  float mean = 0;
+  float p50 = 0;
+  float p95 = 0;
+  float p99 = 0;
+  float max = 0;
+};
+
+/*!
+ * Timing of one part of the frame. The tree of nodes is kept from frame to frame: children are
+ * found again by name, in the order they were made last frame, so the profiler doesn't allocate
+ * after the first frame. Each node keeps the durations of its last kHistorySize runs.
+ */
 class ProfilerNode {
  public:
-  ProfilerNode(const std::string& name);
-  ProfilerNode* make_child(const std::string& name);
+  static constexpr int kHistorySize = 1024;
+  static constexpr int kHistoryStatsInterval = 30;
+
+  explicit ProfilerNode(const char* name);
+  ProfilerNode(const ProfilerNode&) = delete;
+  ProfilerNode& operator=(const ProfilerNode&) = delete;
+
+  ProfilerNode* make_child(const char* name);
+  ProfilerNode* make_child(const std::string& name) { return make_child(name.c_str()); }
+  ScopedProfilerNode make_scoped_child(const char* name);
   ScopedProfilerNode make_scoped_child(const std::string& name);
-  void sort(ProfilerSort mode);
+  void start();
   void finish();
+  void begin_frame();
 
   bool finished() const { return m_finished; }
+  // if this node ran in the current frame. Children that didn't are kept, but should be skipped.
+  bool active() const { return m_active; }
   const std::string& name() const { return m_name; }
 
   void add_draw_call(int count = 1) { m_stats.draw_calls += count; }
   void add_tri(int count = 1) { m_stats.triangles += count; }
   float get_elapsed_time() const { return m_timer.getSeconds(); }
   const ProfilerStats& stats() const { return m_stats; }
+  const std::vector<std::unique_ptr<ProfilerNode>>& children() const { return m_children; }
+  const ProfilerHistoryStats& history_stats() const;
 
  private:
   friend class Profiler;
+  void add_history(float duration);
+  ProfilerHistoryStats compute_history_stats() const;
   void to_string_helper(std::string& str, int depth) const;
+  void export_csv_helper(FILE* fp, const std::string& parent_path) const;
 
   std::string m_name;
   ProfilerStats m_stats;
-  std::vector<ProfilerNode> m_children;
+  std::vector<std::unique_ptr<ProfilerNode>> m_children;
+  size_t m_next_child = 0;
   Timer m_timer;
   bool m_finished = false;
+  bool m_active = false;
+
+  std::array<float, kHistorySize> m_history;
+  int m_history_next = 0;
+  int m_history_count = 0;
+  u64 m_history_total = 0;
+
+  mutable ProfilerHistoryStats m_cached_history;
+  mutable u64 m_cached_history_at = 0;
+  mutable bool m_cached_history_valid = false;
 };
 
 class ScopedProfilerNode {
@@ -58,7 +103,9 @@ class ScopedProfilerNode {
       : m_node(node), m_global_event(scoped_prof(node->name().c_str())) {}
   ScopedProfilerNode(const ScopedProfilerNode& other) = delete;
   ScopedProfilerNode& operator=(const ScopedProfilerNode& other) = delete;
+  ProfilerNode* make_child(const char* name) { return m_node->make_child(name); }
   ProfilerNode* make_child(const std::string& name) { return m_node->make_child(name); }
+  ScopedProfilerNode make_scoped_child(const char* name) { return m_node->make_scoped_child(name); }
   ScopedProfilerNode make_scoped_child(const std::string& name) {
     return m_node->make_scoped_child(name);
   }
@@ -76,13 +123,14 @@ class ScopedProfilerNode {
 class Profiler {
  public:
   Profiler();
-  void clear();
+  void begin_frame();
   void draw();
   void finish();
 
   float root_time() const { return m_root.m_stats.duration; }
 
   std::string to_string();
+  bool export_csv(const std::string& path) const;
   ProfilerNode* root() { return &m_root; }
 
  private:
@@ -94,6 +142,8 @@ class Profiler {
   };
 
   int m_mode_selector = 0;
+  bool m_show_percentiles = true;
+  std::string m_export_status;
   ProfilerNode m_root;
 };
 
@@ -79,6 +79,11 @@ Shader::Shader(const std::string& shader_name, GameVersion version) : m_name(sha
   if (bonesLoc != -1) {
     glUniformBlockBinding(m_program, bonesLoc, 1);
   }
+  // and merc lights at 2
+  GLint lightsLoc = glGetUniformBlockIndex(m_program, "ub_merc_lights");
+  if (lightsLoc != -1) {
+    glUniformBlockBinding(m_program, lightsLoc, 2);
+  }
 
   glDeleteShader(m_vert_shader);
   glDeleteShader(m_frag_shader);
@@ -130,6 +135,7 @@ ShaderLibrary::ShaderLibrary(GameVersion version) {
   at(ShaderId::GLOW_PROBE_ON_GRID) = {"glow_probe_on_grid", version};
   at(ShaderId::HFRAG) = {"hfrag", version};
   at(ShaderId::HFRAG_MONTAGE) = {"hfrag_montage", version};
+  at(ShaderId::TFRAG3_WIND) = {"tfrag3_wind", version};
 
   for (auto& shader : m_shaders) {
     ASSERT_MSG(shader.okay(), "error compiling shader");
@@ -63,6 +63,7 @@ enum class ShaderId {
   GLOW_PROBE_ON_GRID = 36,
   HFRAG = 37,
   HFRAG_MONTAGE = 38,
+  TFRAG3_WIND = 39,
   MAX_SHADERS
 };
 
@@ -1,13 +1,20 @@
 #include "SkyBlendCPU.h"
 
-#ifndef __aarch64__
+#include <algorithm>
+
+#ifdef __aarch64__
+#include "third-party/sse2neon/sse2neon.h"
+#else
 #include <immintrin.h>
 #endif
 
+#include "common/util/Timer.h"
 #include "common/util/os.h"
 
 #include "game/graphics/opengl_renderer/AdgifHandler.h"
 
+#include "third-party/imgui/imgui.h"
+
 SkyBlendCPU::SkyBlendCPU() {
   for (int i = 0; i < 2; i++) {
     glGenTextures(1, &m_textures[i].gl);
@@ -24,80 +31,98 @@ SkyBlendCPU::~SkyBlendCPU() {
   }
 }
 
+void blend_sky_initial_slow(u8 intensity, u8* out, const u8* in, u32 size) {
+  for (u32 i = 0; i < size; i++) {
+    out[i] = std::min(255u, ((u32)in[i] * intensity) >> 7);
+  }
+}
+
+void blend_sky_slow(u8 intensity, u8* out, const u8* in, u32 size) {
+  for (u32 i = 0; i < size; i++) {
+    out[i] = std::min(255u, out[i] + std::min(255u, ((u32)in[i] * intensity) >> 7));
+  }
+}
+
+#ifndef __aarch64__
+AVX2_TARGET void blend_sky_initial_avx2(u8 intensity, u8* out, const u8* in, u32 size) {
+  __m256i intensity_vec = _mm256_set1_epi16(intensity);
+  for (u32 i = 0; i < size / 16; i++) {
+    __m128i tex_data8 = _mm_loadu_si128((const __m128i*)(in + (i * 16)));
+    __m256i tex_data16 = _mm256_cvtepu8_epi16(tex_data8);
+    tex_data16 = _mm256_mullo_epi16(tex_data16, intensity_vec);
+    tex_data16 = _mm256_srli_epi16(tex_data16, 7);
+    auto hi = _mm256_extracti128_si256(tex_data16, 1);
+    auto result = _mm_packus_epi16(_mm256_castsi256_si128(tex_data16), hi);
+    _mm_storeu_si128((__m128i*)(out + (i * 16)), result);
+  }
+}
+
+AVX2_TARGET void blend_sky_avx2(u8 intensity, u8* out, const u8* in, u32 size) {
+  __m256i intensity_vec = _mm256_set1_epi16(intensity);
+  __m256i max_intensity = _mm256_set1_epi16(255);
+  for (u32 i = 0; i < size / 16; i++) {
+    __m128i tex_data8 = _mm_loadu_si128((const __m128i*)(in + (i * 16)));
+    __m128i out_val = _mm_loadu_si128((const __m128i*)(out + (i * 16)));
+    __m256i tex_data16 = _mm256_cvtepu8_epi16(tex_data8);
+    tex_data16 = _mm256_mullo_epi16(tex_data16, intensity_vec);
+    tex_data16 = _mm256_srli_epi16(tex_data16, 7);
+    tex_data16 = _mm256_min_epi16(max_intensity, tex_data16);
+    auto hi = _mm256_extracti128_si256(tex_data16, 1);
+    auto result = _mm_packus_epi16(_mm256_castsi256_si128(tex_data16), hi);
+    out_val = _mm_adds_epu8(out_val, result);
+    _mm_storeu_si128((__m128i*)(out + (i * 16)), out_val);
+  }
+}
+#endif
+
 void blend_sky_initial_fast(u8 intensity, u8* out, const u8* in, u32 size) {
-#ifndef __arm64__
+#ifndef __aarch64__
   if (get_cpu_info().has_avx2) {
-#ifdef __AVX2__
-    __m256i intensity_vec = _mm256_set1_epi16(intensity);
-    for (u32 i = 0; i < size / 16; i++) {
-      __m128i tex_data8 = _mm_loadu_si128((const __m128i*)(in + (i * 16)));
-      __m256i tex_data16 = _mm256_cvtepu8_epi16(tex_data8);
-      tex_data16 = _mm256_mullo_epi16(tex_data16, intensity_vec);
-      tex_data16 = _mm256_srli_epi16(tex_data16, 7);
-      auto hi = _mm256_extracti128_si256(tex_data16, 1);
-      auto result = _mm_packus_epi16(_mm256_castsi256_si128(tex_data16), hi);
-      _mm_storeu_si128((__m128i*)(out + (i * 16)), result);
-    }
-#else
-    ASSERT(false);
-#endif
-  } else {
-    __m128i intensity_vec = _mm_set1_epi16(intensity);
-    for (u32 i = 0; i < size / 8; i++) {
-      __m128i tex_data8 = _mm_loadu_si64((const __m128i*)(in + (i * 8)));
-      __m128i tex_data16 = _mm_cvtepu8_epi16(tex_data8);
-      tex_data16 = _mm_mullo_epi16(tex_data16, intensity_vec);
-      tex_data16 = _mm_srli_epi16(tex_data16, 7);
-      auto result = _mm_packus_epi16(tex_data16, tex_data16);
-      _mm_storel_epi64((__m128i*)(out + (i * 8)), result);
-    }
+    blend_sky_initial_avx2(intensity, out, in, size);
+    return;
   }
 #endif
+  __m128i intensity_vec = _mm_set1_epi16(intensity);
+  for (u32 i = 0; i < size / 8; i++) {
+    __m128i tex_data8 = _mm_loadu_si64((const __m128i*)(in + (i * 8)));
+    __m128i tex_data16 = _mm_cvtepu8_epi16(tex_data8);
+    tex_data16 = _mm_mullo_epi16(tex_data16, intensity_vec);
+    tex_data16 = _mm_srli_epi16(tex_data16, 7);
+    auto result = _mm_packus_epi16(tex_data16, tex_data16);
+    _mm_storel_epi64((__m128i*)(out + (i * 8)), result);
+  }
 }
 
 void blend_sky_fast(u8 intensity, u8* out, const u8* in, u32 size) {
-#ifndef __arm64__
+#ifndef __aarch64__
   if (get_cpu_info().has_avx2) {
-#ifdef __AVX2__
-    __m256i intensity_vec = _mm256_set1_epi16(intensity);
-    __m256i max_intensity = _mm256_set1_epi16(255);
-    for (u32 i = 0; i < size / 16; i++) {
-      __m128i tex_data8 = _mm_loadu_si128((const __m128i*)(in + (i * 16)));
-      __m128i out_val = _mm_loadu_si128((const __m128i*)(out + (i * 16)));
-      __m256i tex_data16 = _mm256_cvtepu8_epi16(tex_data8);
-      tex_data16 = _mm256_mullo_epi16(tex_data16, intensity_vec);
-      tex_data16 = _mm256_srli_epi16(tex_data16, 7);
-      tex_data16 = _mm256_min_epi16(max_intensity, tex_data16);
-      auto hi = _mm256_extracti128_si256(tex_data16, 1);
-      auto result = _mm_packus_epi16(_mm256_castsi256_si128(tex_data16), hi);
-      out_val = _mm_adds_epu8(out_val, result);
-      _mm_storeu_si128((__m128i*)(out + (i * 16)), out_val);
-    }
-#else
-    ASSERT(false);
-#endif
-  } else {
-    __m128i intensity_vec = _mm_set1_epi16(intensity);
-    __m128i max_intensity = _mm_set1_epi16(255);
-    for (u32 i = 0; i < size / 8; i++) {
-      __m128i tex_data8 = _mm_loadu_si64((const __m128i*)(in + (i * 8)));
-      __m128i out_val = _mm_loadu_si64((const __m128i*)(out + (i * 8)));
-      __m128i tex_data16 = _mm_cvtepu8_epi16(tex_data8);
-      tex_data16 = _mm_mullo_epi16(tex_data16, intensity_vec);
-      tex_data16 = _mm_srli_epi16(tex_data16, 7);
-      tex_data16 = _mm_min_epi16(max_intensity, tex_data16);
-      auto result = _mm_packus_epi16(tex_data16, tex_data16);
-      out_val = _mm_adds_epu8(out_val, result);
-      _mm_storel_epi64((__m128i*)(out + (i * 8)), out_val);
-    }
+    blend_sky_avx2(intensity, out, in, size);
+    return;
   }
 #endif
+  __m128i intensity_vec = _mm_set1_epi16(intensity);
+  __m128i max_intensity = _mm_set1_epi16(255);
+  for (u32 i = 0; i < size / 8; i++) {
+    __m128i tex_data8 = _mm_loadu_si64((const __m128i*)(in + (i * 8)));
+    __m128i out_val = _mm_loadu_si64((const __m128i*)(out + (i * 8)));
+    __m128i tex_data16 = _mm_cvtepu8_epi16(tex_data8);
+    tex_data16 = _mm_mullo_epi16(tex_data16, intensity_vec);
+    tex_data16 = _mm_srli_epi16(tex_data16, 7);
+    tex_data16 = _mm_min_epi16(max_intensity, tex_data16);
+    auto result = _mm_packus_epi16(tex_data16, tex_data16);
+    out_val = _mm_adds_epu8(out_val, result);
+    _mm_storel_epi64((__m128i*)(out + (i * 8)), out_val);
+  }
 }
 
 SkyBlendStats SkyBlendCPU::do_sky_blends(DmaFollower& dma,
                                          SharedRenderState* render_state,
                                          ScopedProfilerNode& /*prof*/) {
   SkyBlendStats stats;
+  bool touched[2] = {false, false};
+  for (auto& ops : m_ops) {
+    ops.clear();
+  }
 
   while (dma.current_tag().qwc == 6) {
     // assuming that the vif and gif-tag is correct
@@ -139,32 +164,13 @@ SkyBlendStats SkyBlendCPU::do_sky_blends(DmaFollower& dma,
     auto tex = render_state->texture_pool->lookup_gpu_texture(adgif.tex0().tbp0());
     ASSERT(tex);
 
-    // slow version
-    /*
-    if (is_first_draw) {
-      memset(m_texture_data[buffer_idx].data(), 0, m_texture_data[buffer_idx].size());
-    }
-
-    // intensities should be 0-128 (maybe higher is okay, but I don't see how this could be
-    // generated with the GOAL code.)
-    ASSERT(intensity <= 128);
-    ASSERT(m_texture_data[buffer_idx].size() == tex->data.size());
-    for (size_t i = 0; i < m_texture_data[buffer_idx].size(); i++) {
-      u32 val = tex->data[i] * intensity;
-      val >>= 7;
-      m_texture_data[buffer_idx][i] += val;
-    }
-     */
     if (tex->get_data_ptr()) {
-      if (m_texture_data[buffer_idx].size() == tex->data_size()) {
-        if (is_first_draw) {
-          blend_sky_initial_fast(intensity, m_texture_data[buffer_idx].data(), tex->get_data_ptr(),
-                                 m_texture_data[buffer_idx].size());
-        } else {
-          blend_sky_fast(intensity, m_texture_data[buffer_idx].data(), tex->get_data_ptr(),
-                         m_texture_data[buffer_idx].size());
-        }
-      }
+      // intensities should be 0-128 (maybe higher is okay, but I don't see how this could be
+      // generated with the GOAL code.)
+      ASSERT(intensity <= 128);
+      ASSERT(m_texture_data[buffer_idx].size() == tex->data_size());
+      m_ops[buffer_idx].push_back({tex->tex_id, tex->get_data_ptr(), intensity, is_first_draw});
+      touched[buffer_idx] = true;
 
       if (buffer_idx == 0) {
         if (is_first_draw) {
@@ -179,18 +185,115 @@ SkyBlendStats SkyBlendCPU::do_sky_blends(DmaFollower& dma,
           stats.cloud_blends++;
         }
       }
+    }
+  }
+
+  // do the blends, and upload the result once.
+  for (int buffer_idx = 0; buffer_idx < 2; buffer_idx++) {
+    if (!touched[buffer_idx]) {
+      continue;
+    }
+    if (update_buffer(buffer_idx, m_ops[buffer_idx], render_state->frame_idx)) {
       glBindTexture(GL_TEXTURE_2D, m_textures[buffer_idx].gl);
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_sizes[buffer_idx], m_sizes[buffer_idx], 0, GL_RGBA,
                    GL_UNSIGNED_INT_8_8_8_8_REV, m_texture_data[buffer_idx].data());
-
-      render_state->texture_pool->move_existing_to_vram(m_textures[buffer_idx].tex,
-                                                        m_textures[buffer_idx].tbp);
     }
+    render_state->texture_pool->move_existing_to_vram(m_textures[buffer_idx].tex,
+                                                      m_textures[buffer_idx].tbp);
   }
 
   return stats;
 }
 
+/*!
+ * Apply draws and blends to a buffer. Returns false if the buffer didn't change: it was made from
+ * the same source textures and intensities as before, or this is a half rate frame.
+ */
+bool SkyBlendCPU::update_buffer(int buffer_idx, const std::vector<BlendOp>& ops, u64 frame_idx) {
+  if (ops.empty()) {
+    return false;
+  }
+  if (half_rate && (frame_idx & 1)) {
+    // skip all of this frame's ops, so the buffer still matches its history.
+    m_stats.half_rate_skips++;
+    return false;
+  }
+
+  // only the ops after the last first draw matter.
+  auto start = ops.begin();
+  for (auto it = ops.begin(); it != ops.end(); ++it) {
+    if (it->is_first_draw) {
+      start = it;
+    }
+  }
+  bool from_scratch = start->is_first_draw;
+  std::vector<BlendOp> history;
+  if (!from_scratch) {
+    history = m_history[buffer_idx];
+  }
+  history.insert(history.end(), start, ops.end());
+  bool history_valid =
+      (from_scratch || m_history_valid[buffer_idx]) && history.size() <= kMaxHistory;
+
+  auto& data = m_texture_data[buffer_idx];
+  if (history_valid) {
+    if (m_history_valid[buffer_idx] && history == m_history[buffer_idx]) {
+      m_stats.unchanged++;
+      return false;
+    }
+    for (auto& cached : m_cache[buffer_idx]) {
+      if (cached.history == history) {
+        data = cached.data;
+        cached.last_use = ++m_cache_counter;
+        m_history[buffer_idx] = std::move(history);
+        m_history_valid[buffer_idx] = true;
+        m_stats.cache_hits++;
+        return true;
+      }
+    }
+  }
+
+  Timer timer;
+  for (auto it = start; it != ops.end(); ++it) {
+    if (it->is_first_draw) {
+      blend_sky_initial_fast(it->intensity, data.data(), it->data, data.size());
+    } else {
+      blend_sky_fast(it->intensity, data.data(), it->data, data.size());
+    }
+  }
+  m_stats.blends++;
+  m_stats.total_ms += timer.getMs();
+
+  m_history_valid[buffer_idx] = history_valid;
+  if (history_valid) {
+    // remember this result, replacing the least recently used one.
+    auto& cache = m_cache[buffer_idx];
+    CachedBlend* entry;
+    if (cache.size() < kMaxCachedBlends) {
+      entry = &cache.emplace_back();
+    } else {
+      entry = &*std::min_element(cache.begin(), cache.end(), [](const auto& a, const auto& b) {
+        return a.last_use < b.last_use;
+      });
+    }
+    entry->history = history;
+    entry->data = data;
+    entry->last_use = ++m_cache_counter;
+    m_history[buffer_idx] = std::move(history);
+  }
+  return true;
+}
+
+void SkyBlendCPU::draw_debug_window() {
+  ImGui::Checkbox("Half rate", &half_rate);
+  ImGui::Text("%d blends (%.2f ms total), %d unchanged, %d cached, %d half rate skips",
+              m_stats.blends, m_stats.total_ms, m_stats.unchanged, m_stats.cache_hits,
+              m_stats.half_rate_skips);
+  if (ImGui::Button("Reset sky blend stats")) {
+    m_stats = {};
+  }
+}
+
 void SkyBlendCPU::init_textures(TexturePool& tex_pool, GameVersion version) {
   for (int i = 0; i < 2; i++) {
     // update it
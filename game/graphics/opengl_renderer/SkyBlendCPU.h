@@ -1,11 +1,20 @@
 #pragma once
 
+#include <vector>
+
 #include "common/dma/dma_chain_read.h"
 
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/opengl_renderer/SkyBlendCommon.h"
 #include "game/graphics/pipelines/opengl.h"
 
+// out = in * intensity / 128, or out += in * intensity / 128 with saturation.
+// The fast versions use AVX2 if the CPU has it, otherwise SSE (NEON through sse2neon).
+void blend_sky_initial_slow(u8 intensity, u8* out, const u8* in, u32 size);
+void blend_sky_slow(u8 intensity, u8* out, const u8* in, u32 size);
+void blend_sky_initial_fast(u8 intensity, u8* out, const u8* in, u32 size);
+void blend_sky_fast(u8 intensity, u8* out, const u8* in, u32 size);
+
 class SkyBlendCPU {
  public:
   SkyBlendCPU();
@@ -15,6 +24,10 @@ class SkyBlendCPU {
                               SharedRenderState* render_state,
                               ScopedProfilerNode& prof);
   void init_textures(TexturePool& tex_pool, GameVersion version);
+  void draw_debug_window();
+
+  // only update the sky on every other frame. At high frame rates, this isn't noticeable.
+  bool half_rate = false;
 
  private:
   static constexpr int m_sizes[2] = {32, 64};
@@ -25,4 +38,39 @@ class SkyBlendCPU {
     u32 tbp;
     GpuTexture* tex;
   } m_textures[2];
-};
\ No newline at end of file
+
+  // a draw or blend of a source texture into one of the buffers.
+  struct BlendOp {
+    PcTextureId tex_id;
+    const u8* data = nullptr;
+    u32 intensity = 0;
+    bool is_first_draw = false;
+    bool operator==(const BlendOp& other) const = default;
+  };
+
+  // The contents of a buffer only depend on the ops since the last first draw. The sky handler of
+  // each level blends into the same buffers, so a few recent results are kept.
+  struct CachedBlend {
+    std::vector<BlendOp> history;
+    std::vector<u8> data;
+    u64 last_use = 0;
+  };
+  static constexpr size_t kMaxCachedBlends = 4;
+  static constexpr size_t kMaxHistory = 32;
+
+  bool update_buffer(int buffer_idx, const std::vector<BlendOp>& ops, u64 frame_idx);
+
+  std::vector<BlendOp> m_ops[2];
+  std::vector<BlendOp> m_history[2];  // ops that made the current buffer contents
+  bool m_history_valid[2] = {true, true};
+  std::vector<CachedBlend> m_cache[2];
+  u64 m_cache_counter = 0;
+
+  struct Stats {
+    u32 blends = 0;
+    u32 unchanged = 0;
+    u32 cache_hits = 0;
+    u32 half_rate_skips = 0;
+    float total_ms = 0;
+  } m_stats;
+};
@@ -1,11 +1,20 @@
 #include "TextureAnimator.h"
 
+#ifdef __aarch64__
+#include "third-party/sse2neon/sse2neon.h"
+#else
+#include <immintrin.h>
+#endif
+
 #include "common/global_profiler/GlobalProfiler.h"
 #include "common/log/log.h"
 #include "common/texture/texture_slots.h"
 #include "common/util/FileUtil.h"
 #include "common/util/Timer.h"
+#include "common/goal_constants.h"
+#include "common/util/os.h"
 
+#include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/opengl_renderer/slime_lut.h"
 #include "game/graphics/texture/TexturePool.h"
 
@@ -237,6 +246,85 @@ void opengl_upload_texture(GLint dest, const void* data, int w, int h) {
   glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+namespace {
+#ifndef __aarch64__
+/*!
+ * Two CLUT entries per iteration. Rounds the same way as the SSE version.
+ */
+AVX2_TARGET void blend_cluts_avx2(const math::Vector4<u8>* a,
+                                  const math::Vector4<u8>* b,
+                                  const float* weights,
+                                  u32* out) {
+  const __m256 wa = _mm256_set1_ps(weights[0]);
+  const __m256 wb = _mm256_set1_ps(weights[1]);
+  for (int i = 0; i < 256; i += 2) {
+    __m256 ca = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&a[i])));
+    __m256 cb = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&b[i])));
+    __m256i v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(ca, wa), _mm256_mul_ps(cb, wb)));
+    __m128i v16 = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64((__m128i*)&out[i], _mm_packus_epi16(v16, v16));
+  }
+}
+
+/*!
+ * Gather 8 CLUT entries at a time. Returns how many pixels were done, the rest are left for the
+ * caller.
+ */
+AVX2_TARGET size_t expand_indices_avx2(const u8* indices, const u32* clut, u32* out, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)clut, idx, 4));
+  }
+  return i;
+}
+#endif
+
+/*!
+ * Blend two 256 entry CLUTs, like sum(clut[j] * weight[j]) with floats, truncated to u8.
+ * Uses AVX2 if the CPU has it, otherwise SSE.
+ */
+void blend_cluts(const math::Vector4<u8>* a,
+                 const math::Vector4<u8>* b,
+                 const float* weights,
+                 u32* out) {
+#ifndef __aarch64__
+  if (get_cpu_info().has_avx2) {
+    blend_cluts_avx2(a, b, weights, out);
+    return;
+  }
+#endif
+  // SSE, or NEON through sse2neon.
+  const __m128 wa = _mm_set1_ps(weights[0]);
+  const __m128 wb = _mm_set1_ps(weights[1]);
+  for (int i = 0; i < 256; i++) {
+    u32 pa, pb;
+    memcpy(&pa, a[i].data(), 4);
+    memcpy(&pb, b[i].data(), 4);
+    __m128 ca = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(pa)));
+    __m128 cb = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(pb)));
+    __m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(ca, wa), _mm_mul_ps(cb, wb)));
+    v = _mm_packus_epi32(v, v);
+    out[i] = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+  }
+}
+
+/*!
+ * Look up each index in the CLUT to make an RGBA texture.
+ */
+void expand_indices(const u8* indices, const u32* clut, u32* out, size_t count) {
+  size_t i = 0;
+#ifndef __aarch64__
+  if (get_cpu_info().has_avx2) {
+    i = expand_indices_avx2(indices, clut, out, count);
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = clut[indices[i]];
+  }
+}
+}  // namespace
+
 /*!
  * Utility class to grab CLUTs from the source textures, blend them, and produce a destination RGBA
  * texture using the index data in dest.
@@ -265,7 +353,9 @@ ClutBlender::ClutBlender(const std::string& dest,
 }
 
 /*!
- * Blend cluts and create an output texture.
+ * Blend cluts and create an output texture. The game sends weights every frame, even if they
+ * haven't changed, so this skips the work if the weights, or the blended CLUT, are the same as
+ * last time.
  */
 GLuint ClutBlender::run(const float* weights) {
   bool needs_run = false;
@@ -279,30 +369,35 @@ GLuint ClutBlender::run(const float* weights) {
   }
 
   if (!needs_run) {
+    m_stats.same_weights++;
     return m_texture;
   }
 
+  Timer timer;
   // update weights
   for (size_t i = 0; i < m_current_weights.size(); i++) {
     m_current_weights[i] = weights[i];
   }
 
-  // blend cluts
-  for (int i = 0; i < 256; i++) {
-    math::Vector4f v = math::Vector4f::zero();
-    for (size_t j = 0; j < m_current_weights.size(); j++) {
-      v += (*m_cluts[j])[i].cast<float>() * m_current_weights[j];
-    }
-    m_temp_clut[i] = v.cast<u8>();
+  // blend cluts. Small changes in weight often round to the same colors.
+  blend_cluts(m_cluts[0]->data(), m_cluts[1]->data(), m_current_weights.data(),
+              m_blended_clut.data());
+  if (m_clut_valid && m_blended_clut == m_temp_clut) {
+    m_stats.same_clut++;
+    m_stats.total_ms += timer.getMs();
+    return m_texture;
   }
+  m_temp_clut = m_blended_clut;
+  m_clut_valid = true;
 
   // do texture lookups
-  for (size_t i = 0; i < m_temp_rgba.size(); i++) {
-    memcpy(&m_temp_rgba[i], m_temp_clut[m_dest->index_data[i]].data(), 4);
-  }
+  expand_indices(m_dest->index_data.data(), m_temp_clut.data(), m_temp_rgba.data(),
+                 m_temp_rgba.size());
 
   // send to GPU.
   opengl_upload_texture(m_texture, m_temp_rgba.data(), m_dest->w, m_dest->h);
+  m_stats.blends++;
+  m_stats.total_ms += timer.getMs();
 
   return m_texture;
 }
@@ -550,6 +645,27 @@ void imgui_show_tex(GLuint tex) {
 void TextureAnimator::draw_debug_window() {
   ImGui::Checkbox("fast-scrambler", &m_debug.use_fast_scrambler);
 
+  ImGui::Text("CLUT blenders:");
+  ClutBlender::Stats clut_stats;
+  for (auto& group : m_clut_blender_groups) {
+    for (auto& blender : group.blenders) {
+      clut_stats.blends += blender.stats().blends;
+      clut_stats.same_weights += blender.stats().same_weights;
+      clut_stats.same_clut += blender.stats().same_clut;
+      clut_stats.total_ms += blender.stats().total_ms;
+    }
+  }
+  ImGui::Text("%d blends, skipped %d (same weights) %d (same CLUT), %.2f ms total",
+              clut_stats.blends, clut_stats.same_weights, clut_stats.same_clut,
+              clut_stats.total_ms);
+  if (ImGui::Button("Reset CLUT stats")) {
+    for (auto& group : m_clut_blender_groups) {
+      for (auto& blender : group.blenders) {
+        blender.reset_stats();
+      }
+    }
+  }
+
   ImGui::Text("Slime:");
   ImGui::Text("dests %d %d", m_debug_slime_input.dest, m_debug_slime_input.scroll_dest);
   for (int i = 0; i < 9; i++) {
@@ -696,11 +812,66 @@ struct TextureAnimPcTransform {
   u32 pad1;
 };
 
+namespace {
+// the number of bytes of game memory read by an upload, see handle_generic_upload.
+u32 upload_bytes(u32 code, const TextureAnimPcUpload& upload) {
+  if (code == UPLOAD_CLUT_16_16) {
+    return 16 * 16 * 4;
+  }
+  switch (upload.format) {
+    case (int)GsTex0::PSM::PSMCT32:
+      return upload.width * upload.height * 4;
+    case (int)GsTex0::PSM::PSMT8:
+    case (int)GsTex0::PSM::PSMT4:
+      return upload.width * upload.height;
+    default:
+      return 0;
+  }
+}
+
+// the data of an upload, either copied with the chain or still in game memory.
+const u8* upload_source(const DmaTransfer& tf, const u8* ee_mem, const EeSnapshot* ee_snapshot) {
+  if (ee_snapshot) {
+    auto it = ee_snapshot->anim_uploads.find(tf.data);
+    ASSERT(it != ee_snapshot->anim_uploads.end());
+    return it->second.data();
+  }
+  return ee_mem + ((const TextureAnimPcUpload*)tf.data)->data;
+}
+}  // namespace
+
+/*!
+ * Copy the game memory read by the uploads in texture animation data, so the animations can run
+ * after the game has moved on. Stops at the end of the animation data.
+ */
+void TextureAnimator::snapshot_anim_uploads(DmaFollower& dma, const u8* ee_mem, EeSnapshot* out) {
+  while (!dma.ended()) {
+    auto tf = dma.read_and_advance();
+    auto vif0 = tf.vifcode0();
+    if (vif0.kind != VifCode::Kind::PC_PORT) {
+      continue;
+    }
+    if (vif0.immediate == FINISH_ARRAY) {
+      return;
+    }
+    if ((vif0.immediate == UPLOAD_CLUT_16_16 || vif0.immediate == GENERIC_UPLOAD) &&
+        tf.size_bytes == sizeof(TextureAnimPcUpload)) {
+      TextureAnimPcUpload upload;
+      memcpy(&upload, tf.data, sizeof(upload));
+      u32 size = upload_bytes(vif0.immediate, upload);
+      if ((u64)upload.data + size <= EE_MAIN_MEM_SIZE) {
+        out->anim_uploads[tf.data].assign(ee_mem + upload.data, ee_mem + upload.data + size);
+      }
+    }
+  }
+}
+
 /*!
  * Main function to run texture animations from DMA. Updates textures in the pool.
  */
 void TextureAnimator::handle_texture_anim_data(DmaFollower& dma,
                                                const u8* ee_mem,
+                                               const EeSnapshot* ee_snapshot,
                                                TexturePool* texture_pool,
                                                u64 frame_idx) {
   dprintf("animator\n");
@@ -729,7 +900,7 @@ void TextureAnimator::handle_texture_anim_data(DmaFollower& dma,
       switch (vif0.immediate) {
         case UPLOAD_CLUT_16_16: {
           auto p = scoped_prof("clut-16-16");
-          handle_upload_clut_16_16(tf, ee_mem);
+          handle_upload_clut_16_16(tf, upload_source(tf, ee_mem, ee_snapshot));
         } break;
         case ERASE_DEST_TEXTURE: {
           auto p = scoped_prof("erase");
@@ -737,7 +908,7 @@ void TextureAnimator::handle_texture_anim_data(DmaFollower& dma,
         } break;
         case GENERIC_UPLOAD: {
           auto p = scoped_prof("generic-upload");
-          handle_generic_upload(tf, ee_mem);
+          handle_generic_upload(tf, upload_source(tf, ee_mem, ee_snapshot));
         } break;
         case SET_SHADER: {
           auto p = scoped_prof("set-shader");
@@ -1129,7 +1300,7 @@ void TextureAnimator::clear_stale_textures(u64 frame_idx) {
  * They upload cluts as PSM32, so there's no funny addressing stuff, other than
  * the CLUT indexing scramble stuff.
  */
-void TextureAnimator::handle_upload_clut_16_16(const DmaTransfer& tf, const u8* ee_mem) {
+void TextureAnimator::handle_upload_clut_16_16(const DmaTransfer& tf, const u8* src) {
   dprintf("[tex anim] upload clut 16 16\n");
   ASSERT(tf.size_bytes == sizeof(TextureAnimPcUpload));
   auto* upload = (const TextureAnimPcUpload*)(tf.data);
@@ -1142,7 +1313,7 @@ void TextureAnimator::handle_upload_clut_16_16(const DmaTransfer& tf, const u8*
   vram.data.resize(16 * 16 * 4);
   vram.tex_width = upload->width;
   vram.tex_height = upload->height;
-  memcpy(vram.data.data(), ee_mem + upload->data, vram.data.size());
+  memcpy(vram.data.data(), src, vram.data.size());
   if (m_tex_looking_for_clut) {
     m_tex_looking_for_clut->cbp = upload->dest;
     m_tex_looking_for_clut = nullptr;
@@ -1152,8 +1323,8 @@ void TextureAnimator::handle_upload_clut_16_16(const DmaTransfer& tf, const u8*
 /*!
  * Create an entry for any texture upload. Leaves it on the CPU, as we may do fancy scramble stuff.
  */
-void TextureAnimator::handle_generic_upload(const DmaTransfer& tf, const u8* ee_mem) {
-  dprintf("[tex anim] upload generic @ 0x%lx\n", tf.data - ee_mem);
+void TextureAnimator::handle_generic_upload(const DmaTransfer& tf, const u8* src) {
+  dprintf("[tex anim] upload generic\n");
   ASSERT(tf.size_bytes == sizeof(TextureAnimPcUpload));
   auto* upload = (const TextureAnimPcUpload*)(tf.data);
   dprintf(" size %d x %d\n", upload->width, upload->height);
@@ -1167,7 +1338,7 @@ void TextureAnimator::handle_generic_upload(const DmaTransfer& tf, const u8* ee_
       vram.data.resize(upload->width * upload->height * 4);
       vram.tex_width = upload->width;
       vram.tex_height = upload->height;
-      memcpy(vram.data.data(), ee_mem + upload->data, vram.data.size());
+      memcpy(vram.data.data(), src, vram.data.size());
       if (m_tex_looking_for_clut) {
         m_tex_looking_for_clut->cbp = upload->dest;
       }
@@ -1181,7 +1352,7 @@ void TextureAnimator::handle_generic_upload(const DmaTransfer& tf, const u8* ee_
       vram.data.resize(upload->width * upload->height);
       vram.tex_width = upload->width;
       vram.tex_height = upload->height;
-      memcpy(vram.data.data(), ee_mem + upload->data, vram.data.size());
+      memcpy(vram.data.data(), src, vram.data.size());
       m_tex_looking_for_clut = &vram;
       if (upload->force_to_gpu) {
         m_force_to_gpu.insert(upload->dest);
@@ -1192,7 +1363,7 @@ void TextureAnimator::handle_generic_upload(const DmaTransfer& tf, const u8* ee_
       vram.data.resize(upload->width * upload->height);
       vram.tex_width = upload->width;
       vram.tex_height = upload->height;
-      memcpy(vram.data.data(), ee_mem + upload->data, vram.data.size());
+      memcpy(vram.data.data(), src, vram.data.size());
       m_tex_looking_for_clut = &vram;
       if (upload->force_to_gpu) {
         m_force_to_gpu.insert(upload->dest);
@@ -18,6 +18,7 @@
 #include "game/graphics/texture/TextureID.h"
 
 struct GpuTexture;
+struct EeSnapshot;
 
 struct VramEntry {
   enum class Kind {
@@ -77,13 +78,25 @@ class ClutBlender {
   GLuint texture() const { return m_texture; }
   bool at_default() const { return m_current_weights[0] == 1.f && m_current_weights[1] == 0.f; }
 
+  struct Stats {
+    u32 blends = 0;
+    u32 same_weights = 0;  // skipped because the weights didn't change
+    u32 same_clut = 0;     // weights changed, but blended to the same CLUT
+    float total_ms = 0;
+  };
+  const Stats& stats() const { return m_stats; }
+  void reset_stats() { m_stats = {}; }
+
  private:
   const tfrag3::IndexTexture* m_dest;
   std::array<const std::array<math::Vector4<u8>, 256>*, 2> m_cluts;
   std::array<float, 2> m_current_weights;
   GLuint m_texture;
-  std::array<math::Vector4<u8>, 256> m_temp_clut;
+  std::array<u32, 256> m_temp_clut;
+  std::array<u32, 256> m_blended_clut;
+  bool m_clut_valid = false;
   std::vector<u32> m_temp_rgba;
+  Stats m_stats;
 };
 
 struct Psm32ToPsm8Scrambler {
@@ -250,8 +263,10 @@ class TextureAnimator {
   ~TextureAnimator();
   void handle_texture_anim_data(DmaFollower& dma,
                                 const u8* ee_mem,
+                                const EeSnapshot* ee_snapshot,
                                 TexturePool* texture_pool,
                                 u64 frame_idx);
+  static void snapshot_anim_uploads(DmaFollower& dma, const u8* ee_mem, EeSnapshot* out);
   GLuint get_by_slot(int idx);
   void draw_debug_window();
   const std::vector<GLuint>* slots() { return &m_public_output_slots; }
@@ -264,8 +279,8 @@ class TextureAnimator {
   void setup_texture_anims_jak3();
 
   void setup_sky();
-  void handle_upload_clut_16_16(const DmaTransfer& tf, const u8* ee_mem);
-  void handle_generic_upload(const DmaTransfer& tf, const u8* ee_mem);
+  void handle_upload_clut_16_16(const DmaTransfer& tf, const u8* src);
+  void handle_generic_upload(const DmaTransfer& tf, const u8* src);
   void handle_clouds_and_fog(const DmaTransfer& tf, TexturePool* texture_pool, bool hires);
   void handle_slime(const DmaTransfer& tf, TexturePool* texture_pool);
   void handle_erase_dest(DmaFollower& dma);
@@ -1,6 +1,7 @@
 #include "TextureUploadHandler.h"
 
 #include "common/global_profiler/GlobalProfiler.h"
+#include "common/goal_constants.h"
 #include "common/log/log.h"
 
 #include "game/graphics/opengl_renderer/EyeRenderer.h"
@@ -9,6 +10,13 @@
 #include "fmt/core.h"
 #include "third-party/imgui/imgui.h"
 
+namespace {
+bool is_upload_record(const DmaTransfer& data) {
+  return data.size_bytes == 16 && data.vifcode0().kind == VifCode::Kind::PC_PORT &&
+         data.vif1() == 3;
+}
+}  // namespace
+
 TextureUploadHandler::TextureUploadHandler(const std::string& name,
                                            int my_id,
                                            std::shared_ptr<TextureAnimator> texture_animator,
@@ -25,7 +33,7 @@ void TextureUploadHandler::render(DmaFollower& dma,
                                   ScopedProfilerNode& prof) {
   // this is the data we get from the PC Port modification.
   m_upload_count = 0;
-  std::vector<TextureUpload> uploads;
+  std::vector<const u8*> uploads;  // upload records in the chain
   if (m_direct) {
     m_direct->reset_state();
   }
@@ -45,6 +53,7 @@ void TextureUploadHandler::render(DmaFollower& dma,
           m_direct->flush_pending(render_state, prof);
         }
         m_texture_animator->handle_texture_anim_data(dma, (const u8*)render_state->ee_main_memory,
+                                                     render_state->ee_snapshot,
                                                      render_state->texture_pool.get(),
                                                      render_state->frame_idx);
         if (m_direct) {
@@ -66,11 +75,8 @@ void TextureUploadHandler::render(DmaFollower& dma,
       continue;
     }
 
-    if (data.size_bytes == 16 && data.vifcode0().kind == VifCode::Kind::PC_PORT &&
-        data.vif1() == 3) {
-      TextureUpload upload_data;
-      memcpy(&upload_data, data.data, sizeof(upload_data));
-      uploads.push_back(upload_data);
+    if (is_upload_record(data)) {
+      uploads.push_back(data.data);
       continue;
     }
 
@@ -95,7 +101,7 @@ void TextureUploadHandler::render(DmaFollower& dma,
   }
 }
 
-void TextureUploadHandler::flush_uploads(std::vector<TextureUpload>& uploads,
+void TextureUploadHandler::flush_uploads(std::vector<const u8*>& uploads,
                                          SharedRenderState* render_state) {
   auto p = scoped_prof("flush-uploads");
   if (m_fake_uploads) {
@@ -104,14 +110,54 @@ void TextureUploadHandler::flush_uploads(std::vector<TextureUpload>& uploads,
     m_upload_count += uploads.size();
     // NOTE: we don't actually copy the textures in the dma chain copying because they aren't
     // reference by DMA tag.  So there's the potential for race conditions if the game gets messed
-    // up and corrupts the texture memory.
+    // up and corrupts the texture memory. If the game is running during rendering, the texture
+    // page was already read when the chain was copied.
     const u8* ee_mem = (const u8*)render_state->ee_main_memory;
-    for (auto& upload : uploads) {
-      render_state->texture_pool->handle_upload_now(ee_mem + upload.page, upload.mode, ee_mem,
-                                                    render_state->offset_of_s7, m_my_id == 999);
+    for (auto* record : uploads) {
+      if (render_state->ee_snapshot) {
+        auto it = render_state->ee_snapshot->upload_now.find(record);
+        ASSERT(it != render_state->ee_snapshot->upload_now.end());
+        render_state->texture_pool->apply_upload_now(it->second);
+      } else {
+        TextureUpload upload;
+        memcpy(&upload, record, sizeof(upload));
+        render_state->texture_pool->handle_upload_now(ee_mem + upload.page, upload.mode, ee_mem,
+                                                      render_state->offset_of_s7, m_my_id == 999);
+      }
+    }
+  }
+}
+
+/*!
+ * Read the game memory that the texture upload buckets of a copied chain will need, so they can be
+ * rendered while the game runs.
+ */
+void TextureUploadHandler::snapshot_ee_reads(const DmaData& chain,
+                                             const u8* ee_mem,
+                                             u32 s7_ptr,
+                                             EeSnapshot* out) {
+  out->clear();
+  DmaFollower dma(chain.data.data(), chain.start_offset);
+  while (!dma.ended()) {
+    auto vif0 = dma.current_tag_vifcode0();
+    if (vif0.kind == VifCode::Kind::PC_PORT && vif0.immediate == 12) {
+      dma.read_and_advance();
+      TextureAnimator::snapshot_anim_uploads(dma, ee_mem, out);
+      continue;
+    }
+
+    auto data = dma.read_and_advance();
+    if (is_upload_record(data)) {
+      TextureUpload upload;
+      memcpy(&upload, data.data, sizeof(upload));
+      if (upload.page < EE_MAIN_MEM_SIZE) {
+        out->upload_now[data.data] =
+            TexturePool::plan_upload_now(ee_mem + upload.page, upload.mode, ee_mem, s7_ptr, false);
+      }
     }
   }
 }
+
 void TextureUploadHandler::draw_debug_window() {
   ImGui::Checkbox("Fake Uploads", &m_fake_uploads);
   ImGui::Text("Uploads: %d", m_upload_count);
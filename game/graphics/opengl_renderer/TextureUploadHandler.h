@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common/dma/dma_copy.h"
+
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/opengl_renderer/DirectRenderer.h"
 #include "game/graphics/opengl_renderer/TextureAnimator.h"
@@ -18,13 +20,17 @@ class TextureUploadHandler : public BucketRenderer {
                        bool add_direct = false);
   void render(DmaFollower& dma, SharedRenderState* render_state, ScopedProfilerNode& prof) override;
   void draw_debug_window() override;
+  static void snapshot_ee_reads(const DmaData& chain,
+                                const u8* ee_mem,
+                                u32 s7_ptr,
+                                EeSnapshot* out);
 
  private:
   struct TextureUpload {
     u64 page;
     s64 mode;
   };
-  void flush_uploads(std::vector<TextureUpload>& uploads, SharedRenderState* render_state);
+  void flush_uploads(std::vector<const u8*>& uploads, SharedRenderState* render_state);
   bool m_fake_uploads = false;
   int m_upload_count = 0;
   std::shared_ptr<TextureAnimator> m_texture_animator;
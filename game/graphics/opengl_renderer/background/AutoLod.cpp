@@ -0,0 +1,240 @@
+#include "AutoLod.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/util/Assert.h"
+
+#include "third-party/imgui/imgui.h"
+#include "third-party/zstd/lib/common/xxhash.h"
+
+namespace {
+// spheres closer than this (or behind the camera) always use the best geometry.
+constexpr float kNearW = 1.f;
+}  // namespace
+
+u64 AutoLodSettings::hash() const {
+  float data[7] = {thresholds[0],
+                   thresholds[1],
+                   thresholds[2],
+                   hysteresis,
+                   (float)tri_budget,
+                   enable ? 1.f : 0.f,
+                   use_budget ? 1.f : 0.f};
+  return XXH64(data, sizeof(data), 0);
+}
+
+void AutoLodSettings::draw_debug_window() {
+  ImGui::Checkbox("Auto LOD", &enable);
+  if (enable) {
+    ImGui::SliderFloat3("LOD radius (px)", thresholds, 0.f, 128.f);
+    ImGui::SliderFloat("LOD hysteresis", &hysteresis, 0.f, 0.5f);
+    ImGui::Checkbox("Triangle budget", &use_budget);
+    if (use_budget) {
+      ImGui::SameLine();
+      ImGui::InputInt("tris", &tri_budget, 10000, 100000);
+    }
+  }
+}
+
+void AutoLod::init(int num_trees, int num_geoms) {
+  ASSERT(num_geoms > 0 && num_geoms <= kMaxGeoms);
+  m_num_geoms = num_geoms;
+  m_trees.clear();
+  m_trees.resize(num_trees);
+}
+
+/*!
+ * Count the triangles that each leaf draws in the given geom. Must be called for every tree and
+ * geom after init.
+ */
+void AutoLod::set_tree_geom(int tree,
+                            int geom,
+                            const tfrag3::BVH& bvh,
+                            const std::vector<tfrag3::StripDraw>& draws) {
+  auto& t = m_trees.at(tree);
+  auto& tris = t.tris_per_leaf.at(geom);
+  tris.assign(bvh.vis_nodes.size(), 0);
+  for (auto& draw : draws) {
+    for (auto& grp : draw.vis_groups) {
+      if (grp.vis_idx_in_pc_bvh != UINT16_MAX) {
+        tris.at(grp.vis_idx_in_pc_bvh) += grp.num_tris;
+      } else {
+        t.has_always_visible = true;
+      }
+    }
+  }
+  t.lod.assign(bvh.vis_nodes.size(), UINT8_MAX);
+  t.last_lod.assign(bvh.vis_nodes.size(), UINT8_MAX);
+  t.size.assign(bvh.vis_nodes.size(), 0);
+}
+
+/*!
+ * Start a new selection. Groups that aren't in the BVH are drawn with fallback_geom when no leaf of
+ * their tree is visible, which is always the case for trees without leaves.
+ */
+void AutoLod::begin_frame(const math::Vector4f camera[4],
+                          float fog_constant,
+                          const AutoLodSettings& settings,
+                          int fallback_geom) {
+  ASSERT(fallback_geom >= 0 && fallback_geom < m_num_geoms);
+  m_fallback_geom = fallback_geom;
+  for (int i = 0; i < 4; i++) {
+    m_camera[i] = camera[i];
+  }
+  // radius in GS units is radius * (length of camera x row) * fog / w.
+  float x_row = std::sqrt(camera[0].x() * camera[0].x() + camera[1].x() * camera[1].x() +
+                          camera[2].x() * camera[2].x());
+  m_size_scale = x_row * std::abs(fog_constant);
+  m_settings = settings;
+  m_stats = Stats();
+  for (auto& tree : m_trees) {
+    std::fill(tree.lod.begin(), tree.lod.end(), UINT8_MAX);
+    tree.leaves_per_geom = {};
+  }
+}
+
+/*!
+ * The geom for a leaf of this projected size, with the thresholds multiplied by scale.
+ */
+int AutoLod::lod_for_size(float size, float scale) const {
+  int lod = 0;
+  while (lod < m_num_geoms - 1 && lod < 3 && size < m_settings.thresholds[lod] * scale) {
+    lod++;
+  }
+  return lod;
+}
+
+/*!
+ * Pick a geom for each visible leaf of a tree. Leaves only switch geom once their size is past the
+ * threshold by the hysteresis fraction.
+ */
+void AutoLod::select(int tree, const tfrag3::BVH& bvh, const u8* vis) {
+  auto& t = m_trees.at(tree);
+  ASSERT(t.lod.size() == bvh.vis_nodes.size());
+  for (size_t i = 0; i < bvh.vis_nodes.size(); i++) {
+    const auto& node = bvh.vis_nodes[i];
+    if (node.flags || !vis[i]) {
+      continue;
+    }
+    const auto& sphere = node.bsphere;
+    float w = -(m_camera[3].w() + m_camera[0].w() * sphere.x() + m_camera[1].w() * sphere.y() +
+                m_camera[2].w() * sphere.z());
+    u8 lod = 0;
+    if (w > kNearW) {
+      float size = sphere.w() * m_size_scale / w;
+      t.size[i] = size;
+      int coarse = lod_for_size(size, 1.f + m_settings.hysteresis);
+      int fine = lod_for_size(size, 1.f - m_settings.hysteresis);
+      if (t.last_lod[i] == UINT8_MAX) {
+        lod = lod_for_size(size, 1.f);
+      } else {
+        lod = std::clamp((int)t.last_lod[i], fine, coarse);
+      }
+    } else {
+      t.size[i] = INFINITY;
+    }
+    t.lod[i] = lod;
+  }
+}
+
+/*!
+ * Apply the triangle budget, then record the selection for hysteresis and stats.
+ */
+void AutoLod::finish_frame() {
+  if (m_settings.use_budget) {
+    apply_budget();
+  }
+  for (auto& t : m_trees) {
+    for (size_t i = 0; i < t.lod.size(); i++) {
+      u8 lod = t.lod[i];
+      if (lod == UINT8_MAX) {
+        continue;
+      }
+      t.last_lod[i] = lod;
+      t.leaves_per_geom[lod]++;
+      m_stats.leaves[lod]++;
+      m_stats.tris[lod] += t.tris_per_leaf[lod][i];
+    }
+  }
+}
+
+/*!
+ * Coarsen the smallest leaves, one geom at a time, until the total is under the budget.
+ */
+void AutoLod::apply_budget() {
+  struct Candidate {
+    float size;
+    u32 tree;
+    u32 leaf;
+  };
+  std::vector<Candidate> candidates;
+  u64 total = 0;
+  for (u32 ti = 0; ti < m_trees.size(); ti++) {
+    auto& t = m_trees[ti];
+    for (u32 i = 0; i < t.lod.size(); i++) {
+      if (t.lod[i] != UINT8_MAX) {
+        total += t.tris_per_leaf[t.lod[i]][i];
+        candidates.push_back({t.size[i], ti, i});
+      }
+    }
+  }
+  if (total <= (u64)std::max(0, m_settings.tri_budget)) {
+    return;
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) { return a.size < b.size; });
+
+  bool changed = true;
+  while (total > (u64)m_settings.tri_budget && changed) {
+    changed = false;
+    for (auto& c : candidates) {
+      auto& t = m_trees[c.tree];
+      u8& lod = t.lod[c.leaf];
+      if (lod + 1 >= m_num_geoms) {
+        continue;
+      }
+      total -= t.tris_per_leaf[lod][c.leaf];
+      lod++;
+      total += t.tris_per_leaf[lod][c.leaf];
+      m_stats.budget_coarsened++;
+      changed = true;
+      if (total <= (u64)m_settings.tri_budget) {
+        break;
+      }
+    }
+  }
+}
+
+/*!
+ * The geom that draws the groups of a tree that aren't in the BVH. Every geom would draw them, so
+ * only the lowest geom in use does, or the fallback geom if no leaf is visible.
+ */
+int AutoLod::always_visible_geom(int tree) const {
+  const auto& t = m_trees.at(tree);
+  for (int geom = 0; geom < m_num_geoms; geom++) {
+    if (t.leaves_per_geom[geom] > 0) {
+      return geom;
+    }
+  }
+  return m_fallback_geom;
+}
+
+/*!
+ * Does the tree of this geom draw anything: leaves that picked it, or the groups that aren't in the
+ * BVH.
+ */
+bool AutoLod::geom_used(int tree, int geom) const {
+  const auto& t = m_trees.at(tree);
+  return t.leaves_per_geom[geom] > 0 || (t.has_always_visible && always_visible_geom(tree) == geom);
+}
+
+/*!
+ * Make a vis string for one geom of a tree: leaves are visible only if they picked this geom.
+ */
+void AutoLod::write_vis(int tree, int geom, const tfrag3::BVH& bvh, u8* out) const {
+  const auto& t = m_trees.at(tree);
+  for (size_t i = 0; i < bvh.vis_nodes.size(); i++) {
+    out[i] = bvh.vis_nodes[i].flags ? 1 : (t.lod[i] == geom);
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "common/custom_data/Tfrag3Data.h"
+#include "common/math/Vector.h"
+
+/*!
+ * Settings for picking the geometry level of each BVH leaf automatically, instead of using the
+ * global lod_tie/lod_tfrag setting for everything.
+ */
+struct AutoLodSettings {
+  bool enable = false;
+  // a leaf moves to the next coarser geometry when its projected radius, in PS2 pixels (GS units),
+  // drops below these.
+  float thresholds[3] = {48.f, 24.f, 12.f};
+  // fraction of the threshold that the size must move past before switching back, to avoid popping.
+  float hysteresis = 0.2f;
+  // coarsen the smallest leaves further until the visible triangle count is under tri_budget.
+  bool use_budget = false;
+  int tri_budget = 300000;
+
+  u64 hash() const;
+  void draw_debug_window();
+};
+
+/*!
+ * Per-leaf LOD selection for a set of trees with multiple geometry levels that share a BVH (the
+ * extractor builds the same vis tree for every geom). The selection for each leaf is turned into a
+ * per-geom vis string, so the existing draw list builders only emit the leaves using that geom.
+ * Groups that aren't in the BVH are drawn by only one geom of each tree, see always_visible_geom.
+ */
+class AutoLod {
+ public:
+  static constexpr int kMaxGeoms = 4;
+
+  struct Stats {
+    std::array<u32, kMaxGeoms> leaves = {};
+    std::array<u32, kMaxGeoms> tris = {};
+    u32 budget_coarsened = 0;
+  };
+
+  void init(int num_trees, int num_geoms);
+  void set_tree_geom(int tree,
+                     int geom,
+                     const tfrag3::BVH& bvh,
+                     const std::vector<tfrag3::StripDraw>& draws);
+
+  void begin_frame(const math::Vector4f camera[4],
+                   float fog_constant,
+                   const AutoLodSettings& settings,
+                   int fallback_geom);
+  void select(int tree, const tfrag3::BVH& bvh, const u8* vis);
+  void finish_frame();
+
+  bool geom_used(int tree, int geom) const;
+  int always_visible_geom(int tree) const;
+  void write_vis(int tree, int geom, const tfrag3::BVH& bvh, u8* out) const;
+  const Stats& stats() const { return m_stats; }
+  int num_trees() const { return m_trees.size(); }
+
+ private:
+  int lod_for_size(float size, float scale) const;
+  void apply_budget();
+
+  struct Tree {
+    std::array<std::vector<u32>, kMaxGeoms> tris_per_leaf;
+    std::vector<u8> lod;       // this frame, UINT8_MAX if not visible
+    std::vector<u8> last_lod;  // for hysteresis, UINT8_MAX if never selected
+    std::vector<float> size;
+    std::array<u32, kMaxGeoms> leaves_per_geom = {};
+    bool has_always_visible = false;  // has groups that aren't in the BVH
+  };
+
+  std::vector<Tree> m_trees;
+  int m_num_geoms = 1;
+  int m_fallback_geom = 0;
+  math::Vector4f m_camera[4];
+  float m_size_scale = 0;
+  AutoLodSettings m_settings;
+  Stats m_stats;
+};
@@ -256,6 +256,7 @@ void Hfrag::load_hfrag_level(const std::string& load_name,
   );
   glActiveTexture(GL_TEXTURE10);
   glGenTextures(1, &lev->time_of_day_texture);
+  lev->tod_cache.invalidate();
   glBindTexture(GL_TEXTURE_1D, lev->time_of_day_texture);
   glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA, TIME_OF_DAY_COLOR_COUNT, 0, GL_RGBA,
                GL_UNSIGNED_INT_8_8_8_8, nullptr);
@@ -388,11 +389,14 @@ void Hfrag::render_hfrag_level(Hfrag::HfragLevel* lev,
   render_hfrag_montage_textures(lev, render_state, prof);
 
   // generate time of day texture
-  interp_time_of_day(pc_data.camera.itimes, lev->hfrag->time_of_day_colors, m_color_result.data());
-  glActiveTexture(GL_TEXTURE10);
-  glBindTexture(GL_TEXTURE_1D, lev->time_of_day_texture);
-  glTexSubImage1D(GL_TEXTURE_1D, 0, 0, lev->num_colors, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
-                  m_color_result.data());
+  if (lev->tod_cache.needs_update(pc_data.camera.itimes)) {
+    interp_time_of_day(pc_data.camera.itimes, lev->hfrag->time_of_day_colors,
+                       m_color_result.data());
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_1D, lev->time_of_day_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, lev->num_colors, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                    m_color_result.data());
+  }
 
   // initialize data
   glBindVertexArray(lev->vao);
@@ -29,6 +29,7 @@ class Hfrag : public BucketRenderer {
     GLuint vertex_buffer;
     GLuint index_buffer;
     GLuint time_of_day_texture;
+    TimeOfDayCache tod_cache;
     GLuint vao;
     tfrag3::Hfragment* hfrag = nullptr;
     u64 num_colors = 0;
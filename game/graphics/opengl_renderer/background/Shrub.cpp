@@ -73,22 +73,16 @@ void Shrub::update_load(const LevelData* loader_data) {
   discard_tree_cache();
   m_trees.resize(lev_data->shrub_trees.size());
 
-  size_t max_draws = 0;
   u32 time_of_day_count = 0;
-  size_t max_num_grps = 0;
   size_t max_inds = 0;
 
   for (u32 l_tree = 0; l_tree < lev_data->shrub_trees.size(); l_tree++) {
-    size_t num_grps = 0;
-
     const auto& tree = lev_data->shrub_trees[l_tree];
-    max_draws = std::max(tree.static_draws.size(), max_draws);
-    for (auto& draw : tree.static_draws) {
-      (void)draw;
-      // num_grps += draw.vis_groups.size(); TODO
-      max_num_grps += 1;
-    }
-    max_num_grps = std::max(max_num_grps, num_grps);
+    // one multidraw entry per draw.
+    m_trees[l_tree].draw_idx_temp.resize(tree.static_draws.size());
+    m_trees[l_tree].multidraw_offset_per_stripdraw.resize(tree.static_draws.size());
+    m_trees[l_tree].multidraw_count_buffer.resize(tree.static_draws.size());
+    m_trees[l_tree].multidraw_index_offset_buffer.resize(tree.static_draws.size());
 
     time_of_day_count = std::max(tree.time_of_day_colors.color_count, time_of_day_count);
     max_inds = std::max(tree.indices.size(), max_inds);
@@ -161,10 +155,6 @@ void Shrub::update_load(const LevelData* loader_data) {
     glBindVertexArray(0);
   }
 
-  m_cache.multidraw_offset_per_stripdraw.resize(max_draws);
-  m_cache.multidraw_count_buffer.resize(max_num_grps);
-  m_cache.multidraw_index_offset_buffer.resize(max_num_grps);
-  m_cache.draw_idx_temp.resize(max_draws);
   m_cache.index_temp.resize(max_inds);
   ASSERT(time_of_day_count <= TIME_OF_DAY_COLOR_COUNT);
 }
@@ -285,14 +275,19 @@ void Shrub::render_tree(int idx,
   }
 
   Timer interp_timer;
-  interp_time_of_day(settings.camera.itimes, *tree.colors, m_color_result.data());
+  bool tod_changed = tree.tod_cache.needs_update(settings.camera.itimes);
+  if (tod_changed) {
+    interp_time_of_day(settings.camera.itimes, *tree.colors, m_color_result.data());
+  }
   tree.perf.tod_time.add(interp_timer.getSeconds());
 
   Timer setup_timer;
-  glActiveTexture(GL_TEXTURE10);
-  glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
-  glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
-                  GL_UNSIGNED_INT_8_8_8_8_REV, m_color_result.data());
+  if (tod_changed) {
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
+                    GL_UNSIGNED_INT_8_8_8_8_REV, m_color_result.data());
+  }
 
   first_tfrag_draw_setup(settings.camera, render_state, ShaderId::SHRUB);
 
@@ -313,15 +308,18 @@ void Shrub::render_tree(int idx,
 
   tree.perf.cull_time.add(0);
   Timer index_timer;
-  if (render_state->no_multidraw) {
-    u32 idx_buffer_size = make_all_visible_index_list(
-        m_cache.draw_idx_temp.data(), m_cache.index_temp.data(), *tree.draws, tree.index_data);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_buffer_size * sizeof(u32), m_cache.index_temp.data(),
-                 GL_STREAM_DRAW);
-  } else {
-    make_all_visible_multidraws(m_cache.multidraw_offset_per_stripdraw.data(),
-                                m_cache.multidraw_count_buffer.data(),
-                                m_cache.multidraw_index_offset_buffer.data(), *tree.draws);
+  if (!tree.draw_list_cache.can_reuse(render_state->no_multidraw)) {
+    if (render_state->no_multidraw) {
+      u32 idx_buffer_size = make_all_visible_index_list(
+          tree.draw_idx_temp.data(), m_cache.index_temp.data(), *tree.draws, tree.index_data);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_buffer_size * sizeof(u32),
+                   m_cache.index_temp.data(), GL_STREAM_DRAW);
+    } else {
+      make_all_visible_multidraws(tree.multidraw_offset_per_stripdraw.data(),
+                                  tree.multidraw_count_buffer.data(),
+                                  tree.multidraw_index_offset_buffer.data(), *tree.draws);
+    }
+    tree.draw_list_cache.update(render_state->no_multidraw, 0);
   }
 
   tree.perf.index_time.add(index_timer.getSeconds());
@@ -333,8 +331,8 @@ void Shrub::render_tree(int idx,
     if (!tree.proto_vis_mask.at(draw.proto_idx)) {
       continue;
     }
-    const auto& multidraw_indices = m_cache.multidraw_offset_per_stripdraw[draw_idx];
-    const auto& singledraw_indices = m_cache.draw_idx_temp[draw_idx];
+    const auto& multidraw_indices = tree.multidraw_offset_per_stripdraw[draw_idx];
+    const auto& singledraw_indices = tree.draw_idx_temp[draw_idx];
 
     if (render_state->no_multidraw) {
       if (singledraw_indices.second == 0) {
@@ -365,8 +363,8 @@ void Shrub::render_tree(int idx,
                      (void*)(singledraw_indices.first * sizeof(u32)));
     } else {
       glMultiDrawElements(GL_TRIANGLE_STRIP,
-                          &m_cache.multidraw_count_buffer[multidraw_indices.first], GL_UNSIGNED_INT,
-                          &m_cache.multidraw_index_offset_buffer[multidraw_indices.first],
+                          &tree.multidraw_count_buffer[multidraw_indices.first], GL_UNSIGNED_INT,
+                          &tree.multidraw_index_offset_buffer[multidraw_indices.first],
                           multidraw_indices.second);
     }
 
@@ -386,8 +384,8 @@ void Shrub::render_tree(int idx,
                          (void*)(singledraw_indices.first * sizeof(u32)));
         } else {
           glMultiDrawElements(
-              GL_TRIANGLE_STRIP, &m_cache.multidraw_count_buffer[multidraw_indices.first],
-              GL_UNSIGNED_INT, &m_cache.multidraw_index_offset_buffer[multidraw_indices.first],
+              GL_TRIANGLE_STRIP, &tree.multidraw_count_buffer[multidraw_indices.first],
+              GL_UNSIGNED_INT, &tree.multidraw_index_offset_buffer[multidraw_indices.first],
               multidraw_indices.second);
         }
         break;
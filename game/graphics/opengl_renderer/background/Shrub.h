@@ -35,6 +35,7 @@ class Shrub : public BucketRenderer {
     GLuint index_buffer;
     GLuint single_draw_index_buffer;
     GLuint time_of_day_texture;
+    TimeOfDayCache tod_cache;
     GLuint vao;
     u32 vert_count;
     const std::vector<tfrag3::ShrubDraw>* draws = nullptr;
@@ -44,6 +45,13 @@ class Shrub : public BucketRenderer {
     std::vector<bool> proto_vis_mask;
     std::unordered_map<std::string, std::vector<u32>> proto_name_to_idx;
 
+    // shrubs aren't culled, so the draw lists only need to be built once.
+    DrawListCache draw_list_cache;
+    std::vector<std::pair<int, int>> draw_idx_temp;
+    std::vector<std::pair<int, int>> multidraw_offset_per_stripdraw;
+    std::vector<GLsizei> multidraw_count_buffer;
+    std::vector<void*> multidraw_index_offset_buffer;
+
     struct {
       u32 draws = 0;
       u32 wind_draws = 0;
@@ -71,11 +79,7 @@ class Shrub : public BucketRenderer {
   bool m_has_level = false;
 
   struct Cache {
-    std::vector<std::pair<int, int>> draw_idx_temp;
     std::vector<u32> index_temp;
-    std::vector<std::pair<int, int>> multidraw_offset_per_stripdraw;
-    std::vector<GLsizei> multidraw_count_buffer;
-    std::vector<void*> multidraw_index_offset_buffer;
   } m_cache;
   TfragPcPortData m_pc_port_data;
   const u8* m_proto_vis_data = nullptr;
@@ -0,0 +1,318 @@
+#include "SoftwareOcclusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __aarch64__
+#include "third-party/sse2neon/sse2neon.h"
+#else
+#include <immintrin.h>
+#endif
+
+#include "common/util/Assert.h"
+#include "common/util/Timer.h"
+
+namespace {
+// the buffer covers this many GS units on either side of the center (2048), which includes the
+// whole screen for both games.
+constexpr float kGsExtent = 256.f;
+constexpr float kPixelsPerGsX = SoftwareOcclusionBuffer::kWidth / (2.f * kGsExtent);
+constexpr float kPixelsPerGsY = SoftwareOcclusionBuffer::kHeight / (2.f * kGsExtent);
+// points closer than this (or behind the camera) are not projected.
+constexpr float kNearW = 1.f;
+// triangles smaller than this (in game units squared, 1 square meter) are never worth drawing
+constexpr float kMinOccluderArea = 4096.f * 4096.f;
+
+/*!
+ * Should triangles from this draw block the view? Only fully opaque draws count.
+ */
+bool is_occluder_draw(const tfrag3::StripDraw& draw) {
+  if (draw.mode.get_ab_enable()) {
+    return false;
+  }
+  if (draw.mode.get_at_enable() && draw.mode.get_alpha_test() != DrawMode::AlphaTest::ALWAYS &&
+      draw.mode.get_aref() != 0) {
+    return false;
+  }
+  return true;
+}
+
+struct OccluderCandidate {
+  float area;
+  u32 tree;
+  u32 v[3];
+};
+}  // namespace
+
+void build_occluder_mesh(const std::vector<tfrag3::TfragTree>& trees,
+                         u32 max_tris,
+                         OccluderMesh* out) {
+  out->clear();
+  std::vector<OccluderCandidate> candidates;
+
+  auto add_tri = [&](u32 tree_idx, u32 a, u32 b, u32 c) {
+    if (a == b || b == c || a == c) {
+      return;
+    }
+    const auto& verts = trees[tree_idx].unpacked.vertices;
+    math::Vector3f va(verts[a].x, verts[a].y, verts[a].z);
+    math::Vector3f vb(verts[b].x, verts[b].y, verts[b].z);
+    math::Vector3f vc(verts[c].x, verts[c].y, verts[c].z);
+    float area = 0.5f * (vb - va).cross(vc - va).length();
+    if (area >= kMinOccluderArea) {
+      candidates.push_back({area, tree_idx, {a, b, c}});
+    }
+  };
+
+  for (u32 tree_idx = 0; tree_idx < trees.size(); tree_idx++) {
+    const auto& tree = trees[tree_idx];
+    if (tree.kind != tfrag3::TFragmentTreeKind::NORMAL) {
+      continue;
+    }
+    const auto& indices = tree.unpacked.indices;
+    for (size_t draw_idx = 0; draw_idx < tree.draws.size(); draw_idx++) {
+      const auto& draw = tree.draws[draw_idx];
+      if (!is_occluder_draw(draw)) {
+        continue;
+      }
+      u32 start = draw.unpacked.idx_of_first_idx_in_full_buffer;
+      u32 end = draw_idx + 1 < tree.draws.size()
+                    ? tree.draws[draw_idx + 1].unpacked.idx_of_first_idx_in_full_buffer
+                    : indices.size();
+      if (tree.use_strips) {
+        u32 strip_len = 0;
+        for (u32 i = start; i < end; i++) {
+          if (indices[i] == UINT32_MAX) {
+            strip_len = 0;
+            continue;
+          }
+          if (++strip_len >= 3) {
+            add_tri(tree_idx, indices[i - 2], indices[i - 1], indices[i]);
+          }
+        }
+      } else {
+        for (u32 i = start; i + 2 < end; i += 3) {
+          add_tri(tree_idx, indices[i], indices[i + 1], indices[i + 2]);
+        }
+      }
+    }
+  }
+
+  if (candidates.size() > max_tris) {
+    std::nth_element(candidates.begin(), candidates.begin() + max_tris, candidates.end(),
+                     [](const auto& a, const auto& b) { return a.area > b.area; });
+    candidates.resize(max_tris);
+  }
+
+  // copy out the used vertices, sharing them between triangles of the same tree.
+  std::vector<std::vector<u32>> remap(trees.size());
+  for (auto& tri : candidates) {
+    auto& tree_remap = remap[tri.tree];
+    const auto& verts = trees[tri.tree].unpacked.vertices;
+    if (tree_remap.empty()) {
+      tree_remap.resize(verts.size(), UINT32_MAX);
+    }
+    for (u32 v : tri.v) {
+      if (tree_remap[v] == UINT32_MAX) {
+        tree_remap[v] = out->vertices.size();
+        out->vertices.emplace_back(verts[v].x, verts[v].y, verts[v].z);
+      }
+      out->indices.push_back(tree_remap[v]);
+    }
+  }
+}
+
+SoftwareOcclusionBuffer::SoftwareOcclusionBuffer() {
+  static_assert(kWidth % 4 == 0);
+  m_depth.resize(kWidth * kHeight, INFINITY);
+}
+
+math::Vector4f SoftwareOcclusionBuffer::transform(const math::Vector3f& pt) const {
+  return (m_camera[3] + m_camera[0] * pt.x() + m_camera[1] * pt.y() + m_camera[2] * pt.z()) * -1.f;
+}
+
+void SoftwareOcclusionBuffer::begin_frame(const math::Vector4f camera[4],
+                                          const math::Vector4f& hvdf_off,
+                                          float fog_constant) {
+  std::fill(m_depth.begin(), m_depth.end(), INFINITY);
+  for (int i = 0; i < 4; i++) {
+    m_camera[i] = camera[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    m_row_scale[i] = std::sqrt(camera[0][i] * camera[0][i] + camera[1][i] * camera[1][i] +
+                               camera[2][i] * camera[2][i]);
+  }
+  m_hvdf_off = hvdf_off;
+  m_fog_constant = fog_constant;
+  m_stats = Stats();
+}
+
+/*!
+ * Draw all occluder triangles into the depth buffer.
+ */
+void SoftwareOcclusionBuffer::rasterize(const OccluderMesh& mesh) {
+  Timer timer;
+  m_screen_verts.resize(mesh.vertices.size());
+  for (size_t i = 0; i < mesh.vertices.size(); i++) {
+    auto t = transform(mesh.vertices[i]);
+    auto& out = m_screen_verts[i];
+    if (t.w() < kNearW) {
+      out.z() = -1;
+      continue;
+    }
+    float q = m_fog_constant / t.w();
+    out.x() = (t.x() * q + m_hvdf_off.x() - (2048.f - kGsExtent)) * kPixelsPerGsX;
+    out.y() = (t.y() * q + m_hvdf_off.y() - (2048.f - kGsExtent)) * kPixelsPerGsY;
+    out.z() = t.w();
+  }
+
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    const auto& a = m_screen_verts[mesh.indices[i]];
+    const auto& b = m_screen_verts[mesh.indices[i + 1]];
+    const auto& c = m_screen_verts[mesh.indices[i + 2]];
+    // triangles crossing the near plane are skipped. Leaving out an occluder is always safe.
+    if (a.z() < 0 || b.z() < 0 || c.z() < 0) {
+      continue;
+    }
+    rasterize_triangle(a, b, c);
+  }
+  m_stats.occluder_tris += mesh.num_tris();
+  m_stats.raster_ms += timer.getMs();
+}
+
+/*!
+ * Draw a single triangle at the depth of its farthest vertex. The rasterization is conservative:
+ * pixels are only covered if they are entirely inside of the triangle, so objects peeking out from
+ * behind the edge of an occluder are never hidden. 4 pixels of a row are done at once.
+ */
+void SoftwareOcclusionBuffer::rasterize_triangle(const math::Vector3f& a,
+                                                 const math::Vector3f& b_in,
+                                                 const math::Vector3f& c_in) {
+  float area = (b_in.x() - a.x()) * (c_in.y() - a.y()) - (b_in.y() - a.y()) * (c_in.x() - a.x());
+  if (std::abs(area) < 1e-6f) {
+    return;
+  }
+  // make the winding consistent so all edge functions are positive inside.
+  const auto& b = area > 0 ? b_in : c_in;
+  const auto& c = area > 0 ? c_in : b_in;
+
+  int min_x = std::max(0, (int)std::floor(std::min({a.x(), b.x(), c.x()})));
+  int max_x = std::min(kWidth - 1, (int)std::floor(std::max({a.x(), b.x(), c.x()})));
+  int min_y = std::max(0, (int)std::floor(std::min({a.y(), b.y(), c.y()})));
+  int max_y = std::min(kHeight - 1, (int)std::floor(std::max({a.y(), b.y(), c.y()})));
+  if (min_x > max_x || min_y > max_y) {
+    return;
+  }
+  min_x &= ~3;
+
+  // edge function for p0 -> p1: E(x, y) = ex * x + ey * y + e0
+  // E is linear, so its smallest value over a pixel is at a corner, half a pixel from the center
+  // in x and y. Moving the edge in by that much means testing the center checks the whole pixel.
+  const math::Vector3f* pts[4] = {&a, &b, &c, &a};
+  __m128 ex[3], ey[3], e0[3];
+  for (int i = 0; i < 3; i++) {
+    const auto& p0 = *pts[i];
+    const auto& p1 = *pts[i + 1];
+    float dx = p1.x() - p0.x();
+    float dy = p1.y() - p0.y();
+    ex[i] = _mm_set1_ps(-dy);
+    ey[i] = _mm_set1_ps(dx);
+    e0[i] = _mm_set1_ps(dy * p0.x() - dx * p0.y() - 0.5f * (std::abs(dx) + std::abs(dy)));
+  }
+
+  const __m128 depth = _mm_set1_ps(std::max({a.z(), b.z(), c.z()}));
+  const __m128 inf = _mm_set1_ps(INFINITY);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 lane_offset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+  for (int y = min_y; y <= max_y; y++) {
+    __m128 py = _mm_set1_ps(y + 0.5f);
+    __m128 row[3];
+    for (int i = 0; i < 3; i++) {
+      row[i] = _mm_add_ps(_mm_mul_ps(ey[i], py), e0[i]);
+    }
+    float* dst = m_depth.data() + y * kWidth;
+    for (int x = min_x; x <= max_x; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane_offset);
+      __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[0], px), row[0]), zero);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[1], px), row[1]), zero));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ex[2], px), row[2]), zero));
+      __m128 new_depth = _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, inf));
+      _mm_storeu_ps(dst + x, _mm_min_ps(_mm_loadu_ps(dst + x), new_depth));
+    }
+  }
+}
+
+/*!
+ * Is any part of this sphere (x, y, z, radius) possibly in front of the occluders?
+ * Spheres that are close to the camera or outside of the buffer are always visible.
+ */
+bool SoftwareOcclusionBuffer::sphere_visible(const math::Vector4f& sphere) const {
+  auto t = transform(sphere.xyz());
+  float r = sphere.w();
+  float w_near = t.w() - r * m_row_scale.w();
+  if (w_near < kNearW) {
+    return true;
+  }
+  float w_far = t.w() + r * m_row_scale.w();
+
+  // bound the projection of the sphere. x / w is monotonic in both x and w (w > 0), so the extremes
+  // are at the corners of the x, w range.
+  auto project_range = [&](float center, float extent, float* lo, float* hi) {
+    float v0 = (center - extent) / w_near;
+    float v1 = (center - extent) / w_far;
+    float v2 = (center + extent) / w_near;
+    float v3 = (center + extent) / w_far;
+    float a = std::min({v0, v1, v2, v3}) * m_fog_constant;
+    float b = std::max({v0, v1, v2, v3}) * m_fog_constant;
+    *lo = std::min(a, b);
+    *hi = std::max(a, b);
+  };
+  float gx0, gx1, gy0, gy1;
+  project_range(t.x(), r * m_row_scale.x(), &gx0, &gx1);
+  project_range(t.y(), r * m_row_scale.y(), &gy0, &gy1);
+
+  float fx0 = (gx0 + m_hvdf_off.x() - (2048.f - kGsExtent)) * kPixelsPerGsX;
+  float fx1 = (gx1 + m_hvdf_off.x() - (2048.f - kGsExtent)) * kPixelsPerGsX;
+  float fy0 = (gy0 + m_hvdf_off.y() - (2048.f - kGsExtent)) * kPixelsPerGsY;
+  float fy1 = (gy1 + m_hvdf_off.y() - (2048.f - kGsExtent)) * kPixelsPerGsY;
+  if (fx1 < 0 || fy1 < 0 || fx0 >= kWidth || fy0 >= kHeight) {
+    // off screen, leave it to frustum culling.
+    return true;
+  }
+  int min_x = std::max(0, (int)std::floor(fx0)) & ~3;
+  int max_x = std::min(kWidth - 1, (int)std::floor(fx1));
+  int min_y = std::max(0, (int)std::floor(fy0));
+  int max_y = std::min(kHeight - 1, (int)std::floor(fy1));
+
+  // visible if any pixel has an occluder behind the front of the sphere. Rounding min_x down may
+  // test a few extra pixels, which can only make the answer more conservative.
+  const __m128 front = _mm_set1_ps(w_near);
+  for (int y = min_y; y <= max_y; y++) {
+    const float* src = m_depth.data() + y * kWidth;
+    for (int x = min_x; x <= max_x; x += 4) {
+      if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(src + x), front))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*!
+ * Test the leaf nodes of a frustum culled BVH against the buffer, and clear the visibility of the
+ * ones that are hidden.
+ */
+void SoftwareOcclusionBuffer::cull_bvh_leaves(const tfrag3::BVH& bvh, u8* vis) {
+  for (size_t i = 0; i < bvh.vis_nodes.size(); i++) {
+    const auto& node = bvh.vis_nodes[i];
+    if (node.flags || !vis[i]) {
+      continue;
+    }
+    m_stats.spheres_tested++;
+    if (!sphere_visible(node.bsphere)) {
+      vis[i] = 0;
+      m_stats.spheres_rejected++;
+    }
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "common/custom_data/Tfrag3Data.h"
+#include "common/math/Vector.h"
+
+/*!
+ * Triangles used as occluders by the software occlusion buffer. These are a subset of the opaque
+ * tfrag triangles of a level, picked when the level is loaded.
+ */
+struct OccluderMesh {
+  std::vector<math::Vector3f> vertices;
+  std::vector<u32> indices;  // triangle list
+  void clear() {
+    vertices.clear();
+    indices.clear();
+  }
+  u32 num_tris() const { return indices.size() / 3; }
+};
+
+/*!
+ * Build an occluder mesh from the largest opaque triangles in the given tfrag trees. The trees must
+ * be unpacked. At most max_tris triangles are kept.
+ */
+void build_occluder_mesh(const std::vector<tfrag3::TfragTree>& trees,
+                         u32 max_tris,
+                         OccluderMesh* out);
+
+/*!
+ * A low resolution depth buffer that occluders are rasterized into on the CPU, used to reject
+ * bounding spheres that are hidden behind them. The transformation matches tfrag3.vert, and depth is
+ * the w of the transformed point. Each occluder triangle is drawn with the depth of its farthest
+ * vertex, so a sphere is only rejected if it is behind all of the occluders that cover it.
+ */
+class SoftwareOcclusionBuffer {
+ public:
+  static constexpr int kWidth = 128;
+  static constexpr int kHeight = 128;
+
+  struct Stats {
+    u32 occluder_tris = 0;
+    u32 spheres_tested = 0;
+    u32 spheres_rejected = 0;
+    float raster_ms = 0;
+  };
+
+  SoftwareOcclusionBuffer();
+
+  void begin_frame(const math::Vector4f camera[4],
+                   const math::Vector4f& hvdf_off,
+                   float fog_constant);
+  void rasterize(const OccluderMesh& mesh);
+  bool sphere_visible(const math::Vector4f& sphere) const;
+  void cull_bvh_leaves(const tfrag3::BVH& bvh, u8* vis);
+
+  const Stats& stats() const { return m_stats; }
+  const float* depth() const { return m_depth.data(); }
+
+ private:
+  math::Vector4f transform(const math::Vector3f& pt) const;
+  void rasterize_triangle(const math::Vector3f& a, const math::Vector3f& b, const math::Vector3f& c);
+
+  std::vector<float> m_depth;
+  std::vector<math::Vector3f> m_screen_verts;  // pixel x, pixel y, w (negative if clipped)
+  math::Vector4f m_camera[4];
+  math::Vector4f m_row_scale;  // how much each output component can change per unit of distance
+  math::Vector4f m_hvdf_off;
+  float m_fog_constant = 0;
+  Stats m_stats;
+};
@@ -57,10 +57,6 @@ TFragment::TFragment(const std::string& name,
                         (void*)offsetof(DebugVertex, rgba)  // offset (0)
   );
   glBindVertexArray(0);
-  // regardless of how many we use some fixed max
-  // we won't actually interp or upload to gpu the unused ones, but we need a fixed maximum so
-  // indexing works properly.
-  m_color_result.resize(TIME_OF_DAY_COLOR_COUNT);
 }
 
 TFragment::~TFragment() {
@@ -71,8 +67,22 @@ TFragment::~TFragment() {
 void TFragment::render(DmaFollower& dma,
                        SharedRenderState* render_state,
                        ScopedProfilerNode& prof) {
+  prepare(dma, render_state->next_bucket, render_state, prof);
+  submit(render_state, prof);
+}
+
+/*!
+ * Read the DMA, and if the level is already set up, do culling and build the draw lists.
+ * The vis data copy writes render_state, but that bucket is always rendered with render().
+ */
+void TFragment::prepare(DmaFollower& dma,
+                        u32 bucket_end,
+                        SharedRenderState* render_state,
+                        ScopedProfilerNode& /*prof*/) {
+  m_frame_level_name.clear();
+  m_trees_ready = false;
   if (!m_enabled) {
-    while (dma.current_tag_offset() != render_state->next_bucket) {
+    while (dma.current_tag_offset() != bucket_end) {
       dma.read_and_advance();
     }
     return;
@@ -92,7 +102,7 @@ void TFragment::render(DmaFollower& dma,
     for (int i = 0; i < 4; i++) {
       dma.read_and_advance();
     }
-    ASSERT(dma.current_tag_offset() == render_state->next_bucket);
+    ASSERT(dma.current_tag_offset() == bucket_end);
     return;
   }
 
@@ -122,7 +132,7 @@ void TFragment::render(DmaFollower& dma,
     for (int i = 0; i < 4; i++) {
       dma.read_and_advance();
     }
-    ASSERT(dma.current_tag_offset() == render_state->next_bucket);
+    ASSERT(dma.current_tag_offset() == bucket_end);
     return;
   }
 
@@ -140,36 +150,58 @@ void TFragment::render(DmaFollower& dma,
     }
   }
 
-  while (dma.current_tag_offset() != render_state->next_bucket) {
+  while (dma.current_tag_offset() != bucket_end) {
     dma.read_and_advance();
   }
 
   if (level_name.empty()) {
     return;
   }
-  {
-    setup_for_level(m_tree_kinds, level_name, render_state);
-    TfragRenderSettings settings;
 
-    settings.camera = m_pc_port_data.camera;
-    settings.tree_idx = 0;
-    if (render_state->occlusion_vis[m_level_id].valid) {
-      settings.occlusion_culling = render_state->occlusion_vis[m_level_id].data;
-    }
+  m_frame_level_name = level_name;
+  m_frame_settings = TfragRenderSettings();
+  m_frame_settings.camera = m_pc_port_data.camera;
+  m_frame_settings.tree_idx = 0;
+  if (render_state->occlusion_vis[m_level_id].valid) {
+    m_frame_settings.occlusion_culling = render_state->occlusion_vis[m_level_id].data;
+  }
+  m_frame_geom = lod();
 
-    update_render_state_from_pc_settings(render_state, m_pc_port_data);
+  if (level_ready(level_name, render_state)) {
+    prepare_matching_trees(m_frame_geom, m_tree_kinds, m_frame_settings, render_state);
+    m_trees_ready = true;
+  }
+}
 
-    auto t3prof = prof.make_scoped_child("t3");
-    render_matching_trees(lod(), m_tree_kinds, settings, render_state, t3prof);
+/*!
+ * Load the level if needed, finish the culling that prepare couldn't do, and draw.
+ */
+void TFragment::submit(SharedRenderState* render_state, ScopedProfilerNode& prof) {
+  if (m_frame_level_name.empty()) {
+    return;
   }
+  setup_for_level(m_tree_kinds, m_frame_level_name, render_state);
+  update_render_state_from_pc_settings(render_state, m_pc_port_data);
 
-  while (dma.current_tag_offset() != render_state->next_bucket) {
-    auto tag = dma.current_tag().print();
-    dma.read_and_advance();
+  auto t3prof = prof.make_scoped_child("t3");
+  if (!m_trees_ready) {
+    prepare_matching_trees(m_frame_geom, m_tree_kinds, m_frame_settings, render_state);
   }
+  render_matching_trees(m_frame_geom, m_frame_settings, render_state, t3prof);
 }
 
 void TFragment::draw_debug_window() {
+  ImGui::Checkbox("Reuse Draw Lists", &m_use_draw_list_cache);
+  m_auto_lod_settings.draw_debug_window();
+  if (m_auto_lod_active) {
+    const auto& lod_stats = m_auto_lod.stats();
+    for (int i = 0; i < GEOM_MAX; i++) {
+      ImGui::Text("  geom %d: %d leaves, %d tris", i, lod_stats.leaves[i], lod_stats.tris[i]);
+    }
+    ImGui::Text("  coarsened for budget: %d", lod_stats.budget_coarsened);
+  } else if (m_auto_lod_settings.enable && !m_auto_lod_available) {
+    ImGui::Text("  auto LOD not available for this level");
+  }
   for (int i = 0; i < (int)m_cached_trees.at(lod()).size(); i++) {
     auto& tree = m_cached_trees.at(lod()).at(i);
     if (tree.kind == tfrag3::TFragmentTreeKind::INVALID) {
@@ -187,6 +219,10 @@ void TFragment::draw_debug_window() {
     if (tree.rendered_this_frame) {
       ImGui::Checkbox("freeze itimes", &tree.freeze_itimes);
       ImGui::Text("  tris: %d draws: %d", tree.tris_this_frame, tree.draws_this_frame);
+      const auto& md = tree.multidraw_stats;
+      ImGui::Text("  multidraw: %d groups, %d entries (%d merged), %d draws skipped%s",
+                  md.visible_groups, md.entries, md.merged(), md.draws_skipped,
+                  md.trees_reused ? " (reused)" : "");
       for (int j = 0; j < 4; j++) {
         ImGui::Text(" itimes[%d] 0x%x 0x%x 0x%x 0x%x", j, tree.itimes_debug[j][0],
                     tree.itimes_debug[j][1], tree.itimes_debug[j][2], tree.itimes_debug[j][3]);
@@ -269,9 +305,6 @@ void TFragment::update_load(const std::vector<tfrag3::TFragmentTreeKind>& tree_k
 
   u32 time_of_day_count = 0;
   size_t vis_temp_len = 0;
-  size_t max_draws = 0;
-  size_t max_num_grps = 0;
-  size_t max_inds = 0;
 
   for (int geom = 0; geom < GEOM_MAX; ++geom) {
     for (size_t tree_idx = 0; tree_idx < lev_data->tfrag_trees[geom].size(); tree_idx++) {
@@ -280,13 +313,15 @@ void TFragment::update_load(const std::vector<tfrag3::TFragmentTreeKind>& tree_k
       if (std::find(tree_kinds.begin(), tree_kinds.end(), tree.kind) != tree_kinds.end()) {
         auto& tree_cache = m_cached_trees[geom].emplace_back();
         tree_cache.kind = tree.kind;
-        max_draws = std::max(tree.draws.size(), max_draws);
         size_t num_grps = 0;
         for (auto& draw : tree.draws) {
           num_grps += draw.vis_groups.size();
         }
-        max_num_grps = std::max(max_num_grps, num_grps);
-        max_inds = std::max(tree.unpacked.indices.size(), max_inds);
+        tree_cache.draw_idx_temp.resize(tree.draws.size());
+        tree_cache.index_temp.resize(tree.unpacked.indices.size());
+        tree_cache.multidraw_offset_per_stripdraw.resize(tree.draws.size());
+        tree_cache.multidraw_count_buffer.resize(num_grps);
+        tree_cache.multidraw_index_offset_buffer.resize(num_grps);
         time_of_day_count = std::max(tree.colors.color_count, time_of_day_count);
         u32 verts = tree.packed_vertices.vertices.size();
         glGenVertexArrays(1, &tree_cache.vao);
@@ -297,6 +332,7 @@ void TFragment::update_load(const std::vector<tfrag3::TFragmentTreeKind>& tree_k
         tree_cache.draws = &tree.draws;  // todo - should we just copy this?
         tree_cache.colors = &tree.colors;
         tree_cache.vis = &tree.bvh;
+        tree_cache.draw_vis_ranges = make_draw_vis_ranges(tree.draws);
         tree_cache.index_data = tree.unpacked.indices.data();
         tree_cache.draw_mode = tree.use_strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
         vis_temp_len = std::max(vis_temp_len, tree.bvh.vis_nodes.size());
@@ -348,11 +384,31 @@ void TFragment::update_load(const std::vector<tfrag3::TFragmentTreeKind>& tree_k
   }
 
   m_cache.vis_temp.resize(vis_temp_len);
-  m_cache.multidraw_offset_per_stripdraw.resize(max_draws);
-  m_cache.multidraw_count_buffer.resize(max_num_grps);
-  m_cache.multidraw_index_offset_buffer.resize(max_num_grps);
-  m_cache.draw_idx_temp.resize(max_draws);
-  m_cache.index_temp.resize(max_inds);
+
+  // the extractor builds the same vis tree for every geom, so each leaf can pick its own geom.
+  m_auto_lod_available = true;
+  for (int geom = 0; geom < GEOM_MAX; ++geom) {
+    if (m_cached_trees[geom].size() != m_cached_trees[0].size()) {
+      m_auto_lod_available = false;
+      break;
+    }
+    for (size_t i = 0; i < m_cached_trees[geom].size(); i++) {
+      if (m_cached_trees[geom][i].vis->vis_nodes.size() !=
+          m_cached_trees[0][i].vis->vis_nodes.size()) {
+        m_auto_lod_available = false;
+      }
+    }
+  }
+  m_auto_lod_key = 0;
+  if (m_auto_lod_available) {
+    m_auto_lod.init(m_cached_trees[0].size(), GEOM_MAX);
+    for (int geom = 0; geom < GEOM_MAX; ++geom) {
+      for (size_t i = 0; i < m_cached_trees[geom].size(); i++) {
+        const auto& tree = m_cached_trees[geom][i];
+        m_auto_lod.set_tree_geom(i, geom, *tree.vis, *tree.draws);
+      }
+    }
+  }
   ASSERT(time_of_day_count <= TIME_OF_DAY_COLOR_COUNT);
 }
 
@@ -398,10 +454,26 @@ bool TFragment::setup_for_level(const std::vector<tfrag3::TFragmentTreeKind>& tr
   return m_has_level;
 }
 
-void TFragment::render_tree(int geom,
-                            const TfragRenderSettings& settings,
-                            SharedRenderState* render_state,
-                            ScopedProfilerNode& prof) {
+/*!
+ * Is this level already loaded and set up? If so, the trees can be prepared without touching
+ * OpenGL.
+ */
+bool TFragment::level_ready(const std::string& level,
+                            const SharedRenderState* render_state) const {
+  if (!m_has_level || m_level_name != level) {
+    return false;
+  }
+  auto lev_data = render_state->loader->get_tfrag3_level(level);
+  return lev_data && lev_data->load_id == m_load_id;
+}
+
+/*!
+ * Update time of day colors and build the draw list for a tree. Doesn't use OpenGL: the results
+ * are uploaded by render_tree.
+ */
+void TFragment::prepare_tree(int geom,
+                             const TfragRenderSettings& settings,
+                             const SharedRenderState* render_state) {
   if (!m_has_level) {
     return;
   }
@@ -418,14 +490,65 @@ void TFragment::render_tree(int geom,
 
   ASSERT(tree.kind != tfrag3::TFragmentTreeKind::INVALID);
 
-  if (m_color_result.size() < tree.colors->color_count) {
-    m_color_result.resize(tree.colors->color_count);
+  if (tree.tod_cache.needs_update(settings.camera.itimes)) {
+    if (tree.tod_colors.size() < tree.colors->color_count) {
+      tree.tod_colors.resize(tree.colors->color_count);
+    }
+    interp_time_of_day(settings.camera.itimes, *tree.colors, tree.tod_colors.data());
+    tree.tod_upload_pending = true;
+  }
+
+  // reuse the draw lists from the last frame if the culling inputs haven't changed.
+  u64 list_key = draw_list_key(settings, render_state);
+  if (!m_use_draw_list_cache) {
+    tree.draw_list_cache.valid = false;
+  }
+  if (tree.draw_list_cache.can_reuse(list_key)) {
+    tree.multidraw_stats.trees_reused++;
+    return;
+  }
+
+  if (m_auto_lod_active) {
+    m_auto_lod.write_vis(settings.tree_idx, geom, *tree.vis, m_cache.vis_temp.data());
+  } else {
+    cull_check_hierarchical(settings.camera.planes, *tree.vis, settings.occlusion_culling,
+                            m_cache.vis_temp.data());
+  }
+
+  // with auto LOD, the groups that aren't in the BVH are only drawn by one geom.
+  bool draw_always_visible =
+      !m_auto_lod_active || m_auto_lod.always_visible_geom(settings.tree_idx) == geom;
+  u32 total_tris;
+  if (render_state->no_multidraw) {
+    tree.index_upload_count = make_index_list_from_vis_string(
+        tree.draw_idx_temp.data(), tree.index_temp.data(), *tree.draws, tree.draw_vis_ranges,
+        m_cache.vis_temp, draw_always_visible, tree.index_data, &total_tris);
+    tree.index_upload_pending = true;
+  } else {
+    total_tris = make_multidraws_from_vis_string(
+        tree.multidraw_offset_per_stripdraw.data(), tree.multidraw_count_buffer.data(),
+        tree.multidraw_index_offset_buffer.data(), *tree.draws, tree.draw_vis_ranges,
+        m_cache.vis_temp, draw_always_visible, &tree.multidraw_stats);
+  }
+  tree.draw_list_cache.update(list_key, total_tris);
+}
+
+void TFragment::render_tree(int geom,
+                            const TfragRenderSettings& settings,
+                            SharedRenderState* render_state,
+                            ScopedProfilerNode& prof) {
+  if (!m_has_level) {
+    return;
+  }
+  auto& tree = m_cached_trees.at(geom).at(settings.tree_idx);
+
+  if (tree.tod_upload_pending) {
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
+                    GL_UNSIGNED_INT_8_8_8_8_REV, tree.tod_colors.data());
+    tree.tod_upload_pending = false;
   }
-  interp_time_of_day(settings.camera.itimes, *tree.colors, m_color_result.data());
-  glActiveTexture(GL_TEXTURE10);
-  glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
-  glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
-                  GL_UNSIGNED_INT_8_8_8_8_REV, m_color_result.data());
 
   first_tfrag_draw_setup(settings.camera, render_state, ShaderId::TFRAG3);
 
@@ -437,28 +560,18 @@ void TFragment::render_tree(int geom,
   glEnable(GL_PRIMITIVE_RESTART);
   glPrimitiveRestartIndex(UINT32_MAX);
 
-  cull_check_all_slow(settings.camera.planes, tree.vis->vis_nodes, settings.occlusion_culling,
-                      m_cache.vis_temp.data());
-
-  u32 total_tris;
-  if (render_state->no_multidraw) {
-    u32 idx_buffer_size = make_index_list_from_vis_string(
-        m_cache.draw_idx_temp.data(), m_cache.index_temp.data(), *tree.draws, m_cache.vis_temp,
-        tree.index_data, &total_tris);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_buffer_size * sizeof(u32), m_cache.index_temp.data(),
-                 GL_STREAM_DRAW);
-  } else {
-    total_tris = make_multidraws_from_vis_string(
-        m_cache.multidraw_offset_per_stripdraw.data(), m_cache.multidraw_count_buffer.data(),
-        m_cache.multidraw_index_offset_buffer.data(), *tree.draws, m_cache.vis_temp);
+  if (tree.index_upload_pending) {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, tree.index_upload_count * sizeof(u32),
+                 tree.index_temp.data(), GL_STREAM_DRAW);
+    tree.index_upload_pending = false;
   }
 
-  prof.add_tri(total_tris);
+  prof.add_tri(tree.draw_list_cache.num_tris);
 
   for (size_t draw_idx = 0; draw_idx < tree.draws->size(); draw_idx++) {
     const auto& draw = tree.draws->operator[](draw_idx);
-    const auto& multidraw_indices = m_cache.multidraw_offset_per_stripdraw[draw_idx];
-    const auto& singledraw_indices = m_cache.draw_idx_temp[draw_idx];
+    const auto& multidraw_indices = tree.multidraw_offset_per_stripdraw[draw_idx];
+    const auto& singledraw_indices = tree.draw_idx_temp[draw_idx];
 
     if (render_state->no_multidraw) {
       if (singledraw_indices.second == 0) {
@@ -487,9 +600,9 @@ void TFragment::render_tree(int geom,
       glDrawElements(tree.draw_mode, singledraw_indices.second, GL_UNSIGNED_INT,
                      (void*)(singledraw_indices.first * sizeof(u32)));
     } else {
-      glMultiDrawElements(tree.draw_mode, &m_cache.multidraw_count_buffer[multidraw_indices.first],
+      glMultiDrawElements(tree.draw_mode, &tree.multidraw_count_buffer[multidraw_indices.first],
                           GL_UNSIGNED_INT,
-                          &m_cache.multidraw_index_offset_buffer[multidraw_indices.first],
+                          &tree.multidraw_index_offset_buffer[multidraw_indices.first],
                           multidraw_indices.second);
     }
 
@@ -508,8 +621,8 @@ void TFragment::render_tree(int geom,
                          (void*)(singledraw_indices.first * sizeof(u32)));
         } else {
           glMultiDrawElements(
-              tree.draw_mode, &m_cache.multidraw_count_buffer[multidraw_indices.first],
-              GL_UNSIGNED_INT, &m_cache.multidraw_index_offset_buffer[multidraw_indices.first],
+              tree.draw_mode, &tree.multidraw_count_buffer[multidraw_indices.first],
+              GL_UNSIGNED_INT, &tree.multidraw_index_offset_buffer[multidraw_indices.first],
               multidraw_indices.second);
         }
         break;
@@ -533,16 +646,26 @@ void TFragment::render_all_trees(int geom,
   for (size_t i = 0; i < m_cached_trees[geom].size(); i++) {
     if (m_cached_trees[geom][i].kind != tfrag3::TFragmentTreeKind::INVALID) {
       settings_copy.tree_idx = i;
+      prepare_tree(geom, settings_copy, render_state);
       render_tree(geom, settings_copy, render_state, prof);
     }
   }
 }
 
-void TFragment::render_matching_trees(int geom,
-                                      const std::vector<tfrag3::TFragmentTreeKind>& trees,
-                                      const TfragRenderSettings& settings,
-                                      SharedRenderState* render_state,
-                                      ScopedProfilerNode& prof) {
+/*!
+ * Pick the trees to render, and prepare them. The picked trees are marked with rendered_this_frame.
+ */
+void TFragment::prepare_matching_trees(int geom,
+                                       const std::vector<tfrag3::TFragmentTreeKind>& trees,
+                                       const TfragRenderSettings& settings,
+                                       const SharedRenderState* render_state) {
+  m_auto_lod_active = m_auto_lod_settings.enable && m_auto_lod_available && m_has_level;
+  if (m_auto_lod_active) {
+    prepare_matching_trees_auto_lod(trees, settings, render_state);
+    return;
+  }
+  m_auto_lod_key = 0;
+
   TfragRenderSettings settings_copy = settings;
   for (size_t i = 0; i < m_cached_trees[geom].size(); i++) {
     auto& tree = m_cached_trees[geom][i];
@@ -553,14 +676,96 @@ void TFragment::render_matching_trees(int geom,
     if (std::find(trees.begin(), trees.end(), tree.kind) != trees.end() || tree.forced) {
       tree.rendered_this_frame = true;
       settings_copy.tree_idx = i;
-      render_tree(geom, settings_copy, render_state, prof);
-      if (tree.cull_debug) {
-        render_tree_cull_debug(settings_copy, render_state, prof);
+      prepare_tree(geom, settings_copy, render_state);
+    }
+  }
+}
+
+/*!
+ * Render the trees picked by prepare_matching_trees.
+ */
+void TFragment::render_matching_trees(int geom,
+                                      const TfragRenderSettings& settings,
+                                      SharedRenderState* render_state,
+                                      ScopedProfilerNode& prof) {
+  TfragRenderSettings settings_copy = settings;
+  for (int g = 0; g < GEOM_MAX; ++g) {
+    if (!m_auto_lod_active && g != geom) {
+      continue;
+    }
+    for (size_t i = 0; i < m_cached_trees[g].size(); i++) {
+      auto& tree = m_cached_trees[g][i];
+      if (tree.rendered_this_frame) {
+        settings_copy.tree_idx = i;
+        render_tree(g, settings_copy, render_state, prof);
+        if (tree.cull_debug && !m_auto_lod_active) {
+          render_tree_cull_debug(settings_copy, render_state, prof);
+        }
       }
     }
   }
 }
 
+/*!
+ * Prepare trees with a geom picked for each leaf. Each tree is culled once with the vis tree of
+ * geom 0, and the trees of every geom draw the leaves that picked them.
+ */
+void TFragment::prepare_matching_trees_auto_lod(const std::vector<tfrag3::TFragmentTreeKind>& trees,
+                                                const TfragRenderSettings& settings,
+                                                const SharedRenderState* render_state) {
+  // the allow/force debug settings are taken from the trees shown in the debug window.
+  auto should_render = [&](size_t i) {
+    const auto& tree = m_cached_trees[lod()][i];
+    return tree.allowed &&
+           (std::find(trees.begin(), trees.end(), tree.kind) != trees.end() || tree.forced);
+  };
+
+  u64 key = draw_list_key(settings, render_state);
+  if (!m_use_draw_list_cache || key != m_auto_lod_key) {
+    m_auto_lod.begin_frame(settings.camera.camera, settings.camera.fog.x(), m_auto_lod_settings,
+                           lod());
+    for (size_t i = 0; i < m_cached_trees[0].size(); i++) {
+      if (should_render(i)) {
+        const auto& bvh = *m_cached_trees[0][i].vis;
+        cull_check_hierarchical(settings.camera.planes, bvh, settings.occlusion_culling,
+                                m_cache.vis_temp.data());
+        m_auto_lod.select(i, bvh, m_cache.vis_temp.data());
+      }
+    }
+    m_auto_lod.finish_frame();
+    for (int geom = 0; geom < GEOM_MAX; ++geom) {
+      for (auto& tree : m_cached_trees[geom]) {
+        tree.draw_list_cache.valid = false;
+      }
+    }
+    m_auto_lod_key = key;
+  }
+
+  TfragRenderSettings settings_copy = settings;
+  for (int geom = 0; geom < GEOM_MAX; ++geom) {
+    for (size_t i = 0; i < m_cached_trees[geom].size(); i++) {
+      auto& tree = m_cached_trees[geom][i];
+      tree.reset_stats();
+      if (should_render(i) && m_auto_lod.geom_used(i, geom)) {
+        tree.rendered_this_frame = true;
+        settings_copy.tree_idx = i;
+        prepare_tree(geom, settings_copy, render_state);
+      }
+    }
+  }
+}
+
+u64 TFragment::draw_list_key(const TfragRenderSettings& settings,
+                             const SharedRenderState* render_state) const {
+  u64 key = draw_list_cache_key(settings.camera.planes, settings.occlusion_culling, nullptr, 0,
+                                (render_state->no_multidraw ? 1 : 0) |
+                                    (m_auto_lod_active ? 2 | (lod() << 2) : 0));
+  if (m_auto_lod_active) {
+    key ^= m_auto_lod_settings.hash();
+  }
+  return key;
+}
+
 void TFragment::discard_tree_cache() {
   m_textures = nullptr;
   for (int geom = 0; geom < GEOM_MAX; ++geom) {
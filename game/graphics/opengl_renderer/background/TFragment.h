@@ -5,6 +5,7 @@
 
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/opengl_renderer/DirectRenderer.h"
+#include "game/graphics/opengl_renderer/background/AutoLod.h"
 #include "game/graphics/opengl_renderer/background/Tie3.h"
 
 using math::Matrix4f;
@@ -43,6 +44,12 @@ class TFragment : public BucketRenderer {
             const std::vector<GLuint>* anim_slot_array);
   ~TFragment();
   void render(DmaFollower& dma, SharedRenderState* render_state, ScopedProfilerNode& prof) override;
+  bool can_prepare() const override { return true; }
+  void prepare(DmaFollower& dma,
+               u32 bucket_end,
+               SharedRenderState* render_state,
+               ScopedProfilerNode& prof) override;
+  void submit(SharedRenderState* render_state, ScopedProfilerNode& prof) override;
   void draw_debug_window() override;
   void init_shaders(ShaderLibrary& shaders) override;
 
@@ -51,20 +58,33 @@ class TFragment : public BucketRenderer {
                         SharedRenderState* render_state,
                         ScopedProfilerNode& prof);
 
+  void prepare_matching_trees(int geom,
+                              const std::vector<tfrag3::TFragmentTreeKind>& trees,
+                              const TfragRenderSettings& settings,
+                              const SharedRenderState* render_state);
+
   void render_matching_trees(int geom,
-                             const std::vector<tfrag3::TFragmentTreeKind>& trees,
                              const TfragRenderSettings& settings,
                              SharedRenderState* render_state,
                              ScopedProfilerNode& prof);
 
+  void prepare_tree(int geom,
+                    const TfragRenderSettings& settings,
+                    const SharedRenderState* render_state);
+
   void render_tree(int geom,
                    const TfragRenderSettings& settings,
                    SharedRenderState* render_state,
                    ScopedProfilerNode& prof);
 
+  void prepare_matching_trees_auto_lod(const std::vector<tfrag3::TFragmentTreeKind>& trees,
+                                       const TfragRenderSettings& settings,
+                                       const SharedRenderState* render_state);
+
   bool setup_for_level(const std::vector<tfrag3::TFragmentTreeKind>& tree_kinds,
                        const std::string& level,
                        SharedRenderState* render_state);
+  bool level_ready(const std::string& level, const SharedRenderState* render_state) const;
   void discard_tree_cache();
 
   void render_tree_cull_debug(const TfragRenderSettings& settings,
@@ -82,6 +102,8 @@ class TFragment : public BucketRenderer {
 
  private:
   void handle_initialization(DmaFollower& dma);
+  u64 draw_list_key(const TfragRenderSettings& settings,
+                    const SharedRenderState* render_state) const;
   bool m_child_mode = false;
 
   // GS setup data
@@ -119,22 +141,40 @@ class TFragment : public BucketRenderer {
     GLuint index_buffer = -1;
     GLuint single_draw_index_buffer = -1;
     GLuint time_of_day_texture = -1;
+    TimeOfDayCache tod_cache;
     GLuint vao = -1;
     u32 vert_count = 0;
     const std::vector<tfrag3::StripDraw>* draws = nullptr;
     const tfrag3::PackedTimeOfDay* colors = nullptr;
     const tfrag3::BVH* vis = nullptr;
     const u32* index_data = nullptr;
+    std::vector<DrawVisRange> draw_vis_ranges;
     u64 draw_mode = 0;
 
+    // draw lists, kept per tree so they can be reused when the culling inputs don't change.
+    DrawListCache draw_list_cache;
+    std::vector<std::pair<int, int>> draw_idx_temp;
+    std::vector<std::pair<int, int>> multidraw_offset_per_stripdraw;
+    std::vector<GLsizei> multidraw_count_buffer;
+    std::vector<void*> multidraw_index_offset_buffer;
+
+    // results of prepare_tree that are uploaded by render_tree.
+    std::vector<math::Vector<u8, 4>> tod_colors;
+    bool tod_upload_pending = false;
+    std::vector<u32> index_temp;
+    u32 index_upload_count = 0;
+    bool index_upload_pending = false;
+
     void reset_stats() {
       rendered_this_frame = false;
       tris_this_frame = 0;
       draws_this_frame = 0;
+      multidraw_stats.reset();
     }
     bool rendered_this_frame = false;
     int tris_this_frame = 0;
     int draws_this_frame = 0;
+    MultidrawStats multidraw_stats;
     bool allowed = true;
     bool forced = false;
     bool cull_debug = false;
@@ -149,20 +189,22 @@ class TFragment : public BucketRenderer {
 
   struct Cache {
     std::vector<u8> vis_temp;
-    std::vector<std::pair<int, int>> draw_idx_temp;
-    std::vector<u32> index_temp;
-    std::vector<std::pair<int, int>> multidraw_offset_per_stripdraw;
-    std::vector<GLsizei> multidraw_count_buffer;
-    std::vector<void*> multidraw_index_offset_buffer;
   } m_cache;
 
+  bool m_use_draw_list_cache = true;
+
+  // per-leaf LOD selection, used instead of lod() when enabled.
+  AutoLodSettings m_auto_lod_settings;
+  AutoLod m_auto_lod;
+  bool m_auto_lod_available = false;
+  bool m_auto_lod_active = false;
+  u64 m_auto_lod_key = 0;
+
   std::string m_level_name;
 
   const std::vector<GLuint>* m_textures = nullptr;
   std::array<std::vector<TreeCache>, GEOM_MAX> m_cached_trees;
 
-  std::vector<math::Vector<u8, 4>> m_color_result;
-
   GLuint m_debug_vao = -1;
   GLuint m_debug_verts = -1;
 
@@ -177,4 +219,10 @@ class TFragment : public BucketRenderer {
 
   bool m_has_level = false;
   const std::vector<GLuint>* m_anim_slot_array;
+
+  // set by prepare: the level in this frame's DMA (empty if none), and if the trees are prepared.
+  std::string m_frame_level_name;
+  TfragRenderSettings m_frame_settings;
+  int m_frame_geom = 0;
+  bool m_trees_ready = false;
 };
@@ -1,5 +1,11 @@
 #include "Tie3.h"
 
+#ifdef __aarch64__
+#include "third-party/sse2neon/sse2neon.h"
+#else
+#include <immintrin.h>
+#endif
+
 #include "common/global_profiler/GlobalProfiler.h"
 #include "common/log/log.h"
 #include "common/util/Assert.h"
@@ -8,11 +14,6 @@
 
 Tie3::Tie3(const std::string& name, int my_id, int level_id, tfrag3::TieCategory category)
     : BucketRenderer(name, my_id), m_level_id(level_id), m_default_category(category) {
-  // regardless of how many we use some fixed max
-  // we won't actually interp or upload to gpu the unused ones, but we need a fixed maximum so
-  // indexing works properly.
-  m_color_result.resize(TIME_OF_DAY_COLOR_COUNT);
-
   m_wind_data.paused = 0;
   math::Vector4f ones(1, 1, 1, 1);
   m_wind_data.wind_normal = ones;
@@ -31,6 +32,15 @@ Tie3::~Tie3() {
 
 void Tie3::init_shaders(ShaderLibrary& shaders) {
   m_uniforms.decal = glGetUniformLocation(shaders[ShaderId::TFRAG3].id(), "decal");
+  m_uniforms.camera = glGetUniformLocation(shaders[ShaderId::TFRAG3].id(), "camera");
+  m_uniforms.alpha_min = glGetUniformLocation(shaders[ShaderId::TFRAG3].id(), "alpha_min");
+  m_uniforms.alpha_max = glGetUniformLocation(shaders[ShaderId::TFRAG3].id(), "alpha_max");
+
+  m_wind_uniforms.decal = glGetUniformLocation(shaders[ShaderId::TFRAG3_WIND].id(), "decal");
+  m_wind_uniforms.alpha_min =
+      glGetUniformLocation(shaders[ShaderId::TFRAG3_WIND].id(), "alpha_min");
+  m_wind_uniforms.alpha_max =
+      glGetUniformLocation(shaders[ShaderId::TFRAG3_WIND].id(), "alpha_max");
 
   m_etie_uniforms.persp0 = glGetUniformLocation(shaders[ShaderId::ETIE].id(), "persp0");
   m_etie_uniforms.persp1 = glGetUniformLocation(shaders[ShaderId::ETIE].id(), "persp1");
@@ -100,6 +110,7 @@ void Tie3::load_from_fr3_data(const LevelData* loader_data) {
       lod_tree[l_tree].colors = &tree.colors;
       // visibility BVH from FR3
       lod_tree[l_tree].vis = &tree.bvh;
+      lod_tree[l_tree].draw_vis_ranges = make_draw_vis_ranges(tree.static_draws);
       // indices from FR3 (needed on CPU for culling)
       lod_tree[l_tree].index_data = tree.unpacked.indices.data();
       // wind metadata
@@ -169,6 +180,33 @@ void Tie3::load_from_fr3_data(const LevelData* loader_data) {
           lod_tree[l_tree].wind_vertex_index_offsets.push_back(off);
           off += draw.vertex_index_stream.size();
         }
+
+        // all groups for an instance share the same vis node, so we can check visibility once per
+        // instance, and skip the wind math for ones that won't be drawn.
+        auto& inst_vis = lod_tree[l_tree].wind_instance_vis_idx;
+        inst_vis.assign(tree.wind_instance_info.size(), UINT32_MAX);
+        for (auto& draw : tree.instanced_wind_draws) {
+          for (auto& grp : draw.instance_groups) {
+            inst_vis.at(grp.instance_idx) = grp.vis_idx;
+          }
+        }
+        lod_tree[l_tree].visible_wind_instances.reserve(tree.wind_instance_info.size());
+        lod_tree[l_tree].wind_instance_slot.resize(tree.wind_instance_info.size());
+
+        // buffer of per-instance matrices for the instanced path, read as a mat4 at locations 5-8.
+        glGenBuffers(1, &lod_tree[l_tree].wind_matrix_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, lod_tree[l_tree].wind_matrix_buffer);
+        glBufferData(GL_ARRAY_BUFFER,
+                     tree.wind_instance_info.size() * sizeof(std::array<math::Vector4f, 4>),
+                     nullptr, GL_STREAM_DRAW);
+        for (int i = 0; i < 4; i++) {
+          glEnableVertexAttribArray(5 + i);
+          glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(std::array<math::Vector4f, 4>),
+                                (void*)(i * sizeof(math::Vector4f)));
+          glVertexAttribDivisor(5 + i, 1);
+        }
+        glGenBuffers(1, &lod_tree[l_tree].wind_indirect_buffer);
+        lod_tree[l_tree].wind_draw_ranges.resize(tree.instanced_wind_draws.size());
       }
 
       // set up per-proto visibility. Jak 2 needs to enable/disable individual protos.
@@ -198,6 +236,37 @@ void Tie3::load_from_fr3_data(const LevelData* loader_data) {
     }
   }
 
+  // the occluder mesh is only built once occlusion is enabled, see setup_all_trees.
+  m_occluders.clear();
+  m_occluder_level = lev_data;
+  m_occluders_built = false;
+
+  // the extractor builds the same vis tree for every geom, so each leaf can pick its own geom.
+  m_auto_lod_available = true;
+  for (u32 l_geo = 0; l_geo < tfrag3::TIE_GEOS; l_geo++) {
+    const auto& trees = lev_data->tie_trees[l_geo];
+    if (trees.size() != lev_data->tie_trees[0].size()) {
+      m_auto_lod_available = false;
+      break;
+    }
+    for (u32 l_tree = 0; l_tree < trees.size(); l_tree++) {
+      if (trees[l_tree].bvh.vis_nodes.size() !=
+          lev_data->tie_trees[0][l_tree].bvh.vis_nodes.size()) {
+        m_auto_lod_available = false;
+      }
+    }
+  }
+  m_auto_lod_key = 0;
+  if (m_auto_lod_available) {
+    m_auto_lod.init(lev_data->tie_trees[0].size(), tfrag3::TIE_GEOS);
+    for (u32 l_geo = 0; l_geo < tfrag3::TIE_GEOS; l_geo++) {
+      for (u32 l_tree = 0; l_tree < lev_data->tie_trees[l_geo].size(); l_tree++) {
+        const auto& tree = lev_data->tie_trees[l_geo][l_tree];
+        m_auto_lod.set_tree_geom(l_tree, l_geo, tree.bvh, tree.static_draws);
+      }
+    }
+  }
+
   // set up temporary caches. These are just temporary, so they don't need per-tree versions.
 
   m_wind_vectors.resize(4 * max_wind_idx + 4);  // 4x u32's per wind.
@@ -251,6 +320,18 @@ bool Tie3::try_loading_level(const std::string& level, SharedRenderState* render
   return m_has_level;
 }
 
+/*!
+ * Is the level from this frame's DMA already loaded and set up? If so, the trees can be set up
+ * without touching OpenGL.
+ */
+bool Tie3::level_ready(const SharedRenderState* render_state) const {
+  if (!m_has_level || m_level_name != m_pc_port_data.level_name) {
+    return false;
+  }
+  auto lev_data = render_state->loader->get_tfrag3_level(m_level_name);
+  return lev_data && lev_data->load_id == m_load_id;
+}
+
 void Tie3::discard_tree_cache() {
   for (int geo = 0; geo < 4; ++geo) {
     for (auto& tree : m_trees[geo]) {
@@ -258,6 +339,8 @@ void Tie3::discard_tree_cache() {
       glDeleteTextures(1, &tree.time_of_day_texture);
       // glDeleteBuffers(1, &tree.index_buffer);
       glDeleteBuffers(1, &tree.single_draw_index_buffer);
+      glDeleteBuffers(1, &tree.wind_matrix_buffer);
+      glDeleteBuffers(1, &tree.wind_indirect_buffer);
       glDeleteVertexArrays(1, &tree.vao);
     }
 
@@ -265,7 +348,9 @@ void Tie3::discard_tree_cache() {
   }
 }
 
-bool Tie3::set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* render_state) {
+bool Tie3::set_up_common_data_from_dma(DmaFollower& dma,
+                                        u32 bucket_end,
+                                        const SharedRenderState* render_state) {
   auto data0 = dma.read_and_advance();
   ASSERT(data0.vif1() == 0 || data0.vifcode1().kind == VifCode::Kind::NOP);
   ASSERT(data0.vif0() == 0 || data0.vifcode0().kind == VifCode::Kind::NOP ||
@@ -277,11 +362,11 @@ bool Tie3::set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* rend
     for (int i = 0; i < 4; i++) {
       dma.read_and_advance();
     }
-    ASSERT(dma.current_tag_offset() == render_state->next_bucket);
+    ASSERT(dma.current_tag_offset() == bucket_end);
     return false;
   }
 
-  if (dma.current_tag_offset() == render_state->next_bucket) {
+  if (dma.current_tag_offset() == bucket_end) {
     return false;
   }
 
@@ -336,7 +421,7 @@ bool Tie3::set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* rend
 
   m_common_data.frame_idx = render_state->frame_idx;
 
-  while (dma.current_tag_offset() != render_state->next_bucket) {
+  while (dma.current_tag_offset() != bucket_end) {
     dma.read_and_advance();
   }
 
@@ -350,9 +435,6 @@ bool Tie3::set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* rend
     m_common_data.settings.occlusion_culling = 0;
   }
 
-  update_render_state_from_pc_settings(render_state, m_pc_port_data);
-
-  m_has_level = try_loading_level(m_pc_port_data.level_name, render_state);
   return true;
 }
 /*!
@@ -360,20 +442,50 @@ bool Tie3::set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* rend
  * Does common setup for all category, but only renderers default_category.
  */
 void Tie3::render(DmaFollower& dma, SharedRenderState* render_state, ScopedProfilerNode& prof) {
+  prepare(dma, render_state->next_bucket, render_state, prof);
+  submit(render_state, prof);
+}
+
+/*!
+ * Read the DMA, and if the level is already set up, do culling and build the draw lists.
+ */
+void Tie3::prepare(DmaFollower& dma,
+                   u32 bucket_end,
+                   SharedRenderState* render_state,
+                   ScopedProfilerNode& prof) {
+  m_has_frame_data = false;
+  m_trees_ready = false;
   if (!m_enabled) {
-    while (dma.current_tag_offset() != render_state->next_bucket) {
+    while (dma.current_tag_offset() != bucket_end) {
       dma.read_and_advance();
     }
     return;
   }
 
-  if (set_up_common_data_from_dma(dma, render_state)) {
+  m_has_frame_data = set_up_common_data_from_dma(dma, bucket_end, render_state);
+  if (m_has_frame_data && level_ready(render_state)) {
     setup_all_trees(lod(), m_common_data.settings, m_common_data.proto_vis_data,
                     m_common_data.proto_vis_data_size, !render_state->no_multidraw, prof);
+    m_trees_ready = true;
+  }
+}
 
-    draw_matching_draws_for_all_trees(lod(), m_common_data.settings, render_state, prof,
-                                      m_default_category);
+/*!
+ * Load the level if needed, finish the setup that prepare couldn't do, and draw.
+ */
+void Tie3::submit(SharedRenderState* render_state, ScopedProfilerNode& prof) {
+  if (!m_has_frame_data) {
+    return;
+  }
+  update_render_state_from_pc_settings(render_state, m_pc_port_data);
+  m_has_level = try_loading_level(m_pc_port_data.level_name, render_state);
+  if (!m_trees_ready) {
+    setup_all_trees(lod(), m_common_data.settings, m_common_data.proto_vis_data,
+                    m_common_data.proto_vis_data_size, !render_state->no_multidraw, prof);
   }
+
+  draw_matching_draws_for_all_trees(lod(), m_common_data.settings, render_state, prof,
+                                    m_default_category);
 }
 
 void Tie3::render_from_another(SharedRenderState* render_state,
@@ -390,6 +502,16 @@ void Tie3::draw_matching_draws_for_all_trees(int geom,
                                              SharedRenderState* render_state,
                                              ScopedProfilerNode& prof,
                                              tfrag3::TieCategory category) {
+  if (m_auto_lod_active) {
+    for (int lod_geom = 0; lod_geom < tfrag3::TIE_GEOS; lod_geom++) {
+      for (u32 i = 0; i < m_trees[lod_geom].size(); i++) {
+        if (m_trees[lod_geom][i].lod_in_use) {
+          draw_matching_draws_for_tree(i, lod_geom, settings, render_state, prof, category);
+        }
+      }
+    }
+    return;
+  }
   for (u32 i = 0; i < m_trees[geom].size(); i++) {
     draw_matching_draws_for_tree(i, geom, settings, render_state, prof, category);
   }
@@ -401,18 +523,103 @@ void Tie3::setup_all_trees(int geom,
                            size_t proto_vis_data_size,
                            bool use_multidraw,
                            ScopedProfilerNode& prof) {
+  m_multidraw_stats.reset();
+  bool software_occlusion = m_use_software_occlusion && !m_debug_all_visible;
+  m_auto_lod_active =
+      m_auto_lod_settings.enable && m_auto_lod_available && m_has_level && !m_debug_all_visible;
+  m_draw_list_key = draw_list_cache_key(
+      settings.camera.planes, settings.occlusion_culling, proto_vis_data, proto_vis_data_size,
+      (use_multidraw ? 1 : 0) | (m_debug_all_visible ? 2 : 0) | (software_occlusion ? 4 : 0) |
+          (m_auto_lod_active ? 8 | (geom << 4) : 0));
+
+  // culling only needs to run if some tree can't reuse its draw lists.
+  bool any_rebuild = false;
+  if (m_auto_lod_active) {
+    m_draw_list_key ^= m_auto_lod_settings.hash();
+    any_rebuild = !m_use_draw_list_cache || m_auto_lod_key != m_draw_list_key;
+  } else {
+    m_auto_lod_key = 0;
+    for (auto& tree : m_trees[geom]) {
+      if (!m_use_draw_list_cache || !tree.draw_list_cache.can_reuse(m_draw_list_key)) {
+        any_rebuild = true;
+        break;
+      }
+    }
+  }
+
+  if (software_occlusion && m_has_level && any_rebuild) {
+    if (!m_occluders_built) {
+      if (!m_occluder_level->tfrag_trees[0].empty()) {
+        build_occluder_mesh(m_occluder_level->tfrag_trees[0], kMaxOccluderTris, &m_occluders);
+      }
+      m_occluders_built = true;
+    }
+    m_occlusion_buffer.begin_frame(settings.camera.camera, settings.camera.hvdf_off,
+                                   settings.camera.fog.x());
+    m_occlusion_buffer.rasterize(m_occluders);
+  }
+
+  if (m_auto_lod_active) {
+    if (any_rebuild) {
+      setup_auto_lod(geom, settings);
+    }
+    for (int lod_geom = 0; lod_geom < tfrag3::TIE_GEOS; lod_geom++) {
+      for (u32 i = 0; i < m_trees[lod_geom].size(); i++) {
+        if (m_trees[lod_geom][i].lod_in_use) {
+          setup_tree(i, lod_geom, settings, proto_vis_data, proto_vis_data_size, use_multidraw,
+                     prof, true);
+        }
+      }
+    }
+    return;
+  }
+
   for (u32 i = 0; i < m_trees[geom].size(); i++) {
     setup_tree(i, geom, settings, proto_vis_data, proto_vis_data_size, use_multidraw, prof);
   }
 }
 
+/*!
+ * Cull each tree once, pick a geom for each visible leaf, and write the vis strings for the trees
+ * of every geom. The draw lists of the trees that are used get rebuilt by setup_tree. Trees
+ * without visible leaves draw their groups that aren't in the BVH with fallback_geom.
+ */
+void Tie3::setup_auto_lod(int fallback_geom, const TfragRenderSettings& settings) {
+  m_auto_lod.begin_frame(settings.camera.camera, settings.camera.fog.x(), m_auto_lod_settings,
+                         fallback_geom);
+  for (u32 i = 0; i < m_trees[0].size(); i++) {
+    const auto& bvh = *m_trees[0][i].vis;
+    m_auto_lod_vis_temp.resize(bvh.vis_nodes.size());
+    cull_check_hierarchical(settings.camera.planes, bvh, settings.occlusion_culling,
+                            m_auto_lod_vis_temp.data());
+    if (m_use_software_occlusion) {
+      m_occlusion_buffer.cull_bvh_leaves(bvh, m_auto_lod_vis_temp.data());
+    }
+    m_auto_lod.select(i, bvh, m_auto_lod_vis_temp.data());
+  }
+  m_auto_lod.finish_frame();
+
+  for (int geom = 0; geom < tfrag3::TIE_GEOS; geom++) {
+    for (u32 i = 0; i < m_trees[geom].size(); i++) {
+      auto& tree = m_trees[geom][i];
+      tree.lod_in_use = m_auto_lod.geom_used(i, geom);
+      tree.draw_list_cache.valid = false;
+      if (tree.lod_in_use) {
+        m_auto_lod.write_vis(i, geom, *tree.vis, tree.vis_temp.data());
+      }
+    }
+  }
+  m_auto_lod_key = m_draw_list_key;
+}
+
 void Tie3::setup_tree(int idx,
                       int geom,
                       const TfragRenderSettings& settings,
                       const u8* proto_vis_data,
                       size_t proto_vis_data_size,
                       bool use_multidraw,
-                      ScopedProfilerNode& prof) {
+                      ScopedProfilerNode& prof,
+                      bool vis_ready) {
   // reset perf
   auto& tree = m_trees.at(geom).at(idx);
   // don't render if we haven't loaded
@@ -420,29 +627,46 @@ void Tie3::setup_tree(int idx,
     return;
   }
 
-  // update time of day
-  if (m_color_result.size() < tree.colors->color_count) {
-    m_color_result.resize(tree.colors->color_count);
+  // update time of day, unless the texture already has colors for these weights.
+  if (!m_use_fast_time_of_day) {
+    tree.tod_cache.invalidate();
   }
+  if (tree.tod_cache.needs_update(settings.camera.itimes)) {
+    if (tree.tod_colors.size() < tree.colors->color_count) {
+      tree.tod_colors.resize(tree.colors->color_count);
+    }
 
-  interp_time_of_day(settings.camera.itimes, *tree.colors, m_color_result.data());
+    interp_time_of_day(settings.camera.itimes, *tree.colors, tree.tod_colors.data());
+    tree.tod_upload_pending = true;
+  }
 
-  glActiveTexture(GL_TEXTURE10);
-  glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
-  glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
-                  GL_UNSIGNED_INT_8_8_8_8_REV, m_color_result.data());
+  // if the camera, occlusion and proto visibility are the same as last frame, so is the output of
+  // culling, and the old draw lists can be used.
+  if (!m_use_draw_list_cache) {
+    tree.draw_list_cache.valid = false;
+  }
+  if (tree.draw_list_cache.can_reuse(m_draw_list_key)) {
+    m_multidraw_stats.trees_reused++;
+    prof.add_tri(tree.draw_list_cache.num_tris);
+    return;
+  }
 
   // update proto vis mask
   if (proto_vis_data) {
     tree.proto_visibility.update(proto_vis_data, proto_vis_data_size);
   }
 
-  if (!m_debug_all_visible) {
+  if (!m_debug_all_visible && !vis_ready) {
     // need culling data
-    cull_check_all_slow(settings.camera.planes, tree.vis->vis_nodes, settings.occlusion_culling,
-                        tree.vis_temp.data());
+    cull_check_hierarchical(settings.camera.planes, *tree.vis, settings.occlusion_culling,
+                            tree.vis_temp.data());
+    if (m_use_software_occlusion) {
+      m_occlusion_buffer.cull_bvh_leaves(*tree.vis, tree.vis_temp.data());
+    }
   }
 
+  // with auto LOD, the groups that aren't in the BVH are only drawn by one geom.
+  bool draw_always_visible = !m_auto_lod_active || m_auto_lod.always_visible_geom(idx) == geom;
   u32 num_tris = 0;
   if (use_multidraw) {
     if (m_debug_all_visible) {
@@ -454,12 +678,14 @@ void Tie3::setup_tree(int idx,
       if (tree.has_proto_visibility) {
         num_tris = make_multidraws_from_vis_and_proto_string(
             tree.multidraw_offset_per_stripdraw.data(), tree.multidraw_count_buffer.data(),
-            tree.multidraw_index_offset_buffer.data(), *tree.draws, tree.vis_temp,
-            tree.proto_visibility.vis_flags);
+            tree.multidraw_index_offset_buffer.data(), *tree.draws, tree.draw_vis_ranges,
+            tree.vis_temp, tree.proto_visibility.vis_flags, draw_always_visible,
+            &m_multidraw_stats);
       } else {
         num_tris = make_multidraws_from_vis_string(
             tree.multidraw_offset_per_stripdraw.data(), tree.multidraw_count_buffer.data(),
-            tree.multidraw_index_offset_buffer.data(), *tree.draws, tree.vis_temp);
+            tree.multidraw_index_offset_buffer.data(), *tree.draws, tree.draw_vis_ranges,
+            tree.vis_temp, draw_always_visible, &m_multidraw_stats);
       }
     }
   } else {
@@ -471,23 +697,43 @@ void Tie3::setup_tree(int idx,
     } else {
       if (tree.has_proto_visibility) {
         idx_buffer_size = make_index_list_from_vis_and_proto_string(
-            tree.draw_idx_temp.data(), tree.index_temp.data(), *tree.draws, tree.vis_temp,
-            tree.proto_visibility.vis_flags, tree.index_data, &num_tris);
+            tree.draw_idx_temp.data(), tree.index_temp.data(), *tree.draws, tree.draw_vis_ranges,
+            tree.vis_temp, tree.proto_visibility.vis_flags, draw_always_visible, tree.index_data,
+            &num_tris);
       } else {
-        idx_buffer_size =
-            make_index_list_from_vis_string(tree.draw_idx_temp.data(), tree.index_temp.data(),
-                                            *tree.draws, tree.vis_temp, tree.index_data, &num_tris);
+        idx_buffer_size = make_index_list_from_vis_string(
+            tree.draw_idx_temp.data(), tree.index_temp.data(), *tree.draws, tree.draw_vis_ranges,
+            tree.vis_temp, draw_always_visible, tree.index_data, &num_tris);
       }
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tree.single_draw_index_buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_buffer_size * sizeof(u32), tree.index_temp.data(),
-                 GL_STREAM_DRAW);
+    tree.index_upload_count = idx_buffer_size;
+    tree.index_upload_pending = true;
   }
 
+  tree.draw_list_cache.update(m_draw_list_key, num_tris);
   prof.add_tri(num_tris);
 }
 
+/*!
+ * Upload the time of day colors and index list from setup_tree, if they changed.
+ */
+void Tie3::upload_tree_data(Tree& tree) {
+  if (tree.tod_upload_pending) {
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_1D, tree.time_of_day_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, tree.colors->color_count, GL_RGBA,
+                    GL_UNSIGNED_INT_8_8_8_8_REV, tree.tod_colors.data());
+    tree.tod_upload_pending = false;
+  }
+  if (tree.index_upload_pending) {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tree.single_draw_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, tree.index_upload_count * sizeof(u32),
+                 tree.index_temp.data(), GL_STREAM_DRAW);
+    tree.index_upload_pending = false;
+  }
+}
+
 namespace {
 void set_uniform(GLuint uniform, const math::Vector4f& val) {
   glUniform4f(uniform, val.x(), val.y(), val.z(), val.w());
@@ -532,6 +778,7 @@ void Tie3::draw_matching_draws_for_tree(int idx,
   if (!m_has_level) {
     return;
   }
+  upload_tree_data(tree);
   bool use_envmap = tfrag3::is_envmap_first_draw_category(category);
   auto shader_id = use_envmap ? ShaderId::ETIE_BASE : ShaderId::TFRAG3;
 
@@ -698,7 +945,31 @@ void Tie3::draw_debug_window() {
   ImGui::SameLine();
   ImGui::Checkbox("All Visible", &m_debug_all_visible);
   ImGui::Checkbox("Hide Wind", &m_hide_wind);
+  ImGui::Checkbox("Instanced Wind", &m_use_instanced_wind);
+  ImGui::SameLine();
+  ImGui::Checkbox("Reuse Draw Lists", &m_use_draw_list_cache);
   ImGui::SliderFloat("Wind Multiplier", &m_wind_multiplier, 0., 40.f);
+  ImGui::Text("multidraw: %d groups, %d entries (%d merged), %d draws skipped",
+              m_multidraw_stats.visible_groups, m_multidraw_stats.entries,
+              m_multidraw_stats.merged(), m_multidraw_stats.draws_skipped);
+  ImGui::Text("trees reusing last frame's draw lists: %d", m_multidraw_stats.trees_reused);
+  m_auto_lod_settings.draw_debug_window();
+  if (m_auto_lod_active) {
+    const auto& lod_stats = m_auto_lod.stats();
+    for (int i = 0; i < tfrag3::TIE_GEOS; i++) {
+      ImGui::Text("  geom %d: %d leaves, %d tris", i, lod_stats.leaves[i], lod_stats.tris[i]);
+    }
+    ImGui::Text("  coarsened for budget: %d", lod_stats.budget_coarsened);
+  } else if (m_auto_lod_settings.enable && !m_auto_lod_available) {
+    ImGui::Text("  auto LOD not available for this level");
+  }
+  ImGui::Checkbox("Software Occlusion", &m_use_software_occlusion);
+  if (m_use_software_occlusion) {
+    const auto& occ = m_occlusion_buffer.stats();
+    ImGui::Text("occluders: %d tris, raster %.3f ms", occ.occluder_tris, occ.raster_ms);
+    ImGui::Text("occlusion: %d/%d instance groups rejected", occ.spheres_rejected,
+                occ.spheres_tested);
+  }
   ImGui::Separator();
 }
 
@@ -864,6 +1135,152 @@ void do_wind_math(u16 wind_idx,
   // sd s2, 0(s5)
 }
 
+namespace {
+
+/*!
+ * Same as do_wind_math, but for 4 instances at once, stored as structure-of-arrays.
+ * The instances must use different wind vectors, since the vectors are updated in place.
+ * Writes the x and z wind offsets for each instance, which must be applied to the matrix.
+ */
+void do_wind_math_x4(const u16* wind_idx,
+                     float* wind_vector_data,
+                     const Tie3::WindWork& wind_work,
+                     const float* stiffness,
+                     float* wind_x_out,
+                     float* wind_z_out) {
+  // load wind vectors and transpose so each register has one component of all 4 instances.
+  __m128 v17x = _mm_loadu_ps(wind_vector_data + 4 * wind_idx[0]);
+  __m128 v17z = _mm_loadu_ps(wind_vector_data + 4 * wind_idx[1]);
+  __m128 v18x = _mm_loadu_ps(wind_vector_data + 4 * wind_idx[2]);
+  __m128 v18z = _mm_loadu_ps(wind_vector_data + 4 * wind_idx[3]);
+  _MM_TRANSPOSE4_PS(v17x, v17z, v18x, v18z);
+
+  __m128 w16x = _mm_loadu_ps(wind_work.wind_array[(wind_work.wind_time + wind_idx[0]) & 63].data());
+  __m128 w16y = _mm_loadu_ps(wind_work.wind_array[(wind_work.wind_time + wind_idx[1]) & 63].data());
+  __m128 w16z = _mm_loadu_ps(wind_work.wind_array[(wind_work.wind_time + wind_idx[2]) & 63].data());
+  __m128 w16w = _mm_loadu_ps(wind_work.wind_array[(wind_work.wind_time + wind_idx[3]) & 63].data());
+  _MM_TRANSPOSE4_PS(w16x, w16y, w16z, w16w);
+
+  const __m128 cx = _mm_set1_ps(0.5);
+  const __m128 cy = _mm_set1_ps(100.0);
+  const __m128 cz = _mm_set1_ps(0.0166);
+
+  // vf16 -= (vf18 * wind_const.x) + (vf17 * wind_const.y)
+  w16x = _mm_sub_ps(w16x, _mm_add_ps(_mm_mul_ps(cx, v18x), _mm_mul_ps(cy, v17x)));
+  w16z = _mm_sub_ps(w16z, _mm_add_ps(_mm_mul_ps(cx, v18z), _mm_mul_ps(cy, v17z)));
+
+  // vf18 += vf16 * wind_const.z
+  v18x = _mm_add_ps(v18x, _mm_mul_ps(w16x, cz));
+  v18z = _mm_add_ps(v18z, _mm_mul_ps(w16z, cz));
+
+  // vf17 += vf18 * wind_const.z
+  v17x = _mm_add_ps(v17x, _mm_mul_ps(v18x, cz));
+  v17z = _mm_add_ps(v17z, _mm_mul_ps(v18z, cz));
+
+  // vminiw, vmaxw, vmulw
+  const __m128 stiff = _mm_loadu_ps(stiffness);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 neg_one = _mm_set1_ps(-1.f);
+  __m128 v27x = _mm_mul_ps(_mm_max_ps(_mm_min_ps(v17x, one), neg_one), stiff);
+  __m128 v27z = _mm_mul_ps(_mm_max_ps(_mm_min_ps(v17z, one), neg_one), stiff);
+  _mm_storeu_ps(wind_x_out, v27x);
+  _mm_storeu_ps(wind_z_out, v27z);
+
+  if (!wind_work.paused) {
+    _MM_TRANSPOSE4_PS(v27x, v27z, v18x, v18z);
+    _mm_storeu_ps(wind_vector_data + 4 * wind_idx[0], v27x);
+    _mm_storeu_ps(wind_vector_data + 4 * wind_idx[1], v27z);
+    _mm_storeu_ps(wind_vector_data + 4 * wind_idx[2], v18x);
+    _mm_storeu_ps(wind_vector_data + 4 * wind_idx[3], v18z);
+  }
+}
+
+/*!
+ * Apply the wind offset to the instance matrix, then multiply by the camera matrix.
+ */
+void wind_camera_multiply(const std::array<math::Vector4f, 4>& mat,
+                          float wind_x,
+                          float wind_z,
+                          const __m128* cam,
+                          std::array<math::Vector4f, 4>& out) {
+  for (int i = 0; i < 4; i++) {
+    float x = mat[i].x();
+    float y = mat[i].y();
+    float z = mat[i].z();
+    if (i < 3) {
+      x += wind_x * y;
+      z += wind_z * y;
+    }
+    __m128 result = _mm_mul_ps(cam[0], _mm_set1_ps(x));
+    result = _mm_add_ps(result, _mm_mul_ps(cam[1], _mm_set1_ps(y)));
+    result = _mm_add_ps(result, _mm_mul_ps(cam[2], _mm_set1_ps(z)));
+    if (i == 3) {
+      result = _mm_add_ps(result, cam[3]);
+    }
+    _mm_storeu_ps(out[i].data(), result);
+  }
+}
+
+/*!
+ * Compute the wind matrices for the given instances. The matrix for instances[i] is stored in
+ * out[i]. Instances are processed in batches of 4, falling back to one at a time when a batch
+ * shares a wind vector.
+ */
+void compute_wind_matrices(const std::vector<u32>& instances,
+                           const std::vector<tfrag3::TieWindInstance>& info,
+                           std::vector<float>& wind_vectors,
+                           const Tie3::WindWork& wind_work,
+                           float wind_multiplier,
+                           const std::array<math::Vector4f, 4>& cam,
+                           std::vector<std::array<math::Vector4f, 4>>& out) {
+  __m128 cam_vec[4];
+  for (int i = 0; i < 4; i++) {
+    cam_vec[i] = _mm_loadu_ps(cam[i].data());
+  }
+
+  size_t i = 0;
+  for (; i + 4 <= instances.size(); i += 4) {
+    u16 wind_idx[4];
+    float stiffness[4];
+    for (int j = 0; j < 4; j++) {
+      const auto& inst = info[instances[i + j]];
+      ASSERT(inst.wind_idx * 4 <= wind_vectors.size());
+      wind_idx[j] = inst.wind_idx;
+      stiffness[j] = inst.stiffness * wind_multiplier;
+    }
+
+    bool unique = wind_idx[0] != wind_idx[1] && wind_idx[0] != wind_idx[2] &&
+                  wind_idx[0] != wind_idx[3] && wind_idx[1] != wind_idx[2] &&
+                  wind_idx[1] != wind_idx[3] && wind_idx[2] != wind_idx[3];
+    if (unique) {
+      float wind_x[4], wind_z[4];
+      do_wind_math_x4(wind_idx, wind_vectors.data(), wind_work, stiffness, wind_x, wind_z);
+      for (int j = 0; j < 4; j++) {
+        u32 inst_id = instances[i + j];
+        wind_camera_multiply(info[inst_id].matrix, wind_x[j], wind_z[j], cam_vec, out[i + j]);
+      }
+    } else {
+      for (int j = 0; j < 4; j++) {
+        u32 inst_id = instances[i + j];
+        auto mat = info[inst_id].matrix;
+        do_wind_math(wind_idx[j], wind_vectors.data(), wind_work, stiffness[j], mat);
+        wind_camera_multiply(mat, 0, 0, cam_vec, out[i + j]);
+      }
+    }
+  }
+
+  for (; i < instances.size(); i++) {
+    u32 inst_id = instances[i];
+    const auto& inst = info[inst_id];
+    ASSERT(inst.wind_idx * 4 <= wind_vectors.size());
+    auto mat = inst.matrix;
+    do_wind_math(inst.wind_idx, wind_vectors.data(), wind_work, inst.stiffness * wind_multiplier,
+                 mat);
+    wind_camera_multiply(mat, 0, 0, cam_vec, out[i]);
+  }
+}
+}  // namespace
+
 void Tie3::render_tree_wind(int idx,
                             int geom,
                             const TfragRenderSettings& settings,
@@ -874,50 +1291,38 @@ void Tie3::render_tree_wind(int idx,
     return;
   }
 
-  // note: this isn't the most efficient because we might compute wind matrices for invisible
-  // instances. TODO: add vis ids to the instance info to avoid this
-  memset(tree.wind_matrix_cache.data(), 0, sizeof(float) * 16 * tree.wind_matrix_cache.size());
+  // only compute wind matrices for instances that will be drawn.
+  tree.visible_wind_instances.clear();
+  for (u32 inst_id = 0; inst_id < tree.wind_instance_vis_idx.size(); inst_id++) {
+    u32 vis_idx = tree.wind_instance_vis_idx[inst_id];
+    if (vis_idx != UINT32_MAX && (m_debug_all_visible || tree.vis_temp[vis_idx])) {
+      tree.wind_instance_slot[inst_id] = tree.visible_wind_instances.size();
+      tree.visible_wind_instances.push_back(inst_id);
+    }
+  }
+
+  if (tree.visible_wind_instances.empty()) {
+    return;
+  }
+
   auto& cam_bad = settings.camera.camera;
   std::array<math::Vector4f, 4> cam;
   for (int i = 0; i < 4; i++) {
     cam[i] = cam_bad[i];
   }
 
-  for (size_t inst_id = 0; inst_id < tree.instance_info->size(); inst_id++) {
-    auto& info = tree.instance_info->operator[](inst_id);
-    auto& out = tree.wind_matrix_cache[inst_id];
-    // auto& mat = tree.instance_info->operator[](inst_id).matrix;
-    auto mat = info.matrix;
-
-    ASSERT(info.wind_idx * 4 <= m_wind_vectors.size());
-    do_wind_math(info.wind_idx, m_wind_vectors.data(), m_wind_data,
-                 info.stiffness * m_wind_multiplier, mat);
+  compute_wind_matrices(tree.visible_wind_instances, *tree.instance_info, m_wind_vectors,
+                        m_wind_data, m_wind_multiplier, cam, tree.wind_matrix_cache);
 
-    // vmulax.xyzw acc, vf20, vf10
-    // vmadday.xyzw acc, vf21, vf10
-    // vmaddz.xyzw vf10, vf22, vf10
-    out[0] = cam[0] * mat[0].x() + cam[1] * mat[0].y() + cam[2] * mat[0].z();
-
-    // vmulax.xyzw acc, vf20, vf11
-    // vmadday.xyzw acc, vf21, vf11
-    // vmaddz.xyzw vf11, vf22, vf11
-    out[1] = cam[0] * mat[1].x() + cam[1] * mat[1].y() + cam[2] * mat[1].z();
-
-    // vmulax.xyzw acc, vf20, vf12
-    // vmadday.xyzw acc, vf21, vf12
-    // vmaddz.xyzw vf12, vf22, vf12
-    out[2] = cam[0] * mat[2].x() + cam[1] * mat[2].y() + cam[2] * mat[2].z();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tree.wind_vertex_index_buffer);
 
-    // vmulax.xyzw acc, vf20, vf13
-    // vmadday.xyzw acc, vf21, vf13
-    // vmaddaz.xyzw acc, vf22, vf13
-    // vmaddw.xyzw vf13, vf23, vf0
-    out[3] = cam[0] * mat[3].x() + cam[1] * mat[3].y() + cam[2] * mat[3].z() + cam[3];
+  // indirect multi-draw requires OpenGL 4.3, fall back to one draw per group otherwise.
+  if (m_use_instanced_wind && GLAD_GL_VERSION_4_3) {
+    render_tree_wind_instanced(tree, settings, render_state, prof);
+    return;
   }
 
   int last_texture = -1;
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tree.wind_vertex_index_buffer);
-
   for (size_t draw_idx = 0; draw_idx < tree.wind_draws->size(); draw_idx++) {
     const auto& draw = tree.wind_draws->operator[](draw_idx);
 
@@ -934,9 +1339,8 @@ void Tie3::render_tree_wind(int idx,
         continue;  // invisible, skip.
       }
 
-      glUniformMatrix4fv(
-          glGetUniformLocation(render_state->shaders[ShaderId::TFRAG3].id(), "camera"), 1, GL_FALSE,
-          tree.wind_matrix_cache.at(grp.instance_idx)[0].data());
+      const auto& mat = tree.wind_matrix_cache.at(tree.wind_instance_slot[grp.instance_idx]);
+      glUniformMatrix4fv(m_uniforms.camera, 1, GL_FALSE, mat[0].data());
 
       prof.add_draw_call();
       prof.add_tri(grp.num);
@@ -951,12 +1355,8 @@ void Tie3::render_tree_wind(int idx,
         case DoubleDrawKind::AFAIL_NO_DEPTH_WRITE:
           prof.add_draw_call();
           prof.add_tri(grp.num);
-          glUniform1f(
-              glGetUniformLocation(render_state->shaders[ShaderId::TFRAG3].id(), "alpha_min"),
-              -10.f);
-          glUniform1f(
-              glGetUniformLocation(render_state->shaders[ShaderId::TFRAG3].id(), "alpha_max"),
-              double_draw.aref_second);
+          glUniform1f(m_uniforms.alpha_min, -10.f);
+          glUniform1f(m_uniforms.alpha_max, double_draw.aref_second);
           glDepthMask(GL_FALSE);
           glDrawElements(GL_TRIANGLE_STRIP, draw.vertex_index_stream.size(), GL_UNSIGNED_INT,
                          (void*)0);
@@ -968,6 +1368,93 @@ void Tie3::render_tree_wind(int idx,
   }
 }
 
+/*!
+ * Draw wind instances with one indirect multi-draw per wind draw. The matrices of visible
+ * instances are streamed to a buffer that the shader reads as a per-instance attribute, and each
+ * group selects its matrix with base_instance.
+ */
+void Tie3::render_tree_wind_instanced(Tree& tree,
+                                      const TfragRenderSettings& settings,
+                                      SharedRenderState* render_state,
+                                      ScopedProfilerNode& prof) {
+  // orphan the old matrices so we don't wait on the previous frame's draws.
+  glBindBuffer(GL_ARRAY_BUFFER, tree.wind_matrix_buffer);
+  glBufferData(GL_ARRAY_BUFFER, tree.wind_matrix_cache.size() * sizeof(tree.wind_matrix_cache[0]),
+               nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+                  tree.visible_wind_instances.size() * sizeof(tree.wind_matrix_cache[0]),
+                  tree.wind_matrix_cache.data());
+
+  // one command per visible group
+  tree.wind_indirect_temp.clear();
+  for (size_t draw_idx = 0; draw_idx < tree.wind_draws->size(); draw_idx++) {
+    const auto& draw = tree.wind_draws->operator[](draw_idx);
+    auto& range = tree.wind_draw_ranges[draw_idx];
+    range.first_cmd = tree.wind_indirect_temp.size();
+    range.num_indices = 0;
+    u32 off = tree.wind_vertex_index_offsets[draw_idx];
+    for (auto& grp : draw.instance_groups) {
+      if (m_debug_all_visible || tree.vis_temp[grp.vis_idx]) {
+        auto& cmd = tree.wind_indirect_temp.emplace_back();
+        cmd.count = grp.num;
+        cmd.instance_count = 1;
+        cmd.first_index = off;
+        cmd.base_vertex = 0;
+        cmd.base_instance = tree.wind_instance_slot[grp.instance_idx];
+        range.num_indices += grp.num;
+      }
+      off += grp.num;
+    }
+    range.num_cmds = tree.wind_indirect_temp.size() - range.first_cmd;
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, tree.wind_indirect_buffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER,
+               tree.wind_indirect_temp.size() * sizeof(DrawElementsIndirectCommand),
+               tree.wind_indirect_temp.data(), GL_STREAM_DRAW);
+
+  first_tfrag_draw_setup(settings.camera, render_state, ShaderId::TFRAG3_WIND);
+
+  int last_texture = -1;
+  for (size_t draw_idx = 0; draw_idx < tree.wind_draws->size(); draw_idx++) {
+    const auto& draw = tree.wind_draws->operator[](draw_idx);
+    const auto& range = tree.wind_draw_ranges[draw_idx];
+    if (range.num_cmds == 0) {
+      continue;
+    }
+
+    if ((int)draw.tree_tex_id != last_texture) {
+      glBindTexture(GL_TEXTURE_2D, m_textures->at(draw.tree_tex_id));
+      last_texture = draw.tree_tex_id;
+    }
+    auto double_draw = setup_tfrag_shader(render_state, draw.mode, ShaderId::TFRAG3_WIND);
+    glUniform1i(m_wind_uniforms.decal, draw.mode.get_decal() ? 1 : 0);
+
+    void* cmd_offset = (void*)(range.first_cmd * sizeof(DrawElementsIndirectCommand));
+    prof.add_draw_call();
+    prof.add_tri(range.num_indices);
+    glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_INT, cmd_offset, range.num_cmds, 0);
+
+    switch (double_draw.kind) {
+      case DoubleDrawKind::NONE:
+        break;
+      case DoubleDrawKind::AFAIL_NO_DEPTH_WRITE:
+        prof.add_draw_call();
+        prof.add_tri(range.num_indices);
+        glUniform1f(m_wind_uniforms.alpha_min, -10.f);
+        glUniform1f(m_wind_uniforms.alpha_max, double_draw.aref_second);
+        glDepthMask(GL_FALSE);
+        glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_INT, cmd_offset, range.num_cmds,
+                                    0);
+        break;
+      default:
+        ASSERT(false);
+    }
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
 Tie3AnotherCategory::Tie3AnotherCategory(const std::string& name,
                                          int my_id,
                                          Tie3* parent,
@@ -994,10 +1481,8 @@ void Tie3AnotherCategory::render(DmaFollower& dma,
 Tie3WithEnvmapJak1::Tie3WithEnvmapJak1(const std::string& name, int my_id, int level_id)
     : Tie3(name, my_id, level_id, tfrag3::TieCategory::NORMAL) {}
 
-void Tie3WithEnvmapJak1::render(DmaFollower& dma,
-                                SharedRenderState* render_state,
-                                ScopedProfilerNode& prof) {
-  Tie3::render(dma, render_state, prof);
+void Tie3WithEnvmapJak1::submit(SharedRenderState* render_state, ScopedProfilerNode& prof) {
+  Tie3::submit(render_state, prof);
   if (m_enable_envmap) {
     render_from_another(render_state, prof, tfrag3::TieCategory::NORMAL_ENVMAP);
   }
@@ -6,6 +6,8 @@
 
 #include "game/graphics/gfx.h"
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
+#include "game/graphics/opengl_renderer/background/AutoLod.h"
+#include "game/graphics/opengl_renderer/background/SoftwareOcclusion.h"
 #include "game/graphics/opengl_renderer/background/background_common.h"
 #include "game/graphics/pipelines/opengl.h"
 
@@ -23,6 +25,17 @@ struct EtieUniforms {
   GLuint persp0, persp1, cam_no_persp, envmap_tod_tint, decal;
 };
 
+/*!
+ * Layout of a command for glMultiDrawElementsIndirect.
+ */
+struct DrawElementsIndirectCommand {
+  u32 count;
+  u32 instance_count;
+  u32 first_index;
+  s32 base_vertex;
+  u32 base_instance;
+};
+
 class Tie3 : public BucketRenderer {
  public:
   // by default, only render the specified category on the call to render.
@@ -32,11 +45,19 @@ class Tie3 : public BucketRenderer {
        int level_id,
        tfrag3::TieCategory category = tfrag3::TieCategory::NORMAL);
   void render(DmaFollower& dma, SharedRenderState* render_state, ScopedProfilerNode& prof) override;
+  bool can_prepare() const override { return true; }
+  void prepare(DmaFollower& dma,
+               u32 bucket_end,
+               SharedRenderState* render_state,
+               ScopedProfilerNode& prof) override;
+  void submit(SharedRenderState* render_state, ScopedProfilerNode& prof) override;
   void draw_debug_window() override;
   void init_shaders(ShaderLibrary& shaders) override;
   ~Tie3();
 
-  bool set_up_common_data_from_dma(DmaFollower& dma, SharedRenderState* render_state);
+  bool set_up_common_data_from_dma(DmaFollower& dma,
+                                   u32 bucket_end,
+                                   const SharedRenderState* render_state);
 
   void setup_all_trees(int geom,
                        const TfragRenderSettings& settings,
@@ -51,7 +72,8 @@ class Tie3 : public BucketRenderer {
                   const u8* proto_vis_data,
                   size_t proto_vis_data_size,
                   bool use_multidraw,
-                  ScopedProfilerNode& prof);
+                  ScopedProfilerNode& prof,
+                  bool vis_ready = false);
 
   void draw_matching_draws_for_all_trees(int geom,
                                          const TfragRenderSettings& settings,
@@ -67,6 +89,7 @@ class Tie3 : public BucketRenderer {
                                     tfrag3::TieCategory category);
 
   bool try_loading_level(const std::string& str, SharedRenderState* render_state);
+  bool level_ready(const SharedRenderState* render_state) const;
 
   void render_from_another(SharedRenderState* render_state,
                            ScopedProfilerNode& prof,
@@ -88,6 +111,7 @@ class Tie3 : public BucketRenderer {
  private:
   void load_from_fr3_data(const LevelData* loader_data);
   void discard_tree_cache();
+  void setup_auto_lod(int fallback_geom, const TfragRenderSettings& settings);
   void render_tree_wind(int idx,
                         int geom,
                         const TfragRenderSettings& settings,
@@ -110,6 +134,8 @@ class Tie3 : public BucketRenderer {
     GLuint index_buffer;
     GLuint single_draw_index_buffer;
     GLuint time_of_day_texture;
+    TimeOfDayCache tod_cache;
+    DrawListCache draw_list_cache;
     GLuint vao;
     std::array<u32, tfrag3::kNumTieCategories + 1> category_draw_indices;
     const std::vector<tfrag3::StripDraw>* draws = nullptr;
@@ -117,21 +143,53 @@ class Tie3 : public BucketRenderer {
     const std::vector<tfrag3::TieWindInstance>* instance_info = nullptr;
     const tfrag3::PackedTimeOfDay* colors = nullptr;
     const tfrag3::BVH* vis = nullptr;
+    std::vector<DrawVisRange> draw_vis_ranges;
     const u32* index_data = nullptr;
+    // wind matrices of visible instances, indexed by slot
     std::vector<std::array<math::Vector4f, 4>> wind_matrix_cache;
     GLuint wind_vertex_index_buffer;
     std::vector<u32> wind_vertex_index_offsets;
+    // vis node of each wind instance (UINT32_MAX if the instance is never drawn)
+    std::vector<u32> wind_instance_vis_idx;
+    std::vector<u32> visible_wind_instances;
+    // slot in wind_matrix_cache for each visible instance
+    std::vector<u32> wind_instance_slot;
+    // instanced wind path: matrices streamed as a per-instance attribute, plus indirect commands
+    GLuint wind_matrix_buffer = 0;
+    GLuint wind_indirect_buffer = 0;
+    std::vector<DrawElementsIndirectCommand> wind_indirect_temp;
+    struct WindDrawRange {
+      u32 first_cmd = 0;
+      u32 num_cmds = 0;
+      u32 num_indices = 0;
+    };
+    std::vector<WindDrawRange> wind_draw_ranges;
     bool has_proto_visibility = false;
     TieProtoVisibility proto_visibility;
+    // with auto LOD, set if this geom of the tree draws anything
+    bool lod_in_use = false;
 
     std::vector<std::pair<int, int>> draw_idx_temp;
     std::vector<u32> index_temp;
     std::vector<u8> vis_temp;
+
+    // results of setup_tree that are uploaded right before drawing, so setup can run in prepare.
+    std::vector<math::Vector<u8, 4>> tod_colors;
+    bool tod_upload_pending = false;
+    u32 index_upload_count = 0;
+    bool index_upload_pending = false;
     std::vector<std::pair<int, int>> multidraw_offset_per_stripdraw;
     std::vector<GLsizei> multidraw_count_buffer;
     std::vector<void*> multidraw_index_offset_buffer;
   };
 
+  void upload_tree_data(Tree& tree);
+
+  void render_tree_wind_instanced(Tree& tree,
+                                  const TfragRenderSettings& settings,
+                                  SharedRenderState* render_state,
+                                  ScopedProfilerNode& prof);
+
   void envmap_second_pass_draw(const Tree& tree,
                                const TfragRenderSettings& settings,
                                SharedRenderState* render_state,
@@ -143,17 +201,39 @@ class Tie3 : public BucketRenderer {
   const std::vector<GLuint>* m_textures;
   u64 m_load_id = -1;
 
-  std::vector<math::Vector<u8, 4>> m_color_result;
-
   static constexpr int TIME_OF_DAY_COLOR_COUNT = 8192;
 
   bool m_has_level = false;
+  // set by prepare: the bucket had data this frame, and the trees were already set up.
+  bool m_has_frame_data = false;
+  bool m_trees_ready = false;
   bool m_use_fast_time_of_day = true;
   bool m_debug_all_visible = false;
   bool m_hide_wind = false;
+  bool m_use_instanced_wind = true;
+  bool m_use_draw_list_cache = true;
+  bool m_use_software_occlusion = false;
   bool m_draw_envmap_second_draw = true;
 
   TfragPcPortData m_pc_port_data;
+  MultidrawStats m_multidraw_stats;
+  u64 m_draw_list_key = 0;
+
+  // tfrag triangles that hide TIE instances, for software occlusion culling.
+  // built from m_occluder_level the first time occlusion is used after a level load.
+  OccluderMesh m_occluders;
+  const tfrag3::Level* m_occluder_level = nullptr;
+  bool m_occluders_built = false;
+  SoftwareOcclusionBuffer m_occlusion_buffer;
+  static constexpr u32 kMaxOccluderTris = 8192;
+
+  // per-leaf LOD selection, used instead of lod() when enabled.
+  AutoLodSettings m_auto_lod_settings;
+  AutoLod m_auto_lod;
+  bool m_auto_lod_available = false;
+  bool m_auto_lod_active = false;
+  u64 m_auto_lod_key = 0;
+  std::vector<u8> m_auto_lod_vis_temp;
 
   std::vector<float> m_wind_vectors;  // note: I suspect these are shared with shrub.
 
@@ -164,9 +244,13 @@ class Tie3 : public BucketRenderer {
   tfrag3::TieCategory m_default_category;
 
   struct {
-    GLuint decal;
+    GLuint decal, camera, alpha_min, alpha_max;
   } m_uniforms;
 
+  struct {
+    GLuint decal, alpha_min, alpha_max;
+  } m_wind_uniforms;
+
   EtieUniforms m_etie_uniforms, m_etie_base_uniforms;
 
   static_assert(sizeof(WindWork) == 84 * 16);
@@ -192,7 +276,7 @@ class Tie3AnotherCategory : public BucketRenderer {
 class Tie3WithEnvmapJak1 : public Tie3 {
  public:
   Tie3WithEnvmapJak1(const std::string& name, int my_id, int level_id);
-  void render(DmaFollower& dma, SharedRenderState* render_state, ScopedProfilerNode& prof) override;
+  void submit(SharedRenderState* render_state, ScopedProfilerNode& prof) override;
   void draw_debug_window() override;
 
  private:
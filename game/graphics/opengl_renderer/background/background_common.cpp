@@ -2,6 +2,8 @@
 
 #include "background_common.h"
 
+#include <bit>
+
 #ifdef __aarch64__
 #include "third-party/sse2neon/sse2neon.h"
 #else
@@ -13,6 +15,8 @@
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 #include "game/graphics/pipelines/opengl.h"
 
+#include "third-party/zstd/lib/common/xxhash.h"
+
 DoubleDraw setup_opengl_from_draw_mode(DrawMode mode, u32 tex_unit, bool mipmap) {
   glActiveTexture(tex_unit);
 
@@ -191,10 +195,12 @@ void first_tfrag_draw_setup(const GoalBackgroundCameraData& settings,
               render_state->fog_intensity / 255);
 }
 
-void interp_time_of_day_slow(const math::Vector<s32, 4> itimes[4],
-                             const tfrag3::PackedTimeOfDay& in,
-                             math::Vector<u8, 4>* out) {
-  math::Vector<u16, 4> weights[8];
+namespace {
+/*!
+ * Unpack the 8-bit time of day weights for each of the 8 palettes.
+ */
+void unpack_time_of_day_weights(const math::Vector<s32, 4> itimes[4],
+                                math::Vector<u16, 4>* weights) {
   for (int component = 0; component < 8; component++) {
     int quad_idx = component / 2;
     int word_off = (component % 2 * 2);
@@ -208,55 +214,51 @@ void interp_time_of_day_slow(const math::Vector<s32, 4> itimes[4],
       weights[component][channel] = hw_val;
     }
   }
+}
 
-  math::Vector<u16, 4> temp[4];
+#ifdef __aarch64__
+void interp_time_of_day_neon(const math::Vector<u16, 4>* weights,
+                             const tfrag3::PackedTimeOfDay& packed_colors,
+                             math::Vector<u8, 4>* out) {
+  // each register holds 8x u16: 2 colors, with the weights repeated for each color.
+  uint16x8_t w[8];
+  for (int i = 0; i < 8; i++) {
+    uint16x4_t half = vld1_u16(weights[i].data());
+    w[i] = vcombine_u16(half, half);
+  }
 
-  for (u32 color_quad = 0; color_quad < (in.color_count + 3) / 4; color_quad++) {
-    for (auto& x : temp) {
-      x.set_zero();
-    }
+  // saturation: note that alpha is saturated to 128 but the rest are 255.
+  const u16 sat_vals[8] = {255, 255, 255, 128, 255, 255, 255, 128};
+  uint16x8_t sat = vld1q_u16(sat_vals);
 
-    const u8* input_ptr = in.data.data() + color_quad * 128;
-    for (u32 component = 0; component < 8; component++) {
-      for (u32 color = 0; color < 4; color++) {
-        for (u32 channel = 0; channel < 4; channel++) {
-          temp[color][channel] += weights[component][channel] * (*input_ptr);
-          input_ptr++;
-        }
-      }
+  for (u32 color_quad = 0; color_quad < packed_colors.color_count / 4; color_quad++) {
+    const u8* base = packed_colors.data.data() + color_quad * 128;
+    // each palette has 16 bytes for the 4 colors of this quad. Do colors 0-1 and 2-3 in parallel.
+    int16x8_t lo[8], hi[8];
+    for (int i = 0; i < 8; i++) {
+      uint8x16_t colors = vld1q_u8(base + 16 * i);
+      lo[i] = vreinterpretq_s16_u16(vmulq_u16(vmovl_u8(vget_low_u8(colors)), w[i]));
+      hi[i] = vreinterpretq_s16_u16(vmulq_u16(vmovl_u8(vget_high_u8(colors)), w[i]));
     }
 
-    for (u32 color = 0; color < 4; color++) {
-      auto& o = out[color_quad * 4 + color];
-      for (u32 channel = 0; channel < 3; channel++) {
-        o[channel] = std::min(255, temp[color][channel] >> 6);
-      }
-      o[3] = std::min(128, temp[color][3] >> 6);
+    // add, with the same saturating signed add as the SSE version.
+    for (int i = 0; i < 4; i++) {
+      lo[i] = vqaddq_s16(lo[2 * i], lo[2 * i + 1]);
+      hi[i] = vqaddq_s16(hi[2 * i], hi[2 * i + 1]);
     }
+    lo[0] = vqaddq_s16(vqaddq_s16(lo[0], lo[1]), vqaddq_s16(lo[2], lo[3]));
+    hi[0] = vqaddq_s16(vqaddq_s16(hi[0], hi[1]), vqaddq_s16(hi[2], hi[3]));
+
+    // divide, saturate, and back to u8s.
+    uint16x8_t lo_result = vminq_u16(sat, vshrq_n_u16(vreinterpretq_u16_s16(lo[0]), 6));
+    uint16x8_t hi_result = vminq_u16(sat, vshrq_n_u16(vreinterpretq_u16_s16(hi[0]), 6));
+    vst1q_u8((u8*)(&out[color_quad * 4]), vcombine_u8(vmovn_u16(lo_result), vmovn_u16(hi_result)));
   }
 }
-
-void interp_time_of_day(const math::Vector<s32, 4> itimes[4],
-                        const tfrag3::PackedTimeOfDay& packed_colors,
-                        math::Vector<u8, 4>* out) {
-#ifdef __aarch64__
-  interp_time_of_day_slow(itimes, packed_colors, out);
 #else
-  math::Vector<u16, 4> weights[8];
-  for (int component = 0; component < 8; component++) {
-    int quad_idx = component / 2;
-    int word_off = (component % 2 * 2);
-    for (int channel = 0; channel < 4; channel++) {
-      int word = word_off + (channel / 2);
-      int hw_off = channel % 2;
-
-      u32 word_val = itimes[quad_idx][word];
-      u32 hw_val = hw_off ? (word_val >> 16) : word_val;
-      hw_val = hw_val & 0xff;
-      weights[component][channel] = hw_val;
-    }
-  }
-
+void interp_time_of_day_sse(const math::Vector<u16, 4>* weights,
+                            const tfrag3::PackedTimeOfDay& packed_colors,
+                            math::Vector<u8, 4>* out) {
   // weight multipliers
   __m128i weights0 = _mm_setr_epi16(weights[0][0], weights[0][1], weights[0][2], weights[0][3],
                                     weights[0][0], weights[0][1], weights[0][2], weights[0][3]);
@@ -393,7 +395,131 @@ void interp_time_of_day(const math::Vector<s32, 4> itimes[4],
       _mm_storel_epi64((__m128i*)(&out[color_quad * 4 + 2]), result);
     }
   }
+}
+
+/*!
+ * 16 colors of one quad, after weighting and summing the 8 palettes. Not a lambda, because those
+ * don't get the AVX2 target of the enclosing function.
+ */
+AVX2_TARGET inline __m256i sum_quad_avx2(const u8* base, const __m256i* w, __m256i sat) {
+  __m256i c[8];
+  for (int i = 0; i < 8; i++) {
+    c[i] = _mm256_mullo_epi16(
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(base + 16 * i))), w[i]);
+  }
+  // add. This order minimizes dependencies, and matches the SSE version.
+  c[0] = _mm256_adds_epi16(c[0], c[1]);
+  c[2] = _mm256_adds_epi16(c[2], c[3]);
+  c[4] = _mm256_adds_epi16(c[4], c[5]);
+  c[6] = _mm256_adds_epi16(c[6], c[7]);
+  c[0] = _mm256_adds_epi16(c[0], c[2]);
+  c[4] = _mm256_adds_epi16(c[4], c[6]);
+  c[0] = _mm256_adds_epi16(c[0], c[4]);
+  return _mm256_min_epu16(sat, _mm256_srli_epi16(c[0], 6));
+}
+
+/*!
+ * Like the SSE version, but each register holds all 4 colors of a quad, and two quads are done
+ * per iteration.
+ */
+AVX2_TARGET void interp_time_of_day_avx2(const math::Vector<u16, 4>* weights,
+                                         const tfrag3::PackedTimeOfDay& packed_colors,
+                                         math::Vector<u8, 4>* out) {
+  __m256i w[8];
+  for (int i = 0; i < 8; i++) {
+    w[i] = _mm256_setr_epi16(weights[i][0], weights[i][1], weights[i][2], weights[i][3],
+                             weights[i][0], weights[i][1], weights[i][2], weights[i][3],
+                             weights[i][0], weights[i][1], weights[i][2], weights[i][3],
+                             weights[i][0], weights[i][1], weights[i][2], weights[i][3]);
+  }
+
+  // saturation: note that alpha is saturated to 128 but the rest are 255.
+  const __m256i sat = _mm256_setr_epi16(255, 255, 255, 128, 255, 255, 255, 128, 255, 255, 255,
+                                        128, 255, 255, 255, 128);
+
+  const u32 num_quads = packed_colors.color_count / 4;
+  const u8* data = packed_colors.data.data();
+
+  u32 color_quad = 0;
+  for (; color_quad + 2 <= num_quads; color_quad += 2) {
+    __m256i q0 = sum_quad_avx2(data + color_quad * 128, w, sat);
+    __m256i q1 = sum_quad_avx2(data + color_quad * 128 + 128, w, sat);
+    // packus works per 128-bit lane, giving q0 lo, q1 lo, q0 hi, q1 hi. Put them back in order.
+    __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi16(q0, q1), 0b11011000);
+    _mm256_storeu_si256((__m256i*)(&out[color_quad * 4]), result);
+  }
+
+  if (color_quad < num_quads) {
+    __m256i q0 = sum_quad_avx2(data + color_quad * 128, w, sat);
+    __m128i result = _mm_packus_epi16(_mm256_castsi256_si128(q0), _mm256_extracti128_si256(q0, 1));
+    _mm_storeu_si128((__m128i*)(&out[color_quad * 4]), result);
+  }
+}
 #endif
+}  // namespace
+
+void interp_time_of_day_slow(const math::Vector<s32, 4> itimes[4],
+                             const tfrag3::PackedTimeOfDay& in,
+                             math::Vector<u8, 4>* out) {
+  math::Vector<u16, 4> weights[8];
+  unpack_time_of_day_weights(itimes, weights);
+
+  math::Vector<u16, 4> temp[4];
+
+  for (u32 color_quad = 0; color_quad < (in.color_count + 3) / 4; color_quad++) {
+    for (auto& x : temp) {
+      x.set_zero();
+    }
+
+    const u8* input_ptr = in.data.data() + color_quad * 128;
+    for (u32 component = 0; component < 8; component++) {
+      for (u32 color = 0; color < 4; color++) {
+        for (u32 channel = 0; channel < 4; channel++) {
+          temp[color][channel] += weights[component][channel] * (*input_ptr);
+          input_ptr++;
+        }
+      }
+    }
+
+    for (u32 color = 0; color < 4; color++) {
+      auto& o = out[color_quad * 4 + color];
+      for (u32 channel = 0; channel < 3; channel++) {
+        o[channel] = std::min(255, temp[color][channel] >> 6);
+      }
+      o[3] = std::min(128, temp[color][3] >> 6);
+    }
+  }
+}
+
+void interp_time_of_day(const math::Vector<s32, 4> itimes[4],
+                        const tfrag3::PackedTimeOfDay& packed_colors,
+                        math::Vector<u8, 4>* out) {
+  math::Vector<u16, 4> weights[8];
+  unpack_time_of_day_weights(itimes, weights);
+#ifdef __aarch64__
+  interp_time_of_day_neon(weights, packed_colors, out);
+#else
+  if (get_cpu_info().has_avx2) {
+    interp_time_of_day_avx2(weights, packed_colors, out);
+  } else {
+    interp_time_of_day_sse(weights, packed_colors, out);
+  }
+#endif
+}
+
+bool TimeOfDayCache::needs_update(const math::Vector<s32, 4> itimes[4]) {
+  std::array<u32, 16> key;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      key[i * 4 + j] = itimes[i][j] & 0x00ff00ff;
+    }
+  }
+  if (m_valid && key == m_key) {
+    return false;
+  }
+  m_key = key;
+  m_valid = true;
+  return true;
 }
 
 bool sphere_in_view_ref(const math::Vector4f& sphere, const math::Vector4f* planes) {
@@ -423,6 +549,190 @@ void cull_check_all_slow(const math::Vector4f* planes,
   }
 }
 
+namespace {
+
+/*!
+ * Frustum planes, with each plane coefficient broadcast to all lanes so a group of spheres can be
+ * tested at once.
+ */
+struct SimdFrustum {
+#ifdef __AVX__
+  static constexpr int kWidth = 8;
+  __m256 coef[4][4];  // [plane][xyzw]
+#else
+  static constexpr int kWidth = 4;
+  __m128 coef[4][4];
+#endif
+
+  explicit SimdFrustum(const math::Vector4f* planes) {
+    for (int plane = 0; plane < 4; plane++) {
+      for (int i = 0; i < 4; i++) {
+#ifdef __AVX__
+        coef[plane][i] = _mm256_set1_ps(planes[i][plane]);
+#else
+        coef[plane][i] = _mm_set1_ps(planes[i][plane]);
+#endif
+      }
+    }
+  }
+};
+
+/*!
+ * Load 4 bounding spheres and transpose them into x, y, z, r registers.
+ * If there are fewer than 4, the last one is repeated.
+ */
+void load_spheres_x4(const tfrag3::VisNode* nodes, int count, __m128* x, __m128* y, __m128* z,
+                     __m128* r) {
+  __m128 s0 = _mm_loadu_ps(nodes[0].bsphere.data());
+  __m128 s1 = _mm_loadu_ps(nodes[std::min(1, count - 1)].bsphere.data());
+  __m128 s2 = _mm_loadu_ps(nodes[std::min(2, count - 1)].bsphere.data());
+  __m128 s3 = _mm_loadu_ps(nodes[std::min(3, count - 1)].bsphere.data());
+  _MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+  *x = s0;
+  *y = s1;
+  *z = s2;
+  *r = s3;
+}
+
+/*!
+ * Test up to SimdFrustum::kWidth consecutive bounding spheres against the frustum.
+ * Bit i of the result's low half is set if sphere i intersects the frustum (same test as
+ * sphere_in_view_ref), and bit i of the high half is set if it is entirely inside all planes.
+ */
+u32 test_sphere_group(const SimdFrustum& frustum, const tfrag3::VisNode* nodes, int count) {
+#ifdef __AVX__
+  __m128 x0, y0, z0, r0, x1, y1, z1, r1;
+  load_spheres_x4(nodes, count, &x0, &y0, &z0, &r0);
+  if (count > 4) {
+    load_spheres_x4(nodes + 4, count - 4, &x1, &y1, &z1, &r1);
+  } else {
+    x1 = x0;
+    y1 = y0;
+    z1 = z0;
+    r1 = r0;
+  }
+  __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+  __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+  __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+  __m256 r = _mm256_insertf128_ps(_mm256_castps128_ps256(r0), r1, 1);
+  __m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(), r);
+
+  __m256 in_view = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  __m256 inside = in_view;
+  for (const auto& plane : frustum.coef) {
+    __m256 dist = _mm256_mul_ps(plane[0], x);
+    dist = _mm256_add_ps(dist, _mm256_mul_ps(plane[1], y));
+    dist = _mm256_add_ps(dist, _mm256_mul_ps(plane[2], z));
+    dist = _mm256_sub_ps(dist, plane[3]);
+    in_view = _mm256_and_ps(in_view, _mm256_cmp_ps(dist, neg_r, _CMP_GT_OQ));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, r, _CMP_GT_OQ));
+  }
+  u32 valid = (1u << count) - 1;
+  u32 view_mask = _mm256_movemask_ps(in_view) & valid;
+  u32 inside_mask = _mm256_movemask_ps(inside) & valid;
+#else
+  __m128 x, y, z, r;
+  load_spheres_x4(nodes, count, &x, &y, &z, &r);
+  __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+  __m128 in_view = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  __m128 inside = in_view;
+  for (const auto& plane : frustum.coef) {
+    __m128 dist = _mm_mul_ps(plane[0], x);
+    dist = _mm_add_ps(dist, _mm_mul_ps(plane[1], y));
+    dist = _mm_add_ps(dist, _mm_mul_ps(plane[2], z));
+    dist = _mm_sub_ps(dist, plane[3]);
+    in_view = _mm_and_ps(in_view, _mm_cmpgt_ps(dist, neg_r));
+    inside = _mm_and_ps(inside, _mm_cmpgt_ps(dist, r));
+  }
+  u32 valid = (1u << count) - 1;
+  u32 view_mask = _mm_movemask_ps(in_view) & valid;
+  u32 inside_mask = _mm_movemask_ps(inside) & valid;
+#endif
+  return view_mask | (inside_mask << 16);
+}
+
+bool node_not_occluded(const tfrag3::VisNode& node, const u8* level_occlusion_string) {
+  if (!level_occlusion_string) {
+    return true;
+  }
+  u16 my_id = node.my_id;
+  return my_id != 0xffff && level_occlusion_string[my_id / 8] & (1 << (7 - (my_id & 7)));
+}
+
+struct HierarchicalCullState {
+  const tfrag3::BVH* bvh;
+  const u8* level_occlusion_string;
+  u8* out;
+};
+
+/*!
+ * Mark a node and all of its descendants as in view. Used once a parent sphere is known to be
+ * entirely inside the frustum, so there is no need to test the children.
+ */
+void accept_subtree(const HierarchicalCullState& state, u32 idx) {
+  const auto& node = state.bvh->vis_nodes[idx];
+  state.out[idx] = node_not_occluded(node, state.level_occlusion_string);
+  if (node.flags) {
+    u32 first_child = node.child_id - state.bvh->first_root;
+    for (u32 i = 0; i < node.num_kids; i++) {
+      accept_subtree(state, first_child + i);
+    }
+  }
+}
+
+/*!
+ * Cull a range of consecutive nodes (the roots, or the children of a single node).
+ * Children of nodes outside of the frustum are never visited, and are left as not visible.
+ */
+void cull_node_range(const HierarchicalCullState& state,
+                     const SimdFrustum& frustum,
+                     u32 first,
+                     u32 count) {
+  ASSERT(first + count <= state.bvh->vis_nodes.size());
+  const auto* nodes = state.bvh->vis_nodes.data();
+  for (u32 group = 0; group < count; group += SimdFrustum::kWidth) {
+    int group_size = std::min(count - group, (u32)SimdFrustum::kWidth);
+    u32 result = test_sphere_group(frustum, nodes + first + group, group_size);
+    u32 view_mask = result & 0xffff;
+    u32 inside_mask = result >> 16;
+    while (view_mask) {
+      int bit = std::countr_zero(view_mask);
+      view_mask &= view_mask - 1;
+      u32 idx = first + group + bit;
+      if (inside_mask & (1 << bit)) {
+        accept_subtree(state, idx);
+      } else {
+        const auto& node = nodes[idx];
+        state.out[idx] = node_not_occluded(node, state.level_occlusion_string);
+        if (node.flags) {
+          cull_node_range(state, frustum, node.child_id - state.bvh->first_root, node.num_kids);
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+/*!
+ * Frustum cull a BVH, producing the same per-node visibility string as cull_check_all_slow.
+ * This walks the tree from the roots: subtrees whose parent sphere is outside the frustum are
+ * skipped entirely, and subtrees whose parent sphere is fully inside are accepted without further
+ * sphere tests. The siblings of a node are consecutive, so they are tested in SIMD groups.
+ */
+void cull_check_hierarchical(const math::Vector4f* planes,
+                             const tfrag3::BVH& bvh,
+                             const u8* level_occlusion_string,
+                             u8* out) {
+  if (bvh.vis_nodes.empty()) {
+    return;
+  }
+  memset(out, 0, bvh.vis_nodes.size());
+  SimdFrustum frustum(planes);
+  HierarchicalCullState state{&bvh, level_occlusion_string, out};
+  cull_node_range(state, frustum, 0, std::min((u32)bvh.num_roots, (u32)bvh.vis_nodes.size()));
+}
+
 void make_all_visible_multidraws(std::pair<int, int>* draw_ptrs_out,
                                  GLsizei* counts_out,
                                  void** index_offsets_out,
@@ -484,11 +794,92 @@ u32 make_all_visible_index_list(std::pair<int, int>* group_out,
   return idx_buffer_ptr;
 }
 
+namespace {
+/*!
+ * Check if any byte is nonzero. Vis strings are mostly zeros, so this checks 64 bytes at a time.
+ */
+bool any_nonzero(const u8* data, u32 size) {
+  const __m128i zero = _mm_setzero_si128();
+  u32 i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(data + i + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(data + i + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(data + i + 48));
+    __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xffff) {
+      return true;
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) != 0xffff) {
+      return true;
+    }
+  }
+  for (; i < size; i++) {
+    if (data[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool draw_may_be_visible(const DrawVisRange& range,
+                         const std::vector<u8>& vis_data,
+                         bool draw_always_visible) {
+  if (range.always_visible && draw_always_visible) {
+    return true;
+  }
+  if (range.first_vis > range.last_vis) {
+    return false;  // no groups
+  }
+  return any_nonzero(vis_data.data() + range.first_vis, range.last_vis - range.first_vis + 1);
+}
+}  // namespace
+
+u64 draw_list_cache_key(const math::Vector4f* planes,
+                        const u8* level_occlusion_string,
+                        const u8* extra_data,
+                        size_t extra_data_size,
+                        u32 flags) {
+  u64 hash = XXH64(planes, 4 * sizeof(math::Vector4f), flags);
+  if (level_occlusion_string) {
+    hash = XXH64(level_occlusion_string, sizeof(LevelVis::data), hash);
+  } else {
+    hash = ~hash;
+  }
+  if (extra_data) {
+    hash = XXH64(extra_data, extra_data_size, hash);
+  }
+  return hash;
+}
+
+std::vector<DrawVisRange> make_draw_vis_ranges(const std::vector<tfrag3::StripDraw>& draws) {
+  std::vector<DrawVisRange> result(draws.size());
+  for (size_t i = 0; i < draws.size(); i++) {
+    auto& range = result[i];
+    for (auto& grp : draws[i].vis_groups) {
+      range.num_inds += grp.num_inds;
+      if (grp.vis_idx_in_pc_bvh == UINT16_MAX) {
+        range.always_visible = true;
+      } else {
+        range.first_vis = std::min(range.first_vis, grp.vis_idx_in_pc_bvh);
+        range.last_vis = std::max(range.last_vis, grp.vis_idx_in_pc_bvh);
+      }
+    }
+  }
+  return result;
+}
+
 u32 make_multidraws_from_vis_string(std::pair<int, int>* draw_ptrs_out,
                                     GLsizei* counts_out,
                                     void** index_offsets_out,
                                     const std::vector<tfrag3::StripDraw>& draws,
-                                    const std::vector<u8>& vis_data) {
+                                    const std::vector<DrawVisRange>& vis_ranges,
+                                    const std::vector<u8>& vis_data,
+                                    bool draw_always_visible,
+                                    MultidrawStats* stats_out) {
   u64 md_idx = 0;
   u32 num_tris = 0;
   u32 sanity_check = 0;
@@ -499,13 +890,21 @@ u32 make_multidraws_from_vis_string(std::pair<int, int>* draw_ptrs_out,
     std::pair<int, int> ds;
     ds.first = md_idx;
     ds.second = 0;
+    if (!draw_may_be_visible(vis_ranges[i], vis_data, draw_always_visible)) {
+      sanity_check += vis_ranges[i].num_inds;
+      stats_out->draws_skipped++;
+      draw_ptrs_out[i] = ds;
+      continue;
+    }
     bool building_run = false;
     u64 run_start = 0;
     for (auto& grp : draw.vis_groups) {
       sanity_check += grp.num_inds;
-      bool vis = grp.vis_idx_in_pc_bvh == UINT16_MAX || vis_data[grp.vis_idx_in_pc_bvh];
+      bool vis = grp.vis_idx_in_pc_bvh == UINT16_MAX ? draw_always_visible
+                                                     : vis_data[grp.vis_idx_in_pc_bvh];
       if (vis) {
         num_tris += grp.num_tris;
+        stats_out->visible_groups++;
       }
 
       if (building_run) {
@@ -536,6 +935,7 @@ u32 make_multidraws_from_vis_string(std::pair<int, int>* draw_ptrs_out,
 
     draw_ptrs_out[i] = ds;
   }
+  stats_out->entries += md_idx;
   return num_tris;
 }
 
@@ -543,8 +943,11 @@ u32 make_multidraws_from_vis_and_proto_string(std::pair<int, int>* draw_ptrs_out
                                               GLsizei* counts_out,
                                               void** index_offsets_out,
                                               const std::vector<tfrag3::StripDraw>& draws,
+                                              const std::vector<DrawVisRange>& vis_ranges,
                                               const std::vector<u8>& vis_data,
-                                              const std::vector<u8>& proto_vis_data) {
+                                              const std::vector<u8>& proto_vis_data,
+                                              bool draw_always_visible,
+                                              MultidrawStats* stats_out) {
   u64 md_idx = 0;
   u32 num_tris = 0;
   u32 sanity_check = 0;
@@ -555,14 +958,22 @@ u32 make_multidraws_from_vis_and_proto_string(std::pair<int, int>* draw_ptrs_out
     std::pair<int, int> ds;
     ds.first = md_idx;
     ds.second = 0;
+    if (!draw_may_be_visible(vis_ranges[i], vis_data, draw_always_visible)) {
+      sanity_check += vis_ranges[i].num_inds;
+      stats_out->draws_skipped++;
+      draw_ptrs_out[i] = ds;
+      continue;
+    }
     bool building_run = false;
     u64 run_start = 0;
     for (auto& grp : draw.vis_groups) {
       sanity_check += grp.num_inds;
-      bool vis = (grp.vis_idx_in_pc_bvh == UINT16_MAX || vis_data[grp.vis_idx_in_pc_bvh]) &&
+      bool vis = (grp.vis_idx_in_pc_bvh == UINT16_MAX ? draw_always_visible
+                                                      : vis_data[grp.vis_idx_in_pc_bvh]) &&
                  proto_vis_data[grp.tie_proto_idx];
       if (vis) {
         num_tris += grp.num_tris;
+        stats_out->visible_groups++;
       }
 
       if (building_run) {
@@ -593,13 +1004,16 @@ u32 make_multidraws_from_vis_and_proto_string(std::pair<int, int>* draw_ptrs_out
 
     draw_ptrs_out[i] = ds;
   }
+  stats_out->entries += md_idx;
   return num_tris;
 }
 
 u32 make_index_list_from_vis_string(std::pair<int, int>* group_out,
                                     u32* idx_out,
                                     const std::vector<tfrag3::StripDraw>& draws,
+                                    const std::vector<DrawVisRange>& vis_ranges,
                                     const std::vector<u8>& vis_data,
+                                    bool draw_always_visible,
                                     const u32* idx_in,
                                     u32* num_tris_out) {
   int idx_buffer_ptr = 0;
@@ -609,11 +1023,17 @@ u32 make_index_list_from_vis_string(std::pair<int, int>* group_out,
     int vtx_idx = 0;
     std::pair<int, int> ds;
     ds.first = idx_buffer_ptr;
+    if (!draw_may_be_visible(vis_ranges[i], vis_data, draw_always_visible)) {
+      ds.second = 0;
+      group_out[i] = ds;
+      continue;
+    }
     bool building_run = false;
     int run_start_out = 0;
     int run_start_in = 0;
     for (auto& grp : draw.vis_groups) {
-      bool vis = grp.vis_idx_in_pc_bvh == UINT16_MAX || vis_data[grp.vis_idx_in_pc_bvh];
+      bool vis = grp.vis_idx_in_pc_bvh == UINT16_MAX ? draw_always_visible
+                                                     : vis_data[grp.vis_idx_in_pc_bvh];
       if (vis) {
         num_tris += grp.num_tris;
       }
@@ -654,8 +1074,10 @@ u32 make_index_list_from_vis_string(std::pair<int, int>* group_out,
 u32 make_index_list_from_vis_and_proto_string(std::pair<int, int>* group_out,
                                               u32* idx_out,
                                               const std::vector<tfrag3::StripDraw>& draws,
+                                              const std::vector<DrawVisRange>& vis_ranges,
                                               const std::vector<u8>& vis_data,
                                               const std::vector<u8>& proto_vis_data,
+                                              bool draw_always_visible,
                                               const u32* idx_in,
                                               u32* num_tris_out) {
   int idx_buffer_ptr = 0;
@@ -665,11 +1087,17 @@ u32 make_index_list_from_vis_and_proto_string(std::pair<int, int>* group_out,
     int vtx_idx = 0;
     std::pair<int, int> ds;
     ds.first = idx_buffer_ptr;
+    if (!draw_may_be_visible(vis_ranges[i], vis_data, draw_always_visible)) {
+      ds.second = 0;
+      group_out[i] = ds;
+      continue;
+    }
     bool building_run = false;
     int run_start_out = 0;
     int run_start_in = 0;
     for (auto& grp : draw.vis_groups) {
-      bool vis = (grp.vis_idx_in_pc_bvh == UINT16_MAX || vis_data[grp.vis_idx_in_pc_bvh]) &&
+      bool vis = (grp.vis_idx_in_pc_bvh == UINT16_MAX ? draw_always_visible
+                                                      : vis_data[grp.vis_idx_in_pc_bvh]) &&
                  proto_vis_data[grp.tie_proto_idx];
       if (vis) {
         num_tris += grp.num_tris;
@@ -50,15 +50,64 @@ void first_tfrag_draw_setup(const GoalBackgroundCameraData& settings,
 void interp_time_of_day(const math::Vector<s32, 4> itimes[4],
                         const tfrag3::PackedTimeOfDay& packed_colors,
                         math::Vector<u8, 4>* out);
+void interp_time_of_day_slow(const math::Vector<s32, 4> itimes[4],
+                             const tfrag3::PackedTimeOfDay& in,
+                             math::Vector<u8, 4>* out);
+
+/*!
+ * Remembers the time of day weights last used to fill a time of day texture. The interpolation
+ * only uses the low byte of each half-word of itimes, so this is the key we compare against.
+ */
+class TimeOfDayCache {
+ public:
+  /*!
+   * Returns true if colors for these itimes differ from the cached ones, and updates the cache.
+   */
+  bool needs_update(const math::Vector<s32, 4> itimes[4]);
+  void invalidate() { m_valid = false; }
+
+ private:
+  std::array<u32, 16> m_key;
+  bool m_valid = false;
+};
 
 void cull_check_all_slow(const math::Vector4f* planes,
                          const std::vector<tfrag3::VisNode>& nodes,
                          const u8* level_occlusion_string,
                          u8* out);
 bool sphere_in_view_ref(const math::Vector4f& sphere, const math::Vector4f* planes);
+void cull_check_hierarchical(const math::Vector4f* planes,
+                             const tfrag3::BVH& bvh,
+                             const u8* level_occlusion_string,
+                             u8* out);
 
 void update_render_state_from_pc_settings(SharedRenderState* state, const TfragPcPortData& data);
 
+/*!
+ * The vis nodes used by the groups of a draw. The draw lists use this to skip draws where every
+ * node is invisible, with a SIMD scan of the vis string instead of checking each group.
+ */
+struct DrawVisRange {
+  u32 num_inds = 0;
+  u16 first_vis = UINT16_MAX;
+  u16 last_vis = 0;
+  bool always_visible = false;  // has a group that isn't culled.
+};
+
+std::vector<DrawVisRange> make_draw_vis_ranges(const std::vector<tfrag3::StripDraw>& draws);
+
+/*!
+ * Statistics from building multidraws from a vis string.
+ */
+struct MultidrawStats {
+  u32 visible_groups = 0;  // visible groups, before merging contiguous groups
+  u32 entries = 0;         // multidraw entries, after merging
+  u32 draws_skipped = 0;   // draws skipped by the vis string scan
+  u32 trees_reused = 0;    // trees that reused last frame's draw lists
+  void reset() { *this = {}; }
+  u32 merged() const { return visible_groups - entries; }
+};
+
 void make_all_visible_multidraws(std::pair<int, int>* draw_ptrs_out,
                                  GLsizei* counts_out,
                                  void** index_offsets_out,
@@ -69,11 +118,43 @@ u32 make_all_visible_multidraws(std::pair<int, int>* draw_ptrs_out,
                                 void** index_offsets_out,
                                 const std::vector<tfrag3::StripDraw>& draws);
 
+/*!
+ * The key used to build a tree's culling result and draw lists. If the key is unchanged from the
+ * last frame, the tree can skip culling and reuse its old draw lists.
+ */
+struct DrawListCache {
+  bool valid = false;
+  u64 key = 0;
+  u32 num_tris = 0;  // triangles in the cached lists, for the profiler
+
+  bool can_reuse(u64 new_key) const { return valid && key == new_key; }
+  void update(u64 new_key, u32 tris) {
+    valid = true;
+    key = new_key;
+    num_tris = tris;
+  }
+};
+
+/*!
+ * Hash the inputs to culling that are shared by all trees: the frustum planes, the level occlusion
+ * string (may be null), optional extra data (like TIE proto visibility), and renderer flags.
+ */
+u64 draw_list_cache_key(const math::Vector4f* planes,
+                        const u8* level_occlusion_string,
+                        const u8* extra_data,
+                        size_t extra_data_size,
+                        u32 flags);
+
+// The draw list builders below draw the groups that aren't in the BVH only if draw_always_visible
+// is set. With auto LOD, they must only be drawn by one geom of the tree.
 u32 make_multidraws_from_vis_string(std::pair<int, int>* draw_ptrs_out,
                                     GLsizei* counts_out,
                                     void** index_offsets_out,
                                     const std::vector<tfrag3::StripDraw>& draws,
-                                    const std::vector<u8>& vis_data);
+                                    const std::vector<DrawVisRange>& vis_ranges,
+                                    const std::vector<u8>& vis_data,
+                                    bool draw_always_visible,
+                                    MultidrawStats* stats_out);
 
 u32 make_all_visible_index_list(std::pair<int, int>* group_out,
                                 u32* idx_out,
@@ -84,7 +165,9 @@ u32 make_all_visible_index_list(std::pair<int, int>* group_out,
 u32 make_index_list_from_vis_string(std::pair<int, int>* group_out,
                                     u32* idx_out,
                                     const std::vector<tfrag3::StripDraw>& draws,
+                                    const std::vector<DrawVisRange>& vis_ranges,
                                     const std::vector<u8>& vis_data,
+                                    bool draw_always_visible,
                                     const u32* idx_in,
                                     u32* num_tris_out);
 
@@ -97,13 +180,18 @@ u32 make_multidraws_from_vis_and_proto_string(std::pair<int, int>* draw_ptrs_out
                                               GLsizei* counts_out,
                                               void** index_offsets_out,
                                               const std::vector<tfrag3::StripDraw>& draws,
+                                              const std::vector<DrawVisRange>& vis_ranges,
                                               const std::vector<u8>& vis_data,
-                                              const std::vector<u8>& proto_vis_data);
+                                              const std::vector<u8>& proto_vis_data,
+                                              bool draw_always_visible,
+                                              MultidrawStats* stats_out);
 
 u32 make_index_list_from_vis_and_proto_string(std::pair<int, int>* group_out,
                                               u32* idx_out,
                                               const std::vector<tfrag3::StripDraw>& draws,
+                                              const std::vector<DrawVisRange>& vis_ranges,
                                               const std::vector<u8>& vis_data,
                                               const std::vector<u8>& proto_vis_data,
+                                              bool draw_always_visible,
                                               const u32* idx_in,
                                               u32* num_tris_out);
@@ -123,6 +123,11 @@ void OpenGlDebugGui::draw(const DmaStats& dma_stats) {
         ImGui::Checkbox("Quick-Screenshot on F2", &screenshot_hotkey_enabled);
         ImGui::EndMenu();
       }
+      if (ImGui::BeginMenu("Frame Capture")) {
+        ImGui::MenuItem("Capture Frames!", nullptr, &want_frame_capture);
+        ImGui::InputInt("Frames", &frame_capture_count);
+        ImGui::EndMenu();
+      }
       ImGui::MenuItem("Subtitle Editor", nullptr, &m_subtitle_editor);
       ImGui::MenuItem("Debug Text Filter", nullptr, &m_filters_menu);
       ImGui::EndMenu();
@@ -151,6 +156,7 @@ void OpenGlDebugGui::draw(const DmaStats& dma_stats) {
         ImGui::Separator();
         ImGui::Checkbox("Accurate Lag Mode", &Gfx::g_global_settings.experimental_accurate_lag);
         ImGui::Checkbox("Sleep in Frame Limiter", &Gfx::g_global_settings.sleep_in_frame_limiter);
+        ImGui::Checkbox("Pipelined Frames", &Gfx::g_global_settings.pipelined_frames);
         ImGui::TreePop();
       }
       ImGui::Checkbox("Treat Pad0 as Pad1", &Gfx::g_debug_settings.treat_pad0_as_pad1);
@@ -168,6 +174,10 @@ void OpenGlDebugGui::draw(const DmaStats& dma_stats) {
         prof().set_enable(record_events);
       }
       ImGui::MenuItem("Dump to file", nullptr, &dump_events);
+      bool streaming = prof().streaming();
+      if (ImGui::Checkbox("Stream to file", &streaming)) {
+        toggle_stream_events = true;
+      }
       ImGui::EndMenu();
     }
 
@@ -65,7 +65,10 @@ class OpenGlDebugGui {
   bool small_profiler = false;
   bool record_events = false;
   bool dump_events = false;
+  bool toggle_stream_events = false;
   bool want_reboot_in_debug = false;
+  bool want_frame_capture = false;
+  int frame_capture_count = 300;
 
   bool screenshot_hotkey_enabled = true;
 
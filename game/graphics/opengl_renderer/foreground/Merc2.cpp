@@ -42,16 +42,11 @@
 
 /*!
  * Remaining ideas for optimization:
- * - port blerc to C++, do it in the rendering thread and avoid the lock.
  * - combine envmap draws per effect (might require some funky indexing stuff, or multidraw)
- * - smaller vertex formats for mod-vertex
  * - AVX version of vertex conversion math
  * - eliminate the "copy" step of vertex modification
- * - batch uploading the vertex modification data
  */
 
-std::mutex g_merc_data_mutex;
-
 Merc2::Merc2(ShaderLibrary& shaders, const std::vector<GLuint>* anim_slot_array)
     : m_anim_slot_array(anim_slot_array) {
   // Set up main vertex array. This will point to the data stored in the .FR3 level file, and will
@@ -59,15 +54,9 @@ Merc2::Merc2(ShaderLibrary& shaders, const std::vector<GLuint>* anim_slot_array)
   glGenVertexArrays(1, &m_vao);
   glBindVertexArray(m_vao);
 
-  // Bone buffer to store skinning matrices for multiple draws
-  glGenBuffers(1, &m_bones_buffer);
-  glBindBuffer(GL_UNIFORM_BUFFER, m_bones_buffer);
-
-  // zero initialize the bone buffer.
-  std::vector<u8> temp(MAX_SHADER_BONE_VECTORS * sizeof(math::Vector4f));
-  glBufferData(GL_UNIFORM_BUFFER, MAX_SHADER_BONE_VECTORS * sizeof(math::Vector4f), temp.data(),
-               GL_DYNAMIC_DRAW);
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  // Modified vertices are drawn from the vertex ring buffer, in either format.
+  glGenVertexArrays(1, &m_mod_vao);
+  glGenVertexArrays(1, &m_mod_compact_vao);
 
   // annoyingly, glBindBufferRange can have alignment restrictions that vary per platform.
   // the GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT gives us the minimum alignment for views into the bone
@@ -84,6 +73,9 @@ Merc2::Merc2(ShaderLibrary& shaders, const std::vector<GLuint>* anim_slot_array)
                  fmt::format("opengl uniform buffer alignment is {}, which is strange\n", val));
     }
   }
+  // lights are bound one at a time, so each needs to be aligned.
+  u32 align_bytes = m_opengl_buffer_alignment * 16;
+  m_lights_stride = ((sizeof(VuLights) + align_bytes - 1) / align_bytes) * align_bytes;
 
   // initialize draw buffers, these will store lists of draws to flush.
   for (int i = 0; i < MAX_LEVELS; i++) {
@@ -92,25 +84,20 @@ Merc2::Merc2(ShaderLibrary& shaders, const std::vector<GLuint>* anim_slot_array)
     draws.envmap_draws.resize(MAX_ENVMAP_DRAWS_PER_LEVEL);
   }
 
-  m_mod_vtx_temp.resize(MAX_MOD_VTX);
   m_mod_vtx_unpack_temp.resize(MAX_MOD_VTX * 2);
 
   for (auto& x : m_effect_debug_mask) {
     x = true;
   }
 
-  init_shader_common(shaders[ShaderId::MERC2], &m_merc_uniforms, true);
-  init_shader_common(shaders[ShaderId::EMERC], &m_emerc_uniforms, false);
+  init_shader_common(shaders[ShaderId::MERC2], &m_merc_uniforms);
+  init_shader_common(shaders[ShaderId::EMERC], &m_emerc_uniforms);
   m_emerc_uniforms.fade = glGetUniformLocation(shaders[ShaderId::EMERC].id(), "fade");
 }
 
 Merc2::~Merc2() {
-  for (auto& x : m_mod_vtx_buffers) {
-    glDeleteBuffers(1, &x.vertex);
-    glDeleteVertexArrays(1, &x.vao);
-  }
-
-  glDeleteBuffers(1, &m_bones_buffer);
+  glDeleteVertexArrays(1, &m_mod_vao);
+  glDeleteVertexArrays(1, &m_mod_compact_vao);
   glDeleteVertexArrays(1, &m_vao);
 }
 
@@ -168,10 +155,8 @@ float blerc_multiplier = 1.f;
 
 void Merc2::model_mod_blerc_draws(int num_effects,
                                   const tfrag3::MercModel* model,
-                                  const LevelData* lev,
-                                  ModBuffers* mod_opengl_buffers,
-                                  const float* blerc_weights,
-                                  MercDebugStats* stats) {
+                                  u32* first_mod_vtx,
+                                  const float* blerc_weights) {
   // loop over effects.
   for (int ei = 0; ei < num_effects; ei++) {
     const auto& effect = model->effects[ei];
@@ -180,10 +165,6 @@ void Merc2::model_mod_blerc_draws(int num_effects,
       continue;
     }
 
-    // grab opengl buffer
-    auto opengl_buffers = alloc_mod_vtx_buffer(lev);
-    mod_opengl_buffers[ei] = opengl_buffers;
-
     // check that we have enough room for the finished thing.
     if (effect.mod.vertices.size() > MAX_MOD_VTX) {
       fmt::print("More mod vertices than MAX_MOD_VTX. {} > {}\n", effect.mod.vertices.size(),
@@ -191,25 +172,124 @@ void Merc2::model_mod_blerc_draws(int num_effects,
       ASSERT_NOT_REACHED();
     }
 
+    // queue the blerc math to run on the workers at the next flush.
+    first_mod_vtx[ei] = alloc_mod_vtx(effect.mod.vertices.size());
+    auto& job = m_pending_blerc.emplace_back();
+    job.effect = &effect;
+    memcpy(job.weights.data(), blerc_weights, kMaxBlerc * sizeof(float));
+    job.vtx_offset = first_mod_vtx[ei];
+  }
+}
+
+/*!
+ * Compute vertices for all blerc effects queued since the last flush.
+ */
+void Merc2::run_pending_blerc() {
+  if (m_pending_blerc.empty()) {
+    return;
+  }
+  auto p = scoped_prof("blerc");
+
+  // effects are independent, and each writes to its own part of m_mod_vtx.
+  m_blerc_workers.parallel_for(m_pending_blerc.size(), [&](int i) {
+    const auto& job = m_pending_blerc[i];
+    const auto& mod = job.effect->mod;
+    auto* out = m_mod_vtx.data() + job.vtx_offset;
     // start with the correct vertices from the model data:
-    memcpy(m_mod_vtx_temp.data(), effect.mod.vertices.data(),
-           sizeof(tfrag3::MercVertex) * effect.mod.vertices.size());
+    memcpy(out, mod.vertices.data(), sizeof(tfrag3::MercVertex) * mod.vertices.size());
+    const u32* i_data = mod.blerc.int_data.data();
+    blerc_avx(i_data, i_data + mod.blerc.int_data.size(), mod.blerc.float_data.data(),
+              job.weights.data(), out, blerc_multiplier);
+  });
+  m_pending_blerc.clear();
+}
+
+/*!
+ * Reserve space for count modified vertices, returning the index of the first.
+ */
+u32 Merc2::alloc_mod_vtx(u32 count) {
+  u32 first = m_mod_vtx_used;
+  m_mod_vtx_used += count;
+  if (m_mod_vtx.size() < m_mod_vtx_used) {
+    m_mod_vtx.resize(m_mod_vtx_used);
+  }
+  return first;
+}
 
-    // do blerc math
-    const auto* f_data = effect.mod.blerc.float_data.data();
-    const u32* i_data = effect.mod.blerc.int_data.data();
-    const u32* i_data_end = i_data + effect.mod.blerc.int_data.size();
-    blerc_avx(i_data, i_data_end, f_data, blerc_weights, m_mod_vtx_temp.data(), blerc_multiplier);
+namespace {
+u32 pack_normal(const float* nrm) {
+  // the length of the normal doesn't matter, the shader normalizes after skinning.
+  float len = std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+  float scale = len > 0 ? 511.f / len : 0;
+  u32 result = 0;
+  for (int i = 0; i < 3; i++) {
+    s32 v = std::clamp((s32)std::round(nrm[i] * scale), -511, 511);
+    result |= (v & 0x3ff) << (10 * i);
+  }
+  return result;
+}
 
-    // and upload to GPU
-    stats->num_uploads++;
-    stats->num_upload_bytes += effect.mod.vertices.size() * sizeof(tfrag3::MercVertex);
-    {
-      glBindBuffer(GL_ARRAY_BUFFER, opengl_buffers.vertex);
-      glBufferData(GL_ARRAY_BUFFER, effect.mod.vertices.size() * sizeof(tfrag3::MercVertex),
-                   m_mod_vtx_temp.data(), GL_DYNAMIC_DRAW);
-    }
+u16 pack_weight(float w) {
+  return std::clamp((s32)std::round(w * UINT16_MAX), 0, (s32)UINT16_MAX);
+}
+}  // namespace
+
+/*!
+ * Copy all modified vertices for this flush to the vertex ring, converting them to the compact
+ * format if enabled.
+ */
+void Merc2::upload_mod_vtx(MercDebugStats* stats) {
+  if (!m_mod_vtx_used) {
+    return;
+  }
+  auto p = scoped_prof("mod-vtx-upload");
+  stats->num_mod_vertices += m_mod_vtx_used;
+  stats->num_uploads++;
+
+  if (m_use_compact_mod_vtx) {
+    constexpr u32 kStride = sizeof(CompactMercVertex);
+    u32 offset;
+    auto* out = (CompactMercVertex*)m_vertex_ring.map(m_mod_vtx_used * kStride, kStride, &offset);
+    constexpr u32 kChunk = 4096;
+    m_blerc_workers.parallel_for((m_mod_vtx_used + kChunk - 1) / kChunk, [&](int chunk) {
+      u32 end = std::min(m_mod_vtx_used, (chunk + 1) * kChunk);
+      for (u32 i = chunk * kChunk; i < end; i++) {
+        const auto& in = m_mod_vtx[i];
+        CompactMercVertex v;
+        memcpy(v.pos, in.pos, sizeof(v.pos));
+        v.normal = pack_normal(in.normal);
+        for (int j = 0; j < 3; j++) {
+          v.weights[j] = pack_weight(in.weights[j]);
+        }
+        v.weights[3] = 0;
+        memcpy(v.st, in.st, sizeof(v.st));
+        memcpy(v.rgba, in.rgba, sizeof(v.rgba));
+        memcpy(v.mats, in.mats, sizeof(v.mats));
+        memcpy(&out[i], &v, sizeof(v));
+      }
+    });
+    m_vertex_ring.unmap();
+    m_mod_vtx_base = offset / kStride;
+    stats->num_upload_bytes += m_mod_vtx_used * kStride;
+  } else {
+    constexpr u32 kStride = sizeof(tfrag3::MercVertex);
+    u32 offset = m_vertex_ring.write(m_mod_vtx.data(), m_mod_vtx_used * kStride, kStride);
+    m_mod_vtx_base = offset / kStride;
+    stats->num_upload_bytes += m_mod_vtx_used * kStride;
+  }
+
+  // the ring may have moved to a new buffer, so the vertex arrays need to be pointed at it.
+  if (m_vertex_ring.generation() != m_mod_vao_generation) {
+    m_mod_vao_generation = m_vertex_ring.generation();
+    glBindVertexArray(m_mod_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_ring.buffer());
+    setup_merc_vao();
+    glBindVertexArray(m_mod_compact_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_ring.buffer());
+    setup_compact_merc_vao();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
+  m_mod_vtx_used = 0;
 }
 
 // We can run into a problem where adding a PC model would overflow the
@@ -219,11 +299,9 @@ void Merc2::model_mod_blerc_draws(int num_effects,
 
 void Merc2::model_mod_draws(int num_effects,
                             const tfrag3::MercModel* model,
-                            const LevelData* lev,
                             const u8* input_data,
                             const DmaTransfer& setup,
-                            ModBuffers* mod_opengl_buffers,
-                            MercDebugStats* stats) {
+                            u32* first_mod_vtx) {
   auto p = scoped_prof("update-verts");
 
   // loop over effects. Mod vertices are done per effect (possibly a bad idea?)
@@ -235,10 +313,6 @@ void Merc2::model_mod_draws(int num_effects,
     }
 
     prof().begin_event("start1");
-    // grab opengl buffer
-    auto opengl_buffers = alloc_mod_vtx_buffer(lev);
-    mod_opengl_buffers[ei] = opengl_buffers;
-
     // check that we have enough room for the finished thing.
     if (effect.mod.vertices.size() > MAX_MOD_VTX) {
       fmt::print("More mod vertices than MAX_MOD_VTX. {} > {}\n", effect.mod.vertices.size(),
@@ -254,7 +328,9 @@ void Merc2::model_mod_draws(int num_effects,
     }
 
     // start with the "correct" vertices from the model data:
-    memcpy(m_mod_vtx_temp.data(), effect.mod.vertices.data(),
+    first_mod_vtx[ei] = alloc_mod_vtx(effect.mod.vertices.size());
+    auto* mod_vtx = m_mod_vtx.data() + first_mod_vtx[ei];
+    memcpy(mod_vtx, effect.mod.vertices.data(),
            sizeof(tfrag3::MercVertex) * effect.mod.vertices.size());
 
     // get pointers to the fragment and fragment control data
@@ -278,13 +354,9 @@ void Merc2::model_mod_draws(int num_effects,
     float xyz_scale = model->xyz_scale;
     prof().end_event();
     {
-      // we're going to look at data that the game may be modifying.
-      // in the original game, they didn't have any lock, but I think that the
-      // scratchpad access from the EE would effectively block the VIF1 DMA, so you'd
-      // hopefully never get a partially updated model (which causes obvious holes).
-      // this lock is not ideal, and can block the rendering thread while blerc_execute runs,
-      // which can take up to 2ms on really blerc-heavy scenes
-      std::unique_lock<std::mutex> lk(g_merc_data_mutex);
+      // we're going to look at data that the game may be modifying. Models with blend shapes use
+      // the PC blerc path above, and the game only runs its own blerc on warp models, which are
+      // drawn by generic, so no lock is needed here.
       [[maybe_unused]] int frags_done = 0;
       auto p = scoped_prof("vert-math");
 
@@ -371,22 +443,12 @@ void Merc2::model_mod_draws(int num_effects,
       for (u32 vi = 0; vi < effect.mod.vertices.size(); vi++) {
         u32 addr = effect.mod.vertex_lump4_addr[vi];
         if (addr < vidx) {
-          memcpy(&m_mod_vtx_temp[vi], &m_mod_vtx_unpack_temp[addr], 32);
-          m_mod_vtx_temp[vi].st[0] = m_mod_vtx_unpack_temp[addr].uv[0];
-          m_mod_vtx_temp[vi].st[1] = m_mod_vtx_unpack_temp[addr].uv[1];
+          memcpy(&mod_vtx[vi], &m_mod_vtx_unpack_temp[addr], 32);
+          mod_vtx[vi].st[0] = m_mod_vtx_unpack_temp[addr].uv[0];
+          mod_vtx[vi].st[1] = m_mod_vtx_unpack_temp[addr].uv[1];
         }
       }
     }
-
-    // and upload to GPU
-    stats->num_uploads++;
-    stats->num_upload_bytes += effect.mod.vertices.size() * sizeof(tfrag3::MercVertex);
-    {
-      auto pp = scoped_prof("update-verts-upload");
-      glBindBuffer(GL_ARRAY_BUFFER, opengl_buffers.vertex);
-      glBufferData(GL_ARRAY_BUFFER, effect.mod.vertices.size() * sizeof(tfrag3::MercVertex),
-                   m_mod_vtx_temp.data(), GL_DYNAMIC_DRAW);
-    }
   }
 }
 
@@ -560,12 +622,12 @@ void Merc2::handle_pc_model(const DmaTransfer& setup,
 
   // Next is pointers to merc data, needed so we can update vertices
 
-  // will hold opengl buffers for the updated vertices
-  ModBuffers mod_opengl_buffers[kMaxEffect];
+  // will hold the location of the updated vertices
+  u32 first_mod_vtx[kMaxEffect];
   if (model_uses_pc_blerc) {
-    model_mod_blerc_draws(num_effects, model, lev, mod_opengl_buffers, blerc_weights, stats);
+    model_mod_blerc_draws(num_effects, model, first_mod_vtx, blerc_weights);
   } else if (model_uses_mod) {  // only if we've enabled, this path is slow.
-    model_mod_draws(num_effects, model, lev, input_data, setup, mod_opengl_buffers, stats);
+    model_mod_draws(num_effects, model, input_data, setup, first_mod_vtx);
   }
 
   // stats
@@ -644,16 +706,16 @@ void Merc2::handle_pc_model(const DmaTransfer& setup,
       for (auto& mdraw : effect.mod.mod_draw) {
         auto n = alloc_normal_draw(mdraw, ignore_alpha, lev_bucket, first_bone, lights, uses_water,
                                    model_disables_fog);
-        // modify the draw, set the mod flag and point it to the opengl buffer
+        // modify the draw, set the mod flag and point it to the modified vertices
         n->flags |= MOD_VTX;
-        n->mod_vtx_buffer = mod_opengl_buffers[ei];
+        n->first_mod_vtx = first_mod_vtx[ei];
         if (should_envmap) {
           auto e =
               try_alloc_envmap_draw(mdraw, effect.envmap_mode, effect.envmap_texture, lev_bucket,
                                     fade_buffer + 4 * ei, first_bone, lights, uses_water);
           if (e) {
             e->flags |= MOD_VTX;
-            e->mod_vtx_buffer = mod_opengl_buffers[ei];
+            e->first_mod_vtx = first_mod_vtx[ei];
           }
         }
       }
@@ -685,6 +747,13 @@ void Merc2::draw_debug_window(MercDebugStats* stats) {
 
   ImGui::Text("Uploads  : %d", stats->num_uploads);
   ImGui::Text("Upload kB: %d", stats->num_upload_bytes / 1024);
+  ImGui::Text("Mod vtx  : %d", stats->num_mod_vertices);
+  ImGui::Text("Ring wait: %d uniform, %d vertex", m_uniform_ring.stats().fence_waits,
+              m_vertex_ring.stats().fence_waits);
+  if (ImGui::Checkbox("Mapped uploads", &m_vertex_ring.use_map)) {
+    m_uniform_ring.use_map = m_vertex_ring.use_map;
+  }
+  ImGui::Checkbox("Compact mod vertices", &m_use_compact_mod_vtx);
 
   ImGui::Checkbox("Debug", &stats->collect_debug_model_list);
 
@@ -710,19 +779,9 @@ void Merc2::draw_debug_window(MercDebugStats* stats) {
   }
 }
 
-void Merc2::init_shader_common(Shader& shader, Uniforms* uniforms, bool include_lights) {
+void Merc2::init_shader_common(Shader& shader, Uniforms* uniforms) {
   auto id = shader.id();
   shader.activate();
-  if (include_lights) {
-    uniforms->light_direction[0] = glGetUniformLocation(id, "light_dir0");
-    uniforms->light_direction[1] = glGetUniformLocation(id, "light_dir1");
-    uniforms->light_direction[2] = glGetUniformLocation(id, "light_dir2");
-    uniforms->light_color[0] = glGetUniformLocation(id, "light_col0");
-    uniforms->light_color[1] = glGetUniformLocation(id, "light_col1");
-    uniforms->light_color[2] = glGetUniformLocation(id, "light_col2");
-    uniforms->light_ambient = glGetUniformLocation(id, "light_ambient");
-  }
-
   uniforms->hvdf_offset = glGetUniformLocation(id, "hvdf_offset");
 
   uniforms->fog = glGetUniformLocation(id, "fog_constants");
@@ -832,9 +891,6 @@ void Merc2::handle_all_dma(DmaFollower& dma,
 }
 
 namespace {
-void set_uniform(GLuint uniform, const math::Vector3f& val) {
-  glUniform3f(uniform, val.x(), val.y(), val.z());
-}
 void set_uniform(GLuint uniform, const math::Vector4f& val) {
   glUniform4f(uniform, val.x(), val.y(), val.z(), val.w());
 }
@@ -1014,21 +1070,6 @@ u32 Merc2::alloc_bones(int count, ShaderMercMat* data) {
   return first_bone_vector;
 }
 
-Merc2::ModBuffers Merc2::alloc_mod_vtx_buffer(const LevelData* lev) {
-  if (m_next_mod_vtx_buffer >= m_mod_vtx_buffers.size()) {
-    GLuint b;
-    glGenBuffers(1, &b);
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, b);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lev->merc_indices);
-    setup_merc_vao();
-    m_mod_vtx_buffers.push_back({vao, b});
-  }
-  return m_mod_vtx_buffers[m_next_mod_vtx_buffer++];
-}
-
 Merc2::Draw* Merc2::try_alloc_envmap_draw(const tfrag3::MercDraw& mdraw,
                                           const DrawMode& envmap_mode,
                                           u32 envmap_texture,
@@ -1162,10 +1203,63 @@ void Merc2::setup_merc_vao() {
   );
 }
 
+/*!
+ * Same as setup_merc_vao, but for CompactMercVertex.
+ */
+void Merc2::setup_compact_merc_vao() {
+  glEnable(GL_PRIMITIVE_RESTART);
+  glPrimitiveRestartIndex(UINT32_MAX);
+  for (int i = 0; i < 6; i++) {
+    glEnableVertexAttribArray(i);
+  }
+  constexpr GLsizei stride = sizeof(CompactMercVertex);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void*)offsetof(CompactMercVertex, pos));
+  glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                        (void*)offsetof(CompactMercVertex, normal));
+  glVertexAttribPointer(2, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                        (void*)offsetof(CompactMercVertex, weights));
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(CompactMercVertex, st));
+  glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                        (void*)offsetof(CompactMercVertex, rgba));
+  glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, stride, (void*)offsetof(CompactMercVertex, mats));
+}
+
 void Merc2::flush_draw_buckets(SharedRenderState* render_state,
                                ScopedProfilerNode& prof,
                                MercDebugStats* stats) {
   stats->num_draw_flush++;
+  run_pending_blerc();
+  upload_mod_vtx(stats);
+
+  if (m_next_free_bone_vector) {
+    // each draw binds a full ub_bones block starting at its first bone, so leave room for that
+    // after the last one.
+    u32 bone_bytes = m_next_free_bone_vector * sizeof(math::Vector4f);
+    u32 offset;
+    u8* bones = m_uniform_ring.map(bone_bytes + MAX_SKEL_BONES * sizeof(ShaderMercMat),
+                                   m_opengl_buffer_alignment * 16, &offset);
+    memcpy(bones, m_shader_bone_vector_buffer, bone_bytes);
+    m_uniform_ring.unmap();
+    m_bones_offset = offset;
+    stats->num_bones_uploaded += m_next_free_bone_vector;
+    stats->num_uploads++;
+    stats->num_upload_bytes += bone_bytes;
+  }
+
+  if (m_next_free_light) {
+    u32 offset;
+    u8* lights = m_uniform_ring.map(m_next_free_light * m_lights_stride,
+                                    m_opengl_buffer_alignment * 16, &offset);
+    for (u32 i = 0; i < m_next_free_light; i++) {
+      memcpy(lights + i * m_lights_stride, &m_lights_buffer[i], sizeof(VuLights));
+    }
+    m_uniform_ring.unmap();
+    m_lights_offset = offset;
+    stats->num_uploads++;
+    stats->num_upload_bytes += m_next_free_light * m_lights_stride;
+  }
+
   for (u32 li = 0; li < m_next_free_level_bucket; li++) {
     const auto& lev_bucket = m_level_draw_buckets[li];
     const auto* lev = lev_bucket.level;
@@ -1173,12 +1267,6 @@ void Merc2::flush_draw_buckets(SharedRenderState* render_state,
     glBindBuffer(GL_ARRAY_BUFFER, lev->merc_vertices);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lev->merc_indices);
     setup_merc_vao();
-    stats->num_bones_uploaded += m_next_free_bone_vector;
-
-    glBindBuffer(GL_UNIFORM_BUFFER, m_bones_buffer);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_next_free_bone_vector * sizeof(math::Vector4f),
-                    m_shader_bone_vector_buffer);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     switch_to_merc2(render_state);
     do_draws(lev_bucket.draws.data(), lev, lev_bucket.next_free_draw, m_merc_uniforms, prof, false,
@@ -1193,7 +1281,6 @@ void Merc2::flush_draw_buckets(SharedRenderState* render_state,
   m_next_free_light = 0;
   m_next_free_bone_vector = 0;
   m_next_free_level_bucket = 0;
-  m_next_mod_vtx_buffer = 0;
 }
 
 void Merc2::do_draws(const Draw* draw_array,
@@ -1213,10 +1300,11 @@ void Merc2::do_draws(const Draw* draw_array,
   for (u32 di = 0; di < num_draws; di++) {
     auto& draw = draw_array[di];
     if (draw.flags & MOD_VTX) {
-      glBindVertexArray(draw.mod_vtx_buffer.vao);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lev->merc_indices);
-      glBindBuffer(GL_ARRAY_BUFFER, lev->merc_vertices);
-      normal_vtx_buffer_bound = false;
+      if (normal_vtx_buffer_bound) {
+        glBindVertexArray(m_use_compact_mod_vtx ? m_mod_compact_vao : m_mod_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lev->merc_indices);
+        normal_vtx_buffer_bound = false;
+      }
     } else {
       if (!normal_vtx_buffer_bound) {
         glBindVertexArray(m_vao);
@@ -1258,13 +1346,8 @@ void Merc2::do_draws(const Draw* draw_array,
     }
 
     if ((int)draw.light_idx != last_light && !set_fade) {
-      set_uniform(uniforms.light_direction[0], m_lights_buffer[draw.light_idx].direction0);
-      set_uniform(uniforms.light_direction[1], m_lights_buffer[draw.light_idx].direction1);
-      set_uniform(uniforms.light_direction[2], m_lights_buffer[draw.light_idx].direction2);
-      set_uniform(uniforms.light_color[0], m_lights_buffer[draw.light_idx].color0);
-      set_uniform(uniforms.light_color[1], m_lights_buffer[draw.light_idx].color1);
-      set_uniform(uniforms.light_color[2], m_lights_buffer[draw.light_idx].color2);
-      set_uniform(uniforms.light_ambient, m_lights_buffer[draw.light_idx].ambient);
+      glBindBufferRange(GL_UNIFORM_BUFFER, 2, m_uniform_ring.buffer(),
+                        m_lights_offset + draw.light_idx * m_lights_stride, sizeof(VuLights));
       last_light = draw.light_idx;
     }
     setup_opengl_from_draw_mode(draw.mode, GL_TEXTURE0, use_mipmaps_for_filtering);
@@ -1281,10 +1364,17 @@ void Merc2::do_draws(const Draw* draw_array,
 
     prof.add_draw_call();
     prof.add_tri(draw.num_triangles);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 1, m_bones_buffer,
-                      sizeof(math::Vector4f) * draw.first_bone, 128 * sizeof(ShaderMercMat));
-    glDrawElements(GL_TRIANGLE_STRIP, draw.index_count, GL_UNSIGNED_INT,
-                   (void*)(sizeof(u32) * draw.first_index));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 1, m_uniform_ring.buffer(),
+                      m_bones_offset + sizeof(math::Vector4f) * draw.first_bone,
+                      MAX_SKEL_BONES * sizeof(ShaderMercMat));
+    if (draw.flags & MOD_VTX) {
+      glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, draw.index_count, GL_UNSIGNED_INT,
+                               (void*)(sizeof(u32) * draw.first_index),
+                               m_mod_vtx_base + draw.first_mod_vtx);
+    } else {
+      glDrawElements(GL_TRIANGLE_STRIP, draw.index_count, GL_UNSIGNED_INT,
+                     (void*)(sizeof(u32) * draw.first_index));
+    }
   }
 
   if (!normal_vtx_buffer_bound) {
@@ -1,5 +1,8 @@
 #pragma once
+#include "common/util/WorkerPool.h"
+
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
+#include "game/graphics/opengl_renderer/opengl_utils.h"
 
 struct MercDebugStats {
   int num_models = 0;
@@ -17,6 +20,7 @@ struct MercDebugStats {
 
   int num_upload_bytes = 0;
   int num_uploads = 0;
+  int num_mod_vertices = 0;
 
   struct DrawDebug {
     DrawMode mode;
@@ -47,6 +51,8 @@ class Merc2 {
               SharedRenderState* render_state,
               ScopedProfilerNode& prof,
               MercDebugStats* stats);
+  // total bytes written to the bone, light and vertex ring buffers.
+  u64 upload_bytes() const { return m_uniform_ring.stats().bytes + m_vertex_ring.stats().bytes; }
   static constexpr int kMaxBlerc = 40;
 
  private:
@@ -86,10 +92,6 @@ class Merc2 {
                        MercDebugStats* stats);
   u32 alloc_lights(const VuLights& lights);
 
-  struct ModBuffers {
-    GLuint vao, vertex;
-  };
-
   static constexpr int kMaxEffect = 64;
   bool m_effect_debug_mask[kMaxEffect];
 
@@ -116,10 +118,6 @@ class Merc2 {
   math::Vector4f m_shader_bone_vector_buffer[MAX_SHADER_BONE_VECTORS];
 
   struct Uniforms {
-    GLuint light_direction[3];
-    GLuint light_color[3];
-    GLuint light_ambient;
-
     GLuint hvdf_offset;
     GLuint fog;
 
@@ -139,7 +137,7 @@ class Merc2 {
 
   Uniforms m_merc_uniforms, m_emerc_uniforms;
 
-  void init_shader_common(Shader& shader, Uniforms* uniforms, bool include_lights);
+  void init_shader_common(Shader& shader, Uniforms* uniforms);
   void handle_setup_dma(DmaFollower& dma, SharedRenderState* render_state);
   void handle_all_dma(DmaFollower& dma,
                       SharedRenderState* render_state,
@@ -156,12 +154,20 @@ class Merc2 {
   GLuint m_vao;
 
   void setup_merc_vao();
-
-  std::vector<ModBuffers> m_mod_vtx_buffers;
-  u32 m_next_mod_vtx_buffer = 0;
+  void setup_compact_merc_vao();
+
+  // smaller version of tfrag3::MercVertex, used for uploading modified vertices.
+  struct CompactMercVertex {
+    float pos[3];
+    u32 normal;      // 2-10-10-10 signed normalized
+    u16 weights[4];  // unsigned normalized, last is padding
+    float st[2];
+    u8 rgba[4];
+    u8 mats[4];
+  };
+  static_assert(sizeof(CompactMercVertex) == 40);
 
   static constexpr int MAX_MOD_VTX = UINT16_MAX;
-  std::vector<tfrag3::MercVertex> m_mod_vtx_temp;
 
   struct UnpackTempVtx {
     float pos[4];
@@ -170,9 +176,35 @@ class Merc2 {
   };
   std::vector<UnpackTempVtx> m_mod_vtx_unpack_temp;
 
-  ModBuffers alloc_mod_vtx_buffer(const LevelData* lev);
-
-  GLuint m_bones_buffer;
+  // modified vertices for all models in this flush. Draws refer to them by index, and they are
+  // uploaded to m_vertex_ring once at flush time.
+  std::vector<tfrag3::MercVertex> m_mod_vtx;
+  u32 m_mod_vtx_used = 0;
+  u32 alloc_mod_vtx(u32 count);
+  void upload_mod_vtx(MercDebugStats* stats);
+
+  // blerc effects waiting for the next flush. The math runs on m_blerc_workers, writing to
+  // m_mod_vtx at vtx_offset.
+  struct PendingBlerc {
+    const tfrag3::MercEffect* effect = nullptr;
+    std::array<float, kMaxBlerc> weights;
+    u32 vtx_offset = 0;
+  };
+  std::vector<PendingBlerc> m_pending_blerc;
+  WorkerPool m_blerc_workers{WorkerPool::default_worker_count(4)};
+  void run_pending_blerc();
+
+  // per-frame data: bones and lights in the uniform ring, modified vertices in the vertex ring.
+  StreamRingBuffer m_uniform_ring{GL_UNIFORM_BUFFER, 2 * 1024 * 1024};
+  StreamRingBuffer m_vertex_ring{GL_ARRAY_BUFFER, 8 * 1024 * 1024};
+  u32 m_bones_offset = 0;
+  u32 m_lights_offset = 0;
+  u32 m_lights_stride = 0;
+  u32 m_mod_vtx_base = 0;
+  GLuint m_mod_vao = 0;
+  GLuint m_mod_compact_vao = 0;
+  u32 m_mod_vao_generation = 0;
+  bool m_use_compact_mod_vtx = true;
 
   enum DrawFlags {
     IGNORE_ALPHA = 1,
@@ -188,7 +220,7 @@ class Merc2 {
     u16 first_bone;
     u16 light_idx;
     u8 flags;
-    ModBuffers mod_vtx_buffer;
+    u32 first_mod_vtx;
     u8 fade[4];
   };
 
@@ -244,15 +276,11 @@ class Merc2 {
                           MercDebugStats* stats);
   void model_mod_draws(int num_effects,
                        const tfrag3::MercModel* model,
-                       const LevelData* lev,
                        const u8* input_data,
                        const DmaTransfer& setup,
-                       ModBuffers* mod_opengl_buffers,
-                       MercDebugStats* stats);
+                       u32* first_mod_vtx);
   void model_mod_blerc_draws(int num_effects,
                              const tfrag3::MercModel* model,
-                             const LevelData* lev,
-                             ModBuffers* mod_opengl_buffers,
-                             const float* blerc_weights,
-                             MercDebugStats* stats);
+                             u32* first_mod_vtx,
+                             const float* blerc_weights);
 };
@@ -1,14 +1,65 @@
 #include "Loader.h"
 
+#include "common/custom_data/fr3_file.h"
 #include "common/global_profiler/GlobalProfiler.h"
 #include "common/util/FileUtil.h"
+#include "common/util/MappedFile.h"
 #include "common/util/Timer.h"
-#include "common/util/compress.h"
 
 #include "game/graphics/opengl_renderer/loader/LoaderStages.h"
 
 #include "third-party/imgui/imgui.h"
 
+namespace {
+/*!
+ * Approximate memory used by a decoded and unpacked level.
+ */
+size_t level_memory_estimate(const tfrag3::Level& level) {
+  tfrag3::MemoryUsageTracker tracker;
+  level.memory_usage(&tracker);
+  size_t result = 0;
+  for (auto x : tracker.data) {
+    result += x;
+  }
+  for (auto& trees : level.tfrag_trees) {
+    for (auto& tree : trees) {
+      result += tree.unpacked.vertices.size() * sizeof(tfrag3::PreloadedVertex);
+      result += tree.unpacked.indices.size() * sizeof(u32);
+    }
+  }
+  for (auto& trees : level.tie_trees) {
+    for (auto& tree : trees) {
+      result += tree.unpacked.vertices.size() * sizeof(tfrag3::PreloadedVertex);
+      result += tree.unpacked.indices.size() * sizeof(u32);
+    }
+  }
+  for (auto& tree : level.shrub_trees) {
+    result += tree.unpacked.vertices.size() * sizeof(tfrag3::ShrubGpuVertex);
+  }
+  for (auto& tex : level.textures) {
+    if (tex.format != tfrag3::TextureFormat::RGBA8) {
+      result += tex.data.size() * sizeof(u32);
+    }
+  }
+  return result;
+}
+
+/*!
+ * Decode the largest mip of compressed textures to RGBA data. Textures given to the pool need the
+ * pixels on the CPU. Textures of the common level are the sources of animated textures, so all of
+ * them are decoded.
+ */
+void decode_compressed_textures(tfrag3::Level& level, WorkerPool& workers, bool pool_only) {
+  std::vector<tfrag3::Texture*> textures;
+  for (auto& tex : level.textures) {
+    if (tex.format != tfrag3::TextureFormat::RGBA8 && (tex.load_to_pool || !pool_only)) {
+      textures.push_back(&tex);
+    }
+  }
+  workers.parallel_for(textures.size(), [&](int i) { decode_texture(*textures[i]); });
+}
+}  // namespace
+
 Loader::Loader(const fs::path& base_path, int max_levels)
     : m_base_path(base_path), m_max_levels(max_levels) {
   m_loader_thread = std::thread(&Loader::loader_thread, this);
@@ -56,7 +107,20 @@ void Loader::debug_print_loaded_levels() {
  */
 void Loader::set_want_levels(const std::vector<std::string>& levels) {
   std::unique_lock<std::mutex> lk(m_loader_mutex);
-  m_desired_levels = levels;
+  if (levels != m_desired_levels) {
+    // remember which levels are wanted together, these are the ones to prefetch later.
+    for (auto& a : levels) {
+      for (auto& b : levels) {
+        if (a != b) {
+          m_level_neighbors[a].insert(b);
+        }
+      }
+    }
+    m_desired_levels = levels;
+    m_prefetch_skipped.clear();
+    // there may be a new level to prefetch.
+    m_loader_cv.notify_all();
+  }
   if (!m_level_to_load.empty()) {
     // can't do anything, we're loading a level right now
     return;
@@ -73,6 +137,10 @@ void Loader::set_want_levels(const std::vector<std::string>& levels) {
     if (it == m_loaded_tfrag3_levels.end()) {
       // we haven't loaded it yet. Request this level to load and wake up the thread.
       m_level_to_load = lev;
+      if (!m_level_to_prefetch.empty() && m_level_to_prefetch != lev) {
+        // the loader is busy guessing, stop so it can load this one.
+        m_cancel_prefetch = true;
+      }
       lk.unlock();
       m_loader_cv.notify_all();
       return;
@@ -89,6 +157,17 @@ void Loader::set_active_levels(const std::vector<std::string>& levels) {
   m_active_levels = levels;
 }
 
+/*!
+ * Set the amount of memory used for prefetched levels. 0 disables prefetching.
+ */
+void Loader::set_prefetch_budget(size_t bytes) {
+  std::unique_lock<std::mutex> lk(m_loader_mutex);
+  m_prefetch_budget = bytes;
+  m_prefetch_skipped.clear();
+  evict_prefetched_levels();
+  m_loader_cv.notify_all();
+}
+
 /*!
  * Get all levels that are in memory and used very recently.
  */
@@ -157,88 +236,246 @@ void Loader::draw_debug_window() {
     ImGui::Separator();
   }
 
+  draw_prefetch_debug();
+  ImGui::Separator();
+  ImGui::Text("texture uploads");
+  m_texture_uploads.draw_debug_window();
   ImGui::End();
 }
 
+void Loader::draw_prefetch_debug() {
+  ImGui::Text("prefetch");
+  int budget_mb = m_prefetch_budget / (1024 * 1024);
+  if (ImGui::SliderInt("budget (MB)", &budget_mb, 0, 2048)) {
+    m_prefetch_budget = (size_t)budget_mb * 1024 * 1024;
+    m_prefetch_skipped.clear();
+    evict_prefetched_levels();
+    m_loader_cv.notify_all();
+  }
+  ImGui::Text("  using %.1f MB, %d levels", m_prefetch_bytes / (1024.f * 1024.f),
+              (int)m_prefetched_levels.size());
+  ImGui::Text("  %d hits, %d misses", m_prefetch_stats.hits, m_prefetch_stats.misses);
+  ImGui::Text("  %d prefetched, %d kept after unload, %d evicted", m_prefetch_stats.prefetched,
+              m_prefetch_stats.kept, m_prefetch_stats.evicted);
+  if (!m_level_to_prefetch.empty()) {
+    ImGui::Text("  prefetching %s", m_level_to_prefetch.c_str());
+  }
+  for (auto& lev : m_prefetched_levels) {
+    ImGui::Text("  %20s : %.1f MB", lev.name.c_str(), lev.bytes / (1024.f * 1024.f));
+  }
+}
+
+/*!
+ * Read and decode a level's FR3 file. Called from the loader thread, without holding the lock.
+ * Prefetches are only a guess, so they are decoded on the loader thread alone, leaving the other
+ * cores to the game, and give up (returning nullptr) if the game wants a different level.
+ */
+std::unique_ptr<tfrag3::Level> Loader::read_level(const std::string& name, bool prefetch) {
+  // map the fr3 file. The data is read from disk as it's decoded, and uncompressed sections
+  // are deserialized straight from the OS file cache.
+  prof().begin_event("map-file");
+  Timer disk_timer;
+  MappedFile file(m_base_path / fmt::format("{}.fr3", name));
+  double disk_load_time = disk_timer.getSeconds();
+  prof().end_event();
+
+  // decompress, deserialize and "unpack", which creates the vertex data we'll upload to the
+  // GPU. Chunked FR3 files are split into sections that are all done in parallel.
+  prof().begin_event("decode-file");
+  Timer decode_timer;
+  auto result = prefetch ? tfrag3::read_fr3(file.data(), file.size(), nullptr, true,
+                                            &m_cancel_prefetch)
+                         : tfrag3::read_fr3(file.data(), file.size(), &m_decode_workers, true);
+  if (!result) {
+    prof().end_event();
+    fmt::print("------------> Prefetch of {} canceled\n", name);
+    return nullptr;
+  }
+  decode_compressed_textures(*result, m_decode_workers, true);
+  double decode_time = decode_timer.getSeconds();
+  prof().end_event();
+
+  fmt::print("------------> Map file {}: {:.3f}s, decode {:.3f}s ({})\n", name, disk_load_time,
+             decode_time,
+             tfrag3::is_chunked_fr3(file.data(), file.size()) ? "chunked" : "single frame");
+  return result;
+}
+
+/*!
+ * Size of a level's serialized data, from the header of its FR3 file. Returns 0 if there's no file.
+ */
+size_t Loader::level_serialized_size(const std::string& name) const {
+  auto path = m_base_path / fmt::format("{}.fr3", name);
+  std::error_code ec;
+  if (!fs::exists(path, ec)) {
+    return 0;
+  }
+  MappedFile file(path);
+  return tfrag3::fr3_serialized_size(file.data(), file.size());
+}
+
+/*!
+ * Pick a level that isn't loaded, but will likely be wanted soon: wanted levels that are waiting
+ * for another level to finish, then levels that were wanted along with the current ones before.
+ * Must hold the loader mutex.
+ */
+std::string Loader::get_level_to_prefetch() {
+  if (m_prefetch_bytes >= m_prefetch_budget) {
+    return {};
+  }
+  // don't bother decoding levels that would be evicted right away. A decoded level is at least as
+  // big as its serialized data, which the file header tells us without decoding anything.
+  auto fits_budget = [&](const std::string& name) {
+    auto it = m_level_serialized_sizes.find(name);
+    if (it == m_level_serialized_sizes.end()) {
+      it = m_level_serialized_sizes.emplace(name, level_serialized_size(name)).first;
+    }
+    return it->second > 0 && it->second <= m_prefetch_budget;
+  };
+  auto should_prefetch = [&](const std::string& name) {
+    return name != m_level_to_load &&
+           m_loaded_tfrag3_levels.find(name) == m_loaded_tfrag3_levels.end() &&
+           m_initializing_tfrag3_levels.find(name) == m_initializing_tfrag3_levels.end() &&
+           !m_prefetch_skipped.count(name) &&
+           std::find_if(m_prefetched_levels.begin(), m_prefetched_levels.end(),
+                        [&](const PrefetchedLevel& lev) { return lev.name == name; }) ==
+               m_prefetched_levels.end() &&
+           fits_budget(name);
+  };
+
+  for (auto& lev : m_desired_levels) {
+    if (should_prefetch(lev)) {
+      return lev;
+    }
+  }
+
+  for (auto& lev : m_desired_levels) {
+    const auto& neighbors = m_level_neighbors.find(lev);
+    if (neighbors == m_level_neighbors.end()) {
+      continue;
+    }
+    for (auto& neighbor : neighbors->second) {
+      if (should_prefetch(neighbor)) {
+        return neighbor;
+      }
+    }
+  }
+  return {};
+}
+
+/*!
+ * Remove a level from the prefetch cache, or return nullptr if it's not there.
+ * Must hold the loader mutex.
+ */
+std::unique_ptr<tfrag3::Level> Loader::take_prefetched_level(const std::string& name) {
+  for (auto it = m_prefetched_levels.begin(); it != m_prefetched_levels.end(); ++it) {
+    if (it->name == name) {
+      auto result = std::move(it->level);
+      m_prefetch_bytes -= it->bytes;
+      m_prefetched_levels.erase(it);
+      return result;
+    }
+  }
+  return nullptr;
+}
+
+/*!
+ * Add a decoded level to the prefetch cache, evicting the least recently used levels to stay in
+ * the budget. Must hold the loader mutex.
+ */
+void Loader::add_prefetched_level(const std::string& name, std::unique_ptr<tfrag3::Level> level) {
+  auto& entry = m_prefetched_levels.emplace_back();
+  entry.name = name;
+  entry.bytes = level_memory_estimate(*level);
+  entry.level = std::move(level);
+  m_prefetch_bytes += entry.bytes;
+  evict_prefetched_levels();
+}
+
+/*!
+ * Evict the least recently used levels until the cache is in the budget. Evicted levels aren't
+ * prefetched again until the wanted levels change, so two levels that don't fit together don't
+ * keep replacing each other. Must hold the loader mutex.
+ */
+void Loader::evict_prefetched_levels() {
+  while (m_prefetch_bytes > m_prefetch_budget) {
+    auto& oldest = m_prefetched_levels.front();
+    m_prefetch_skipped.insert(oldest.name);
+    m_prefetch_bytes -= oldest.bytes;
+    m_prefetched_levels.pop_front();
+    m_prefetch_stats.evicted++;
+  }
+}
+
 /*!
  * Loader function that runs in a completely separate thread.
  * This is used for file I/O and unpacking.
  */
 void Loader::loader_thread() {
+  prof().set_thread_name("loader");
   try {
     while (!m_want_shutdown) {
       prof().root_event();
       std::unique_lock<std::mutex> lk(m_loader_mutex);
 
-      // this will keep us asleep until we've got a level to load.
-      m_loader_cv.wait(lk, [&] { return !m_level_to_load.empty() || m_want_shutdown; });
+      // this will keep us asleep until we've got a level to load or prefetch.
+      m_loader_cv.wait(lk, [&] {
+        if (!m_level_to_load.empty() || m_want_shutdown) {
+          return true;
+        }
+        m_level_to_prefetch = get_level_to_prefetch();
+        return !m_level_to_prefetch.empty();
+      });
       if (m_want_shutdown) {
         return;
       }
-      std::string lev = m_level_to_load;
-      // don't hold the lock while reading the file.
-      lk.unlock();
 
-      // simulate slower hard drive (so that the loader thread can lose to the game loads)
-      // std::this_thread::sleep_for(std::chrono::milliseconds(1500));
-
-      // load the fr3 file
-      prof().begin_event("read-file");
-      Timer disk_timer;
-      auto data = file_util::read_binary_file(m_base_path / fmt::format("{}.fr3", lev));
-      double disk_load_time = disk_timer.getSeconds();
-      prof().end_event();
-
-      // the FR3 files are compressed
-      prof().begin_event("decompress-file");
-      Timer decomp_timer;
-      auto decomp_data = compression::decompress_zstd(data.data(), data.size());
-      double decomp_time = decomp_timer.getSeconds();
-      prof().end_event();
-
-      // Read back into the tfrag3::Level structure
-      prof().begin_event("deserialize");
-      Timer import_timer;
-      auto result = std::make_unique<tfrag3::Level>();
-      Serializer ser(decomp_data.data(), decomp_data.size());
-      result->serialize(ser);
-      double import_time = import_timer.getSeconds();
-      prof().end_event();
-
-      // and finally "unpack", which creates the vertex data we'll upload to the GPU
-
-      Timer unpack_timer;
-      {
-        auto p = scoped_prof("tie-unpack");
-        for (auto& tie_tree : result->tie_trees) {
-          for (auto& tree : tie_tree) {
-            tree.unpack();
-          }
+      std::string lev;
+      std::unique_ptr<tfrag3::Level> result;
+      if (m_level_to_load.empty()) {
+        // nothing requested, read a level that will probably be wanted soon.
+        lev = m_level_to_prefetch;
+        m_cancel_prefetch = false;
+        lk.unlock();
+        try {
+          result = read_level(lev, true);
+        } catch (std::exception& e) {
+          // only a guess, so it's fine if the level doesn't exist.
+          fmt::print("Failed to prefetch {}: {}\n", lev, e.what());
         }
-      }
-
-      {
-        auto p = scoped_prof("tfrag-unpack");
-        for (auto& t_tree : result->tfrag_trees) {
-          for (auto& tree : t_tree) {
-            tree.unpack();
+        lk.lock();
+        m_level_to_prefetch.clear();
+        if (!result) {
+          if (!m_cancel_prefetch) {
+            m_prefetch_skipped.insert(lev);
           }
+          continue;
         }
-      }
-
-      {
-        auto p = scoped_prof("shrub-unpack");
-        for (auto& shrub_tree : result->shrub_trees) {
-          shrub_tree.unpack();
+        m_prefetch_stats.prefetched++;
+        if (m_level_to_load != lev) {
+          add_prefetched_level(lev, std::move(result));
+          continue;
+        }
+        // the game asked for this level while it was being read, so it can be used right away.
+        m_prefetch_stats.hits++;
+      } else {
+        lev = m_level_to_load;
+        result = take_prefetched_level(lev);
+        if (result) {
+          m_prefetch_stats.hits++;
+        } else {
+          m_prefetch_stats.misses++;
+          // don't hold the lock while reading the file.
+          lk.unlock();
+
+          // simulate slower hard drive (so that the loader thread can lose to the game loads)
+          // std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+          result = read_level(lev, false);
+
+          // grab the lock again
+          lk.lock();
         }
       }
-
-      fmt::print(
-          "------------> Load from file: {:.3f}s, import {:.3f}s, decomp {:.3f}s unpack {:.3f}s\n",
-          disk_load_time, import_time, decomp_time, unpack_timer.getSeconds());
-
-      // grab the lock again
-      lk.lock();
       // move this level to "initializing" state.
       m_initializing_tfrag3_levels[lev] = std::make_unique<LevelData>();  // reset load state
       m_initializing_tfrag3_levels[lev]->level = std::move(result);
@@ -255,14 +492,11 @@ void Loader::loader_thread() {
  * This should be called during initialization, before any threaded loading goes on.
  */
 const tfrag3::Level& Loader::load_common(TexturePool& tex_pool, const std::string& name) {
-  auto data = file_util::read_binary_file(m_base_path / fmt::format("{}.fr3", name));
-
-  auto decomp_data = compression::decompress_zstd(data.data(), data.size());
-  Serializer ser(decomp_data.data(), decomp_data.size());
-  m_common_level.level = std::make_unique<tfrag3::Level>();
-  m_common_level.level->serialize(ser);
+  MappedFile file(m_base_path / fmt::format("{}.fr3", name));
+  m_common_level.level = tfrag3::read_fr3(file.data(), file.size(), &m_decode_workers, false);
+  decode_compressed_textures(*m_common_level.level, m_decode_workers, false);
   for (auto& tex : m_common_level.level->textures) {
-    m_common_level.textures.push_back(add_texture(tex_pool, tex, true));
+    m_common_level.textures.push_back(add_texture(tex_pool, tex, true, &m_texture_uploads));
   }
 
   Timer tim;
@@ -287,10 +521,9 @@ bool Loader::upload_textures(Timer& timer, LevelData& data, TexturePool& texture
   int bytes_this_run = 0;
   int tex_this_run = 0;
   if (data.textures.size() < data.level->textures.size()) {
-    std::unique_lock<std::mutex> tpool_lock(texture_pool.mutex());
     while (data.textures.size() < data.level->textures.size()) {
       auto& tex = data.level->textures[data.textures.size()];
-      data.textures.push_back(add_texture(texture_pool, tex, false));
+      data.textures.push_back(add_texture(texture_pool, tex, false, &m_texture_uploads));
       bytes_this_run += tex.w * tex.h * 4;
       tex_this_run++;
       if (tex_this_run > 20) {
@@ -379,6 +612,7 @@ const std::string* Loader::get_most_unloadable_level() {
 
 void Loader::update(TexturePool& texture_pool) {
   Timer loader_timer;
+  m_texture_uploads.begin_frame();
 
   {
     // lock because we're accessing m_active_levels
@@ -417,6 +651,7 @@ void Loader::update(TexturePool& texture_pool) {
       loader_input.lev_data = lev.get();
       loader_input.mercs = &m_all_merc_models;
       loader_input.tex_pool = &texture_pool;
+      loader_input.tex_uploads = &m_texture_uploads;
 
       for (auto& stage : m_loader_stages) {
         auto evt = scoped_prof(fmt::format("stage-{}", stage->name()).c_str());
@@ -453,15 +688,20 @@ void Loader::update(TexturePool& texture_pool) {
         auto& lev = m_loaded_tfrag3_levels.at(*to_unload);
         std::unique_lock<std::mutex> lk(texture_pool.mutex());
         fmt::print("------------------------- PC unloading {}\n", *to_unload);
+        std::vector<GLuint> textures_to_delete;
         for (size_t i = 0; i < lev->level->textures.size(); i++) {
           auto& tex = lev->level->textures[i];
           if (tex.load_to_pool) {
             texture_pool.unload_texture(PcTextureId::from_combo_id(tex.combo_id),
-                                        lev->textures.at(i));
+                                        lev->textures.at(i), (const u8*)tex.data.data());
+          }
+          // other levels may still use the same texture.
+          if (texture_pool.release_shared_texture(lev->textures.at(i))) {
+            textures_to_delete.push_back(lev->textures.at(i));
           }
         }
         lk.unlock();
-        for (auto tex : lev->textures) {
+        for (auto tex : textures_to_delete) {
           if (EXTRA_TEX_DEBUG) {
             for (auto& slot : texture_pool.all_textures()) {
               if (slot.source) {
@@ -505,6 +745,12 @@ void Loader::update(TexturePool& texture_pool) {
           mercs.erase(it);
         }
 
+        // keep the decoded level around, the game may want it again soon.
+        std::unique_lock<std::mutex> loader_lk(m_loader_mutex);
+        if (m_prefetch_budget > 0) {
+          m_prefetch_stats.kept++;
+          add_prefetched_level(*to_unload, std::move(lev->level));
+        }
         m_loaded_tfrag3_levels.erase(*to_unload);
       }
     }
@@ -1,20 +1,27 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <list>
 #include <mutex>
 #include <thread>
+#include <unordered_set>
 
 #include "common/custom_data/Tfrag3Data.h"
 #include "common/util/FileUtil.h"
 #include "common/util/Timer.h"
+#include "common/util/WorkerPool.h"
 
 #include "game/graphics/opengl_renderer/loader/common.h"
+#include "game/graphics/opengl_renderer/opengl_utils.h"
 #include "game/graphics/texture/TexturePool.h"
 
 class Loader {
  public:
   static constexpr float TIE_LOAD_BUDGET = 1.5f;
   static constexpr float SHARED_TEXTURE_LOAD_BUDGET = 3.f;
+  // enough to keep a recently unloaded level or two around, without raising memory use much.
+  static constexpr size_t DEFAULT_PREFETCH_BUDGET = 64 * 1024 * 1024;
   Loader(const fs::path& base_path, int max_levels);
   ~Loader();
   void update(TexturePool& tex_pool);
@@ -24,12 +31,20 @@ class Loader {
   const tfrag3::Level& load_common(TexturePool& tex_pool, const std::string& name);
   void set_want_levels(const std::vector<std::string>& levels);
   void set_active_levels(const std::vector<std::string>& levels);
+  void set_prefetch_budget(size_t bytes);
   std::vector<LevelData*> get_in_use_levels();
   void draw_debug_window();
   void debug_print_loaded_levels();
 
  private:
   void loader_thread();
+  std::unique_ptr<tfrag3::Level> read_level(const std::string& name, bool prefetch);
+  std::string get_level_to_prefetch();
+  size_t level_serialized_size(const std::string& name) const;
+  std::unique_ptr<tfrag3::Level> take_prefetched_level(const std::string& name);
+  void add_prefetched_level(const std::string& name, std::unique_ptr<tfrag3::Level> level);
+  void evict_prefetched_levels();
+  void draw_prefetch_debug();
   bool upload_textures(Timer& timer, LevelData& data, TexturePool& texture_pool);
 
   const std::string* get_most_unloadable_level();
@@ -42,12 +57,41 @@ class Loader {
   std::string m_level_to_load;
 
   std::thread m_loader_thread;
+  // used by the loader thread to decode the sections of chunked FR3 files in parallel.
+  WorkerPool m_decode_workers{WorkerPool::default_worker_count(8)};
   std::mutex m_loader_mutex;
   std::condition_variable m_loader_cv;
   std::condition_variable m_file_load_done_cv;
   bool m_want_shutdown = false;
   uint64_t m_id = 0;
 
+  // levels that were decoded ahead of time, or kept after being unloaded from the GPU, so they
+  // can skip the file read when the game wants them. Least recently used first.
+  struct PrefetchedLevel {
+    std::string name;
+    std::unique_ptr<tfrag3::Level> level;
+    size_t bytes = 0;
+  };
+  std::list<PrefetchedLevel> m_prefetched_levels;
+  size_t m_prefetch_bytes = 0;
+  size_t m_prefetch_budget = DEFAULT_PREFETCH_BUDGET;
+  std::string m_level_to_prefetch;
+  // set when the game wants a different level than the one being prefetched.
+  std::atomic<bool> m_cancel_prefetch = false;
+  // levels that were wanted at the same time. These are likely to be wanted after each other.
+  std::unordered_map<std::string, std::unordered_set<std::string>> m_level_neighbors;
+  // levels evicted since the wanted levels last changed.
+  std::unordered_set<std::string> m_prefetch_skipped;
+  // serialized size of each level's FR3 file, read from its header. 0 if there's no file.
+  std::unordered_map<std::string, size_t> m_level_serialized_sizes;
+  struct {
+    u32 hits = 0;
+    u32 misses = 0;
+    u32 prefetched = 0;
+    u32 kept = 0;
+    u32 evicted = 0;
+  } m_prefetch_stats;
+
   // used only by game thread
   std::unordered_map<std::string, std::unique_ptr<LevelData>> m_loaded_tfrag3_levels;
 
@@ -57,6 +101,7 @@ class Loader {
   std::vector<std::string> m_active_levels;
   std::vector<std::unique_ptr<LoaderStage>> m_loader_stages;
   std::vector<GLuint> m_garbage_textures;
+  TextureUploadQueue m_texture_uploads;
   std::vector<GLuint> m_garbage_buffers;
 
   fs::path m_base_path;
@@ -4,22 +4,86 @@
 
 #include "common/global_profiler/GlobalProfiler.h"
 
+#include "game/graphics/opengl_renderer/opengl_utils.h"
+
+#include "third-party/zstd/lib/common/xxhash.h"
+
 constexpr float LOAD_BUDGET = 4.5f;
 
+BcFormat texture_bc_format(const tfrag3::Texture& tex) {
+  ASSERT(tex.format != tfrag3::TextureFormat::RGBA8);
+  return tex.format == tfrag3::TextureFormat::BC1 ? BcFormat::BC1 : BcFormat::BC3;
+}
+
 /*!
- * Upload a texture to the GPU, and give it to the pool.
+ * Decode the largest mip of a compressed texture to RGBA data, if it hasn't been already.
  */
-u64 add_texture(TexturePool& pool, const tfrag3::Texture& tex, bool is_common) {
+void decode_texture(tfrag3::Texture& tex) {
+  if (tex.format == tfrag3::TextureFormat::RGBA8 || !tex.data.empty()) {
+    return;
+  }
+  tex.data.resize(tex.w * tex.h);
+  bc_decode_image(texture_bc_format(tex), tex.compressed_data.data(), tex.w, tex.h,
+                  tex.data.data(), tex.bc1_alpha);
+}
+
+/*!
+ * Upload a texture to the GPU, and give it to the pool. If another level has already uploaded a
+ * texture with the same contents, that one is used instead. The pool's mutex is only held while
+ * updating the pool, not during the upload, so the game isn't blocked from uploading tpages.
+ * The upload goes through the upload queue's staging buffers, if there is one.
+ * Compressed textures are uploaded compressed if the driver supports it. BC1 textures that aren't
+ * fully opaque are uploaded as BC3, to give them their alpha. Textures given to the pool must
+ * already be decoded by the loader thread. Other compressed textures are only decoded here if the
+ * driver can't use them.
+ */
+u64 add_texture(TexturePool& pool,
+                tfrag3::Texture& tex,
+                bool is_common,
+                TextureUploadQueue* uploads) {
+  bool compressed = tex.format != tfrag3::TextureFormat::RGBA8 && uploads &&
+                    texture_compression_s3tc_supported();
+  if (!compressed) {
+    decode_texture(tex);
+  }
+  ASSERT(!tex.load_to_pool || tex.format == tfrag3::TextureFormat::RGBA8 || !tex.data.empty());
+  bool add_alpha = tex.format == tfrag3::TextureFormat::BC1 && tex.bc1_alpha != 255;
+  u32 bytes = compressed ? tex.compressed_data.size() * (add_alpha ? 2 : 1)
+                         : tex.data.size() * sizeof(u32);
+  u64 hash = compressed ? XXH64(tex.compressed_data.data(), tex.compressed_data.size(),
+                                ((u64)tex.bc1_alpha << 40) | ((u64)tex.format << 32) |
+                                    ((u64)tex.w << 16) | tex.h)
+                        : XXH64(tex.data.data(), bytes, ((u64)tex.w << 16) | tex.h);
   GLuint gl_tex;
-  glActiveTexture(GL_TEXTURE0);
-  glGenTextures(1, &gl_tex);
-  glBindTexture(GL_TEXTURE_2D, gl_tex);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.w, tex.h, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
-               tex.data.data());
-  glGenerateMipmap(GL_TEXTURE_2D);
-  float aniso = 0.0f;
-  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &aniso);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, aniso);
+  std::unique_lock<std::mutex> lk(pool.mutex());
+  auto shared = pool.acquire_shared_texture(hash);
+  lk.unlock();
+  if (shared) {
+    gl_tex = *shared;
+  } else {
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &gl_tex);
+    glBindTexture(GL_TEXTURE_2D, gl_tex);
+    if (compressed && add_alpha) {
+      auto bc3 = bc1_to_bc3(tex.compressed_data.data(), tex.compressed_data.size(), tex.bc1_alpha);
+      uploads->upload_compressed(gl_tex, BcFormat::BC3, bc3.data(), tex.w, tex.h);
+    } else if (compressed) {
+      uploads->upload_compressed(gl_tex, texture_bc_format(tex), tex.compressed_data.data(), tex.w,
+                                 tex.h);
+    } else if (uploads) {
+      uploads->upload(gl_tex, tex.data.data(), tex.w, tex.h);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex.w, tex.h, 0, GL_RGBA,
+                   GL_UNSIGNED_INT_8_8_8_8_REV, tex.data.data());
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    float aniso = 0.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &aniso);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, aniso);
+    lk.lock();
+    pool.add_shared_texture(hash, gl_tex, bytes);
+    lk.unlock();
+  }
   if (tex.load_to_pool) {
     TextureInput in;
     in.debug_page_name = tex.debug_tpage_name;
@@ -30,6 +94,7 @@ u64 add_texture(TexturePool& pool, const tfrag3::Texture& tex, bool is_common) {
     in.common = is_common;
     in.id = PcTextureId::from_combo_id(tex.combo_id);
     in.src_data = (const u8*)tex.data.data();
+    lk.lock();
     pool.give_texture(in);
   }
 
@@ -40,21 +105,19 @@ class TextureLoaderStage : public LoaderStage {
  public:
   TextureLoaderStage() : LoaderStage("texture") {}
   bool run(Timer& timer, LoaderInput& data) override {
-    constexpr int MAX_TEX_BYTES_PER_FRAME = 1024 * 1024;
-
-    int bytes_this_run = 0;
     int tex_this_run = 0;
     if (data.lev_data->textures.size() < data.lev_data->level->textures.size()) {
-      std::unique_lock<std::mutex> tpool_lock(data.tex_pool->mutex());
-      while (data.lev_data->textures.size() < data.lev_data->level->textures.size()) {
+      // the upload queue has a per-frame byte budget, shared with other uploads.
+      while (data.lev_data->textures.size() < data.lev_data->level->textures.size() &&
+             data.tex_uploads->has_budget()) {
         auto& tex = data.lev_data->level->textures[data.lev_data->textures.size()];
-        data.lev_data->textures.push_back(add_texture(*data.tex_pool, tex, false));
-        bytes_this_run += tex.w * tex.h * 4;
+        data.lev_data->textures.push_back(
+            add_texture(*data.tex_pool, tex, false, data.tex_uploads));
         tex_this_run++;
         if (tex_this_run > 20) {
           break;
         }
-        if (bytes_this_run > MAX_TEX_BYTES_PER_FRAME || timer.getMs() > LOAD_BUDGET) {
+        if (timer.getMs() > LOAD_BUDGET) {
           break;
         }
       }
@@ -1,9 +1,16 @@
 #pragma once
 
+#include "common/texture/texture_compression.h"
+
 #include "game/graphics/opengl_renderer/loader/common.h"
 
 std::vector<std::unique_ptr<LoaderStage>> make_loader_stages();
-u64 add_texture(TexturePool& pool, const tfrag3::Texture& tex, bool is_common);
+BcFormat texture_bc_format(const tfrag3::Texture& tex);
+void decode_texture(tfrag3::Texture& tex);
+u64 add_texture(TexturePool& pool,
+                tfrag3::Texture& tex,
+                bool is_common,
+                TextureUploadQueue* uploads = nullptr);
 
 class MercLoaderStage : public LoaderStage {
  public:
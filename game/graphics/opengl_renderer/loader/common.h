@@ -8,6 +8,8 @@
 
 #include "third-party/glad/include/glad/glad.h"
 
+class TextureUploadQueue;
+
 struct LevelData {
   std::unique_ptr<tfrag3::Level> level;
   std::vector<GLuint> textures;
@@ -46,6 +48,7 @@ struct MercRef {
 struct LoaderInput {
   LevelData* lev_data;
   TexturePool* tex_pool;
+  TextureUploadQueue* tex_uploads = nullptr;
   std::unordered_map<std::string, std::vector<MercRef>>* mercs;
 };
 
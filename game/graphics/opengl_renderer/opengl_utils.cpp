@@ -1,12 +1,17 @@
 #include "opengl_utils.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
+#include <cstring>
 
+#include "common/texture/texture_compression.h"
 #include "common/util/Assert.h"
 
 #include "game/graphics/opengl_renderer/BucketRenderer.h"
 
+#include "third-party/imgui/imgui.h"
+
 FramebufferTexturePair::FramebufferTexturePair(int w, int h, u64 texture_format, int num_levels)
     : m_w(w), m_h(h) {
   m_framebuffers.resize(num_levels);
@@ -230,3 +235,338 @@ void FramebufferCopier::copy_back_now(int render_fb_w, int render_fb_h, GLuint r
 
   glBindFramebuffer(GL_FRAMEBUFFER, render_fb);
 }
+
+StreamRingBuffer::StreamRingBuffer(GLenum target, u32 segment_size) : m_target(target) {
+  allocate(segment_size);
+}
+
+StreamRingBuffer::~StreamRingBuffer() {
+  free();
+}
+
+void StreamRingBuffer::allocate(u32 segment_size) {
+  m_segment_size = segment_size;
+  m_segment = 0;
+  m_segment_offset = 0;
+  glGenBuffers(1, &m_buffer);
+  m_generation++;
+  glBindBuffer(m_target, m_buffer);
+  glBufferData(m_target, (u64)segment_size * kNumSegments, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(m_target, 0);
+}
+
+void StreamRingBuffer::free() {
+  for (auto& fence : m_fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  glDeleteBuffers(1, &m_buffer);
+  m_buffer = 0;
+}
+
+/*!
+ * Fence the current segment and move to the next one, waiting until the GPU is done with it.
+ */
+void StreamRingBuffer::next_segment() {
+  m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_segment = (m_segment + 1) % kNumSegments;
+  m_segment_offset = 0;
+  auto& fence = m_fences[m_segment];
+  if (fence) {
+    if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+      m_stats.fence_waits++;
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+             GL_TIMEOUT_EXPIRED) {
+      }
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+/*!
+ * Reserve size bytes, aligned to alignment bytes from the start of the buffer. Returns a pointer to
+ * write the data to, and sets offset to where it will be in the buffer. Call unmap once written,
+ * before drawing.
+ */
+u8* StreamRingBuffer::map(u32 size, u32 alignment, u32* offset) {
+  ASSERT(m_map_size == 0);
+  ASSERT(size > 0 && alignment > 0);
+  if (size + alignment > m_segment_size) {
+    // too big. The old buffer stays alive in the driver until draws using it are done.
+    u32 new_size = std::max(size + alignment, m_segment_size * 2);
+    free();
+    allocate(new_size);
+    m_stats.grows++;
+  }
+
+  u32 segment_start = m_segment * m_segment_size;
+  u32 start = segment_start + m_segment_offset;
+  start = ((start + alignment - 1) / alignment) * alignment;
+  if (start + size > segment_start + m_segment_size) {
+    next_segment();
+    segment_start = m_segment * m_segment_size;
+    start = ((segment_start + alignment - 1) / alignment) * alignment;
+  }
+  m_segment_offset = start + size - segment_start;
+
+  m_map_offset = start;
+  m_map_size = size;
+  *offset = start;
+  m_stats.writes++;
+  m_stats.bytes += size;
+
+  if (use_map) {
+    glBindBuffer(m_target, m_buffer);
+    void* ptr = glMapBufferRange(
+        m_target, start, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (ptr) {
+      m_mapped = true;
+      return (u8*)ptr;
+    }
+  }
+  m_mapped = false;
+  if (m_staging.size() < size) {
+    m_staging.resize(size);
+  }
+  return m_staging.data();
+}
+
+void StreamRingBuffer::unmap() {
+  ASSERT(m_map_size > 0);
+  glBindBuffer(m_target, m_buffer);
+  if (m_mapped) {
+    glUnmapBuffer(m_target);
+  } else {
+    glBufferSubData(m_target, m_map_offset, m_map_size, m_staging.data());
+  }
+  glBindBuffer(m_target, 0);
+  m_map_size = 0;
+}
+
+/*!
+ * Copy data to the buffer, returning its offset.
+ */
+u32 StreamRingBuffer::write(const void* data, u32 size, u32 alignment) {
+  u32 offset;
+  memcpy(map(size, alignment, &offset), data, size);
+  unmap();
+  return offset;
+}
+
+bool texture_compression_s3tc_supported() {
+  static const bool supported = [] {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+      auto* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+      if (name && !strcmp(name, "GL_EXT_texture_compression_s3tc")) {
+        return true;
+      }
+    }
+    return false;
+  }();
+  return supported;
+}
+
+TextureUploadQueue::~TextureUploadQueue() {
+  for (auto& buffer : m_buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    if (buffer.buffer) {
+      glDeleteBuffers(1, &buffer.buffer);
+    }
+  }
+}
+
+void TextureUploadQueue::allocate() {
+  m_allocated = true;
+  // pixel buffers are core since 2.1 and fences since 3.2, but check in case of an old context.
+  if (!GLAD_GL_VERSION_3_2) {
+    use_pbo = false;
+    return;
+  }
+  for (auto& buffer : m_buffers) {
+    glGenBuffers(1, &buffer.buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, kBufferSize, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/*!
+ * Place a fence after the uploads from the current staging buffer, and move to the next one.
+ */
+void TextureUploadQueue::fence_current() {
+  auto& current = m_buffers[m_current];
+  if (current.offset == 0 || current.fence) {
+    // nothing new to fence.
+    return;
+  }
+  current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  current.fence_timer.start();
+  m_current = (m_current + 1) % kNumBuffers;
+}
+
+/*!
+ * If the GPU is done with this buffer, reset it so it can be filled again. Doesn't wait.
+ */
+bool TextureUploadQueue::try_recycle(StagingBuffer& buffer) {
+  if (buffer.fence) {
+    if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    double latency = buffer.fence_timer.getMs();
+    m_stats.completed_buffers++;
+    m_stats.total_latency_ms += latency;
+    m_stats.max_latency_ms = std::max(m_stats.max_latency_ms, latency);
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+  } else if (&buffer == &m_buffers[m_current]) {
+    // still being filled.
+    return true;
+  }
+  m_stats.in_flight_bytes -= buffer.offset;
+  buffer.offset = 0;
+  return true;
+}
+
+/*!
+ * Start a new frame's budget. Uploads from the last frame are fenced so their buffers can be
+ * reused once the GPU is done with them.
+ */
+void TextureUploadQueue::begin_frame() {
+  if (!m_allocated) {
+    allocate();
+  }
+  m_frame_bytes = 0;
+  if (use_pbo) {
+    fence_current();
+    for (auto& buffer : m_buffers) {
+      try_recycle(buffer);
+    }
+  }
+}
+
+/*!
+ * Copy data into the current staging buffer. On success, returns the offset of the data in the
+ * buffer and leaves the buffer bound to GL_PIXEL_UNPACK_BUFFER. Returns -1 if it must be uploaded
+ * directly instead.
+ */
+s64 TextureUploadQueue::stage(const void* data, u32 size) {
+  if (!use_pbo || size > kBufferSize) {
+    return -1;
+  }
+  auto* buffer = &m_buffers[m_current];
+  if (buffer->offset + size > kBufferSize) {
+    fence_current();
+    buffer = &m_buffers[m_current];
+  }
+  if (!try_recycle(*buffer)) {
+    m_stats.no_free_buffer++;
+    return -1;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+  void* ptr =
+      glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, buffer->offset, size,
+                       GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+  if (!ptr) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return -1;
+  }
+  memcpy(ptr, data, size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  s64 offset = buffer->offset;
+  // keep the next upload aligned.
+  u32 next_offset = std::min((buffer->offset + size + 255) & ~255u, kBufferSize);
+  m_stats.in_flight_bytes += next_offset - buffer->offset;
+  buffer->offset = next_offset;
+  m_stats.pbo_uploads++;
+  return offset;
+}
+
+/*!
+ * Upload data to level 0 of the texture, and generate mipmaps. Leaves the texture bound to
+ * GL_TEXTURE_2D on the active texture unit.
+ */
+void TextureUploadQueue::upload(GLuint texture, const void* data, u16 w, u16 h) {
+  if (!m_allocated) {
+    allocate();
+  }
+  u32 size = w * h * 4;
+  m_frame_bytes += size;
+  m_stats.bytes += size;
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  s64 offset = stage(data, size);
+  if (offset >= 0) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                 (const void*)(uintptr_t)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+    m_stats.direct_uploads++;
+  }
+  glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+/*!
+ * Upload a BC1/BC3 texture with all of its mips, largest first, as made by the level extractor.
+ * The caller should check texture_compression_s3tc_supported() first.
+ */
+void TextureUploadQueue::upload_compressed(GLuint texture,
+                                           BcFormat format,
+                                           const u8* data,
+                                           u16 w,
+                                           u16 h) {
+  if (!m_allocated) {
+    allocate();
+  }
+  u32 levels = mip_count(w, h);
+  u32 size = 0;
+  for (u32 i = 0; i < levels; i++) {
+    size += bc_image_bytes(format, std::max(1, w >> i), std::max(1, h >> i));
+  }
+  m_frame_bytes += size;
+  m_stats.bytes += size;
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  s64 offset = stage(data, size);
+  if (offset < 0) {
+    m_stats.direct_uploads++;
+  }
+  GLenum gl_format = format == BcFormat::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+                                             : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  u32 mip_offset = 0;
+  for (u32 i = 0; i < levels; i++) {
+    int mw = std::max(1, w >> i);
+    int mh = std::max(1, h >> i);
+    u32 mip_size = bc_image_bytes(format, mw, mh);
+    const void* src = offset >= 0 ? (const void*)(uintptr_t)(offset + mip_offset)
+                                  : (const void*)(data + mip_offset);
+    glCompressedTexImage2D(GL_TEXTURE_2D, i, gl_format, mw, mh, 0, mip_size, src);
+    mip_offset += mip_size;
+  }
+  if (offset >= 0) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+}
+
+void TextureUploadQueue::draw_debug_window() {
+  ImGui::Checkbox("Use pixel buffers", &use_pbo);
+  int budget_kb = frame_budget / 1024;
+  if (ImGui::SliderInt("budget per frame (KB)", &budget_kb, 128, 16 * 1024)) {
+    frame_budget = budget_kb * 1024;
+  }
+  ImGui::Text("%d pbo uploads, %d direct, %d with no free buffer, %.1f MB total",
+              m_stats.pbo_uploads, m_stats.direct_uploads, m_stats.no_free_buffer,
+              m_stats.bytes / (1024.f * 1024.f));
+  ImGui::Text("queued %.1f KB, latency %.2f ms avg, %.2f ms max",
+              m_stats.in_flight_bytes / 1024.f,
+              m_stats.completed_buffers ? m_stats.total_latency_ms / m_stats.completed_buffers : 0.,
+              m_stats.max_latency_ms);
+}
@@ -1,12 +1,29 @@
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "common/math/Vector.h"
+#include "common/texture/texture_compression.h"
+#include "common/util/Timer.h"
 
 #include "game/graphics/pipelines/opengl.h"
 
 struct SharedRenderState;
 class ScopedProfilerNode;
 
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/*!
+ * Does the driver support uploading BC1/BC3 (S3TC) textures? Checked once, on the render thread.
+ */
+bool texture_compression_s3tc_supported();
+
 /*!
  * This is a wrapper around a framebuffer and texture to make it easier to render to a texture.
  */
@@ -94,4 +111,113 @@ class FramebufferCopier {
  private:
   GLuint m_fbo = 0, m_fbo_texture = 0;
   int m_fbo_width = 640, m_fbo_height = 480;
-};
\ No newline at end of file
+};
+
+/*!
+ * A GPU buffer for data that is regenerated every frame, like bones or modified vertices.
+ * The buffer is split into kNumSegments segments which are filled in order. A fence is placed when
+ * we move past a segment, and it's only written again after that fence, so writes never overlap
+ * data the GPU may still be reading and never need the driver's implicit sync.
+ * Writes use an unsynchronized glMapBufferRange, or glBufferSubData if use_map is false.
+ */
+class StreamRingBuffer {
+ public:
+  static constexpr int kNumSegments = 3;
+  StreamRingBuffer(GLenum target, u32 segment_size);
+  ~StreamRingBuffer();
+  StreamRingBuffer(const StreamRingBuffer&) = delete;
+  StreamRingBuffer& operator=(const StreamRingBuffer&) = delete;
+
+  u8* map(u32 size, u32 alignment, u32* offset);
+  void unmap();
+  u32 write(const void* data, u32 size, u32 alignment);
+
+  GLuint buffer() const { return m_buffer; }
+  // changes every time a new buffer is allocated. GL may reuse the old name, so compare this
+  // instead of buffer() to know when vertex arrays need to be pointed at the new storage.
+  u32 generation() const { return m_generation; }
+
+  struct Stats {
+    u32 writes = 0;
+    u64 bytes = 0;
+    u32 fence_waits = 0;
+    u32 grows = 0;
+  };
+  const Stats& stats() const { return m_stats; }
+  bool use_map = true;
+
+ private:
+  void allocate(u32 segment_size);
+  void free();
+  void next_segment();
+
+  GLenum m_target;
+  GLuint m_buffer = 0;
+  u32 m_generation = 0;
+  u32 m_segment_size = 0;
+  u32 m_segment = 0;
+  u32 m_segment_offset = 0;
+  std::array<GLsync, kNumSegments> m_fences = {};
+
+  bool m_mapped = false;
+  u32 m_map_offset = 0;
+  u32 m_map_size = 0;
+  std::vector<u8> m_staging;
+  Stats m_stats;
+};
+
+/*!
+ * Uploads RGBA8888 textures through staging pixel buffers, so the driver copies to the texture
+ * asynchronously instead of during glTexImage2D. A fence is placed after each staging buffer is
+ * filled, and it's only reused once the fence has passed, so uploads never wait on the GPU. If no
+ * staging buffer is free, or pixel buffers can't be mapped, textures are uploaded directly.
+ * There is a per-frame byte budget for callers that can spread uploads over several frames.
+ */
+class TextureUploadQueue {
+ public:
+  static constexpr int kNumBuffers = 4;
+  static constexpr u32 kBufferSize = 4 * 1024 * 1024;
+  TextureUploadQueue() = default;
+  ~TextureUploadQueue();
+  TextureUploadQueue(const TextureUploadQueue&) = delete;
+  TextureUploadQueue& operator=(const TextureUploadQueue&) = delete;
+
+  void begin_frame();
+  bool has_budget() const { return m_frame_bytes < frame_budget; }
+  void upload(GLuint texture, const void* data, u16 w, u16 h);
+  void upload_compressed(GLuint texture, BcFormat format, const u8* data, u16 w, u16 h);
+  void draw_debug_window();
+
+  u32 frame_budget = 2 * 1024 * 1024;
+  bool use_pbo = true;
+
+  struct Stats {
+    u32 pbo_uploads = 0;
+    u32 direct_uploads = 0;
+    u32 no_free_buffer = 0;
+    u64 bytes = 0;
+    u64 in_flight_bytes = 0;
+    u32 completed_buffers = 0;
+    double total_latency_ms = 0;
+    double max_latency_ms = 0;
+  };
+  const Stats& stats() const { return m_stats; }
+
+ private:
+  struct StagingBuffer {
+    GLuint buffer = 0;
+    u32 offset = 0;
+    GLsync fence = nullptr;
+    Timer fence_timer;
+  };
+  void allocate();
+  s64 stage(const void* data, u32 size);
+  void fence_current();
+  bool try_recycle(StagingBuffer& buffer);
+
+  std::array<StagingBuffer, kNumBuffers> m_buffers;
+  bool m_allocated = false;
+  int m_current = 0;
+  u32 m_frame_bytes = 0;
+  Stats m_stats;
+};
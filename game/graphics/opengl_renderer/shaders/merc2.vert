@@ -9,13 +9,15 @@ layout (location = 4) in vec4 rgba;
 layout (location = 5) in uvec3 mats;
 
 // light control
-uniform vec3 light_dir0;
-uniform vec3 light_dir1;
-uniform vec3 light_dir2;
-uniform vec4 light_col0;
-uniform vec4 light_col1;
-uniform vec4 light_col2;
-uniform vec4 light_ambient;
+layout (std140) uniform ub_merc_lights {
+  vec3 light_dir0;
+  vec3 light_dir1;
+  vec3 light_dir2;
+  vec4 light_col0;
+  vec4 light_col1;
+  vec4 light_col2;
+  vec4 light_ambient;
+};
 
 // camera control
 uniform vec4 hvdf_offset;
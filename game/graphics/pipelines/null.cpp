@@ -0,0 +1,424 @@
+/*!
+ * @file null.cpp
+ * Headless renderer, for measuring renderer CPU cost without a GPU.
+ * This uses the OpenGL pipeline's frame handling and OpenGLRenderer, but loads glad with stub
+ * functions instead of a real GL context.
+ */
+
+#include "null.h"
+
+#include <cstring>
+
+#include "common/global_profiler/GlobalProfiler.h"
+#include "common/log/log.h"
+#include "common/util/Assert.h"
+#include "common/util/Timer.h"
+
+#include "game/graphics/pipelines/opengl.h"
+#include "game/runtime.h"
+#include "game/system/hid/sdl_util.h"
+
+#include "third-party/imgui/imgui.h"
+
+NullGlStats& null_gl_stats() {
+  static NullGlStats stats;
+  return stats;
+}
+
+namespace {
+
+std::atomic<GLuint> next_object_id = 1;
+
+/*
+ * The stubs. Functions that don't need a specific stub below get a NullStub of their own type,
+ * which does nothing, counts the call and returns 0. Functions that the renderer doesn't use get no
+ * stub at all, so calling one crashes instead of running a stub of the wrong type: add it to the
+ * table in null_get_proc.
+ */
+template <typename F>
+struct NullStub;
+
+template <typename R, typename... Args>
+struct NullStub<R(APIENTRYP)(Args...)> {
+  template <std::atomic<u64> NullGlStats::*counter>
+  static R APIENTRY call(Args...) {
+    (null_gl_stats().*counter)++;
+    return R();
+  }
+};
+
+const GLubyte* APIENTRY null_get_string(GLenum name) {
+  switch (name) {
+    case GL_VERSION:
+      return (const GLubyte*)"4.3.0 Null";
+    case GL_SHADING_LANGUAGE_VERSION:
+      return (const GLubyte*)"4.30";
+    default:
+      return (const GLubyte*)"Null";
+  }
+}
+
+const GLubyte* APIENTRY null_get_stringi(GLenum, GLuint) {
+  return (const GLubyte*)"";
+}
+
+void APIENTRY null_get_integerv(GLenum pname, GLint* data) {
+  switch (pname) {
+    case GL_VIEWPORT:
+      data[0] = 0;
+      data[1] = 0;
+      data[2] = 640;
+      data[3] = 480;
+      break;
+    case GL_MAX_SAMPLES:
+      data[0] = 8;
+      break;
+    case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+      data[0] = 256;
+      break;
+    case GL_MAX_TEXTURE_SIZE:
+      data[0] = 16384;
+      break;
+    default:
+      data[0] = 0;
+  }
+}
+
+void APIENTRY null_get_floatv(GLenum, GLfloat* data) {
+  data[0] = 1.f;
+}
+
+void APIENTRY null_get_booleanv(GLenum, GLboolean* data) {
+  data[0] = GL_FALSE;
+}
+
+void APIENTRY null_get_tex_level_parameteriv(GLenum, GLint, GLenum, GLint* params) {
+  params[0] = 0;
+}
+
+void APIENTRY null_get_object_iv(GLuint, GLenum pname, GLint* params) {
+  params[0] = (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+void APIENTRY null_get_info_log(GLuint, GLsizei size, GLsizei* length, GLchar* log) {
+  if (length) {
+    *length = 0;
+  }
+  if (size > 0) {
+    log[0] = 0;
+  }
+}
+
+void APIENTRY null_gen_objects(GLsizei n, GLuint* ids) {
+  for (GLsizei i = 0; i < n; i++) {
+    ids[i] = next_object_id++;
+  }
+}
+
+GLuint APIENTRY null_create_object() {
+  return next_object_id++;
+}
+
+GLuint APIENTRY null_create_shader(GLenum) {
+  return next_object_id++;
+}
+
+GLenum APIENTRY null_check_framebuffer_status(GLenum) {
+  return GL_FRAMEBUFFER_COMPLETE;
+}
+
+GLenum APIENTRY null_client_wait_sync(GLsync, GLbitfield, GLuint64) {
+  return GL_ALREADY_SIGNALED;
+}
+
+void APIENTRY null_buffer_data(GLenum, GLsizeiptr size, const void*, GLenum) {
+  null_gl_stats().buffer_upload_bytes += size;
+}
+
+void APIENTRY null_buffer_sub_data(GLenum, GLintptr, GLsizeiptr size, const void*) {
+  null_gl_stats().buffer_upload_bytes += size;
+}
+
+void APIENTRY null_read_pixels(GLint,
+                               GLint,
+                               GLsizei width,
+                               GLsizei height,
+                               GLenum format,
+                               GLenum type,
+                               void* pixels) {
+  ASSERT_MSG(type == GL_UNSIGNED_BYTE, "null glReadPixels only supports GL_UNSIGNED_BYTE");
+  size_t components = format == GL_RED ? 1 : (format == GL_RGB ? 3 : 4);
+  memset(pixels, 0, (size_t)width * height * components);
+}
+
+// a stub of the function's own type, counting calls in the given NullGlStats member.
+#define NULL_STUB(name, counter) \
+  { #name, (void*)&NullStub<decltype(glad_##name)>::call<&NullGlStats::counter> }
+
+void* null_get_proc(const char* name) {
+  struct Stub {
+    const char* name;
+    void* func;
+  };
+  static const Stub stubs[] = {
+      {"glGetString", (void*)null_get_string},
+      {"glGetStringi", (void*)null_get_stringi},
+      {"glGetIntegerv", (void*)null_get_integerv},
+      {"glGetFloatv", (void*)null_get_floatv},
+      {"glGetBooleanv", (void*)null_get_booleanv},
+      {"glGetTexLevelParameteriv", (void*)null_get_tex_level_parameteriv},
+      {"glGetShaderiv", (void*)null_get_object_iv},
+      {"glGetProgramiv", (void*)null_get_object_iv},
+      {"glGetShaderInfoLog", (void*)null_get_info_log},
+      {"glGetProgramInfoLog", (void*)null_get_info_log},
+      {"glGenBuffers", (void*)null_gen_objects},
+      {"glGenTextures", (void*)null_gen_objects},
+      {"glGenVertexArrays", (void*)null_gen_objects},
+      {"glGenFramebuffers", (void*)null_gen_objects},
+      {"glGenRenderbuffers", (void*)null_gen_objects},
+      {"glGenQueries", (void*)null_gen_objects},
+      {"glGenSamplers", (void*)null_gen_objects},
+      {"glCreateProgram", (void*)null_create_object},
+      {"glCreateShader", (void*)null_create_shader},
+      {"glCheckFramebufferStatus", (void*)null_check_framebuffer_status},
+      {"glClientWaitSync", (void*)null_client_wait_sync},
+      {"glBufferData", (void*)null_buffer_data},
+      {"glBufferSubData", (void*)null_buffer_sub_data},
+      {"glReadPixels", (void*)null_read_pixels},
+      NULL_STUB(glTexImage2D, texture_uploads),
+      NULL_STUB(glTexSubImage2D, texture_uploads),
+      NULL_STUB(glCompressedTexImage2D, texture_uploads),
+      NULL_STUB(glDrawArrays, draw_calls),
+      NULL_STUB(glDrawArraysInstanced, draw_calls),
+      NULL_STUB(glDrawElements, draw_calls),
+      NULL_STUB(glDrawElementsBaseVertex, draw_calls),
+      NULL_STUB(glMultiDrawElements, draw_calls),
+      NULL_STUB(glMultiDrawElementsIndirect, draw_calls),
+      NULL_STUB(glActiveTexture, gl_calls),
+      NULL_STUB(glAttachShader, gl_calls),
+      NULL_STUB(glBindBuffer, gl_calls),
+      NULL_STUB(glBindBufferBase, gl_calls),
+      NULL_STUB(glBindBufferRange, gl_calls),
+      NULL_STUB(glBindFramebuffer, gl_calls),
+      NULL_STUB(glBindRenderbuffer, gl_calls),
+      NULL_STUB(glBindTexture, gl_calls),
+      NULL_STUB(glBindVertexArray, gl_calls),
+      NULL_STUB(glBlendColor, gl_calls),
+      NULL_STUB(glBlendEquation, gl_calls),
+      NULL_STUB(glBlendFunc, gl_calls),
+      NULL_STUB(glBlendFuncSeparate, gl_calls),
+      NULL_STUB(glBlitFramebuffer, gl_calls),
+      NULL_STUB(glClear, gl_calls),
+      NULL_STUB(glClearBufferfv, gl_calls),
+      NULL_STUB(glClearColor, gl_calls),
+      NULL_STUB(glClearDepth, gl_calls),
+      NULL_STUB(glClearStencil, gl_calls),
+      NULL_STUB(glColorMask, gl_calls),
+      NULL_STUB(glColorMaski, gl_calls),
+      NULL_STUB(glCompileShader, gl_calls),
+      NULL_STUB(glDebugMessageCallback, gl_calls),
+      NULL_STUB(glDebugMessageControl, gl_calls),
+      NULL_STUB(glDeleteBuffers, gl_calls),
+      NULL_STUB(glDeleteFramebuffers, gl_calls),
+      NULL_STUB(glDeleteRenderbuffers, gl_calls),
+      NULL_STUB(glDeleteShader, gl_calls),
+      NULL_STUB(glDeleteSync, gl_calls),
+      NULL_STUB(glDeleteTextures, gl_calls),
+      NULL_STUB(glDeleteVertexArrays, gl_calls),
+      NULL_STUB(glDepthFunc, gl_calls),
+      NULL_STUB(glDepthMask, gl_calls),
+      NULL_STUB(glDisable, gl_calls),
+      NULL_STUB(glDrawBuffers, gl_calls),
+      NULL_STUB(glEnable, gl_calls),
+      NULL_STUB(glEnableVertexAttribArray, gl_calls),
+      NULL_STUB(glFenceSync, gl_calls),
+      NULL_STUB(glFinish, gl_calls),
+      NULL_STUB(glFramebufferRenderbuffer, gl_calls),
+      NULL_STUB(glFramebufferTexture, gl_calls),
+      NULL_STUB(glFramebufferTexture2D, gl_calls),
+      NULL_STUB(glGenerateMipmap, gl_calls),
+      NULL_STUB(glGetTexImage, gl_calls),
+      NULL_STUB(glGetUniformBlockIndex, gl_calls),
+      NULL_STUB(glGetUniformLocation, gl_calls),
+      NULL_STUB(glLinkProgram, gl_calls),
+      NULL_STUB(glMapBufferRange, gl_calls),
+      NULL_STUB(glPixelStorei, gl_calls),
+      NULL_STUB(glPolygonMode, gl_calls),
+      NULL_STUB(glPrimitiveRestartIndex, gl_calls),
+      NULL_STUB(glReadBuffer, gl_calls),
+      NULL_STUB(glRenderbufferStorage, gl_calls),
+      NULL_STUB(glRenderbufferStorageMultisample, gl_calls),
+      NULL_STUB(glShaderSource, gl_calls),
+      NULL_STUB(glStencilFunc, gl_calls),
+      NULL_STUB(glStencilMask, gl_calls),
+      NULL_STUB(glStencilOp, gl_calls),
+      NULL_STUB(glTexImage1D, gl_calls),
+      NULL_STUB(glTexImage2DMultisample, gl_calls),
+      NULL_STUB(glTexParameterf, gl_calls),
+      NULL_STUB(glTexParameteri, gl_calls),
+      NULL_STUB(glTexSubImage1D, gl_calls),
+      NULL_STUB(glUniform1f, gl_calls),
+      NULL_STUB(glUniform1i, gl_calls),
+      NULL_STUB(glUniform1ui, gl_calls),
+      NULL_STUB(glUniform1uiv, gl_calls),
+      NULL_STUB(glUniform2fv, gl_calls),
+      NULL_STUB(glUniform3f, gl_calls),
+      NULL_STUB(glUniform3fv, gl_calls),
+      NULL_STUB(glUniform4f, gl_calls),
+      NULL_STUB(glUniform4fv, gl_calls),
+      NULL_STUB(glUniform4i, gl_calls),
+      NULL_STUB(glUniformBlockBinding, gl_calls),
+      NULL_STUB(glUniformMatrix4fv, gl_calls),
+      NULL_STUB(glUnmapBuffer, gl_calls),
+      NULL_STUB(glUseProgram, gl_calls),
+      NULL_STUB(glVertexAttribDivisor, gl_calls),
+      NULL_STUB(glVertexAttribIPointer, gl_calls),
+      NULL_STUB(glVertexAttribPointer, gl_calls),
+      NULL_STUB(glViewport, gl_calls),
+  };
+  for (const auto& stub : stubs) {
+    if (!strcmp(stub.name, name)) {
+      return stub.func;
+    }
+  }
+  return nullptr;
+}
+
+int null_init(GfxGlobalSettings& /*settings*/) {
+  // the dummy driver gives us a window for the display manager without a real display.
+  SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
+  SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    sdl_util::log_error("Could not initialize SDL, exiting");
+    return 1;
+  }
+  return 0;
+}
+
+void null_exit() {
+  free_graphics_data();
+}
+
+std::shared_ptr<GfxDisplay> null_make_display(int width,
+                                              int height,
+                                              const char* title,
+                                              GfxGlobalSettings& /*settings*/,
+                                              GameVersion game_version,
+                                              bool is_main) {
+  SDL_Window* window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                        width, height, SDL_WINDOW_HIDDEN);
+  if (!window) {
+    sdl_util::log_error("null_make_display failed - Could not create display window");
+    return NULL;
+  }
+
+  load_null_gl();
+  init_graphics_data(game_version);
+
+  // some renderers use imgui for their debug windows, so it needs a context even though nothing
+  // is drawn.
+  ImGui::CreateContext();
+  ImGuiIO& io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.DisplaySize = ImVec2(width, height);
+  unsigned char* pixels;
+  int font_w, font_h;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &font_w, &font_h);
+
+  lg::info("Null renderer initialized");
+  return std::make_shared<NullDisplay>(window, is_main);
+}
+
+}  // namespace
+
+/*!
+ * Point glad at the stubs. Must be called before creating anything that uses GL.
+ */
+void load_null_gl() {
+  gladLoadGLLoader((GLADloadproc)null_get_proc);
+}
+
+NullDisplay::NullDisplay(SDL_Window* window, bool is_main)
+    : m_window(window),
+      m_display_manager(std::make_shared<DisplayManager>(window)),
+      m_input_manager(std::make_shared<InputManager>()) {
+  m_main = is_main;
+  m_display_manager->set_input_manager(m_input_manager);
+  set_imgui_visible(false);
+}
+
+NullDisplay::~NullDisplay() {
+  ImGui::DestroyContext();
+  SDL_DestroyWindow(m_window);
+  SDL_Quit();
+  if (m_main) {
+    null_exit();
+  }
+}
+
+void NullDisplay::render() {
+  SDL_Event evt;
+  while (SDL_PollEvent(&evt) != 0) {
+    if (evt.type == SDL_QUIT) {
+      MasterExit = RuntimeExitStatus::EXIT;
+    }
+    m_display_manager->process_sdl_event(evt);
+    m_input_manager->process_sdl_event(evt);
+  }
+  m_display_manager->process_ee_events();
+  m_input_manager->process_ee_events();
+
+  ImGui::NewFrame();
+  {
+    auto p = scoped_prof("game-render");
+    Timer timer;
+    int w = Gfx::g_global_settings.lbox_w;
+    int h = Gfx::g_global_settings.lbox_h;
+    render_game_frame(w, h, w, h, w, h, 1, false);
+    double ms = timer.getMs();
+    m_render_ms += ms;
+    m_max_render_ms = std::max(m_max_render_ms, ms);
+  }
+  ImGui::EndFrame();
+
+  if (++m_frames == kReportFrames) {
+    report_stats();
+  }
+
+  run_frame_limiter();
+  prof().instant_event("ROOT");
+  notify_vsync();
+}
+
+void NullDisplay::report_stats() {
+  auto& stats = null_gl_stats();
+  lg::info(
+      "null renderer: {} frames, render {:.3f} ms avg, {:.3f} ms max | per frame: {} draws, {} kB "
+      "buffer uploads, {} texture uploads, {} other GL calls",
+      m_frames, m_render_ms / m_frames, m_max_render_ms, stats.draw_calls / m_frames,
+      stats.buffer_upload_bytes / m_frames / 1024, stats.texture_uploads / m_frames,
+      stats.gl_calls / m_frames);
+  stats.draw_calls = 0;
+  stats.buffer_upload_bytes = 0;
+  stats.texture_uploads = 0;
+  stats.gl_calls = 0;
+  m_frames = 0;
+  m_render_ms = 0;
+  m_max_render_ms = 0;
+}
+
+const GfxRendererModule gRendererNull = {
+    null_init,              // init
+    null_make_display,      // make_display
+    null_exit,              // exit
+    gl_vsync,               // vsync
+    gl_sync_path,           // sync_path
+    gl_send_chain,          // send_chain
+    gl_texture_upload_now,  // texture_upload_now
+    gl_texture_relocate,    // texture_relocate
+    gl_set_levels,          // set_levels
+    gl_set_active_levels,   // set_active_levels
+    gl_set_pmode_alp,       // set_pmode_alp
+    GfxPipeline::Null,      // pipeline
+    "Null"                  // name
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+/*!
+ * @file null.h
+ * Headless renderer. Runs the OpenGL renderer's CPU side (DMA processing, culling, draw list
+ * building...) with every GL function replaced by a stub, so renderer CPU cost can be measured on
+ * machines without a GPU.
+ */
+
+#include <atomic>
+
+#include "game/graphics/display.h"
+#include "game/graphics/gfx.h"
+
+#include "third-party/SDL/include/SDL.h"
+
+/*!
+ * Counters updated by the GL stubs.
+ */
+struct NullGlStats {
+  std::atomic<u64> draw_calls = 0;
+  std::atomic<u64> buffer_upload_bytes = 0;
+  std::atomic<u64> texture_uploads = 0;
+  std::atomic<u64> gl_calls = 0;
+};
+
+NullGlStats& null_gl_stats();
+void load_null_gl();
+
+class NullDisplay : public GfxDisplay {
+ public:
+  NullDisplay(SDL_Window* window, bool is_main);
+  virtual ~NullDisplay();
+
+  std::shared_ptr<DisplayManager> get_display_manager() const override { return m_display_manager; }
+  std::shared_ptr<InputManager> get_input_manager() const override { return m_input_manager; }
+
+  void render() override;
+
+ private:
+  void report_stats();
+
+  SDL_Window* m_window;
+  std::shared_ptr<DisplayManager> m_display_manager;
+  std::shared_ptr<InputManager> m_input_manager;
+
+  // renderer time and GL stats, summed over kReportFrames frames.
+  static constexpr int kReportFrames = 300;
+  int m_frames = 0;
+  double m_render_ms = 0;
+  double m_max_render_ms = 0;
+};
+
+extern const GfxRendererModule gRendererNull;
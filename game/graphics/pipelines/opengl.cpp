@@ -20,11 +20,14 @@
 #include "common/util/compress.h"
 
 #include "game/graphics/display.h"
+#include "game/graphics/frame_capture.h"
 #include "game/graphics/gfx.h"
 #include "game/graphics/opengl_renderer/OpenGLRenderer.h"
+#include "game/graphics/opengl_renderer/TextureUploadHandler.h"
 #include "game/graphics/opengl_renderer/debug_gui.h"
 #include "game/graphics/screenshot.h"
 #include "game/graphics/texture/TexturePool.h"
+#include "game/kernel/common/kmachine.h"
 #include "game/runtime.h"
 #include "game/sce/libscf.h"
 #include "game/system/hid/input_manager.h"
@@ -61,6 +64,16 @@ struct GraphicsData {
   bool has_data_to_render = false;
   FixedChunkDmaCopier dma_copier;
 
+  // pipelined frames: the game thread copies the chain in send_chain, and the render thread takes
+  // the copy as soon as it starts the frame, letting the game run the next frame during rendering.
+  bool chain_is_pipelined = false;  // set with has_data_to_render
+  DmaData render_chain;             // the copy being rendered
+  EeSnapshot ee_snapshot;           // game memory read by the renderer, copied with the chain
+  EeSnapshot render_ee_snapshot;    // the copy being rendered
+  u64 chains_sent = 0;
+  std::atomic<u64> chains_taken = 0;
+  std::atomic<u64> chains_rendered = 0;
+
   // texture pool
   std::shared_ptr<TexturePool> texture_pool;
 
@@ -76,6 +89,11 @@ struct GraphicsData {
   double last_engine_time = 1. / 60.;
   float pmode_alp = 1.f;
 
+  // frame capture. The level lists are the last ones from the game, for the initial state.
+  frame_capture::Writer frame_capture;
+  std::atomic<int> frames_to_capture = 0;
+  std::vector<std::string> levels, active_levels;
+
   std::string imgui_log_filename, imgui_filename;
   GameVersion version;
 
@@ -94,6 +112,7 @@ std::unique_ptr<GraphicsData> g_gfx_data;
 
 static bool gl_inited = false;
 static int gl_init(GfxGlobalSettings& settings) {
+  prof().set_thread_name("graphics");
   prof().instant_event("ROOT");
   Timer gl_init_timer;
   // Initialize SDL
@@ -145,10 +164,20 @@ static int gl_init(GfxGlobalSettings& settings) {
 }
 
 static void gl_exit() {
-  g_gfx_data.reset();
+  free_graphics_data();
   gl_inited = false;
 }
 
+void init_graphics_data(GameVersion version) {
+  if (!g_gfx_data) {
+    g_gfx_data = std::make_unique<GraphicsData>(version);
+  }
+}
+
+void free_graphics_data() {
+  g_gfx_data.reset();
+}
+
 static void init_imgui(SDL_Window* window,
                        SDL_GLContext gl_context,
                        const std::string& glsl_version) {
@@ -273,7 +302,7 @@ static std::shared_ptr<GfxDisplay> gl_make_display(int width,
     }
     {
       auto p = scoped_prof("startup::sdl::gfx_data_init");
-      g_gfx_data = std::make_unique<GraphicsData>(game_version);
+      init_graphics_data(game_version);
     }
     gl_inited = true;
     const char* gl_version = (const char*)glGetString(GL_VERSION);
@@ -367,13 +396,29 @@ void render_game_frame(int game_width,
                        bool take_screenshot) {
   // wait for a copied chain.
   bool got_chain = false;
+  bool pipelined = false;
   {
     auto p = scoped_prof("wait-for-dma");
     std::unique_lock<std::mutex> lock(g_gfx_data->dma_mutex);
     // there's a timeout here, so imgui can still be responsive even if we don't render anything
     got_chain = g_gfx_data->dma_cv.wait_for(lock, std::chrono::milliseconds(40),
                                             [=] { return g_gfx_data->has_data_to_render; });
+    // in pipelined mode, take the copied chain and let the game start on the next frame.
+    pipelined = got_chain && g_gfx_data->chain_is_pipelined;
+    if (pipelined) {
+      prof().instant_event("render-took-chain");
+      g_gfx_data->dma_copier.swap_last_result(g_gfx_data->render_chain);
+      std::swap(g_gfx_data->ee_snapshot, g_gfx_data->render_ee_snapshot);
+      g_gfx_data->engine_timer.start();
+      g_gfx_data->has_data_to_render = false;
+      g_gfx_data->chains_taken++;
+      {
+        std::unique_lock<std::mutex> sync_lock(g_gfx_data->sync_mutex);
+        g_gfx_data->sync_cv.notify_all();
+      }
+    }
   }
+
   // render that chain.
   if (got_chain) {
     g_gfx_data->frame_idx_of_input_data = g_gfx_data->frame_idx;
@@ -394,6 +439,9 @@ void render_game_frame(int game_width,
     options.quick_screenshot = false;
     options.internal_res_screenshot = false;
     options.gpu_sync = g_gfx_data->debug_gui.should_gl_finish();
+    // the game is running during the render, it can't take interrupts.
+    options.vif_interrupts = !pipelined;
+    options.ee_snapshot = pipelined ? &g_gfx_data->render_ee_snapshot : nullptr;
 
     if (take_screenshot) {
       options.save_screenshot = true;
@@ -426,7 +474,11 @@ void render_game_frame(int game_width,
       options.msaa_samples = msaa_max;
     }
 
-    if constexpr (run_dma_copy) {
+    if (pipelined) {
+      auto p = scoped_prof("ogl-render");
+      auto& chain = g_gfx_data->render_chain;
+      g_gfx_data->ogl_renderer.render(DmaFollower(chain.data.data(), chain.start_offset), options);
+    } else if constexpr (run_dma_copy) {
       auto& chain = g_gfx_data->dma_copier.get_last_result();
       g_gfx_data->ogl_renderer.render(DmaFollower(chain.data.data(), chain.start_offset), options);
     } else {
@@ -437,21 +489,49 @@ void render_game_frame(int game_width,
     }
   }
 
+  if (got_chain) {
+    std::unique_lock<std::mutex> lock(g_gfx_data->sync_mutex);
+    g_gfx_data->chains_rendered++;
+    g_gfx_data->sync_cv.notify_all();
+  }
+
   // before vsync, mark the chain as rendered.
-  {
+  if (!pipelined) {
     // should be fine to remove this mutex if the game actually waits for vsync to call
     // send_chain again. but let's be safe for now.
     std::unique_lock<std::mutex> lock(g_gfx_data->dma_mutex);
     g_gfx_data->engine_timer.start();
     g_gfx_data->has_data_to_render = false;
+    if (got_chain) {
+      g_gfx_data->chains_taken++;
+    }
     g_gfx_data->sync_cv.notify_all();
   }
 }
 
 void update_global_profiler() {
-  if (g_gfx_data->debug_gui.dump_events) {
+  auto& gui = g_gfx_data->debug_gui;
+  if (gui.toggle_stream_events) {
+    gui.toggle_stream_events = false;
+    if (prof().streaming()) {
+      prof().stop_streaming();
+    } else {
+      auto file_path = file_util::get_jak_project_dir() / "profile_data" /
+                       fmt::format("trace-{}.json", str_util::current_local_timestamp_no_colons());
+      file_util::create_dir_if_needed_for_file(file_path);
+      prof().start_streaming(file_path.string());
+    }
+    gui.record_events = prof().enabled();
+  }
+
+  if (gui.dump_events && prof().streaming()) {
+    lg::warn("Can't dump profiler events while streaming them");
+    gui.dump_events = false;
+  }
+
+  if (gui.dump_events) {
     prof().set_enable(false);
-    g_gfx_data->debug_gui.dump_events = false;
+    gui.dump_events = false;
 
     // TODO - the file rotation code had an infinite loop here if it couldn't find anything
     // matching the format
@@ -565,7 +645,9 @@ void GLDisplay::render() {
   // render debug
   if (is_imgui_visible()) {
     auto p = scoped_prof("debug-gui");
-    g_gfx_data->debug_gui.draw(g_gfx_data->dma_copier.get_last_result().stats);
+    g_gfx_data->debug_gui.draw(Gfx::g_global_settings.pipelined_frames
+                                   ? g_gfx_data->render_chain.stats
+                                   : g_gfx_data->dma_copier.get_last_result().stats);
   }
   {
     auto p = scoped_prof("imgui-render");
@@ -575,12 +657,7 @@ void GLDisplay::render() {
 
   // actual vsync
   g_gfx_data->debug_gui.finish_frame();
-  if (Gfx::g_global_settings.framelimiter) {
-    auto p = scoped_prof("frame-limiter");
-    g_gfx_data->frame_limiter.run(
-        Gfx::g_global_settings.target_fps, Gfx::g_global_settings.experimental_accurate_lag,
-        Gfx::g_global_settings.sleep_in_frame_limiter, g_gfx_data->last_engine_time);
-  }
+  run_frame_limiter();
 
   {
     auto p = scoped_prof("swap-buffers");
@@ -608,12 +685,7 @@ void GLDisplay::render() {
   // toggle even odd and wake up engine waiting on vsync.
   // TODO: we could play with moving this earlier, right after the final bucket renderer.
   //       it breaks the VIF-interrupt profiling though.
-  {
-    prof().instant_event("engine-notify");
-    std::unique_lock<std::mutex> lock(g_gfx_data->sync_mutex);
-    g_gfx_data->frame_idx++;
-    g_gfx_data->sync_cv.notify_all();
-  }
+  notify_vsync();
 
   // reboot whole game, if requested
   if (g_gfx_data->debug_gui.want_reboot_in_debug) {
@@ -621,6 +693,12 @@ void GLDisplay::render() {
     MasterExit = RuntimeExitStatus::RESTART_IN_DEBUG;
   }
 
+  // capture frames, if requested. The capture is started from the game thread.
+  if (g_gfx_data->debug_gui.want_frame_capture) {
+    g_gfx_data->debug_gui.want_frame_capture = false;
+    g_gfx_data->frames_to_capture = g_gfx_data->debug_gui.frame_capture_count;
+  }
+
   {
     auto p = scoped_prof("check-close-window");
     // exit if display window was closed
@@ -632,6 +710,22 @@ void GLDisplay::render() {
   }
 }
 
+void run_frame_limiter() {
+  if (Gfx::g_global_settings.framelimiter) {
+    auto p = scoped_prof("frame-limiter");
+    g_gfx_data->frame_limiter.run(
+        Gfx::g_global_settings.target_fps, Gfx::g_global_settings.experimental_accurate_lag,
+        Gfx::g_global_settings.sleep_in_frame_limiter, g_gfx_data->last_engine_time);
+  }
+}
+
+void notify_vsync() {
+  prof().instant_event("engine-notify");
+  std::unique_lock<std::mutex> lock(g_gfx_data->sync_mutex);
+  g_gfx_data->frame_idx++;
+  g_gfx_data->sync_cv.notify_all();
+}
+
 /*!
  * Wait for the next vsync. Returns 0 or 1 depending on if frame is even or odd.
  * Called from the game thread, on a GOAL stack.
@@ -641,6 +735,15 @@ u32 gl_vsync() {
     return 0;
   }
   std::unique_lock<std::mutex> lock(g_gfx_data->sync_mutex);
+  if (Gfx::g_global_settings.pipelined_frames) {
+    // only wait for the renderer to take the chain, so at most one frame is in flight.
+    auto p = scoped_prof("pipelined-vsync-wait");
+    g_gfx_data->sync_cv.wait(lock, [=] {
+      return (MasterExit != RuntimeExitStatus::RUNNING) ||
+             g_gfx_data->chains_taken >= g_gfx_data->chains_sent;
+    });
+    return g_gfx_data->frame_idx & 1;
+  }
   auto init_frame = g_gfx_data->frame_idx_of_input_data;
   g_gfx_data->sync_cv.wait(lock, [=] {
     return (MasterExit != RuntimeExitStatus::RUNNING) || g_gfx_data->frame_idx > init_frame;
@@ -661,6 +764,23 @@ u32 gl_sync_path() {
   return 0;
 }
 
+/*!
+ * Start recording the renderer input for the next frames. Called from the game thread, when the
+ * game isn't changing any state the renderer uses.
+ */
+static void start_frame_capture(int frame_count) {
+  frame_capture::InitialState state;
+  state.levels = g_gfx_data->levels;
+  state.active_levels = g_gfx_data->active_levels;
+  state.pmode_alp = g_gfx_data->pmode_alp;
+  state.texture_slots = g_gfx_data->texture_pool->get_slot_assignments();
+  auto path = file_util::get_jak_project_dir() / "capture" /
+              fmt::format("{}-{}.fcap", game_version_names[g_gfx_data->version],
+                          str_util::current_local_timestamp_no_colons());
+  g_gfx_data->frame_capture.start(path, frame_count, g_gfx_data->version, offset_of_s7(),
+                                  std::move(state));
+}
+
 /*!
  * Send DMA to the renderer.
  * Called from the game thread, on a GOAL stack.
@@ -688,13 +808,46 @@ void gl_send_chain(const void* data, u32 offset) {
     // The renderers should just operate on DMA chains, so eliminating this step in the future
     // may be easy.
 
-    g_gfx_data->dma_copier.set_input_data(data, offset, run_dma_copy);
+    g_gfx_data->chain_is_pipelined = Gfx::g_global_settings.pipelined_frames;
+    if (g_gfx_data->chain_is_pipelined) {
+      auto p = scoped_prof("copy-dma-chain");
+      g_gfx_data->dma_copier.run(data, offset);
+      // the renderer can't read game memory while the game runs, so copy what it needs now.
+      TextureUploadHandler::snapshot_ee_reads(g_gfx_data->dma_copier.get_last_result(),
+                                              (const u8*)g_ee_main_mem, offset_of_s7(),
+                                              &g_gfx_data->ee_snapshot);
+    } else {
+      g_gfx_data->dma_copier.set_input_data(data, offset, run_dma_copy);
+    }
+    g_gfx_data->chains_sent++;
+
+    int frames_to_capture = g_gfx_data->frames_to_capture.exchange(0);
+    if (frames_to_capture > 0) {
+      start_frame_capture(frames_to_capture);
+    }
+    g_gfx_data->frame_capture.send_chain((const u8*)data, offset);
 
     g_gfx_data->has_data_to_render = true;
     g_gfx_data->dma_cv.notify_all();
   }
 }
 
+/*!
+ * In pipelined mode, the renderer may still be drawing the previous frame. Wait for it to finish
+ * before the game changes the texture pool.
+ */
+static void wait_for_pipelined_render() {
+  if (!Gfx::g_global_settings.pipelined_frames) {
+    return;
+  }
+  auto p = scoped_prof("pipelined-texture-wait");
+  std::unique_lock<std::mutex> lock(g_gfx_data->sync_mutex);
+  g_gfx_data->sync_cv.wait(lock, [=] {
+    return (MasterExit != RuntimeExitStatus::RUNNING) ||
+           g_gfx_data->chains_rendered >= g_gfx_data->chains_sent;
+  });
+}
+
 /*!
  * Upload texture outside of main DMA chain.
  * We trust the game to not remove textures that are currently being used, but if the game is messed
@@ -706,6 +859,8 @@ void gl_texture_upload_now(const u8* tpage, int mode, u32 s7_ptr) {
     // just pass it to the texture pool.
     // the texture pool will take care of locking.
     // we don't want to lock here for the entire duration of the conversion.
+    g_gfx_data->frame_capture.texture_upload_now(g_ee_main_mem, tpage, mode, s7_ptr);
+    wait_for_pipelined_render();
     g_gfx_data->texture_pool->handle_upload_now(tpage, mode, g_ee_main_mem, s7_ptr, false);
   }
 }
@@ -716,19 +871,26 @@ void gl_texture_upload_now(const u8* tpage, int mode, u32 s7_ptr) {
  */
 void gl_texture_relocate(u32 destination, u32 source, u32 format) {
   if (g_gfx_data) {
+    g_gfx_data->frame_capture.texture_relocate(destination, source, format);
+    wait_for_pipelined_render();
     g_gfx_data->texture_pool->relocate(destination, source, format);
   }
 }
 
 void gl_set_levels(const std::vector<std::string>& levels) {
+  g_gfx_data->levels = levels;
+  g_gfx_data->frame_capture.set_levels(levels);
   g_gfx_data->loader->set_want_levels(levels);
 }
 
 void gl_set_active_levels(const std::vector<std::string>& levels) {
+  g_gfx_data->active_levels = levels;
+  g_gfx_data->frame_capture.set_active_levels(levels);
   g_gfx_data->loader->set_active_levels(levels);
 }
 
 void gl_set_pmode_alp(float val) {
+  g_gfx_data->frame_capture.set_pmode_alp(val);
   g_gfx_data->pmode_alp = val;
 }
 
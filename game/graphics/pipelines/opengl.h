@@ -59,3 +59,25 @@ class GLDisplay : public GfxDisplay {
 };
 
 extern const GfxRendererModule gRendererOpenGL;
+
+// Frame handling shared with the null pipeline, which runs the same renderer without a GPU.
+void init_graphics_data(GameVersion version);
+void free_graphics_data();
+void render_game_frame(int game_width,
+                       int game_height,
+                       int window_fb_width,
+                       int window_fb_height,
+                       int draw_region_width,
+                       int draw_region_height,
+                       int msaa_samples,
+                       bool take_screenshot);
+void run_frame_limiter();
+void notify_vsync();
+u32 gl_vsync();
+u32 gl_sync_path();
+void gl_send_chain(const void* data, u32 offset);
+void gl_texture_upload_now(const u8* tpage, int mode, u32 s7_ptr);
+void gl_texture_relocate(u32 destination, u32 source, u32 format);
+void gl_set_levels(const std::vector<std::string>& levels);
+void gl_set_active_levels(const std::vector<std::string>& levels);
+void gl_set_pmode_alp(float val);
@@ -145,7 +145,7 @@ void TexturePool::refresh_links(GpuTexture& texture) {
   }
 }
 
-void TexturePool::unload_texture(PcTextureId tex_id, u64 gpu_id) {
+void TexturePool::unload_texture(PcTextureId tex_id, u64 gpu_id, const u8* src_data) {
   auto* tex = m_loaded_textures.lookup_existing(tex_id);
   ASSERT(tex);
   if (tex->is_common) {
@@ -155,8 +155,9 @@ void TexturePool::unload_texture(PcTextureId tex_id, u64 gpu_id) {
   ASSERT_MSG(!tex->is_placeholder,
              fmt::format("trying to unload something that was already placholdered: {} {}\n",
                          get_debug_texture_name(tex_id), tex->gpu_textures.size()));
+  // levels can share the same OpenGL texture, so also check the data to remove the right copy.
   auto it = std::find_if(tex->gpu_textures.begin(), tex->gpu_textures.end(),
-                         [&](const auto& a) { return a.gl == gpu_id; });
+                         [&](const auto& a) { return a.gl == gpu_id && a.data == src_data; });
   ASSERT(it != tex->gpu_textures.end());
 
   tex->gpu_textures.erase(it);
@@ -166,6 +167,52 @@ void TexturePool::unload_texture(PcTextureId tex_id, u64 gpu_id) {
   refresh_links(*tex);
 }
 
+/*!
+ * Get an already uploaded texture with the given content hash, and add a reference to it.
+ */
+std::optional<GLuint> TexturePool::acquire_shared_texture(u64 hash) {
+  auto it = m_shared_textures.find(hash);
+  if (it == m_shared_textures.end()) {
+    return std::nullopt;
+  }
+  it->second.ref_count++;
+  m_shared_texture_stats.reuses++;
+  m_shared_texture_stats.bytes_saved += it->second.bytes;
+  m_shared_texture_stats.resident_bytes_saved += it->second.bytes;
+  return it->second.gl;
+}
+
+/*!
+ * Add a newly uploaded texture, with one reference.
+ */
+void TexturePool::add_shared_texture(u64 hash, GLuint gl_texture, u32 bytes) {
+  auto& tex = m_shared_textures[hash];
+  ASSERT(tex.ref_count == 0);
+  tex.gl = gl_texture;
+  tex.bytes = bytes;
+  tex.ref_count = 1;
+  m_shared_texture_hashes[gl_texture] = hash;
+  m_shared_texture_stats.uploads++;
+}
+
+/*!
+ * Remove a reference to a shared texture. Returns true if this was the last one, and the OpenGL
+ * texture should be deleted.
+ */
+bool TexturePool::release_shared_texture(GLuint gl_texture) {
+  auto hash_it = m_shared_texture_hashes.find(gl_texture);
+  ASSERT(hash_it != m_shared_texture_hashes.end());
+  auto it = m_shared_textures.find(hash_it->second);
+  ASSERT(it != m_shared_textures.end() && it->second.ref_count > 0);
+  if (--it->second.ref_count > 0) {
+    m_shared_texture_stats.resident_bytes_saved -= it->second.bytes;
+    return false;
+  }
+  m_shared_textures.erase(it);
+  m_shared_texture_hashes.erase(hash_it);
+  return true;
+}
+
 void GpuTexture::remove_slot(u32 slot) {
   auto it = std::find(slots.begin(), slots.end(), slot);
   ASSERT(it != slots.end());
@@ -195,7 +242,19 @@ void TexturePool::handle_upload_now(const u8* tpage,
                                     const u8* memory_base,
                                     u32 s7_ptr,
                                     bool debug) {
-  std::unique_lock<std::mutex> lk(m_mutex);
+  apply_upload_now(plan_upload_now(tpage, mode, memory_base, s7_ptr, debug));
+}
+
+/*!
+ * Find the VRAM slots that each texture of an uploaded texture-page goes to. This only reads game
+ * memory, so it's done without the lock, and in pipelined mode it runs on the game thread.
+ */
+TexturePool::UploadNowPlan TexturePool::plan_upload_now(const u8* tpage,
+                                                        int mode,
+                                                        const u8* memory_base,
+                                                        u32 s7_ptr,
+                                                        bool debug) {
+  UploadNowPlan plan;
   // extract the texture-page object. This is just a description of the page data.
   GoalTexturePage texture_page;
   memcpy(&texture_page, tpage, sizeof(GoalTexturePage));
@@ -214,50 +273,69 @@ void TexturePool::handle_upload_now(const u8* tpage,
   } else {
     // no reason to skip this, other than
     lg::error("TexturePool skipping upload now with mode {}.", mode);
-    return;
+    return plan;
   }
 
-  // loop over all texture in the tpage and download them.
+  // loop over all texture in the tpage and find the VRAM slots they go to.
+  plan.page_name = goal_string(texture_page.name_ptr, memory_base);
   for (int tex_idx = 0; tex_idx < texture_page.length; tex_idx++) {
     GoalTexture tex;
     if (texture_page.try_copy_texture_description(&tex, tex_idx, memory_base, tpage, s7_ptr)) {
       if (debug) {
         fmt::print("Pool upload {} to {}\n",
-                   std::string(goal_string(texture_page.name_ptr, memory_base)) +
-                       goal_string(tex.name_ptr, memory_base),
-                   tex.dest[0]);
+                   plan.page_name + goal_string(tex.name_ptr, memory_base), tex.dest[0]);
       }
       // each texture may have multiple mip levels.
       for (int mip_idx = 0; mip_idx < tex.num_mips; mip_idx++) {
         if (has_segment[tex.segment_of_mip(mip_idx)]) {
-          PcTextureId current_id(texture_page.id, tex_idx);
-          if (!m_id_to_name.lookup_existing(current_id)) {
-            auto name = std::string(goal_string(texture_page.name_ptr, memory_base)) +
-                        goal_string(tex.name_ptr, memory_base);
-            *m_id_to_name.lookup_or_insert(current_id).first = name;
-            m_name_to_id[name] = current_id;
-          }
-
-          auto& slot = m_textures[tex.dest[mip_idx]];
-
-          if (slot.source) {
-            if (slot.source->tex_id == current_id) {
-              // we already have it, no need to do anything
-            } else {
-              slot.source->remove_slot(tex.dest[mip_idx]);
-              slot.source = get_gpu_texture_for_slot(current_id, tex.dest[mip_idx]);
-              ASSERT(slot.gpu_texture != (GLuint)-1);
-            }
-          } else {
-            slot.source = get_gpu_texture_for_slot(current_id, tex.dest[mip_idx]);
-            ASSERT(slot.gpu_texture != (GLuint)-1);
-          }
+          plan.updates.push_back({PcTextureId(texture_page.id, tex_idx), tex.dest[mip_idx],
+                                  goal_string(tex.name_ptr, memory_base)});
         }
       }
     } else {
       // texture was #f, skip it.
     }
   }
+  return plan;
+}
+
+/*!
+ * Point VRAM slots at the textures of an upload planned by plan_upload_now.
+ */
+void TexturePool::apply_upload_now(const UploadNowPlan& plan) {
+  Timer lock_timer;
+  std::unique_lock<std::mutex> lk(m_mutex);
+  float wait_ms = lock_timer.getMs();
+  Timer locked_timer;
+  for (auto& update : plan.updates) {
+    if (!m_id_to_name.lookup_existing(update.id)) {
+      auto name = plan.page_name + update.tex_name;
+      *m_id_to_name.lookup_or_insert(update.id).first = name;
+      m_name_to_id[name] = update.id;
+    }
+
+    auto& slot = m_textures[update.dest];
+
+    if (slot.source) {
+      if (slot.source->tex_id == update.id) {
+        // we already have it, no need to do anything
+      } else {
+        slot.source->remove_slot(update.dest);
+        slot.source = get_gpu_texture_for_slot(update.id, update.dest);
+        ASSERT(slot.gpu_texture != (GLuint)-1);
+      }
+    } else {
+      slot.source = get_gpu_texture_for_slot(update.id, update.dest);
+      ASSERT(slot.gpu_texture != (GLuint)-1);
+    }
+  }
+
+  float locked_ms = locked_timer.getMs();
+  m_upload_now_stats.calls++;
+  m_upload_now_stats.slots += plan.updates.size();
+  m_upload_now_stats.total_wait_ms += wait_ms;
+  m_upload_now_stats.max_wait_ms = std::max(m_upload_now_stats.max_wait_ms, wait_ms);
+  m_upload_now_stats.max_locked_ms = std::max(m_upload_now_stats.max_locked_ms, locked_ms);
 }
 
 void TexturePool::relocate(u32 destination, u32 source, u32 format) {
@@ -369,6 +447,21 @@ void TexturePool::draw_debug_window() {
   ImGui::Text("Total Textures: %d Uploaded: %d Shown: %d VRAM: %.3f MB", total_textures,
               total_uploaded_textures, total_displayed_textures,
               (float)total_vram_bytes / (1024 * 1024));
+  ImGui::Text("Upload now: %d tpages, %d slots, lock wait %.3f ms avg, %.3f ms max, "
+              "held %.3f ms max",
+              m_upload_now_stats.calls, m_upload_now_stats.slots,
+              m_upload_now_stats.calls ? m_upload_now_stats.total_wait_ms / m_upload_now_stats.calls
+                                       : 0.f,
+              m_upload_now_stats.max_wait_ms, m_upload_now_stats.max_locked_ms);
+  ImGui::SameLine();
+  if (ImGui::Button("Reset")) {
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_upload_now_stats = {};
+  }
+  ImGui::Text("Shared level textures: %d uploaded, %d reused, saving %.3f MB VRAM (%.3f MB total)",
+              m_shared_texture_stats.uploads, m_shared_texture_stats.reuses,
+              (float)m_shared_texture_stats.resident_bytes_saved / (1024 * 1024),
+              (float)m_shared_texture_stats.bytes_saved / (1024 * 1024));
 }
 
 void TexturePool::draw_debug_for_tex(const std::string& name, GpuTexture* tex, u32 slot) {
@@ -393,6 +486,84 @@ void TexturePool::draw_debug_for_tex(const std::string& name, GpuTexture* tex, u
   ImGui::PopStyleColor();
 }
 
+/*!
+ * Get the texture in each VRAM slot the game has uploaded to.
+ */
+std::vector<TextureSlotAssignment> TexturePool::get_slot_assignments() {
+  std::unique_lock<std::mutex> lk(m_mutex);
+  std::vector<TextureSlotAssignment> result;
+  for (u32 slot = 0; slot < m_textures.size(); slot++) {
+    if (m_textures[slot].source) {
+      result.push_back({slot, m_textures[slot].source->tex_id, 0});
+    }
+  }
+  for (auto& t : m_mt4hh_textures) {
+    if (t.ref.source) {
+      result.push_back({t.slot, t.ref.source->tex_id, 1});
+    }
+  }
+  return result;
+}
+
+/*!
+ * Put textures back in VRAM slots, as if the game had uploaded them. Slots that aren't in the
+ * assignments are cleared. Textures created by the PC port renderers are skipped, the renderers
+ * will have created them again.
+ * The mt4hh textures must be loaded already.
+ */
+void TexturePool::restore_slot_assignments(
+    const std::vector<TextureSlotAssignment>& assignments) {
+  std::unique_lock<std::mutex> lk(m_mutex);
+  std::vector<bool> assigned(m_textures.size());
+  for (auto& assignment : assignments) {
+    if (!assignment.mt4hh) {
+      assigned.at(assignment.slot) = true;
+    }
+  }
+  for (u32 i = 0; i < m_textures.size(); i++) {
+    auto& slot = m_textures[i];
+    if (slot.source && !assigned[i] && slot.source->tex_id.page + 1u < m_tpage_dir_size) {
+      slot.source->remove_slot(i);
+      slot = {};
+    }
+  }
+  for (auto& t : m_mt4hh_textures) {
+    if (t.ref.source) {
+      auto& slots = t.ref.source->mt4hh_slots;
+      auto it = std::find(slots.begin(), slots.end(), t.slot);
+      if (it != slots.end()) {
+        slots.erase(it);
+      }
+    }
+  }
+  m_mt4hh_textures.clear();
+
+  for (auto& assignment : assignments) {
+    if (assignment.id.page + 1u >= m_tpage_dir_size) {
+      continue;
+    }
+    if (assignment.mt4hh) {
+      auto* tex = m_loaded_textures.lookup_existing(assignment.id);
+      if (tex && !tex->is_placeholder) {
+        m_mt4hh_textures.emplace_back();
+        m_mt4hh_textures.back().slot = assignment.slot;
+        m_mt4hh_textures.back().ref.source = tex;
+        m_mt4hh_textures.back().ref.gpu_texture = tex->gpu_textures.at(0).gl;
+        tex->mt4hh_slots.push_back(assignment.slot);
+      }
+      continue;
+    }
+    auto& slot = m_textures[assignment.slot];
+    if (slot.source) {
+      if (slot.source->tex_id == assignment.id) {
+        continue;
+      }
+      slot.source->remove_slot(assignment.slot);
+    }
+    slot.source = get_gpu_texture_for_slot(assignment.id, assignment.slot);
+  }
+}
+
 PcTextureId TexturePool::allocate_pc_port_texture(GameVersion version) {
   ASSERT(m_next_pc_texture_to_allocate < EXTRA_PC_PORT_TEXTURE_COUNT);
   switch (version) {
@@ -6,6 +6,7 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "common/common_types.h"
 #include "common/util/Serializer.h"
@@ -191,6 +192,16 @@ struct TextureVRAMReference {
   GpuTexture* source = nullptr;
 };
 
+/*!
+ * A texture assigned to a VRAM slot. Used to save and restore the state of the pool for frame
+ * captures.
+ */
+struct TextureSlotAssignment {
+  u32 slot;
+  PcTextureId id;
+  u32 mt4hh;
+};
+
 /*!
  * A texture provided by the loader.
  */
@@ -294,11 +305,32 @@ class TexturePool {
  public:
   TexturePool(GameVersion version);
   void handle_upload_now(const u8* tpage, int mode, const u8* memory_base, u32 s7_ptr, bool debug);
+
+  // the slot changes of a texture-page upload. Only depends on game memory, not the pool.
+  struct UploadNowPlan {
+    struct SlotUpdate {
+      PcTextureId id;
+      u32 dest;
+      std::string tex_name;
+    };
+    std::string page_name;
+    std::vector<SlotUpdate> updates;
+  };
+  static UploadNowPlan plan_upload_now(const u8* tpage,
+                                       int mode,
+                                       const u8* memory_base,
+                                       u32 s7_ptr,
+                                       bool debug);
+  void apply_upload_now(const UploadNowPlan& plan);
   GpuTexture* give_texture(const TextureInput& in);
   GpuTexture* give_texture_and_load_to_vram(const TextureInput& in, u32 vram_slot);
-  void unload_texture(PcTextureId tex_id, u64 gpu_id);
+  void unload_texture(PcTextureId tex_id, u64 gpu_id, const u8* src_data);
   void update_gl_texture(GpuTexture* texture, u32 new_w, u32 new_h, GLuint new_gl_texture);
 
+  std::optional<GLuint> acquire_shared_texture(u64 hash);
+  void add_shared_texture(u64 hash, GLuint gl_texture, u32 bytes);
+  bool release_shared_texture(GLuint gl_texture);
+
   /*!
    * Look up an OpenGL texture by vram address. Return std::nullopt if the game hasn't loaded
    * anything to this address.
@@ -347,6 +379,9 @@ class TexturePool {
   std::mutex& mutex() { return m_mutex; }
   PcTextureId allocate_pc_port_texture(GameVersion version);
 
+  std::vector<TextureSlotAssignment> get_slot_assignments();
+  void restore_slot_assignments(const std::vector<TextureSlotAssignment>& assignments);
+
   std::string get_debug_texture_name(PcTextureId id);
   std::string get_debug_texture_name_from_tbp(u32 tbp);
 
@@ -367,6 +402,31 @@ class TexturePool {
 
   TextureMap<GpuTexture> m_loaded_textures;
 
+  // OpenGL textures uploaded by the loader, by content hash. Levels often contain the same
+  // textures, so these are uploaded once and reference counted.
+  struct SharedTexture {
+    GLuint gl = -1;
+    u32 bytes = 0;
+    u32 ref_count = 0;
+  };
+  std::unordered_map<u64, SharedTexture> m_shared_textures;
+  std::unordered_map<GLuint, u64> m_shared_texture_hashes;
+  struct {
+    u32 uploads = 0;
+    u32 reuses = 0;
+    u64 bytes_saved = 0;           // texture data not uploaded, since the pool was created
+    u64 resident_bytes_saved = 0;  // texture data not in VRAM right now
+  } m_shared_texture_stats;
+
+  // time spent by the game in handle_upload_now, waiting for and holding the lock.
+  struct {
+    u32 calls = 0;
+    u32 slots = 0;
+    float total_wait_ms = 0;
+    float max_wait_ms = 0;
+    float max_locked_ms = 0;
+  } m_upload_now_stats;
+
   // we maintain a mapping of all textures/ids we've seen so far.
   // this is only used for debug.
   TextureMap<std::string> m_id_to_name;
@@ -23,6 +23,7 @@
 #include "game/graphics/screenshot.h"
 #include "game/kernel/common/Ptr.h"
 #include "game/kernel/common/kernel_types.h"
+#include "game/kernel/common/kmalloc.h"
 #include "game/kernel/common/kprint.h"
 #include "game/kernel/common/kscheme.h"
 #include "game/mips2c/mips2c_table.h"
@@ -559,6 +560,7 @@ void pc_memmove(u32 dst, u32 src, u32 size) {
 }
 
 void send_gfx_dma_chain(u32 /*bank*/, u32 chain) {
+  prof().counter("global-heap-used", kheapused(kglobalheap));
   if (Gfx::GetCurrentRenderer()) {
     Gfx::GetCurrentRenderer()->send_chain(g_ee_main_mem, chain);
   }
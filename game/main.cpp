@@ -95,10 +95,13 @@ int main(int argc, char** argv) {
   bool verbose_logging = false;
   bool disable_avx2 = false;
   bool disable_display = false;
+  bool null_renderer = false;
+  bool pipelined_frames = false;
   bool enable_profiling = false;
   bool enable_portable = false;
   bool disable_save_location_override = false;
   std::string profile_until_event = "";
+  std::string profile_stream_path = "";
   std::string gpu_test = "";
   std::string gpu_test_out_path = "";
   int port_number = -1;
@@ -114,6 +117,10 @@ int main(int argc, char** argv) {
       "Specify port number for listener connection (default is 8112 for Jak 1 and 8113 for Jak 2)");
   app.add_flag("--no-avx2", disable_avx2, "Disable AVX2 for testing");
   app.add_flag("--no-display", disable_display, "Disable video display");
+  app.add_flag("--null-renderer", null_renderer,
+               "Run the renderer without a GPU, for measuring renderer CPU cost");
+  app.add_flag("--pipelined-frames", pipelined_frames,
+               "Let the game run the next frame while the renderer draws the current one");
   app.add_flag("--profile", enable_profiling, "Enables profiling immediately from startup");
   app.add_flag("--portable", enable_portable,
                "Save settings and saves relative to the game's executable, takes precedence over "
@@ -123,6 +130,8 @@ int main(int argc, char** argv) {
                "stored to the default location");
   app.add_option("--profile-until-event", profile_until_event,
                  "Stops recording profile events once an event with this name is seen");
+  app.add_option("--profile-stream", profile_stream_path,
+                 "Records profile events from startup and streams them to this trace file");
   app.add_option("--gpu-test", gpu_test,
                  "Tests for minimum graphics requirements.  Valid Options are: [opengl]");
   app.add_option("--gpu-test-out-path", gpu_test_out_path,
@@ -167,10 +176,16 @@ int main(int argc, char** argv) {
 
   prof().set_enable(enable_profiling);
   prof().set_waiting_for_event(profile_until_event);
+  if (!profile_stream_path.empty()) {
+    file_util::create_dir_if_needed_for_file(profile_stream_path);
+    prof().start_streaming(profile_stream_path);
+  }
 
   // Create struct with all non-kmachine handled args to pass to the runtime
   GameLaunchOptions game_options;
   game_options.disable_display = disable_display;
+  game_options.null_renderer = null_renderer;
+  game_options.pipelined_frames = pipelined_frames;
   game_options.game_version = game_name_to_version(game_name);
   game_options.server_port =
       port_number == -1 ? DECI2_PORT - 1 + (int)game_options.game_version : port_number;
@@ -202,13 +217,6 @@ int main(int argc, char** argv) {
     get_cpu_info().has_avx2 = false;
   }
 
-#ifndef __AVX2__
-  if (get_cpu_info().has_avx2) {
-    // printf("Note: your CPU supports AVX2, but this build was not compiled with AVX2 support\n");
-    get_cpu_info().has_avx2 = false;
-  }
-#endif
-
   if (get_cpu_info().has_avx2) {
     lg::info("AVX2 mode enabled");
   } else {
@@ -250,6 +258,7 @@ int main(int argc, char** argv) {
       auto exit_status = exec_runtime(game_options, arg_ptrs.size(), arg_ptrs.data());
       switch (exit_status) {
         case RuntimeExitStatus::EXIT:
+          prof().stop_streaming();
           return 0;
         case RuntimeExitStatus::RESTART_RUNTIME:
         case RuntimeExitStatus::RUNNING:
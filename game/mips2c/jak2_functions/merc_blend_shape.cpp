@@ -101,8 +101,6 @@ void blerc_c(void* a, void* b) {
 // clang-format off
 
 
-extern std::mutex g_merc_data_mutex;
-
 using ::jak2::intern_from_c;
 namespace Mips2C::jak2 {
 namespace blerc_execute {
@@ -118,7 +116,6 @@ u64 execute(void* ctxt) {
   [[maybe_unused]] bool hit18 = false;
   [[maybe_unused]] bool hit19 = false;
   auto pp = scoped_prof("blerc-exec");
-  std::unique_lock<std::mutex> lk(g_merc_data_mutex);
   auto* c = (ExecutionContext*)ctxt;
   bool bc = false;
   u32 call_addr = 0;
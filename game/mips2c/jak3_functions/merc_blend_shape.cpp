@@ -9,8 +9,6 @@
 
 // clang-format off
 
-extern std::mutex g_merc_data_mutex;
-
 #include "game/mips2c/mips2c_private.h"
 #include "game/kernel/jak3/kscheme.h"
 using ::jak3::intern_from_c;
@@ -28,7 +26,6 @@ u64 execute(void* ctxt) {
   [[maybe_unused]] bool hit18 = false;
   [[maybe_unused]] bool hit19 = false;
   auto pp = scoped_prof("blerc-exec");
-  std::unique_lock<std::mutex> lk(g_merc_data_mutex);
   auto* c = (ExecutionContext*)ctxt;
   bool bc = false;
   u32 call_addr = 0;
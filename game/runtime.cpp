@@ -390,7 +390,9 @@ RuntimeExitStatus exec_runtime(GameLaunchOptions game_options, int argc, const c
   {
     auto p = scoped_prof("startup::exec_runtime::init_gfx");
     if (enable_display) {
-      Gfx::Init(g_game_version);
+      Gfx::g_global_settings.pipelined_frames = game_options.pipelined_frames;
+      Gfx::Init(g_game_version,
+                game_options.null_renderer ? GfxPipeline::Null : GfxPipeline::OpenGL);
     }
   }
 
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include "common/custom_data/fr3_file.h"
 #include "common/log/log.h"
 #include "common/util/compress.h"
 #include "common/util/json_util.h"
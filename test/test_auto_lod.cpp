@@ -0,0 +1,97 @@
+#include "game/graphics/opengl_renderer/background/AutoLod.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+constexpr int kGeoms = 3;
+constexpr int kFallbackGeom = 1;
+
+/*!
+ * A camera where w is z, with a size scale of 1000: a leaf of radius r at depth z has a projected
+ * radius of 1000 * r / z.
+ */
+void begin_test_frame(AutoLod* lod) {
+  math::Vector4f camera[4] = {math::Vector4f(1, 0, 0, 0), math::Vector4f(0, 1, 0, 0),
+                              math::Vector4f(0, 0, 1, -1), math::Vector4f(0, 0, 0, 0)};
+  AutoLodSettings settings;
+  settings.enable = true;
+  lod->begin_frame(camera, 1000.f, settings, kFallbackGeom);
+}
+
+// one group for each leaf, and one that isn't in the BVH.
+std::vector<tfrag3::StripDraw> make_draws(int num_leaves) {
+  std::vector<tfrag3::StripDraw> draws(1);
+  for (int i = 0; i < num_leaves; i++) {
+    auto& grp = draws[0].vis_groups.emplace_back();
+    grp.num_tris = 10;
+    grp.vis_idx_in_pc_bvh = i;
+  }
+  auto& grp = draws[0].vis_groups.emplace_back();
+  grp.num_tris = 10;
+  grp.vis_idx_in_pc_bvh = UINT16_MAX;
+  return draws;
+}
+
+// leaf 0 is close and uses geom 0, leaf 1 is far and uses geom 2.
+tfrag3::BVH make_bvh() {
+  tfrag3::BVH bvh;
+  bvh.vis_nodes.resize(2);
+  bvh.vis_nodes[0].bsphere = math::Vector4f(0, 0, 10, 1);
+  bvh.vis_nodes[0].flags = 0;
+  bvh.vis_nodes[1].bsphere = math::Vector4f(0, 0, 100, 1);
+  bvh.vis_nodes[1].flags = 0;
+  return bvh;
+}
+}  // namespace
+
+TEST(AutoLod, TreeWithoutLeaves) {
+  AutoLod lod;
+  lod.init(1, kGeoms);
+  tfrag3::BVH bvh;
+  auto draws = make_draws(0);
+  for (int geom = 0; geom < kGeoms; geom++) {
+    lod.set_tree_geom(0, geom, bvh, draws);
+  }
+  begin_test_frame(&lod);
+  lod.select(0, bvh, nullptr);
+  lod.finish_frame();
+
+  // the whole tree is drawn once, with the fallback geom.
+  EXPECT_EQ(lod.always_visible_geom(0), kFallbackGeom);
+  for (int geom = 0; geom < kGeoms; geom++) {
+    EXPECT_EQ(lod.geom_used(0, geom), geom == kFallbackGeom);
+  }
+}
+
+TEST(AutoLod, AlwaysVisibleGroups) {
+  AutoLod lod;
+  lod.init(1, kGeoms);
+  auto bvh = make_bvh();
+  auto draws = make_draws(2);
+  for (int geom = 0; geom < kGeoms; geom++) {
+    lod.set_tree_geom(0, geom, bvh, draws);
+  }
+
+  auto check = [&](std::vector<u8> vis, int expected_geom, std::vector<bool> expected_used) {
+    begin_test_frame(&lod);
+    lod.select(0, bvh, vis.data());
+    lod.finish_frame();
+    EXPECT_EQ(lod.always_visible_geom(0), expected_geom);
+    for (int geom = 0; geom < kGeoms; geom++) {
+      EXPECT_EQ(lod.geom_used(0, geom), expected_used[geom]);
+      // the groups that aren't in the BVH only come from one geom.
+      std::vector<u8> geom_vis(bvh.vis_nodes.size());
+      lod.write_vis(0, geom, bvh, geom_vis.data());
+      for (size_t i = 0; i < vis.size(); i++) {
+        EXPECT_EQ(geom_vis[i] != 0, vis[i] && (i == 0 ? geom == 0 : geom == 2));
+      }
+    }
+  };
+
+  // both leaves visible: the lowest geom in use draws the other groups.
+  check({1, 1}, 0, {true, false, true});
+  // only the far leaf.
+  check({0, 1}, 2, {false, false, true});
+  // no leaves visible: the other groups are still drawn, with the fallback geom.
+  check({0, 0}, kFallbackGeom, {false, true, false});
+}
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <limits>
 #include <string>
 #include <unordered_set>
@@ -10,6 +11,7 @@
 #include "common/util/Range.h"
 #include "common/util/SmallVector.h"
 #include "common/util/Trie.h"
+#include "common/util/WorkerPool.h"
 #include "common/util/crc32.h"
 #include "common/util/json_util.h"
 #include "common/util/os.h"
@@ -423,5 +425,23 @@ TEST(CRC32, Reference) {
   }
 }
 
+TEST(WorkerPool, RunsEveryIteration) {
+  WorkerPool pool(3);
+  for (int count : {0, 1, 2, 7, 1000}) {
+    std::vector<std::atomic<int>> hits(count);
+    pool.parallel_for(count, [&](int i) { hits[i]++; });
+    for (auto& h : hits) {
+      EXPECT_EQ(h, 1);
+    }
+  }
+}
+
+TEST(WorkerPool, NoWorkers) {
+  WorkerPool pool(0);
+  int sum = 0;
+  pool.parallel_for(10, [&](int i) { sum += i; });
+  EXPECT_EQ(sum, 45);
+}
+
 }  // namespace test
 }  // namespace cu
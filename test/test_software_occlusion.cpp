@@ -0,0 +1,75 @@
+#include "game/graphics/opengl_renderer/background/SoftwareOcclusion.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+constexpr float kFog = 1000.f;
+
+/*!
+ * A camera where the transformed point is (x, y, 0, z), so w is z. With the offset at the center
+ * of the GS, pixel x is (x * kFog / z + 256) / 4, and the same for y.
+ */
+void begin_test_frame(SoftwareOcclusionBuffer* buffer) {
+  math::Vector4f camera[4] = {math::Vector4f(-1, 0, 0, 0), math::Vector4f(0, -1, 0, 0),
+                              math::Vector4f(0, 0, 0, -1), math::Vector4f(0, 0, 0, 0)};
+  buffer->begin_frame(camera, math::Vector4f(2048, 2048, 0, 0), kFog);
+}
+
+// a point at depth z that projects to pixel (px, py).
+math::Vector3f point_at_pixel(float px, float py, float z) {
+  return math::Vector3f((px * 4 - 256) * z / kFog, (py * 4 - 256) * z / kFog, z);
+}
+
+// a sphere at depth z that projects to pixel (px, py), with a radius of about r pixels.
+math::Vector4f sphere_at_pixel(float px, float py, float z, float r) {
+  auto p = point_at_pixel(px, py, z);
+  return math::Vector4f(p.x(), p.y(), p.z(), r * 4 * z / kFog);
+}
+
+/*!
+ * A rectangle at depth 10, covering pixels 32 to 96.5 in x and 32 to 96 in y. The right edge splits
+ * pixel 96.
+ */
+OccluderMesh make_test_occluder() {
+  OccluderMesh mesh;
+  mesh.vertices = {point_at_pixel(32, 32, 10), point_at_pixel(96.5f, 32, 10),
+                   point_at_pixel(96.5f, 96, 10), point_at_pixel(32, 96, 10)};
+  mesh.indices = {0, 1, 2, 0, 2, 3};
+  return mesh;
+}
+}  // namespace
+
+TEST(SoftwareOcclusion, Coverage) {
+  SoftwareOcclusionBuffer buffer;
+  begin_test_frame(&buffer);
+  buffer.rasterize(make_test_occluder());
+  const float* depth = buffer.depth();
+  auto at = [&](int x, int y) { return depth[y * SoftwareOcclusionBuffer::kWidth + x]; };
+
+  EXPECT_FLOAT_EQ(at(40, 80), 10.f);
+  EXPECT_FLOAT_EQ(at(32, 80), 10.f);
+  EXPECT_FLOAT_EQ(at(95, 80), 10.f);
+  // only half of this pixel is covered.
+  EXPECT_EQ(at(96, 80), INFINITY);
+  EXPECT_EQ(at(31, 80), INFINITY);
+  EXPECT_EQ(at(100, 80), INFINITY);
+}
+
+TEST(SoftwareOcclusion, Spheres) {
+  SoftwareOcclusionBuffer buffer;
+  begin_test_frame(&buffer);
+  buffer.rasterize(make_test_occluder());
+
+  // behind the middle of the occluder.
+  EXPECT_FALSE(buffer.sphere_visible(sphere_at_pixel(45, 80, 40, 1)));
+  // in front of the occluder.
+  EXPECT_TRUE(buffer.sphere_visible(sphere_at_pixel(45, 80, 5, 0.1f)));
+  // behind, but sticking out past the left edge.
+  EXPECT_TRUE(buffer.sphere_visible(sphere_at_pixel(33, 80, 40, 2)));
+  // behind, and only inside the pixel that is half covered, but past the edge.
+  EXPECT_TRUE(buffer.sphere_visible(sphere_at_pixel(96.7f, 80, 40, 0.1f)));
+  // not behind the occluder at all.
+  EXPECT_TRUE(buffer.sphere_visible(sphere_at_pixel(110, 80, 40, 1)));
+
+  EXPECT_EQ(buffer.stats().occluder_tris, 2u);
+}
@@ -0,0 +1,115 @@
+#include <random>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/custom_data/fr3_file.h"
+#include "common/texture/texture_compression.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+// smooth gradients with a bit of noise, like most game textures.
+std::vector<u32> make_test_image(u32 w, u32 h, bool opaque) {
+  std::vector<u32> result(w * h);
+  std::mt19937 rng(1);
+  for (u32 y = 0; y < h; y++) {
+    for (u32 x = 0; x < w; x++) {
+      u32 r = std::min<u32>(255, x + rng() % 8);
+      u32 g = y & 255;
+      u32 b = ((x + y) / 2) & 255;
+      u32 a = opaque ? 255 : (x * 3) & 255;
+      result[y * w + x] = r | (g << 8) | (b << 16) | (a << 24);
+    }
+  }
+  return result;
+}
+}  // namespace
+
+TEST(TextureCompression, RoundTrip) {
+  for (auto format : {BcFormat::BC1, BcFormat::BC3}) {
+    auto image = make_test_image(256, 256, format == BcFormat::BC1);
+    u8 bc1_alpha = 0;
+    EXPECT_EQ(pick_bc_format(image.data(), image.size(), &bc1_alpha), format);
+    auto compressed = bc_encode_image(format, image.data(), 256, 256);
+    ASSERT_EQ(compressed.size(), bc_image_bytes(format, 256, 256));
+    std::vector<u32> decoded(image.size());
+    bc_decode_image(format, compressed.data(), 256, 256, decoded.data());
+    EXPECT_GT(rgba_psnr(image.data(), decoded.data(), image.size()), 35.);
+  }
+}
+
+TEST(TextureCompression, UniformAlpha) {
+  // PS2 textures use 0x80 for opaque, these should still be BC1.
+  auto image = make_test_image(64, 64, true);
+  for (auto& pixel : image) {
+    pixel = (pixel & 0xffffff) | 0x80000000;
+  }
+  u8 bc1_alpha = 0;
+  ASSERT_EQ(pick_bc_format(image.data(), image.size(), &bc1_alpha), BcFormat::BC1);
+  EXPECT_EQ(bc1_alpha, 0x80);
+  auto compressed = bc_encode_image(BcFormat::BC1, image.data(), 64, 64);
+  std::vector<u32> decoded(image.size());
+  bc_decode_image(BcFormat::BC1, compressed.data(), 64, 64, decoded.data(), bc1_alpha);
+  EXPECT_GT(rgba_psnr(image.data(), decoded.data(), image.size()), 35.);
+
+  // converting to BC3 for the GPU gives the same pixels.
+  auto bc3 = bc1_to_bc3(compressed.data(), compressed.size(), bc1_alpha);
+  EXPECT_EQ(bc3.size(), bc_image_bytes(BcFormat::BC3, 64, 64));
+  std::vector<u32> decoded_bc3(image.size());
+  bc_decode_image(BcFormat::BC3, bc3.data(), 64, 64, decoded_bc3.data());
+  EXPECT_EQ(decoded, decoded_bc3);
+}
+
+TEST(TextureCompression, OddSizes) {
+  for (u32 size : {1u, 2u, 3u, 5u, 7u}) {
+    std::vector<u32> image(size * size, 0x80402010);
+    auto compressed = bc_encode_image(BcFormat::BC3, image.data(), size, size);
+    EXPECT_EQ(compressed.size(), bc_image_bytes(BcFormat::BC3, size, size));
+    std::vector<u32> decoded(image.size());
+    bc_decode_image(BcFormat::BC3, compressed.data(), size, size, decoded.data());
+    // a solid color should only lose the bits that don't fit in 565.
+    EXPECT_GT(rgba_psnr(image.data(), decoded.data(), image.size()), 40.);
+  }
+}
+
+TEST(TextureCompression, Mips) {
+  EXPECT_EQ(mip_count(1, 1), 1u);
+  EXPECT_EQ(mip_count(256, 64), 9u);
+  auto image = make_test_image(8, 4, true);
+  auto half = downsample_rgba(image.data(), 8, 4);
+  EXPECT_EQ(half.size(), 8u);
+}
+
+TEST(TextureCompression, Fr3) {
+  tfrag3::Level level;
+  level.level_name = "test";
+  auto& tex = level.textures.emplace_back();
+  tex.w = 64;
+  tex.h = 64;
+  tex.data = make_test_image(64, 64, false);
+  tex.format = tfrag3::TextureFormat::BC3;
+  tex.compressed_data = bc_encode_image(BcFormat::BC3, tex.data.data(), 64, 64);
+
+  // only the compressed data is stored.
+  auto fr3 = tfrag3::write_chunked_fr3(level);
+  auto loaded = tfrag3::read_fr3(fr3.data.data(), fr3.data.size(), nullptr, false);
+  ASSERT_EQ(loaded->textures.size(), 1u);
+  EXPECT_EQ(loaded->textures[0].format, tfrag3::TextureFormat::BC3);
+  EXPECT_TRUE(loaded->textures[0].data.empty());
+  EXPECT_EQ(loaded->textures[0].compressed_data, tex.compressed_data);
+}
+
+TEST(TextureCompression, Fr3Bc1Alpha) {
+  tfrag3::Level level;
+  auto& tex = level.textures.emplace_back();
+  tex.w = 8;
+  tex.h = 8;
+  tex.format = tfrag3::TextureFormat::BC1;
+  tex.compressed_data.resize(bc_image_bytes(BcFormat::BC1, 8, 8));
+  tex.bc1_alpha = 0x80;
+
+  auto fr3 = tfrag3::write_chunked_fr3(level);
+  auto loaded = tfrag3::read_fr3(fr3.data.data(), fr3.data.size(), nullptr, false);
+  ASSERT_EQ(loaded->textures.size(), 1u);
+  EXPECT_EQ(loaded->textures[0].bc1_alpha, 0x80);
+}
@@ -1,10 +1,15 @@
+#include <atomic>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <vector>
 
 #include "common/common_types.h"
+#include "common/custom_data/fr3_file.h"
+#include "common/util/WorkerPool.h"
 #include "common/util/compress.h"
 
+#include "fmt/core.h"
 #include "gtest/gtest.h"
 #include "test/all_jak1_symbols.h"
 
@@ -56,4 +61,69 @@ TEST(ZSTD, CommonLibrary) {
   }
 
   EXPECT_TRUE(compressed.size() < 0.5 * all.size());
-}
\ No newline at end of file
+}
+
+TEST(ZSTD, ChunkedFr3) {
+  tfrag3::Level level;
+  level.level_name = "test";
+  for (u32 i = 0; i < 40; i++) {
+    auto& tex = level.textures.emplace_back();
+    tex.w = 128;
+    tex.h = 128;
+    tex.data.resize(128 * 128, i);
+    tex.debug_name = fmt::format("tex-{}", i);
+  }
+  level.tfrag_trees[1].resize(3);
+  level.tie_trees[0].resize(2);
+  level.shrub_trees.resize(1);
+  level.merc_data.indices = {1, 2, 3};
+
+  Serializer original;
+  level.serialize(original);
+  auto [original_data, original_size] = original.get_save_result();
+
+  auto fr3 = tfrag3::write_chunked_fr3(level);
+  ASSERT_TRUE(tfrag3::is_chunked_fr3(fr3.data.data(), fr3.data.size()));
+
+  // loading the sections in parallel should give back the same level.
+  WorkerPool pool(2);
+  auto loaded = tfrag3::read_fr3(fr3.data.data(), fr3.data.size(), &pool, false);
+  Serializer reloaded;
+  loaded->serialize(reloaded);
+  auto [reloaded_data, reloaded_size] = reloaded.get_save_result();
+  ASSERT_EQ(reloaded_size, original_size);
+  EXPECT_EQ(memcmp(reloaded_data, original_data, original_size), 0);
+  EXPECT_EQ(tfrag3::fr3_serialized_size(fr3.data.data(), fr3.data.size()), fr3.uncompressed_size);
+
+  // and the same for uncompressed sections.
+  auto stored = tfrag3::write_chunked_fr3(level, false);
+  EXPECT_GT(stored.data.size(), stored.uncompressed_size);
+  auto loaded_stored = tfrag3::read_fr3(stored.data.data(), stored.data.size(), &pool, false);
+  Serializer reloaded_stored;
+  loaded_stored->serialize(reloaded_stored);
+  ASSERT_EQ(reloaded_stored.get_save_result().second, original_size);
+  EXPECT_EQ(memcmp(reloaded_stored.get_save_result().first, original_data, original_size), 0);
+
+  // files in the original format can still be read.
+  auto single = compression::compress_zstd(original_data, original_size);
+  EXPECT_FALSE(tfrag3::is_chunked_fr3(single.data(), single.size()));
+  EXPECT_EQ(tfrag3::fr3_serialized_size(single.data(), single.size()), original_size);
+  auto loaded_single = tfrag3::read_fr3(single.data(), single.size(), nullptr, false);
+  EXPECT_EQ(loaded_single->level_name, "test");
+  EXPECT_EQ(loaded_single->textures.size(), 40u);
+  EXPECT_EQ(loaded_single->textures[39].data[0], 39u);
+}
+
+TEST(ZSTD, ChunkedFr3Cancel) {
+  tfrag3::Level level;
+  level.level_name = "test";
+  level.textures.emplace_back().data.resize(64);
+  auto fr3 = tfrag3::write_chunked_fr3(level);
+
+  std::atomic<bool> cancel = true;
+  EXPECT_EQ(tfrag3::read_fr3(fr3.data.data(), fr3.data.size(), nullptr, false, &cancel), nullptr);
+  cancel = false;
+  auto loaded = tfrag3::read_fr3(fr3.data.data(), fr3.data.size(), nullptr, false, &cancel);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->textures.size(), 1u);
+}
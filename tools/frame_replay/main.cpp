@@ -0,0 +1,332 @@
+/*!
+ * Replays a frame capture (see game/graphics/frame_capture.h) through the OpenGLRenderer and prints
+ * timing for each bucket. Uses the null renderer's stub GL by default, so it runs without a GPU.
+ *
+ * Level loads in the capture are done with blocking loads, outside of the timed part, so the
+ * results don't depend on disk speed.
+ */
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "common/goal_constants.h"
+#include "common/log/log.h"
+#include "common/util/FileUtil.h"
+#include "common/util/Timer.h"
+#include "common/util/os.h"
+#include "common/util/unicode_util.h"
+
+#include "game/graphics/frame_capture.h"
+#include "game/graphics/opengl_renderer/OpenGLRenderer.h"
+#include "game/graphics/pipelines/null.h"
+#include "game/graphics/texture/TexturePool.h"
+#include "game/kernel/common/kscheme.h"
+#include "game/runtime.h"
+
+#include "fmt/core.h"
+#include "third-party/CLI11.hpp"
+#include "third-party/SDL/include/SDL.h"
+#include "third-party/imgui/imgui.h"
+
+namespace {
+
+constexpr PerGameVersion<int> fr3_level_count(jak1::LEVEL_TOTAL,
+                                              jak2::LEVEL_TOTAL,
+                                              jak3::LEVEL_TOTAL);
+
+struct ReplayOptions {
+  int loops = 3;
+  int warmup_loops = 1;
+  int top_buckets = 25;
+  bool gpu = false;
+  RenderOptions render;
+};
+
+/*!
+ * Times for each profiler node, over all of the timed frames.
+ */
+class TimingTable {
+ public:
+  void add(const std::string& name, float ms) {
+    auto& times = m_times[name];
+    if (times.empty()) {
+      m_order.push_back(name);
+    }
+    times.push_back(ms);
+  }
+
+  void add_frame(float frame_ms, const ProfilerNode& root) {
+    add("frame", frame_ms);
+    for (auto& child : root.children()) {
+      if (!child->active()) {
+        continue;
+      }
+      add(child->name(), child->stats().duration * 1000.f);
+      if (child->name() == "buckets") {
+        for (auto& bucket : child->children()) {
+          if (!bucket->active()) {
+            continue;
+          }
+          add("buckets/" + bucket->name(), bucket->stats().duration * 1000.f);
+          // buckets prepared on worker threads, which overlap each other.
+          if (bucket->name() == "prepare") {
+            for (auto& prepared : bucket->children()) {
+              if (prepared->active()) {
+                add("buckets/" + prepared->name() + " (prepare)",
+                    prepared->stats().duration * 1000.f);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void print(int top_buckets) {
+    fmt::print("{:40s} {:>8s} {:>8s} {:>8s} {:>8s} {:>8s}  (ms)\n", "", "mean", "p50", "p90",
+               "p99", "max");
+    std::vector<std::pair<double, std::string>> buckets;
+    for (auto& name : m_order) {
+      if (name.rfind("buckets/", 0) == 0) {
+        buckets.emplace_back(mean(m_times[name]), name);
+      } else {
+        print_row(name, m_times[name]);
+      }
+    }
+    std::sort(buckets.begin(), buckets.end(), std::greater<>());
+    fmt::print("slowest buckets:\n");
+    for (int i = 0; i < std::min((int)buckets.size(), top_buckets); i++) {
+      auto& name = buckets[i].second;
+      print_row("  " + name.substr(8), m_times[name]);
+    }
+  }
+
+ private:
+  static double mean(const std::vector<float>& times) {
+    double sum = 0;
+    for (auto t : times) {
+      sum += t;
+    }
+    return times.empty() ? 0 : sum / times.size();
+  }
+
+  static float percentile(const std::vector<float>& sorted, double p) {
+    size_t idx = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[idx];
+  }
+
+  static void print_row(const std::string& name, std::vector<float> times) {
+    std::sort(times.begin(), times.end());
+    fmt::print("{:40s} {:8.3f} {:8.3f} {:8.3f} {:8.3f} {:8.3f}\n", name, mean(times),
+               percentile(times, 0.5), percentile(times, 0.9), percentile(times, 0.99),
+               times.back());
+  }
+
+  std::map<std::string, std::vector<float>> m_times;
+  std::vector<std::string> m_order;
+};
+
+/*!
+ * Set up a GL context, either a real one in a hidden window, or the null renderer's stubs.
+ */
+SDL_Window* init_gl(bool gpu) {
+  if (!gpu) {
+    load_null_gl();
+    return nullptr;
+  }
+  SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    fmt::print("Could not initialize SDL: {}\n", SDL_GetError());
+    return nullptr;
+  }
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+  SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+  auto* window = SDL_CreateWindow("frame_replay", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                  640, 480, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (!window || !SDL_GL_CreateContext(window)) {
+    fmt::print("Could not create GL context: {}\n", SDL_GetError());
+    return nullptr;
+  }
+  gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
+  return window;
+}
+
+void load_levels_now(Loader& loader, TexturePool& pool, const std::vector<std::string>& levels) {
+  loader.set_want_levels(levels);
+  loader.update_blocking(pool);
+}
+
+/*!
+ * Put the renderer back in the state at the start of the capture.
+ */
+void reset_to_initial_state(const frame_capture::InitialState& state,
+                            std::vector<u8>& ee_memory,
+                            Loader& loader,
+                            TexturePool& pool,
+                            float* pmode_alp) {
+  std::fill(ee_memory.begin(), ee_memory.end(), 0);
+  load_levels_now(loader, pool, state.levels);
+  loader.set_active_levels(state.active_levels);
+  pool.restore_slot_assignments(state.texture_slots);
+  *pmode_alp = state.pmode_alp;
+}
+
+int replay(const fs::path& capture_path, const ReplayOptions& options) {
+  frame_capture::Reader reader(capture_path);
+  auto version = (GameVersion)reader.header().game_version;
+  fmt::print("{}: {} {} frames\n", capture_path.string(), game_version_names[version],
+             reader.frame_count());
+  if (reader.frame_count() == 0) {
+    return 1;
+  }
+
+  // the renderers read EE memory directly, so it has to be where the game would have put it.
+  std::vector<u8> ee_memory(EE_MAIN_MEM_SIZE);
+  g_ee_main_mem = ee_memory.data();
+  g_game_version = version;
+  s7.offset = reader.header().s7_offset;
+
+  SDL_Window* window = init_gl(options.gpu);
+  if (options.gpu && !window) {
+    return 1;
+  }
+  ImGui::CreateContext();
+  ImGuiIO& io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.DisplaySize = ImVec2(options.render.window_framebuffer_width,
+                          options.render.window_framebuffer_height);
+  unsigned char* pixels;
+  int font_w, font_h;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &font_w, &font_h);
+
+  auto texture_pool = std::make_shared<TexturePool>(version);
+  auto loader = std::make_shared<Loader>(
+      file_util::get_jak_project_dir() / "out" / game_version_names[version] / "fr3",
+      fr3_level_count[version]);
+  OpenGLRenderer renderer(texture_pool, loader, version);
+
+  TimingTable table;
+  u64 timed_frames = 0;
+  for (int loop = 0; loop < options.loops; loop++) {
+    bool timed = loop >= options.warmup_loops || options.loops <= options.warmup_loops;
+    RenderOptions render_options = options.render;
+    reset_to_initial_state(reader.initial_state(), ee_memory, *loader, *texture_pool,
+                           &render_options.pmode_alp_register);
+    if (timed && timed_frames == 0) {
+      auto& stats = null_gl_stats();
+      stats.draw_calls = 0;
+      stats.buffer_upload_bytes = 0;
+      stats.texture_uploads = 0;
+      stats.gl_calls = 0;
+    }
+
+    for (int frame = 0; frame < reader.frame_count(); frame++) {
+      for (auto& evt : reader.read_frame(frame)) {
+        switch (evt.kind) {
+          case frame_capture::EventKind::MEMORY:
+            for (size_t i = 0; i < evt.chunk_addrs.size(); i++) {
+              memcpy(g_ee_main_mem + evt.chunk_addrs[i],
+                     evt.chunk_data.data() + i * frame_capture::kMemoryChunkSize,
+                     frame_capture::kMemoryChunkSize);
+            }
+            break;
+          case frame_capture::EventKind::TEXTURE_UPLOAD_NOW:
+            texture_pool->handle_upload_now(g_ee_main_mem + evt.args[0], (int)evt.args[1],
+                                            g_ee_main_mem, evt.args[2], false);
+            break;
+          case frame_capture::EventKind::TEXTURE_RELOCATE:
+            texture_pool->relocate(evt.args[0], evt.args[1], evt.args[2]);
+            break;
+          case frame_capture::EventKind::SET_LEVELS:
+            load_levels_now(*loader, *texture_pool, evt.levels);
+            break;
+          case frame_capture::EventKind::SET_ACTIVE_LEVELS:
+            loader->set_active_levels(evt.levels);
+            break;
+          case frame_capture::EventKind::PMODE_ALP:
+            render_options.pmode_alp_register = evt.alp;
+            break;
+          case frame_capture::EventKind::SEND_CHAIN: {
+            ImGui::NewFrame();
+            Timer timer;
+            renderer.render(DmaFollower(g_ee_main_mem, evt.args[0]), render_options);
+            float ms = timer.getMs();
+            ImGui::EndFrame();
+            if (options.gpu) {
+              glFinish();
+            }
+            if (timed) {
+              table.add_frame(ms, *renderer.profiler().root());
+              timed_frames++;
+            }
+          } break;
+        }
+      }
+    }
+  }
+
+  fmt::print("{} timed frames, {}\n", timed_frames, options.gpu ? "GPU" : "null GL");
+  table.print(options.top_buckets);
+  if (!options.gpu) {
+    auto& stats = null_gl_stats();
+    fmt::print("per frame: {} draws, {} kB buffer uploads, {} texture uploads, {} other GL calls\n",
+               stats.draw_calls / timed_frames, stats.buffer_upload_bytes / timed_frames / 1024,
+               stats.texture_uploads / timed_frames, stats.gl_calls / timed_frames);
+  }
+
+  ImGui::DestroyContext();
+  if (window) {
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ArgumentGuard u8_guard(argc, argv);
+
+  fs::path capture_path;
+  fs::path project_path_override;
+  ReplayOptions options;
+
+  CLI::App app{"OpenGOAL Frame Capture Replay"};
+  app.add_option("capture", capture_path, "Frame capture file (.fcap)")->required();
+  app.add_option("--loops", options.loops, "Times to replay the capture (default 3)");
+  app.add_option("--warmup", options.warmup_loops, "Loops to run before timing (default 1)");
+  app.add_option("--top", options.top_buckets, "Number of buckets to print (default 25)");
+  app.add_option("--width", options.render.game_res_w, "Game resolution width");
+  app.add_option("--height", options.render.game_res_h, "Game resolution height");
+  app.add_option("--msaa", options.render.msaa_samples, "MSAA samples");
+  app.add_flag("--gpu", options.gpu, "Render with a real GL context instead of the null renderer");
+  app.add_option("--proj-path", project_path_override,
+                 "Specify the location of the 'data/' folder");
+  app.validate_positionals();
+  CLI11_PARSE(app, argc, argv);
+
+  lg::initialize();
+  options.loops = std::max(options.loops, 1);
+  setup_cpu_info();
+  if (!file_util::setup_project_path(project_path_override.empty()
+                                         ? std::nullopt
+                                         : std::make_optional(project_path_override))) {
+    fmt::print("Could not find the project path\n");
+    return 1;
+  }
+
+  options.render.window_framebuffer_width = options.render.game_res_w;
+  options.render.window_framebuffer_height = options.render.game_res_h;
+  options.render.draw_region_width = options.render.game_res_w;
+  options.render.draw_region_height = options.render.game_res_h;
+  try {
+    return replay(capture_path, options);
+  } catch (const std::exception& e) {
+    fmt::print("Error: {}\n", e.what());
+    return 1;
+  }
+}
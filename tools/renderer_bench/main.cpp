@@ -0,0 +1,354 @@
+/*!
+ * Microbenchmarks for the CPU side of the background and sky renderers.
+ * These run on extracted .fr3 level files and don't need a GPU or a running game.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "common/custom_data/Tfrag3Data.h"
+#include "common/custom_data/fr3_file.h"
+#include "common/util/Assert.h"
+#include "common/util/FileUtil.h"
+#include "common/util/Timer.h"
+#include "common/util/os.h"
+#include "common/util/unicode_util.h"
+
+#include "game/graphics/opengl_renderer/SkyBlendCPU.h"
+#include "game/graphics/opengl_renderer/background/SoftwareOcclusion.h"
+#include "game/graphics/opengl_renderer/background/background_common.h"
+
+#include "fmt/core.h"
+
+namespace {
+
+std::unique_ptr<tfrag3::Level> load_fr3(const std::string& file_name) {
+  auto data = file_util::read_binary_file(file_name);
+  return tfrag3::read_fr3(data.data(), data.size(), nullptr, false);
+}
+
+/*!
+ * Build the 4 frustum planes in the format used by GoalBackgroundCameraData: planes[0..2] are the
+ * x, y, z components of the 4 inward plane normals, and planes[3] is the distance.
+ */
+void make_camera_planes(const math::Vector3f& pos, float yaw, float pitch, math::Vector4f* planes) {
+  const float half_fov = 0.7f;
+  math::Vector3f fwd(std::cos(pitch) * std::sin(yaw), std::sin(pitch),
+                     std::cos(pitch) * std::cos(yaw));
+  math::Vector3f right = math::Vector3f(0, 1, 0).cross(fwd).normalized();
+  math::Vector3f up = fwd.cross(right);
+  math::Vector3f normals[4] = {
+      right * std::cos(half_fov) + fwd * std::sin(half_fov),
+      right * -std::cos(half_fov) + fwd * std::sin(half_fov),
+      up * std::cos(half_fov) + fwd * std::sin(half_fov),
+      up * -std::cos(half_fov) + fwd * std::sin(half_fov),
+  };
+  for (int i = 0; i < 4; i++) {
+    planes[0][i] = normals[i].x();
+    planes[1][i] = normals[i].y();
+    planes[2][i] = normals[i].z();
+    planes[3][i] = normals[i].dot(pos);
+  }
+}
+
+/*!
+ * Build a camera matrix matching the planes above, in the format used by tfrag3.vert. This maps the
+ * edges of the view to +/- 256 GS units from the center of the screen, with fog_constant = 1.
+ */
+void make_camera_matrix(const math::Vector3f& pos,
+                        float yaw,
+                        float pitch,
+                        math::Vector4f* camera) {
+  const float half_fov = 0.7f;
+  math::Vector3f fwd(std::cos(pitch) * std::sin(yaw), std::sin(pitch),
+                     std::cos(pitch) * std::cos(yaw));
+  math::Vector3f right = math::Vector3f(0, 1, 0).cross(fwd).normalized();
+  math::Vector3f up = fwd.cross(right);
+  const float scale = 256.f / std::tan(half_fov);
+  math::Vector3f rows[4] = {right * scale, up * scale, math::Vector3f(0, 0, 0), fwd};
+  // the shader computes -(camera[3] + camera[0] * x + camera[1] * y + camera[2] * z)
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 3; j++) {
+      camera[j][i] = -rows[i][j];
+    }
+    camera[3][i] = rows[i].dot(pos);
+  }
+}
+
+struct CameraPath {
+  std::vector<math::Vector3f> positions;
+};
+
+/*!
+ * Pick camera positions from the centers of the BVH roots, so the camera is somewhere inside of the
+ * level for every frame.
+ */
+CameraPath make_camera_path(const tfrag3::Level& level, int frames) {
+  std::vector<math::Vector3f> candidates;
+  for (auto& tree : level.tfrag_trees[0]) {
+    for (u32 i = 0; i < std::min((u32)tree.bvh.num_roots, (u32)tree.bvh.vis_nodes.size()); i++) {
+      candidates.push_back(tree.bvh.vis_nodes[i].bsphere.xyz());
+    }
+  }
+  if (candidates.empty()) {
+    candidates.emplace_back(0, 0, 0);
+  }
+  CameraPath path;
+  for (int i = 0; i < frames; i++) {
+    path.positions.push_back(candidates[(i * 7919) % candidates.size()]);
+  }
+  return path;
+}
+
+void bench_culling(const tfrag3::Level& level, int frames) {
+  std::vector<const tfrag3::BVH*> bvhs;
+  size_t max_nodes = 0;
+  size_t total_nodes = 0;
+  for (auto& tree : level.tfrag_trees[0]) {
+    bvhs.push_back(&tree.bvh);
+  }
+  for (auto& tree : level.tie_trees[0]) {
+    bvhs.push_back(&tree.bvh);
+  }
+  for (auto* bvh : bvhs) {
+    max_nodes = std::max(max_nodes, bvh->vis_nodes.size());
+    total_nodes += bvh->vis_nodes.size();
+  }
+
+  auto path = make_camera_path(level, frames);
+  std::vector<u8> vis_slow(max_nodes), vis_fast(max_nodes);
+  double slow_ns = 0, fast_ns = 0;
+  u64 visible_nodes = 0, mismatched_nodes = 0;
+
+  for (int frame = 0; frame < frames; frame++) {
+    math::Vector4f planes[4];
+    make_camera_planes(path.positions[frame], frame * 0.37f, std::sin(frame * 0.11f) * 0.3f,
+                       planes);
+    for (auto* bvh : bvhs) {
+      Timer slow_timer;
+      cull_check_all_slow(planes, bvh->vis_nodes, nullptr, vis_slow.data());
+      slow_ns += slow_timer.getNs();
+
+      Timer fast_timer;
+      cull_check_hierarchical(planes, *bvh, nullptr, vis_fast.data());
+      fast_ns += fast_timer.getNs();
+
+      for (size_t i = 0; i < bvh->vis_nodes.size(); i++) {
+        visible_nodes += vis_fast[i];
+        mismatched_nodes += vis_slow[i] != vis_fast[i];
+      }
+    }
+  }
+
+  fmt::print("culling: {} trees, {} nodes\n", bvhs.size(), total_nodes);
+  fmt::print("  linear:       {:8.2f} us/frame\n", slow_ns / frames / 1000.);
+  fmt::print("  hierarchical: {:8.2f} us/frame\n", fast_ns / frames / 1000.);
+  fmt::print("  visible nodes/frame: {:.1f}, mismatched nodes/frame: {:.2f}\n",
+             (double)visible_nodes / frames, (double)mismatched_nodes / frames);
+}
+
+/*!
+ * Time of day interpolation over all trees, with the scalar, SSE, and (if supported) AVX2 kernels.
+ * The weights change every frame, so the cache in the renderers would never hit here.
+ */
+void bench_time_of_day(const tfrag3::Level& level, int frames) {
+  std::vector<const tfrag3::PackedTimeOfDay*> colors;
+  u32 max_colors = 0;
+  u64 total_colors = 0;
+  for (auto& tree : level.tfrag_trees[0]) {
+    colors.push_back(&tree.colors);
+  }
+  for (auto& tree : level.tie_trees[0]) {
+    colors.push_back(&tree.colors);
+  }
+  for (auto& tree : level.shrub_trees) {
+    colors.push_back(&tree.time_of_day_colors);
+  }
+  for (auto* c : colors) {
+    max_colors = std::max(max_colors, c->color_count);
+    total_colors += c->color_count;
+  }
+
+  std::vector<math::Vector<u8, 4>> out(max_colors + 4);
+  const bool has_avx2 = get_cpu_info().has_avx2;
+
+  auto run = [&](const char* name, bool slow, bool avx2) {
+    get_cpu_info().has_avx2 = avx2;
+    double ns = 0;
+    for (int frame = 0; frame < frames; frame++) {
+      // weights that sum to 128, like the game's.
+      math::Vector<s32, 4> itimes[4];
+      s32 w = (frame * 3) % 64;
+      s32 w2 = 64 - w;
+      for (int i = 0; i < 4; i++) {
+        itimes[i] = math::Vector<s32, 4>(w | (w << 16), w | (w << 16), w2 | (w2 << 16),
+                                         w2 | (w2 << 16));
+      }
+      for (auto* c : colors) {
+        Timer timer;
+        if (slow) {
+          interp_time_of_day_slow(itimes, *c, out.data());
+        } else {
+          interp_time_of_day(itimes, *c, out.data());
+        }
+        ns += timer.getNs();
+      }
+    }
+    fmt::print("  {:12s}{:8.2f} us/frame\n", name, ns / frames / 1000.);
+  };
+
+  fmt::print("time of day: {} trees, {} colors\n", colors.size(), total_colors);
+  run("scalar:", true, false);
+  run("sse:", false, false);
+  if (has_avx2) {
+    run("avx2:", false, true);
+  }
+  get_cpu_info().has_avx2 = has_avx2;
+}
+
+/*!
+ * Software occlusion culling of TIE, using the tfrag of the same level as occluders.
+ * Reports the cost of drawing the occluders and testing the frustum culled TIE leaves.
+ */
+void bench_occlusion(const tfrag3::Level& level, int frames) {
+  OccluderMesh occluders;
+  Timer build_timer;
+  build_occluder_mesh(level.tfrag_trees[0], 8192, &occluders);
+  fmt::print("occlusion: {} occluder tris, {} verts (built in {:.2f} ms)\n", occluders.num_tris(),
+             occluders.vertices.size(), build_timer.getMs());
+
+  size_t max_nodes = 0;
+  for (auto& tree : level.tie_trees[0]) {
+    max_nodes = std::max(max_nodes, tree.bvh.vis_nodes.size());
+  }
+  std::vector<u8> vis(max_nodes);
+  auto path = make_camera_path(level, frames);
+  SoftwareOcclusionBuffer buffer;
+  double raster_ns = 0, test_ns = 0;
+  u64 tested = 0, rejected = 0;
+
+  for (int frame = 0; frame < frames; frame++) {
+    float yaw = frame * 0.37f;
+    float pitch = std::sin(frame * 0.11f) * 0.3f;
+    math::Vector4f planes[4], camera[4];
+    make_camera_planes(path.positions[frame], yaw, pitch, planes);
+    make_camera_matrix(path.positions[frame], yaw, pitch, camera);
+
+    Timer raster_timer;
+    buffer.begin_frame(camera, math::Vector4f(2048.f, 2048.f, 0.f, 0.f), 1.f);
+    buffer.rasterize(occluders);
+    raster_ns += raster_timer.getNs();
+
+    for (auto& tree : level.tie_trees[0]) {
+      cull_check_hierarchical(planes, tree.bvh, nullptr, vis.data());
+      Timer test_timer;
+      buffer.cull_bvh_leaves(tree.bvh, vis.data());
+      test_ns += test_timer.getNs();
+    }
+    tested += buffer.stats().spheres_tested;
+    rejected += buffer.stats().spheres_rejected;
+  }
+
+  fmt::print("  raster:        {:8.2f} us/frame\n", raster_ns / frames / 1000.);
+  fmt::print("  test:          {:8.2f} us/frame\n", test_ns / frames / 1000.);
+  fmt::print("  tie leaves/frame: {:.1f} visible after frustum culling, {:.1f} occluded\n",
+             (double)tested / frames, (double)rejected / frames);
+}
+
+/*!
+ * CPU sky blending at the real sky (32x32) and cloud (64x64) sizes. Each frame, both levels draw
+ * two sky textures and one cloud texture, like the game usually does. The results are checked
+ * against the scalar version.
+ */
+void bench_sky_blend(int frames) {
+  constexpr u32 kSizes[2] = {32 * 32 * 4, 64 * 64 * 4};
+  constexpr int kLevels = 2;
+  constexpr int kSkyTextures = 2;
+  std::vector<u8> sources[kSkyTextures * kLevels];
+  for (int i = 0; i < kSkyTextures * kLevels; i++) {
+    sources[i].resize(kSizes[1]);
+    for (u32 j = 0; j < kSizes[1]; j++) {
+      sources[i][j] = (j * 7 + i * 31) & 0xff;
+    }
+  }
+  std::vector<u8> expected[2], out[2];
+  const bool has_avx2 = get_cpu_info().has_avx2;
+
+  auto run = [&](const char* name, bool slow, bool avx2) {
+    get_cpu_info().has_avx2 = avx2;
+    double ns = 0;
+    bool matches = true;
+    for (int frame = 0; frame < frames; frame++) {
+      for (int buffer = 0; buffer < 2; buffer++) {
+        out[buffer].assign(kSizes[buffer], 0);
+        Timer timer;
+        int textures = buffer == 0 ? kSkyTextures : 1;
+        for (int draw = 0; draw < textures * kLevels; draw++) {
+          u8 intensity = (frame + draw * 40) % 129;
+          const u8* src = sources[draw].data();
+          u8* dst = out[buffer].data();
+          if (draw == 0) {
+            if (slow) {
+              blend_sky_initial_slow(intensity, dst, src, kSizes[buffer]);
+            } else {
+              blend_sky_initial_fast(intensity, dst, src, kSizes[buffer]);
+            }
+          } else if (slow) {
+            blend_sky_slow(intensity, dst, src, kSizes[buffer]);
+          } else {
+            blend_sky_fast(intensity, dst, src, kSizes[buffer]);
+          }
+        }
+        ns += timer.getNs();
+        if (frame == frames - 1) {
+          if (slow) {
+            expected[buffer] = out[buffer];
+          } else {
+            matches = matches && expected[buffer] == out[buffer];
+          }
+        }
+      }
+    }
+    fmt::print("  {:12s}{:8.2f} us/frame{}\n", name, ns / frames / 1000.,
+               matches ? "" : " (MISMATCH)");
+  };
+
+  fmt::print("sky blend: 32x32 sky, 64x64 clouds, {} levels\n", kLevels);
+  run("scalar:", true, false);
+  run("sse:", false, false);
+  if (has_avx2) {
+    run("avx2:", false, true);
+  }
+  get_cpu_info().has_avx2 = has_avx2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ArgumentGuard u8_guard(argc, argv);
+  setup_cpu_info();
+
+  if (argc < 2) {
+    fmt::print("Usage: renderer_bench <path-to-fr3> [frames]\n");
+    return 1;
+  }
+
+  try {
+    int frames = argc > 2 ? std::stoi(argv[2]) : 1000;
+    fmt::print("Loading {}...\n", argv[1]);
+    auto level = load_fr3(argv[1]);
+    for (auto& tree : level->tfrag_trees[0]) {
+      tree.unpack();
+    }
+    bench_culling(*level, frames);
+    bench_time_of_day(*level, frames);
+    bench_occlusion(*level, frames);
+    bench_sky_blend(frames);
+  } catch (const std::exception& e) {
+    fmt::print("Error: {}\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}